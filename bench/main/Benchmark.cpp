@@ -0,0 +1,72 @@
+#include "Benchmark.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+#include "esp_rom_sys.h"
+#include "sdkconfig.h"
+
+constexpr const char* SUITE_NAME = "zigbee_light";
+
+#ifdef CONFIG_LIGHT_COLOR_FIXED_POINT
+constexpr bool FIXED_POINT = true;
+#else
+constexpr bool FIXED_POINT = false;
+#endif
+
+#ifdef CONFIG_LATENCY_TRACE
+constexpr bool LATENCY_TRACE = true;
+#else
+constexpr bool LATENCY_TRACE = false;
+#endif
+
+#ifdef CONFIG_STORAGE_WRITE_BEHIND
+constexpr bool WRITE_BEHIND = true;
+#else
+constexpr bool WRITE_BEHIND = false;
+#endif
+
+uint32_t Benchmark::result_count = 0;
+
+// Tenths of a cycle per call, printed with one decimal without needing float
+// support in printf
+static uint32_t per_call_x10(uint32_t cycles, uint32_t batch) {
+  return static_cast<uint32_t>((cycles * 10ULL + batch / 2) / batch);
+}
+
+// PUBLIC METHODS
+void Benchmark::begin() {
+  result_count = 0;
+  printf("{\"type\":\"context\",\"suite\":\"%s\",\"platform\":\"%s\","
+         "\"cpu_mhz\":%lu,\"samples\":%lu,\"fixed_point\":%s,"
+         "\"latency_trace\":%s,\"write_behind\":%s}\n",
+         SUITE_NAME, CONFIG_IDF_TARGET,
+         static_cast<unsigned long>(esp_rom_get_cpu_ticks_per_us()),
+         static_cast<unsigned long>(SAMPLES), FIXED_POINT ? "true" : "false",
+         LATENCY_TRACE ? "true" : "false", WRITE_BEHIND ? "true" : "false");
+}
+
+void Benchmark::end() {
+  printf("{\"type\":\"end\",\"suite\":\"%s\",\"results\":%lu}\n", SUITE_NAME,
+         static_cast<unsigned long>(result_count));
+}
+
+// PRIVATE METHODS
+void Benchmark::report(const char* name, uint32_t batch,
+                       std::array<uint32_t, SAMPLES>& samples) {
+  std::sort(samples.begin(), samples.end());
+  uint32_t min = per_call_x10(samples.front(), batch);
+  uint32_t median = per_call_x10(samples[SAMPLES / 2], batch);
+  uint32_t max = per_call_x10(samples.back(), batch);
+
+  printf("{\"type\":\"result\",\"name\":\"%s\",\"batch\":%lu,"
+         "\"min\":%lu.%lu,\"median\":%lu.%lu,\"max\":%lu.%lu}\n",
+         name, static_cast<unsigned long>(batch),
+         static_cast<unsigned long>(min / 10),
+         static_cast<unsigned long>(min % 10),
+         static_cast<unsigned long>(median / 10),
+         static_cast<unsigned long>(median % 10),
+         static_cast<unsigned long>(max / 10),
+         static_cast<unsigned long>(max % 10));
+  result_count++;
+}
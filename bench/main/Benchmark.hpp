@@ -0,0 +1,54 @@
+#ifndef BENCHMARK_HPP
+#define BENCHMARK_HPP
+
+#include <array>
+#include <cstdint>
+
+#include "esp_cpu.h"
+
+// Times a call with the CPU cycle counter and prints the result as a line of
+// JSON, so that runs can be compared between releases.
+//
+// A call is timed in batches, each sample is the cycles of one batch divided
+// by its size. This keeps the cost of reading the counter out of short calls
+// and the median of the samples out of interrupts and cache misses. On the
+// host the counter runs at 1 GHz off the monotonic clock, so cycles are ns.
+class Benchmark {
+ public:
+  static constexpr uint32_t SAMPLES = 31;
+  static constexpr uint32_t DEFAULT_BATCH = 64;
+
+  // Prints the context line: platform, CPU clock and build configuration
+  static void begin();
+  // Prints the summary line
+  static void end();
+
+  // Times fn(i) for i counting up across every sample, so that calls can vary
+  // their input and the compiler cannot hoist them out of the loop
+  template <typename Fn>
+  static void run(const char* name, Fn&& fn, uint32_t batch = DEFAULT_BATCH);
+
+ private:
+  static void report(const char* name, uint32_t batch,
+                     std::array<uint32_t, SAMPLES>& samples);
+
+  static uint32_t result_count;
+};
+
+template <typename Fn>
+void Benchmark::run(const char* name, Fn&& fn, uint32_t batch) {
+  // Warms up caches and lazily initialized state
+  uint32_t i = 0;
+  for (uint32_t n = 0; n < batch; n++) fn(i++);
+
+  std::array<uint32_t, SAMPLES> samples;
+  for (uint32_t& sample : samples) {
+    uint32_t start = esp_cpu_get_cycle_count();
+    for (uint32_t n = 0; n < batch; n++) fn(i++);
+    sample = esp_cpu_get_cycle_count() - start;
+  }
+
+  report(name, batch, samples);
+}
+
+#endif
@@ -0,0 +1,169 @@
+// In-memory NVS for the benchmarks, linked over the real API with
+// -Wl,--wrap so that the firmware's storage paths run unchanged while the
+// timings leave out flash, which varies with wear and page state. Fixed-size
+// tables, nothing is allocated.
+#include <array>
+#include <cstring>
+
+#include "nvs.h"
+
+constexpr size_t MAX_NAMESPACES = 16;
+constexpr size_t MAX_ENTRIES = 32;
+// Names and keys are up to 15 characters, as with the real NVS
+constexpr size_t MAX_NAME_SIZE = 16;
+// Fits the scene table at its largest, 64 scenes of 15 bytes
+constexpr size_t MAX_VALUE_SIZE = 960;
+
+struct Entry {
+  nvs_handle_t handle;
+  char key[MAX_NAME_SIZE];
+  size_t size;
+  uint8_t value[MAX_VALUE_SIZE];
+};
+
+// A handle is the index of its namespace plus one, reopening a namespace
+// returns the same handle
+static std::array<char[MAX_NAME_SIZE], MAX_NAMESPACES> namespaces;
+static size_t namespace_count = 0;
+static std::array<Entry, MAX_ENTRIES> entries;
+static size_t entry_count = 0;
+
+static bool is_valid(nvs_handle_t handle) {
+  return handle > 0 && handle <= namespace_count;
+}
+
+static Entry* find_entry(nvs_handle_t handle, const char* key) {
+  for (size_t i = 0; i < entry_count; i++) {
+    if (entries[i].handle == handle && strcmp(entries[i].key, key) == 0) {
+      return &entries[i];
+    }
+  }
+  return nullptr;
+}
+
+static esp_err_t get_value(nvs_handle_t handle, const char* key, void* value,
+                           size_t size) {
+  if (!is_valid(handle)) return ESP_ERR_INVALID_ARG;
+
+  const Entry* entry = find_entry(handle, key);
+  if (entry == nullptr) return ESP_ERR_NVS_NOT_FOUND;
+  if (entry->size != size) return ESP_ERR_NVS_INVALID_LENGTH;
+
+  memcpy(value, entry->value, size);
+  return ESP_OK;
+}
+
+static esp_err_t set_value(nvs_handle_t handle, const char* key,
+                           const void* value, size_t size) {
+  if (!is_valid(handle) || strlen(key) >= MAX_NAME_SIZE) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (size > MAX_VALUE_SIZE) return ESP_ERR_NVS_INVALID_LENGTH;
+
+  Entry* entry = find_entry(handle, key);
+  if (entry == nullptr) {
+    if (entry_count == MAX_ENTRIES) return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    entry = &entries[entry_count++];
+    entry->handle = handle;
+    strcpy(entry->key, key);
+  }
+  entry->size = size;
+  memcpy(entry->value, value, size);
+  return ESP_OK;
+}
+
+extern "C" {
+
+esp_err_t __wrap_nvs_open(const char* namespace_name, nvs_open_mode_t open_mode,
+                          nvs_handle_t* out_handle) {
+  if (strlen(namespace_name) >= MAX_NAME_SIZE) return ESP_ERR_INVALID_ARG;
+
+  size_t index = 0;
+  while (index < namespace_count &&
+         strcmp(namespaces[index], namespace_name) != 0) {
+    index++;
+  }
+  if (index == namespace_count) {
+    if (namespace_count == MAX_NAMESPACES) return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    strcpy(namespaces[namespace_count++], namespace_name);
+  }
+
+  *out_handle = static_cast<nvs_handle_t>(index + 1);
+  return ESP_OK;
+}
+
+void __wrap_nvs_close(nvs_handle_t handle) {}
+
+esp_err_t __wrap_nvs_commit(nvs_handle_t handle) {
+  return is_valid(handle) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t __wrap_nvs_erase_key(nvs_handle_t handle, const char* key) {
+  if (!is_valid(handle)) return ESP_ERR_INVALID_ARG;
+
+  Entry* entry = find_entry(handle, key);
+  if (entry == nullptr) return ESP_ERR_NVS_NOT_FOUND;
+
+  // Entries are unordered, the last one fills the gap
+  *entry = entries[--entry_count];
+  return ESP_OK;
+}
+
+esp_err_t __wrap_nvs_get_u8(nvs_handle_t handle, const char* key,
+                            uint8_t* out_value) {
+  return get_value(handle, key, out_value, sizeof(*out_value));
+}
+
+esp_err_t __wrap_nvs_get_u16(nvs_handle_t handle, const char* key,
+                             uint16_t* out_value) {
+  return get_value(handle, key, out_value, sizeof(*out_value));
+}
+
+esp_err_t __wrap_nvs_get_u64(nvs_handle_t handle, const char* key,
+                             uint64_t* out_value) {
+  return get_value(handle, key, out_value, sizeof(*out_value));
+}
+
+esp_err_t __wrap_nvs_get_blob(nvs_handle_t handle, const char* key,
+                              void* out_value, size_t* length) {
+  if (!is_valid(handle)) return ESP_ERR_INVALID_ARG;
+
+  const Entry* entry = find_entry(handle, key);
+  if (entry == nullptr) return ESP_ERR_NVS_NOT_FOUND;
+
+  // Without a buffer only the length is returned
+  if (out_value == nullptr) {
+    *length = entry->size;
+    return ESP_OK;
+  }
+  if (*length < entry->size) {
+    *length = entry->size;
+    return ESP_ERR_NVS_INVALID_LENGTH;
+  }
+
+  memcpy(out_value, entry->value, entry->size);
+  *length = entry->size;
+  return ESP_OK;
+}
+
+esp_err_t __wrap_nvs_set_u8(nvs_handle_t handle, const char* key,
+                            uint8_t value) {
+  return set_value(handle, key, &value, sizeof(value));
+}
+
+esp_err_t __wrap_nvs_set_u16(nvs_handle_t handle, const char* key,
+                             uint16_t value) {
+  return set_value(handle, key, &value, sizeof(value));
+}
+
+esp_err_t __wrap_nvs_set_u64(nvs_handle_t handle, const char* key,
+                             uint64_t value) {
+  return set_value(handle, key, &value, sizeof(value));
+}
+
+esp_err_t __wrap_nvs_set_blob(nvs_handle_t handle, const char* key,
+                              const void* value, size_t length) {
+  return set_value(handle, key, value, length);
+}
+
+}  // extern "C"
@@ -0,0 +1,333 @@
+#include <array>
+#include <cstdint>
+#include <cstdio>
+
+#include "ActionTable.hpp"
+#include "Benchmark.hpp"
+#include "Color.hpp"
+#include "LEDStrip.hpp"
+#include "LightState.hpp"
+#include "SingleLED.hpp"
+#include "Storage.hpp"
+#include "ZigbeeDevice.hpp"
+#include "ZigbeeStack.hpp"
+#include "esp_zigbee_core.h"
+
+constexpr uint8_t BENCH_ENDPOINT = CONFIG_LIGHT_ENDPOINT;
+// A long strip, where the dirty range and DMA make a difference
+constexpr uint16_t BENCH_STRIP_PIXELS = 300;
+// Each show transmits the whole strip, about 9 ms at 300 pixels
+constexpr uint32_t BENCH_STRIP_BATCH = 4;
+
+constexpr LightState BENCH_STATE = {
+    .active = true,
+    .level = 200,
+    .color_x = 20000,
+    .color_y = 24000,
+    .color_mode = ColorMode::XY,
+    .color_temperature = 300,
+    .enhanced_hue = 0x4000,
+    .saturation = 200,
+};
+
+// Keeps results from being optimized away
+static volatile uint32_t sink;
+
+// Handlers do nothing, so that dispatch is all that is timed
+static esp_err_t handle_attribute(
+    const esp_zb_zcl_set_attr_value_message_t* msg) {
+  sink = msg->attribute.id;
+  return ESP_OK;
+}
+
+static esp_err_t handle_store_scene(
+    const esp_zb_zcl_store_scene_message_t* msg) {
+  sink = msg->scene_id;
+  return ESP_OK;
+}
+
+static esp_err_t handle_recall_scene(
+    const esp_zb_zcl_recall_scene_message_t* msg) {
+  sink = msg->scene_id;
+  return ESP_OK;
+}
+
+static esp_err_t handle_identify_effect(
+    const esp_zb_zcl_identify_effect_message_t* msg) {
+  sink = msg->effect_id;
+  return ESP_OK;
+}
+
+static esp_err_t handle_color(const AttributeBatch& batch) {
+  sink = batch.count;
+  return ESP_OK;
+}
+
+// The actions of a light endpoint
+using LightActions = ActionTable<
+    Action<ESP_ZB_ZCL_CLUSTER_ID_ON_OFF, ESP_ZB_CORE_SET_ATTR_VALUE_CB_ID,
+           handle_attribute>,
+    Action<ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL,
+           ESP_ZB_CORE_SET_ATTR_VALUE_CB_ID, handle_attribute>,
+    Action<ESP_ZB_ZCL_CLUSTER_ID_SCENES, ESP_ZB_CORE_SCENES_STORE_SCENE_CB_ID,
+           handle_store_scene>,
+    Action<ESP_ZB_ZCL_CLUSTER_ID_SCENES, ESP_ZB_CORE_SCENES_RECALL_SCENE_CB_ID,
+           handle_recall_scene>,
+    Action<ESP_ZB_ZCL_CLUSTER_ID_IDENTIFY, ESP_ZB_CORE_IDENTIFY_EFFECT_CB_ID,
+           handle_identify_effect>>;
+
+template <typename... Actions>
+static void handle_actions(ZigbeeDevice& device, ActionTable<Actions...>*) {
+  device.handle_actions<Actions...>();
+}
+
+// The handler ZigbeeStack registers, called directly since the stack is
+// never started
+static esp_zb_core_action_callback_t core_action_handler = nullptr;
+
+extern "C" void __wrap_esp_zb_core_action_handler_register(
+    esp_zb_core_action_callback_t cb) {
+  core_action_handler = cb;
+}
+
+static esp_zb_zcl_set_attr_value_message_t make_attr_message(
+    uint16_t cluster_id, uint16_t attr_id, esp_zb_zcl_attr_type_t type,
+    void* value, uint16_t size) {
+  return esp_zb_zcl_set_attr_value_message_t{
+      .info =
+          {
+              .status = ESP_ZB_ZCL_STATUS_SUCCESS,
+              .dst_endpoint = BENCH_ENDPOINT,
+              .cluster = cluster_id,
+          },
+      .attribute =
+          {
+              .id = attr_id,
+              .data =
+                  {
+                      .type = type,
+                      .size = size,
+                      .value = value,
+                  },
+          },
+  };
+}
+
+static void bench_color() {
+  Benchmark::run("color/xy_to_rgb16", [](uint32_t i) {
+    ColorRGB16 rgb = xy_to_rgb16(20000 + (i & 0xfff), 24000, 200);
+    sink = rgb.r + rgb.g + rgb.b;
+  });
+  Benchmark::run("color/xy_to_rgb16_double", [](uint32_t i) {
+    ColorRGB16 rgb = xy_to_rgb16_double(20000 + (i & 0xfff), 24000, 200);
+    sink = rgb.r + rgb.g + rgb.b;
+  });
+  Benchmark::run("color/mireds_to_rgb16", [](uint32_t i) {
+    ColorRGB16 rgb = mireds_to_rgb16(COLOR_TEMP_MIN_MIREDS + (i & 0xff), 200);
+    sink = rgb.r + rgb.g + rgb.b;
+  });
+  Benchmark::run("color/hsv_to_rgb16", [](uint32_t i) {
+    ColorRGB16 rgb = hsv_to_rgb16(static_cast<uint16_t>(i * 97), 200, 200);
+    sink = rgb.r + rgb.g + rgb.b;
+  });
+}
+
+// get_color_rgb() is private, render_state() computes it for a state and
+// adds gamma correction
+static void bench_single_led() {
+  constexpr struct {
+    const char* name;
+    ColorMode mode;
+  } MODES[] = {
+      {"single_led/render_state/xy", ColorMode::XY},
+      {"single_led/render_state/temperature", ColorMode::TEMPERATURE},
+      {"single_led/render_state/hue_saturation",
+       ColorMode::ENHANCED_HUE_SATURATION},
+  };
+
+  for (const auto& mode : MODES) {
+    LightState state = BENCH_STATE;
+    state.color_mode = mode.mode;
+    Benchmark::run(mode.name, [&](uint32_t i) {
+      state.level = static_cast<uint8_t>(1 + i % 254);
+      LightRender render = SingleLED::render_state(state);
+      sink = render.output.r + render.output.g + render.output.b;
+    });
+  }
+}
+
+static void bench_zigbee() {
+  bool on_off = false;
+  auto on_off_msg =
+      make_attr_message(ESP_ZB_ZCL_CLUSTER_ID_ON_OFF,
+                        ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID,
+                        ESP_ZB_ZCL_ATTR_TYPE_BOOL, &on_off, sizeof(on_off));
+  esp_zb_zcl_recall_scene_message_t recall_msg = {
+      .info =
+          {
+              .status = ESP_ZB_ZCL_STATUS_SUCCESS,
+              .dst_endpoint = BENCH_ENDPOINT,
+              .cluster = ESP_ZB_ZCL_CLUSTER_ID_SCENES,
+          },
+      .group_id = 0,
+      .scene_id = 1,
+      .transition_time = 0,
+      .field_set = nullptr,
+  };
+
+  Benchmark::run("zigbee_device/action_table/hit", [&](uint32_t i) {
+    sink = LightActions::dispatch(ESP_ZB_ZCL_CLUSTER_ID_SCENES,
+                                  ESP_ZB_CORE_SCENES_RECALL_SCENE_CB_ID,
+                                  &recall_msg);
+  });
+  Benchmark::run("zigbee_device/action_table/miss", [&](uint32_t i) {
+    sink = LightActions::dispatch(ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+                                  ESP_ZB_CORE_SET_ATTR_VALUE_CB_ID,
+                                  &on_off_msg);
+  });
+
+  // From the stack's callback through the endpoint route and the device to
+  // the handler
+  Benchmark::run("zigbee_stack/core_action/on_off", [&](uint32_t i) {
+    on_off = (i & 1) != 0;
+    sink = core_action_handler(ESP_ZB_CORE_SET_ATTR_VALUE_CB_ID, &on_off_msg);
+  });
+  Benchmark::run("zigbee_stack/core_action/recall_scene", [&](uint32_t i) {
+    sink = core_action_handler(ESP_ZB_CORE_SCENES_RECALL_SCENE_CB_ID,
+                               &recall_msg);
+  });
+
+  // Two writes that complete an attribute group, collected and then handed to
+  // the group handler as one batch
+  uint16_t x = 0;
+  uint16_t y = 0;
+  auto x_msg = make_attr_message(
+      ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+      ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_X_ID, ESP_ZB_ZCL_ATTR_TYPE_U16, &x,
+      sizeof(x));
+  auto y_msg = make_attr_message(
+      ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+      ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_Y_ID, ESP_ZB_ZCL_ATTR_TYPE_U16, &y,
+      sizeof(y));
+  Benchmark::run("zigbee_stack/core_action/attribute_group", [&](uint32_t i) {
+    x = static_cast<uint16_t>(i);
+    y = static_cast<uint16_t>(~i);
+    core_action_handler(ESP_ZB_CORE_SET_ATTR_VALUE_CB_ID, &x_msg);
+    sink = core_action_handler(ESP_ZB_CORE_SET_ATTR_VALUE_CB_ID, &y_msg);
+  });
+}
+
+static void bench_strip(LEDStrip& strip) {
+  const StripSegment all = {.start = 0, .length = BENCH_STRIP_PIXELS};
+  auto color = [](uint32_t i) {
+    return ColorRGB{static_cast<uint8_t>(i), 0x80, static_cast<uint8_t>(~i)};
+  };
+
+  Benchmark::run("led_strip/fill/300", [&](uint32_t i) {
+    sink = strip.fill(all, color(i), 200);
+  });
+  // The framebuffer was left dirty by fill
+  Benchmark::run(
+      "led_strip/fill_show/300",
+      [&](uint32_t i) {
+        strip.fill(all, color(i), 200);
+        sink = strip.show();
+      },
+      BENCH_STRIP_BATCH);
+  // Only one pixel is copied to the driver, the strip is still transmitted
+  Benchmark::run(
+      "led_strip/set_pixel_show/300",
+      [&](uint32_t i) {
+        strip.set_pixel(BENCH_STRIP_PIXELS / 2, color(i));
+        sink = strip.show();
+      },
+      BENCH_STRIP_BATCH);
+  Benchmark::run("led_strip/show_unchanged/300",
+                 [&](uint32_t i) { sink = strip.show(); });
+}
+
+static void bench_storage(Storage& storage) {
+  Benchmark::run("storage/set_active", [&](uint32_t i) {
+    sink = storage.set_active((i & 1) != 0);
+  });
+
+  LightState state = BENCH_STATE;
+  Benchmark::run("storage/set_state", [&](uint32_t i) {
+    state.level = static_cast<uint8_t>(1 + i % 254);
+    sink = storage.set_state(state);
+  });
+
+  // With write-behind the setters only mark the state dirty, flush() is the
+  // commit. Without it the setter commits and there is nothing to flush.
+  Benchmark::run("storage/set_state_flush", [&](uint32_t i) {
+    state.level = static_cast<uint8_t>(1 + i % 254);
+    storage.set_state(state);
+    sink = storage.flush();
+  });
+
+  std::array<StoredScene, MAX_SCENES> scenes = {};
+  for (size_t i = 0; i < scenes.size(); i++) {
+    scenes[i].scene_id = static_cast<uint8_t>(i);
+  }
+  Benchmark::run("storage/save_scenes", [&](uint32_t i) {
+    scenes[0].level = static_cast<uint8_t>(i);
+    sink = storage.save_scenes(scenes.data(), scenes.size());
+  });
+}
+
+extern "C" void app_main(void) {
+  esp_err_t err = Zigbee.init();
+  if (err != ESP_OK) {
+    printf("Error initializing ZigbeeStack: %s\n", esp_err_to_name(err));
+    return;
+  }
+
+  static ZigbeeDevice device(DeviceConfig{
+      .endpoint = BENCH_ENDPOINT,
+      .app_device_id = ESP_ZB_HA_ON_OFF_LIGHT_DEVICE_ID,
+  });
+  err = device.init([](esp_zb_cluster_list_t* clusters) { return ESP_OK; });
+  if (err != ESP_OK) {
+    printf("Error initializing ZigbeeDevice: %s\n", esp_err_to_name(err));
+    return;
+  }
+  handle_actions(device, static_cast<LightActions*>(nullptr));
+  err = device.handle_attribute_group(
+      ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+      {
+          ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_X_ID,
+          ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_Y_ID,
+      },
+      handle_color);
+  if (err != ESP_OK) {
+    printf("Error setting up ZigbeeDevice: %s\n", esp_err_to_name(err));
+    return;
+  }
+  if (core_action_handler == nullptr) {
+    printf("Error: ZigbeeStack registered no core action handler\n");
+    return;
+  }
+
+  static Storage storage("bench", BENCH_STATE);
+  err = storage.init();
+  if (err != ESP_OK) {
+    printf("Error initializing Storage: %s\n", esp_err_to_name(err));
+    return;
+  }
+
+  // With static allocation the framebuffer arena only fits the firmware's
+  // strip, the strip benchmarks are skipped
+  static LEDStrip strip(CONFIG_LED_PIN, BENCH_STRIP_PIXELS);
+  esp_err_t strip_err = strip.init();
+  if (strip_err != ESP_OK) {
+    printf("Skipping LEDStrip benchmarks: %s\n", esp_err_to_name(strip_err));
+  }
+
+  Benchmark::begin();
+  bench_color();
+  bench_single_led();
+  bench_zigbee();
+  if (strip_err == ESP_OK) bench_strip(strip);
+  bench_storage(storage);
+  Benchmark::end();
+}
@@ -0,0 +1,24 @@
+# Symbols the benchmarks link over with -Wl,--wrap, in the ESP-IDF test app
+# and the host build alike: the NVS API, backed by MockNVS.cpp, and the core
+# action handler registration, which hands ZigbeeStack's handler to the
+# benchmarks.
+set(BENCH_WRAPPED_SYMBOLS
+  nvs_open
+  nvs_close
+  nvs_commit
+  nvs_erase_key
+  nvs_get_u8
+  nvs_get_u16
+  nvs_get_u64
+  nvs_get_blob
+  nvs_set_u8
+  nvs_set_u16
+  nvs_set_u64
+  nvs_set_blob
+  esp_zb_core_action_handler_register
+)
+
+set(BENCH_LINK_OPTIONS "")
+foreach(symbol ${BENCH_WRAPPED_SYMBOLS})
+  list(APPEND BENCH_LINK_OPTIONS "-Wl,--wrap=${symbol}")
+endforeach()
@@ -0,0 +1,567 @@
+#include "Simulator.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <utility>
+
+// Provided by the firmware
+extern "C" void esp_zb_app_signal_handler(esp_zb_app_signal_t* signal_struct);
+
+// Partitions the firmware accesses directly, from partitions.csv
+struct PartitionLayout {
+  const char* label;
+  uint32_t address;
+  uint32_t size;
+};
+
+constexpr PartitionLayout PARTITIONS[] = {
+    {"state_log", 0xf6000, 16 * 1024},
+    {"boot_frame", 0xfa000, 64 * 1024},
+};
+constexpr uint32_t FLASH_SECTOR_SIZE = 4096;
+
+// Globally accessible singleton instance
+Simulator& Sim = Simulator::instance();
+
+// Private singleton constructor
+Simulator::Simulator()
+    : time_us(0),
+      alarm_order(0),
+      action_handler(nullptr),
+      aps_handler(nullptr),
+      zcl_sequence(0),
+      latency{},
+      flash{} {}
+
+// Singleton instance accessor
+Simulator& Simulator::instance() {
+  static Simulator instance;
+  return instance;
+}
+
+// PUBLIC METHODS
+int64_t Simulator::now() { return time_us; }
+
+void Simulator::advance(int64_t duration_us) {
+  int64_t until = time_us + duration_us;
+  run_due(until);
+  time_us = until;
+}
+
+esp_err_t Simulator::write_attribute(uint8_t endpoint, uint16_t cluster_id,
+                                     uint16_t attr_id,
+                                     esp_zb_zcl_attr_type_t type,
+                                     const void* value, uint16_t size) {
+  uint8_t data[8] = {};
+  if (size > sizeof(data)) return ESP_ERR_INVALID_SIZE;
+  memcpy(data, value, size);
+
+  esp_zb_zcl_set_attr_value_message_t msg = {
+      .info =
+          {
+              .status = ESP_ZB_ZCL_STATUS_SUCCESS,
+              .dst_endpoint = endpoint,
+              .cluster = cluster_id,
+          },
+      .attribute =
+          {
+              .id = attr_id,
+              .data =
+                  {
+                      .type = type,
+                      .size = size,
+                      .value = data,
+                  },
+          },
+  };
+  return inject_action(ESP_ZB_CORE_SET_ATTR_VALUE_CB_ID, &msg);
+}
+
+esp_err_t Simulator::write_bool(uint8_t endpoint, uint16_t cluster_id,
+                                uint16_t attr_id, bool value) {
+  return write_attribute(endpoint, cluster_id, attr_id,
+                         ESP_ZB_ZCL_ATTR_TYPE_BOOL, &value, sizeof(value));
+}
+
+esp_err_t Simulator::write_u8(uint8_t endpoint, uint16_t cluster_id,
+                              uint16_t attr_id, uint8_t value) {
+  return write_attribute(endpoint, cluster_id, attr_id, ESP_ZB_ZCL_ATTR_TYPE_U8,
+                         &value, sizeof(value));
+}
+
+esp_err_t Simulator::write_u16(uint8_t endpoint, uint16_t cluster_id,
+                               uint16_t attr_id, uint16_t value) {
+  return write_attribute(endpoint, cluster_id, attr_id,
+                         ESP_ZB_ZCL_ATTR_TYPE_U16, &value, sizeof(value));
+}
+
+void Simulator::send_command(uint8_t endpoint, uint16_t cluster_id,
+                             uint8_t command_id,
+                             const std::vector<uint8_t>& payload) {
+  // Cluster specific, client to server
+  std::vector<uint8_t> frame = {0x01, zcl_sequence++, command_id};
+  frame.insert(frame.end(), payload.begin(), payload.end());
+
+  esp_zb_apsde_data_ind_t ind = {};
+  ind.dst_addr_mode = ESP_ZB_APS_ADDR_MODE_16_ENDP_PRESENT;
+  ind.dst_endpoint = endpoint;
+  ind.profile_id = ESP_ZB_AF_HA_PROFILE_ID;
+  ind.cluster_id = cluster_id;
+  ind.asdu_length = static_cast<uint32_t>(frame.size());
+  ind.asdu = frame.data();
+  indicate(ind);
+}
+
+esp_err_t Simulator::send_groups_command(uint8_t endpoint, uint8_t command_id,
+                                         uint16_t group_id) {
+  // Cluster specific, client to server. Add Group carries an empty name.
+  uint8_t frame[] = {
+      0x01,
+      zcl_sequence++,
+      command_id,
+      static_cast<uint8_t>(group_id),
+      static_cast<uint8_t>(group_id >> 8),
+      0x00,
+  };
+  esp_zb_apsde_data_ind_t ind = {};
+  ind.dst_addr_mode = ESP_ZB_APS_ADDR_MODE_16_ENDP_PRESENT;
+  ind.dst_endpoint = endpoint;
+  ind.profile_id = ESP_ZB_AF_HA_PROFILE_ID;
+  ind.cluster_id = ESP_ZB_ZCL_CLUSTER_ID_GROUPS;
+  ind.asdu_length = sizeof(frame);
+  ind.asdu = frame;
+  if (indicate(ind)) return ESP_ERR_NOT_FOUND;
+
+  switch (command_id) {
+    case 0x00:  // Add Group
+      group_members.insert({group_id, endpoint});
+      break;
+    case 0x03:  // Remove Group
+      group_members.erase({group_id, endpoint});
+      break;
+    case 0x04:  // Remove All Groups
+      std::erase_if(group_members, [&](const auto& member) {
+        return member.second == endpoint;
+      });
+      break;
+  }
+  return ESP_OK;
+}
+
+esp_err_t Simulator::write_group_attribute(uint16_t group_id,
+                                           uint16_t cluster_id,
+                                           uint16_t attr_id,
+                                           esp_zb_zcl_attr_type_t type,
+                                           const void* value, uint16_t size) {
+  // Write Attributes, profile wide
+  std::vector<uint8_t> frame = {
+      0x00,
+      zcl_sequence++,
+      0x02,
+      static_cast<uint8_t>(attr_id),
+      static_cast<uint8_t>(attr_id >> 8),
+      static_cast<uint8_t>(type),
+  };
+  const auto* data = static_cast<const uint8_t*>(value);
+  frame.insert(frame.end(), data, data + size);
+
+  esp_zb_apsde_data_ind_t ind = {};
+  ind.dst_addr_mode = ESP_ZB_APS_ADDR_MODE_16_GROUP_ENDP_NOT_PRESENT;
+  ind.dst_short_addr = group_id;
+  ind.profile_id = ESP_ZB_AF_HA_PROFILE_ID;
+  ind.cluster_id = cluster_id;
+  ind.asdu_length = static_cast<uint32_t>(frame.size());
+  ind.asdu = frame.data();
+  if (indicate(ind)) return ESP_ERR_NOT_FOUND;
+
+  // The stack delivers the frame to every member endpoint
+  esp_err_t result = ESP_OK;
+  auto it = group_members.lower_bound({group_id, 0});
+  for (; it != group_members.end() && it->first == group_id; ++it) {
+    esp_err_t err =
+        write_attribute(it->second, cluster_id, attr_id, type, value, size);
+    if (err != ESP_OK) result = err;
+  }
+  return result;
+}
+
+esp_err_t Simulator::write_group_bool(uint16_t group_id, uint16_t cluster_id,
+                                      uint16_t attr_id, bool value) {
+  return write_group_attribute(group_id, cluster_id, attr_id,
+                               ESP_ZB_ZCL_ATTR_TYPE_BOOL, &value,
+                               sizeof(value));
+}
+
+esp_err_t Simulator::store_scene(uint8_t endpoint, uint16_t group_id,
+                                 uint8_t scene_id) {
+  esp_zb_zcl_store_scene_message_t msg = {
+      .info =
+          {
+              .status = ESP_ZB_ZCL_STATUS_SUCCESS,
+              .dst_endpoint = endpoint,
+              .cluster = ESP_ZB_ZCL_CLUSTER_ID_SCENES,
+          },
+      .group_id = group_id,
+      .scene_id = scene_id,
+  };
+  return inject_action(ESP_ZB_CORE_SCENES_STORE_SCENE_CB_ID, &msg);
+}
+
+esp_err_t Simulator::recall_scene(
+    uint8_t endpoint, uint16_t group_id, uint8_t scene_id,
+    uint16_t transition_time, esp_zb_zcl_scenes_extension_field_t* field_set) {
+  esp_zb_zcl_recall_scene_message_t msg = {
+      .info =
+          {
+              .status = ESP_ZB_ZCL_STATUS_SUCCESS,
+              .dst_endpoint = endpoint,
+              .cluster = ESP_ZB_ZCL_CLUSTER_ID_SCENES,
+          },
+      .group_id = group_id,
+      .scene_id = scene_id,
+      .transition_time = transition_time,
+      .field_set = field_set,
+  };
+  return inject_action(ESP_ZB_CORE_SCENES_RECALL_SCENE_CB_ID, &msg);
+}
+
+void Simulator::identify(uint8_t endpoint, bool on) {
+  auto it = identify_handlers.find(endpoint);
+  if (it != identify_handlers.end()) it->second(on ? 1 : 0);
+}
+
+esp_err_t Simulator::trigger_effect(uint8_t endpoint, uint8_t effect_id,
+                                    uint8_t effect_variant) {
+  esp_zb_zcl_identify_effect_message_t msg = {
+      .info =
+          {
+              .status = ESP_ZB_ZCL_STATUS_SUCCESS,
+              .dst_endpoint = endpoint,
+              .cluster = ESP_ZB_ZCL_CLUSTER_ID_IDENTIFY,
+          },
+      .effect_id = effect_id,
+      .effect_variant = effect_variant,
+  };
+  return inject_action(ESP_ZB_CORE_IDENTIFY_EFFECT_CB_ID, &msg);
+}
+
+esp_err_t Simulator::inject_action(
+    esp_zb_core_action_callback_id_t callback_id, const void* msg) {
+  if (action_handler == nullptr) return ESP_ERR_INVALID_STATE;
+
+  auto start = std::chrono::steady_clock::now();
+  esp_err_t err = action_handler(callback_id, msg);
+  auto end = std::chrono::steady_clock::now();
+
+  uint64_t duration_ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+          .count();
+  if (latency.count == 0 || duration_ns < latency.min_ns) {
+    latency.min_ns = duration_ns;
+  }
+  latency.max_ns = std::max(latency.max_ns, duration_ns);
+  latency.total_ns += duration_ns;
+  latency.count++;
+
+  return err;
+}
+
+HandlerLatency Simulator::get_handler_latency() { return latency; }
+
+void Simulator::signal(esp_zb_app_signal_type_t type, esp_err_t status,
+                       const void* params, size_t params_size) {
+  // The signal type followed by the parameters, word aligned
+  std::vector<uint32_t> buffer(1 + (params_size + 3) / 4);
+  buffer[0] = type;
+  if (params != nullptr) memcpy(&buffer[1], params, params_size);
+
+  esp_zb_app_signal_t signal = {
+      .p_app_signal = buffer.data(),
+      .esp_err_status = status,
+  };
+  esp_zb_app_signal_handler(&signal);
+}
+
+void Simulator::leave_network() {
+  group_members.clear();
+
+  esp_zb_zdo_signal_leave_params_t params = {
+      .leave_type = ESP_ZB_NWK_LEAVE_TYPE_RESET,
+  };
+  signal(ESP_ZB_ZDO_SIGNAL_LEAVE, ESP_OK, &params, sizeof(params));
+}
+
+void Simulator::configure_reporting(uint8_t endpoint, uint16_t cluster_id,
+                                    uint16_t attr_id, uint16_t min_interval_s,
+                                    uint16_t max_interval_s,
+                                    uint16_t reportable_change) {
+  esp_zb_zcl_reporting_info_t info = {};
+  info.direction = ESP_ZB_ZCL_REPORT_DIRECTION_SEND;
+  info.ep = endpoint;
+  info.cluster_id = cluster_id;
+  info.cluster_role = ESP_ZB_ZCL_CLUSTER_SERVER_ROLE;
+  info.attr_id = attr_id;
+  info.u.send_info.min_interval = min_interval_s;
+  info.u.send_info.max_interval = max_interval_s;
+  info.u.send_info.delta.u16 = reportable_change;
+  reporting[{endpoint, cluster_id, attr_id}] = info;
+}
+
+const Attribute* Simulator::get_attribute(uint8_t endpoint,
+                                          uint16_t cluster_id,
+                                          uint16_t attr_id) {
+  auto it = attributes.find({endpoint, cluster_id, attr_id});
+  return it != attributes.end() ? &it->second : nullptr;
+}
+
+const std::vector<LEDFrame>& Simulator::get_frames() { return frames; }
+
+const std::vector<NVSRecord>& Simulator::get_nvs_records() {
+  return nvs_records;
+}
+
+const std::vector<ReportRecord>& Simulator::get_reports() { return reports; }
+
+const std::vector<SentFrame>& Simulator::get_sent_frames() {
+  return sent_frames;
+}
+
+size_t Simulator::count_nvs(NVSOperation operation) {
+  return std::count_if(
+      nvs_records.begin(), nvs_records.end(),
+      [operation](const NVSRecord& r) { return r.operation == operation; });
+}
+
+FlashStats Simulator::get_flash_stats() { return flash; }
+
+void Simulator::clear_records() {
+  frames.clear();
+  nvs_records.clear();
+  reports.clear();
+  sent_frames.clear();
+  flash = {};
+  latency = {};
+}
+
+Simulator::Timer* Simulator::create_timer(const esp_timer_create_args_t& args) {
+  auto* timer = new Timer{
+      .args = args,
+      .active = false,
+      .deadline = 0,
+      .period = 0,
+  };
+  timers.push_back(timer);
+  return timer;
+}
+
+void Simulator::schedule_alarm(esp_zb_callback_t callback, uint8_t param,
+                               uint32_t delay_ms) {
+  alarms.push_back(Alarm{
+      .callback = callback,
+      .param = param,
+      .deadline = time_us + delay_ms * 1000LL,
+      .order = alarm_order++,
+  });
+}
+
+void Simulator::cancel_alarm(esp_zb_callback_t callback, uint8_t param) {
+  std::erase_if(alarms, [&](const Alarm& alarm) {
+    return alarm.callback == callback && alarm.param == param;
+  });
+}
+
+void Simulator::set_aps_handler(
+    esp_zb_aps_data_indication_callback_t handler) {
+  aps_handler = handler;
+}
+
+void Simulator::set_identify_handler(
+    uint8_t endpoint, esp_zb_identify_notify_callback_t handler) {
+  identify_handlers[endpoint] = handler;
+}
+
+void Simulator::set_action_handler(esp_zb_core_action_callback_t handler) {
+  action_handler = handler;
+}
+
+size_t Simulator::attribute_size(esp_zb_zcl_attr_type_t type,
+                                 const void* value) {
+  switch (type) {
+    case ESP_ZB_ZCL_ATTR_TYPE_BOOL:
+    case ESP_ZB_ZCL_ATTR_TYPE_U8:
+    case ESP_ZB_ZCL_ATTR_TYPE_8BIT_ENUM:
+      return 1;
+    case ESP_ZB_ZCL_ATTR_TYPE_U16:
+      return 2;
+    case ESP_ZB_ZCL_ATTR_TYPE_U32:
+      return 4;
+    case ESP_ZB_ZCL_ATTR_TYPE_OCTET_STRING:
+    case ESP_ZB_ZCL_ATTR_TYPE_CHAR_STRING:
+      // Length byte followed by the data
+      return 1 + *static_cast<const uint8_t*>(value);
+    default:
+      return 0;
+  }
+}
+
+void Simulator::define_attribute(uint8_t endpoint, uint16_t cluster_id,
+                                 uint16_t attr_id, esp_zb_zcl_attr_type_t type,
+                                 const void* value) {
+  const auto* data = static_cast<const uint8_t*>(value);
+  attributes[{endpoint, cluster_id, attr_id}] = Attribute{
+      .type = type,
+      .value = std::vector<uint8_t>(data, data + attribute_size(type, value)),
+  };
+}
+
+void Simulator::record_report(uint8_t endpoint, uint16_t cluster_id,
+                              std::vector<uint16_t> attr_ids) {
+  reports.push_back(ReportRecord{
+      .time_us = time_us,
+      .endpoint = endpoint,
+      .cluster_id = cluster_id,
+      .attr_ids = std::move(attr_ids),
+  });
+}
+
+void Simulator::record_sent_frame(const esp_zb_apsde_data_req_t& req) {
+  sent_frames.push_back(SentFrame{
+      .time_us = time_us,
+      .src_endpoint = req.src_endpoint,
+      .dst_short_addr = req.dst_addr.addr_short,
+      .dst_endpoint = req.dst_endpoint,
+      .cluster_id = req.cluster_id,
+      .asdu = std::vector<uint8_t>(req.asdu, req.asdu + req.asdu_length),
+  });
+}
+
+esp_zb_zcl_reporting_info_t* Simulator::find_reporting_info(
+    uint8_t endpoint, uint16_t cluster_id, uint16_t attr_id) {
+  auto it = reporting.find({endpoint, cluster_id, attr_id});
+  return it != reporting.end() ? &it->second : nullptr;
+}
+
+esp_err_t Simulator::set_attribute(uint8_t endpoint, uint16_t cluster_id,
+                                   uint16_t attr_id, const void* value) {
+  auto it = attributes.find({endpoint, cluster_id, attr_id});
+  if (it == attributes.end()) return ESP_ERR_NOT_FOUND;
+
+  Attribute& attr = it->second;
+  const auto* data = static_cast<const uint8_t*>(value);
+  attr.value.assign(data, data + attribute_size(attr.type, value));
+  return ESP_OK;
+}
+
+Simulator::Strip* Simulator::create_strip(uint32_t pixel_count) {
+  auto* strip = new Strip{
+      .index = static_cast<uint8_t>(strips.size()),
+      .pixels = std::vector<ColorRGB>(pixel_count, ColorRGB{0, 0, 0}),
+  };
+  strips.push_back(strip);
+  return strip;
+}
+
+void Simulator::record_frame(const Strip& strip) {
+  frames.push_back(LEDFrame{
+      .time_us = time_us,
+      .strip = strip.index,
+      .pixels = strip.pixels,
+  });
+}
+
+std::map<std::string, std::vector<uint8_t>>& Simulator::nvs_namespace(
+    const std::string& name) {
+  return nvs[name];
+}
+
+void Simulator::record_nvs(NVSOperation operation,
+                           const std::string& name_space,
+                           const std::string& key, size_t size) {
+  nvs_records.push_back(NVSRecord{
+      .time_us = time_us,
+      .operation = operation,
+      .name_space = name_space,
+      .key = key,
+      .size = size,
+  });
+}
+
+Simulator::Partition* Simulator::find_partition(const char* label) {
+  for (auto* partition : partitions) {
+    if (strcmp(partition->info.label, label) == 0) return partition;
+  }
+
+  for (const auto& layout : PARTITIONS) {
+    if (strcmp(layout.label, label) != 0) continue;
+
+    auto* partition = new Partition{
+        .info =
+            {
+                .type = ESP_PARTITION_TYPE_DATA,
+                .subtype = ESP_PARTITION_SUBTYPE_ANY,
+                .address = layout.address,
+                .size = layout.size,
+                .erase_size = FLASH_SECTOR_SIZE,
+                .label = {},
+            },
+        .data = std::vector<uint8_t>(layout.size, 0xff),
+    };
+    strncpy(partition->info.label, layout.label,
+            sizeof(partition->info.label) - 1);
+    partitions.push_back(partition);
+    return partition;
+  }
+
+  return nullptr;
+}
+
+FlashStats& Simulator::flash_stats() { return flash; }
+
+// PRIVATE METHODS
+bool Simulator::indicate(esp_zb_apsde_data_ind_t ind) {
+  return aps_handler != nullptr && aps_handler(ind);
+}
+
+void Simulator::run_due(int64_t until) {
+  while (true) {
+    Timer* next_timer = nullptr;
+    for (auto* timer : timers) {
+      if (!timer->active || timer->deadline > until) continue;
+      if (next_timer == nullptr || timer->deadline < next_timer->deadline) {
+        next_timer = timer;
+      }
+    }
+
+    auto next_alarm = alarms.end();
+    for (auto it = alarms.begin(); it != alarms.end(); it++) {
+      if (it->deadline > until) continue;
+      if (next_alarm == alarms.end() || it->deadline < next_alarm->deadline ||
+          (it->deadline == next_alarm->deadline &&
+           it->order < next_alarm->order)) {
+        next_alarm = it;
+      }
+    }
+
+    bool has_alarm = next_alarm != alarms.end();
+    if (next_timer == nullptr && !has_alarm) return;
+
+    // Alarms go first when both are due at the same time
+    if (has_alarm &&
+        (next_timer == nullptr || next_alarm->deadline <= next_timer->deadline)) {
+      Alarm alarm = *next_alarm;
+      alarms.erase(next_alarm);
+      time_us = std::max(time_us, alarm.deadline);
+      alarm.callback(alarm.param);
+      continue;
+    }
+
+    time_us = std::max(time_us, next_timer->deadline);
+    if (next_timer->period > 0) {
+      next_timer->deadline += next_timer->period;
+    } else {
+      next_timer->active = false;
+    }
+    next_timer->args.callback(next_timer->args.arg);
+  }
+}
@@ -0,0 +1,263 @@
+#ifndef SIMULATOR_HPP
+#define SIMULATOR_HPP
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "Color.hpp"
+#include "esp_partition.h"
+#include "esp_timer.h"
+#include "esp_zigbee_core.h"
+#include "led_strip.h"
+
+// One led_strip refresh
+struct LEDFrame {
+  int64_t time_us;
+  uint8_t strip;
+  std::vector<ColorRGB> pixels;
+};
+
+enum class NVSOperation { GET, SET, ERASE, COMMIT };
+
+struct NVSRecord {
+  int64_t time_us;
+  NVSOperation operation;
+  std::string name_space;
+  std::string key;
+  size_t size;
+};
+
+// Value of a custom cluster attribute, as stored by the stack
+struct Attribute {
+  esp_zb_zcl_attr_type_t type;
+  std::vector<uint8_t> value;
+};
+
+// One Report Attributes frame
+struct ReportRecord {
+  int64_t time_us;
+  uint8_t endpoint;
+  uint16_t cluster_id;
+  std::vector<uint16_t> attr_ids;
+};
+
+// Any other frame the firmware sent with an APS data request
+struct SentFrame {
+  int64_t time_us;
+  uint8_t src_endpoint;
+  uint16_t dst_short_addr;
+  uint8_t dst_endpoint;
+  uint16_t cluster_id;
+  std::vector<uint8_t> asdu;
+};
+
+struct FlashStats {
+  uint32_t reads;
+  uint32_t writes;
+  uint32_t erases;
+  uint64_t bytes_written;
+};
+
+// Wall clock time spent in the core action handler
+struct HandlerLatency {
+  uint32_t count;
+  uint64_t min_ns;
+  uint64_t max_ns;
+  uint64_t total_ns;
+};
+
+// State behind the host stand-ins of the ESP-IDF and Zigbee APIs. Time is
+// simulated: it only moves in advance(), which fires due timers and Zigbee
+// scheduler alarms in order, so runs are deterministic.
+class Simulator {
+ public:
+  // Time
+  int64_t now();
+  void advance(int64_t duration_us);
+
+  // Zigbee
+  // Delivers an attribute write to the registered core action handler, the
+  // way the stack does after updating the attribute. Alarms the handler
+  // schedules run on the next advance(), so advance(0) completes a command
+  // that wrote several attributes.
+  esp_err_t write_attribute(uint8_t endpoint, uint16_t cluster_id,
+                            uint16_t attr_id, esp_zb_zcl_attr_type_t type,
+                            const void* value, uint16_t size);
+  esp_err_t write_bool(uint8_t endpoint, uint16_t cluster_id, uint16_t attr_id,
+                       bool value);
+  esp_err_t write_u8(uint8_t endpoint, uint16_t cluster_id, uint16_t attr_id,
+                     uint8_t value);
+  esp_err_t write_u16(uint8_t endpoint, uint16_t cluster_id, uint16_t attr_id,
+                      uint16_t value);
+
+  // Deliver Store Scene and Recall Scene the way the stack does after
+  // updating its own scene table. field_set is what the stack stored for
+  // the scene, if anything.
+  esp_err_t store_scene(uint8_t endpoint, uint16_t group_id, uint8_t scene_id);
+  esp_err_t recall_scene(
+      uint8_t endpoint, uint16_t group_id, uint8_t scene_id,
+      uint16_t transition_time,
+      esp_zb_zcl_scenes_extension_field_t* field_set = nullptr);
+
+  // Starts or stops identifying the way the stack does when Identify Time is
+  // written or runs out
+  void identify(uint8_t endpoint, bool on);
+  // Delivers a Trigger Effect command of the Identify cluster
+  esp_err_t trigger_effect(uint8_t endpoint, uint8_t effect_id,
+                           uint8_t effect_variant);
+
+  // Sends a cluster specific command to an endpoint, as far as the firmware
+  // sees it before the stack runs it. The attribute writes that follow are
+  // up to the caller.
+  void send_command(uint8_t endpoint, uint16_t cluster_id, uint8_t command_id,
+                    const std::vector<uint8_t>& payload);
+
+  // Sends a Groups cluster command to an endpoint. The stack stand-in keeps
+  // its own group table, updated unless the firmware drops the frame.
+  esp_err_t send_groups_command(uint8_t endpoint, uint8_t command_id,
+                                uint16_t group_id);
+  // Multicasts an attribute write to a group. Returns ESP_ERR_NOT_FOUND if
+  // the firmware dropped the frame, otherwise the write is delivered to each
+  // member endpoint.
+  esp_err_t write_group_attribute(uint16_t group_id, uint16_t cluster_id,
+                                  uint16_t attr_id,
+                                  esp_zb_zcl_attr_type_t type,
+                                  const void* value, uint16_t size);
+  esp_err_t write_group_bool(uint16_t group_id, uint16_t cluster_id,
+                             uint16_t attr_id, bool value);
+
+  // Delivers any core action message to the registered handler
+  esp_err_t inject_action(esp_zb_core_action_callback_id_t callback_id,
+                          const void* msg);
+  HandlerLatency get_handler_latency();
+  // Delivers an application signal to the firmware's signal handler, with
+  // the parameters that follow the signal type
+  void signal(esp_zb_app_signal_type_t type, esp_err_t status,
+              const void* params = nullptr, size_t params_size = 0);
+  // Leaves the network for good: the stack forgets its groups and signals
+  // the leave
+  void leave_network();
+  // Sets reporting parameters the way a Configure Reporting command does
+  void configure_reporting(uint8_t endpoint, uint16_t cluster_id,
+                           uint16_t attr_id, uint16_t min_interval_s,
+                           uint16_t max_interval_s, uint16_t reportable_change);
+  // Custom attribute values, nullptr if the attribute is not defined
+  const Attribute* get_attribute(uint8_t endpoint, uint16_t cluster_id,
+                                 uint16_t attr_id);
+
+  // Records
+  const std::vector<LEDFrame>& get_frames();
+  const std::vector<NVSRecord>& get_nvs_records();
+  const std::vector<ReportRecord>& get_reports();
+  const std::vector<SentFrame>& get_sent_frames();
+  size_t count_nvs(NVSOperation operation);
+  FlashStats get_flash_stats();
+  // Forgets recorded frames, NVS operations, reports, sent frames, flash
+  // stats and latencies
+  void clear_records();
+
+  // Singleton instance accessor
+  static Simulator& instance();
+
+  // Prevent singleton copying
+  Simulator(const Simulator&) = delete;
+  Simulator& operator=(const Simulator&) = delete;
+
+  // Called by the stand-ins
+  struct Timer {
+    esp_timer_create_args_t args;
+    bool active;
+    int64_t deadline;
+    int64_t period;
+  };
+  struct Alarm {
+    esp_zb_callback_t callback;
+    uint8_t param;
+    int64_t deadline;
+    uint64_t order;
+  };
+  struct Strip {
+    uint8_t index;
+    std::vector<ColorRGB> pixels;
+  };
+  struct Partition {
+    esp_partition_t info;
+    std::vector<uint8_t> data;
+  };
+
+  Timer* create_timer(const esp_timer_create_args_t& args);
+  void schedule_alarm(esp_zb_callback_t callback, uint8_t param,
+                      uint32_t delay_ms);
+  void cancel_alarm(esp_zb_callback_t callback, uint8_t param);
+  void set_action_handler(esp_zb_core_action_callback_t handler);
+  void set_aps_handler(esp_zb_aps_data_indication_callback_t handler);
+  void set_identify_handler(uint8_t endpoint,
+                            esp_zb_identify_notify_callback_t handler);
+
+  // Size of an attribute value of the given type, 0 if unsupported
+  static size_t attribute_size(esp_zb_zcl_attr_type_t type, const void* value);
+  void define_attribute(uint8_t endpoint, uint16_t cluster_id,
+                        uint16_t attr_id, esp_zb_zcl_attr_type_t type,
+                        const void* value);
+  esp_err_t set_attribute(uint8_t endpoint, uint16_t cluster_id,
+                          uint16_t attr_id, const void* value);
+  void record_report(uint8_t endpoint, uint16_t cluster_id,
+                     std::vector<uint16_t> attr_ids);
+  void record_sent_frame(const esp_zb_apsde_data_req_t& req);
+  esp_zb_zcl_reporting_info_t* find_reporting_info(uint8_t endpoint,
+                                                   uint16_t cluster_id,
+                                                   uint16_t attr_id);
+
+  Strip* create_strip(uint32_t pixel_count);
+  void record_frame(const Strip& strip);
+
+  std::map<std::string, std::vector<uint8_t>>& nvs_namespace(
+      const std::string& name);
+  void record_nvs(NVSOperation operation, const std::string& name_space,
+                  const std::string& key, size_t size);
+
+  Partition* find_partition(const char* label);
+  FlashStats& flash_stats();
+
+ private:
+  Simulator();
+
+  void run_due(int64_t until);
+  // Returns true if the firmware dropped the frame
+  bool indicate(esp_zb_apsde_data_ind_t ind);
+
+  int64_t time_us;
+  uint64_t alarm_order;
+  std::vector<Timer*> timers;
+  std::vector<Alarm> alarms;
+  esp_zb_core_action_callback_t action_handler;
+  esp_zb_aps_data_indication_callback_t aps_handler;
+  std::map<uint8_t, esp_zb_identify_notify_callback_t> identify_handlers;
+  uint8_t zcl_sequence;
+  // Group ID and endpoint of each membership
+  std::set<std::pair<uint16_t, uint8_t>> group_members;
+  HandlerLatency latency;
+  std::map<std::tuple<uint8_t, uint16_t, uint16_t>, Attribute> attributes;
+  std::map<std::tuple<uint8_t, uint16_t, uint16_t>,
+           esp_zb_zcl_reporting_info_t>
+      reporting;
+  std::vector<ReportRecord> reports;
+  std::vector<SentFrame> sent_frames;
+
+  std::vector<Strip*> strips;
+  std::vector<LEDFrame> frames;
+
+  std::map<std::string, std::map<std::string, std::vector<uint8_t>>> nvs;
+  std::vector<NVSRecord> nvs_records;
+
+  std::vector<Partition*> partitions;
+  FlashStats flash;
+};
+
+extern Simulator& Sim;
+
+#endif
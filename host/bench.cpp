@@ -0,0 +1,8 @@
+// Runs the microbenchmarks in bench/main on the host. Results are printed as
+// JSON lines, cycles are ns at the host's 1 GHz stand-in cycle counter.
+extern "C" void app_main(void);
+
+int main() {
+  app_main();
+  return 0;
+}
@@ -0,0 +1,4 @@
+// Host stand-in for driver/gpio.h
+#pragma once
+
+typedef int gpio_num_t;
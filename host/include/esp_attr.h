@@ -0,0 +1,5 @@
+// Host stand-in for the ESP-IDF section attributes
+#pragma once
+
+// Plain static storage on the host, nothing survives the process
+#define RTC_NOINIT_ATTR
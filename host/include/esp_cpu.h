@@ -0,0 +1,17 @@
+// Host stand-in for the ESP-IDF CPU utilities: the cycle counter runs at
+// 1 GHz off the host's monotonic clock.
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef uint32_t esp_cpu_cycle_count_t;
+
+esp_cpu_cycle_count_t esp_cpu_get_cycle_count(void);
+
+#ifdef __cplusplus
+}
+#endif
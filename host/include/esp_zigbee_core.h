@@ -0,0 +1,502 @@
+// Host stand-in for the parts of the esp-zigbee-lib API that the firmware
+// uses. Clusters and endpoints are only recorded, the registered core action
+// handler and scheduler alarms are driven by the simulator.
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+typedef struct esp_zb_attribute_list_s esp_zb_attribute_list_t;
+typedef struct esp_zb_cluster_list_s esp_zb_cluster_list_t;
+typedef struct esp_zb_ep_list_s esp_zb_ep_list_t;
+
+// ZCL identifiers
+#define ESP_ZB_AF_HA_PROFILE_ID 0x0104
+#define ESP_ZB_HA_ON_OFF_LIGHT_DEVICE_ID 0x0100
+#define ESP_ZB_HA_COLOR_DIMMABLE_LIGHT_DEVICE_ID 0x0102
+
+typedef enum {
+  ESP_ZB_ZCL_CLUSTER_ID_BASIC = 0x0000,
+  ESP_ZB_ZCL_CLUSTER_ID_IDENTIFY = 0x0003,
+  ESP_ZB_ZCL_CLUSTER_ID_GROUPS = 0x0004,
+  ESP_ZB_ZCL_CLUSTER_ID_SCENES = 0x0005,
+  ESP_ZB_ZCL_CLUSTER_ID_ON_OFF = 0x0006,
+  ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL = 0x0008,
+  ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL = 0x0300,
+} esp_zb_zcl_cluster_id_t;
+
+typedef enum {
+  ESP_ZB_ZCL_CLUSTER_SERVER_ROLE = 0x01,
+  ESP_ZB_ZCL_CLUSTER_CLIENT_ROLE = 0x02,
+} esp_zb_zcl_cluster_role_t;
+
+#define ESP_ZB_ZCL_ATTR_BASIC_MANUFACTURER_NAME_ID 0x0004
+#define ESP_ZB_ZCL_ATTR_BASIC_MODEL_IDENTIFIER_ID 0x0005
+#define ESP_ZB_ZCL_ATTR_IDENTIFY_IDENTIFY_TIME_ID 0x0000
+#define ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID 0x0000
+#define ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID 0x0000
+#define ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_HUE_ID 0x0000
+#define ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_SATURATION_ID 0x0001
+#define ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_X_ID 0x0003
+#define ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_Y_ID 0x0004
+#define ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMPERATURE_ID 0x0007
+#define ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_MODE_ID 0x0008
+#define ESP_ZB_ZCL_ATTR_COLOR_CONTROL_ENHANCED_CURRENT_HUE_ID 0x4000
+#define ESP_ZB_ZCL_ATTR_COLOR_CONTROL_ENHANCED_COLOR_MODE_ID 0x4001
+#define ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_LOOP_ACTIVE_ID 0x4002
+#define ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_LOOP_DIRECTION_ID 0x4003
+#define ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_LOOP_TIME_ID 0x4004
+#define ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_LOOP_START_ENHANCED_HUE_ID 0x4005
+#define ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMP_PHYSICAL_MIN_MIREDS_ID 0x400b
+#define ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMP_PHYSICAL_MAX_MIREDS_ID 0x400c
+
+#define ESP_ZB_ZCL_BASIC_ZCL_VERSION_DEFAULT_VALUE 8
+#define ESP_ZB_ZCL_IDENTIFY_IDENTIFY_TIME_DEFAULT_VALUE 0
+#define ESP_ZB_ZCL_COLOR_CONTROL_COLOR_MODE_DEFAULT_VALUE 0x01
+#define ESP_ZB_ZCL_COLOR_CONTROL_OPTIONS_DEFAULT_VALUE 0
+#define ESP_ZB_ZCL_COLOR_CONTROL_ENHANCED_COLOR_MODE_DEFAULT_VALUE 0x01
+
+typedef enum {
+  ESP_ZB_ZCL_BASIC_POWER_SOURCE_UNKNOWN = 0x00,
+  ESP_ZB_ZCL_BASIC_POWER_SOURCE_MAINS_SINGLE_PHASE = 0x01,
+  ESP_ZB_ZCL_BASIC_POWER_SOURCE_BATTERY = 0x03,
+} esp_zb_zcl_basic_power_source_t;
+
+typedef enum {
+  ESP_ZB_ZCL_ATTR_TYPE_BOOL = 0x10,
+  ESP_ZB_ZCL_ATTR_TYPE_U8 = 0x20,
+  ESP_ZB_ZCL_ATTR_TYPE_U16 = 0x21,
+  ESP_ZB_ZCL_ATTR_TYPE_U32 = 0x23,
+  ESP_ZB_ZCL_ATTR_TYPE_8BIT_ENUM = 0x30,
+  ESP_ZB_ZCL_ATTR_TYPE_OCTET_STRING = 0x41,
+  ESP_ZB_ZCL_ATTR_TYPE_CHAR_STRING = 0x42,
+} esp_zb_zcl_attr_type_t;
+
+typedef enum {
+  ESP_ZB_ZCL_ATTR_ACCESS_READ_ONLY = 0x01,
+  ESP_ZB_ZCL_ATTR_ACCESS_WRITE_ONLY = 0x02,
+  ESP_ZB_ZCL_ATTR_ACCESS_READ_WRITE = 0x03,
+  ESP_ZB_ZCL_ATTR_ACCESS_REPORTING = 0x04,
+} esp_zb_zcl_attr_access_t;
+
+typedef enum {
+  ESP_ZB_ZCL_STATUS_SUCCESS = 0x00,
+  ESP_ZB_ZCL_STATUS_FAIL = 0x01,
+} esp_zb_zcl_status_t;
+
+// Cluster configurations
+typedef struct {
+  uint8_t zcl_version;
+  uint8_t power_source;
+} esp_zb_basic_cluster_cfg_t;
+
+typedef struct {
+  uint16_t identify_time;
+} esp_zb_identify_cluster_cfg_t;
+
+typedef struct {
+  bool on_off;
+} esp_zb_on_off_cluster_cfg_t;
+
+typedef struct {
+  uint8_t current_level;
+} esp_zb_level_cluster_cfg_t;
+
+typedef struct {
+  uint8_t groups_name_support_id;
+} esp_zb_groups_cluster_cfg_t;
+
+typedef struct {
+  uint8_t scenes_count;
+  uint8_t current_scene;
+  uint16_t current_group;
+  bool scene_valid;
+  uint8_t name_support;
+} esp_zb_scenes_cluster_cfg_t;
+
+typedef struct {
+  uint16_t current_x;
+  uint16_t current_y;
+  uint8_t color_mode;
+  uint8_t options;
+  uint8_t enhanced_color_mode;
+  uint16_t color_capabilities;
+} esp_zb_color_cluster_cfg_t;
+
+// Core action callbacks
+typedef enum {
+  ESP_ZB_CORE_SET_ATTR_VALUE_CB_ID = 0x0000,
+  ESP_ZB_CORE_SCENES_STORE_SCENE_CB_ID = 0x0001,
+  ESP_ZB_CORE_SCENES_RECALL_SCENE_CB_ID = 0x0002,
+  ESP_ZB_CORE_IDENTIFY_EFFECT_CB_ID = 0x0003,
+} esp_zb_core_action_callback_id_t;
+
+typedef struct {
+  esp_zb_zcl_status_t status;
+  uint8_t dst_endpoint;
+  uint16_t cluster;
+} esp_zb_device_cb_common_info_t;
+
+typedef struct {
+  esp_zb_zcl_attr_type_t type;
+  uint16_t size;
+  void* value;
+} esp_zb_zcl_attribute_data_t;
+
+typedef struct {
+  uint16_t id;
+  esp_zb_zcl_attribute_data_t data;
+} esp_zb_zcl_attribute_t;
+
+typedef struct {
+  esp_zb_device_cb_common_info_t info;
+  esp_zb_zcl_attribute_t attribute;
+} esp_zb_zcl_set_attr_value_message_t;
+
+// Scenes
+typedef struct esp_zb_zcl_scenes_extension_field_s {
+  uint16_t cluster_id;
+  uint8_t length;
+  uint8_t* extension_field_attribute_value_list;
+  struct esp_zb_zcl_scenes_extension_field_s* next;
+} esp_zb_zcl_scenes_extension_field_t;
+
+typedef struct {
+  esp_zb_device_cb_common_info_t info;
+  uint16_t group_id;
+  uint8_t scene_id;
+} esp_zb_zcl_store_scene_message_t;
+
+typedef struct {
+  esp_zb_device_cb_common_info_t info;
+  uint16_t group_id;
+  uint8_t scene_id;
+  uint16_t transition_time;
+  esp_zb_zcl_scenes_extension_field_t* field_set;
+} esp_zb_zcl_recall_scene_message_t;
+
+typedef struct {
+  esp_zb_device_cb_common_info_t info;
+  uint8_t effect_id;
+  uint8_t effect_variant;
+} esp_zb_zcl_identify_effect_message_t;
+
+// Attributes as the stack stores them
+typedef struct {
+  uint16_t id;
+  uint8_t type;
+  uint8_t access;
+  uint16_t manuf_code;
+  void* data_p;
+} esp_zb_zcl_attr_t;
+
+// APS data indication, seen before the stack processes the frame
+typedef struct {
+  uint8_t states;
+  uint8_t dst_addr_mode;
+  uint16_t dst_short_addr;
+  uint8_t dst_endpoint;
+  uint8_t src_addr_mode;
+  uint16_t src_short_addr;
+  uint8_t src_endpoint;
+  uint16_t profile_id;
+  uint16_t cluster_id;
+  uint32_t asdu_length;
+  uint8_t* asdu;
+  uint8_t security_status;
+  int lqi;
+  int rx_time;
+} esp_zb_apsde_data_ind_t;
+
+// Returns true if the frame was handled and the stack should drop it
+typedef bool (*esp_zb_aps_data_indication_callback_t)(
+    esp_zb_apsde_data_ind_t ind);
+
+// Attribute reporting
+#define ESP_ZB_ZCL_ATTR_NON_MANUFACTURER_SPECIFIC 0xFFFF
+#define ESP_ZB_ZCL_REPORT_DIRECTION_SEND 0x00
+
+typedef enum {
+  ESP_ZB_APS_ADDR_MODE_DST_ADDR_ENDP_NOT_PRESENT = 0x00,
+  ESP_ZB_APS_ADDR_MODE_16_GROUP_ENDP_NOT_PRESENT = 0x01,
+  ESP_ZB_APS_ADDR_MODE_16_ENDP_PRESENT = 0x02,
+} esp_zb_zcl_address_mode_t;
+
+typedef enum {
+  ESP_ZB_ZCL_CMD_DIRECTION_TO_SRV = 0x00,
+  ESP_ZB_ZCL_CMD_DIRECTION_TO_CLI = 0x01,
+} esp_zb_zcl_cmd_direction_t;
+
+typedef union {
+  uint16_t addr_short;
+  uint8_t addr_long[8];
+} esp_zb_addr_u;
+
+typedef struct {
+  esp_zb_addr_u dst_addr_u;
+  uint8_t dst_endpoint;
+  uint8_t src_endpoint;
+} esp_zb_zcl_basic_cmd_t;
+
+typedef struct {
+  esp_zb_zcl_basic_cmd_t zcl_basic_cmd;
+  esp_zb_zcl_address_mode_t address_mode;
+  uint16_t clusterID;
+  uint16_t attributeID;
+  uint8_t direction;
+  uint8_t manuf_specific;
+  uint16_t manuf_code;
+} esp_zb_zcl_report_attr_cmd_t;
+
+// APS data request, the stack copies the ASDU
+typedef struct {
+  uint8_t dst_addr_mode;
+  esp_zb_addr_u dst_addr;
+  uint8_t dst_endpoint;
+  uint16_t profile_id;
+  uint16_t cluster_id;
+  uint8_t src_endpoint;
+  uint32_t asdu_length;
+  uint8_t* asdu;
+  uint8_t tx_options;
+  bool use_alias;
+  uint8_t alias_src_addr[8];
+  uint8_t alias_seq_num;
+  uint8_t radius;
+} esp_zb_apsde_data_req_t;
+
+typedef struct {
+  uint8_t endpoint_id;
+  uint16_t cluster_id;
+  uint8_t cluster_role;
+  uint16_t manuf_code;
+  uint16_t attr_id;
+} esp_zb_zcl_attr_location_info_t;
+
+typedef union {
+  uint8_t u8;
+  int8_t s8;
+  uint16_t u16;
+  int16_t s16;
+  uint32_t u32;
+  int32_t s32;
+} esp_zb_zcl_attr_var_t;
+
+typedef struct {
+  uint8_t direction;
+  uint8_t ep;
+  uint16_t cluster_id;
+  uint8_t cluster_role;
+  uint16_t attr_id;
+  uint8_t flags;
+  uint64_t run_time;
+  union {
+    struct {
+      uint16_t min_interval;
+      uint16_t max_interval;
+      esp_zb_zcl_attr_var_t delta;
+      esp_zb_zcl_attr_var_t reported_value;
+      uint16_t def_min_interval;
+      uint16_t def_max_interval;
+    } send_info;
+    struct {
+      uint16_t timeout;
+    } recv_info;
+  } u;
+  struct {
+    uint16_t short_addr;
+    uint8_t endpoint;
+    uint16_t profile_id;
+  } dst;
+  uint16_t manuf_code;
+} esp_zb_zcl_reporting_info_t;
+
+typedef esp_err_t (*esp_zb_core_action_callback_t)(
+    esp_zb_core_action_callback_id_t callback_id, const void* message);
+typedef void (*esp_zb_callback_t)(uint8_t param);
+typedef void (*esp_zb_identify_notify_callback_t)(uint8_t identify_on);
+
+// Platform and network configuration
+#define ZB_RADIO_MODE_NATIVE 0
+#define ZB_HOST_CONNECTION_MODE_NONE 0
+
+typedef struct {
+  int radio_mode;
+  struct {
+    int port;
+  } radio_uart_config;
+} esp_zb_radio_config_t;
+
+typedef struct {
+  int host_connection_mode;
+  struct {
+    int port;
+  } host_uart_config;
+} esp_zb_host_config_t;
+
+typedef struct {
+  esp_zb_radio_config_t radio_config;
+  esp_zb_host_config_t host_config;
+} esp_zb_platform_config_t;
+
+typedef enum {
+  ESP_ZB_DEVICE_TYPE_COORDINATOR = 0x00,
+  ESP_ZB_DEVICE_TYPE_ROUTER = 0x01,
+  ESP_ZB_DEVICE_TYPE_ED = 0x02,
+} esp_zb_nwk_device_type_t;
+
+#define ESP_ZB_ED_AGING_TIMEOUT_64MIN 6
+
+typedef struct {
+  uint8_t ed_timeout;
+  uint32_t keep_alive;
+} esp_zb_zed_cfg_t;
+
+typedef struct {
+  esp_zb_nwk_device_type_t esp_zb_role;
+  bool install_code_policy;
+  union {
+    esp_zb_zed_cfg_t zed_cfg;
+  } nwk_cfg;
+} esp_zb_cfg_t;
+
+typedef struct {
+  uint8_t endpoint;
+  uint16_t app_profile_id;
+  uint16_t app_device_id;
+  uint32_t app_device_version;
+} esp_zb_endpoint_config_t;
+
+// Application signals
+typedef uint32_t esp_zb_app_signal_type_t;
+
+#define ESP_ZB_ZDO_SIGNAL_SKIP_STARTUP 0x01
+#define ESP_ZB_ZDO_SIGNAL_LEAVE 0x03
+#define ESP_ZB_BDB_SIGNAL_DEVICE_FIRST_START 0x05
+#define ESP_ZB_BDB_SIGNAL_DEVICE_REBOOT 0x06
+#define ESP_ZB_BDB_SIGNAL_STEERING 0x0a
+
+#define ESP_ZB_BDB_MODE_INITIALIZATION 0x00
+#define ESP_ZB_BDB_MODE_NETWORK_STEERING 0x02
+
+typedef struct {
+  uint32_t* p_app_signal;
+  esp_err_t esp_err_status;
+} esp_zb_app_signal_t;
+
+typedef enum {
+  ESP_ZB_NWK_LEAVE_TYPE_RESET = 0x00,
+  ESP_ZB_NWK_LEAVE_TYPE_REJOIN = 0x01,
+} esp_zb_nwk_leave_type_t;
+
+typedef struct {
+  uint8_t leave_type;
+} esp_zb_zdo_signal_leave_params_t;
+
+typedef enum {
+  ESP_ZB_APSDE_TX_OPT_ACK_TX = 0x04,
+} esp_zb_apsde_tx_opt_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_zb_attribute_list_t* esp_zb_basic_cluster_create(
+    esp_zb_basic_cluster_cfg_t* basic_cfg);
+esp_zb_attribute_list_t* esp_zb_identify_cluster_create(
+    esp_zb_identify_cluster_cfg_t* identify_cfg);
+esp_zb_attribute_list_t* esp_zb_on_off_cluster_create(
+    esp_zb_on_off_cluster_cfg_t* on_off_cfg);
+esp_zb_attribute_list_t* esp_zb_groups_cluster_create(
+    esp_zb_groups_cluster_cfg_t* groups_cfg);
+esp_zb_attribute_list_t* esp_zb_scenes_cluster_create(
+    esp_zb_scenes_cluster_cfg_t* scenes_cfg);
+esp_zb_attribute_list_t* esp_zb_level_cluster_create(
+    esp_zb_level_cluster_cfg_t* level_cfg);
+esp_zb_attribute_list_t* esp_zb_color_control_cluster_create(
+    esp_zb_color_cluster_cfg_t* color_cfg);
+esp_err_t esp_zb_basic_cluster_add_attr(esp_zb_attribute_list_t* attr_list,
+                                        uint16_t attr_id, void* value_p);
+esp_err_t esp_zb_color_control_cluster_add_attr(
+    esp_zb_attribute_list_t* attr_list, uint16_t attr_id, void* value_p);
+esp_zb_attribute_list_t* esp_zb_zcl_attr_list_create(uint16_t cluster_id);
+esp_err_t esp_zb_custom_cluster_add_custom_attr(
+    esp_zb_attribute_list_t* attr_list, uint16_t attr_id, uint8_t attr_type,
+    uint8_t attr_access, void* value_p);
+
+esp_zb_cluster_list_t* esp_zb_zcl_cluster_list_create(void);
+esp_err_t esp_zb_cluster_list_add_basic_cluster(
+    esp_zb_cluster_list_t* cluster_list, esp_zb_attribute_list_t* attr_list,
+    uint8_t role_mask);
+esp_err_t esp_zb_cluster_list_add_identify_cluster(
+    esp_zb_cluster_list_t* cluster_list, esp_zb_attribute_list_t* attr_list,
+    uint8_t role_mask);
+esp_err_t esp_zb_cluster_list_add_groups_cluster(
+    esp_zb_cluster_list_t* cluster_list, esp_zb_attribute_list_t* attr_list,
+    uint8_t role_mask);
+esp_err_t esp_zb_cluster_list_add_scenes_cluster(
+    esp_zb_cluster_list_t* cluster_list, esp_zb_attribute_list_t* attr_list,
+    uint8_t role_mask);
+esp_err_t esp_zb_cluster_list_add_on_off_cluster(
+    esp_zb_cluster_list_t* cluster_list, esp_zb_attribute_list_t* attr_list,
+    uint8_t role_mask);
+esp_err_t esp_zb_cluster_list_add_level_cluster(
+    esp_zb_cluster_list_t* cluster_list, esp_zb_attribute_list_t* attr_list,
+    uint8_t role_mask);
+esp_err_t esp_zb_cluster_list_add_color_control_cluster(
+    esp_zb_cluster_list_t* cluster_list, esp_zb_attribute_list_t* attr_list,
+    uint8_t role_mask);
+esp_err_t esp_zb_cluster_list_add_custom_cluster(
+    esp_zb_cluster_list_t* cluster_list, esp_zb_attribute_list_t* attr_list,
+    uint8_t role_mask);
+
+esp_zb_ep_list_t* esp_zb_ep_list_create(void);
+esp_err_t esp_zb_ep_list_add_ep(esp_zb_ep_list_t* ep_list,
+                                esp_zb_cluster_list_t* cluster_list,
+                                esp_zb_endpoint_config_t endpoint_config);
+
+esp_err_t esp_zb_platform_config(esp_zb_platform_config_t* config);
+void esp_zb_init(esp_zb_cfg_t* nwk_cfg);
+esp_err_t esp_zb_device_register(esp_zb_ep_list_t* ep_list);
+esp_err_t esp_zb_start(bool autostart);
+void esp_zb_stack_main_loop(void);
+
+void esp_zb_core_action_handler_register(esp_zb_core_action_callback_t cb);
+void esp_zb_aps_data_indication_handler_register(
+    esp_zb_aps_data_indication_callback_t cb);
+void esp_zb_identify_notify_handler_register(
+    uint8_t endpoint, esp_zb_identify_notify_callback_t cb);
+void esp_zb_scheduler_alarm(esp_zb_callback_t cb, uint8_t param,
+                            uint32_t time);
+void esp_zb_scheduler_alarm_cancel(esp_zb_callback_t cb, uint8_t param);
+bool esp_zb_lock_acquire(TickType_t block_ticks);
+void esp_zb_lock_release(void);
+
+esp_zb_zcl_status_t esp_zb_zcl_set_attribute_val(uint8_t endpoint,
+                                                 uint16_t cluster_id,
+                                                 uint8_t cluster_role,
+                                                 uint16_t attr_id,
+                                                 void* value_p, bool check);
+
+esp_zb_zcl_attr_t* esp_zb_zcl_get_attribute(uint8_t endpoint,
+                                            uint16_t cluster_id,
+                                            uint8_t cluster_role,
+                                            uint16_t attr_id);
+
+esp_err_t esp_zb_zcl_report_attr_cmd_req(esp_zb_zcl_report_attr_cmd_t* cmd_req);
+esp_err_t esp_zb_aps_data_request(esp_zb_apsde_data_req_t* req);
+esp_zb_zcl_reporting_info_t* esp_zb_zcl_find_reporting_info(
+    esp_zb_zcl_attr_location_info_t attr_info);
+
+esp_err_t esp_zb_bdb_start_top_level_commissioning(uint8_t mode_mask);
+bool esp_zb_bdb_is_factory_new(void);
+const char* esp_zb_zdo_signal_to_string(esp_zb_app_signal_type_t signal);
+void* esp_zb_app_signal_get_params(uint32_t* signal_p);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,33 @@
+// Host stand-in for FreeRTOS. The simulation is single-threaded, so locks
+// are no-ops and tasks are recorded but never run.
+#pragma once
+
+#include <stdint.h>
+
+#include "sdkconfig.h"
+
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint8_t StackType_t;
+typedef void* TaskHandle_t;
+typedef void* SemaphoreHandle_t;
+
+typedef struct {
+  void* reserved;
+} StaticTask_t;
+
+typedef struct {
+  uint32_t owner;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED {0}
+#define portENTER_CRITICAL(mux) ((void)(mux))
+#define portEXIT_CRITICAL(mux) ((void)(mux))
+
+#define pdPASS 1
+#define pdFAIL 0
+#define pdTRUE 1
+#define pdFALSE 0
+#define portMAX_DELAY 0xffffffffu
+#define pdMS_TO_TICKS(ms) (ms)
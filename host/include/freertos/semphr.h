@@ -0,0 +1,20 @@
+// Host stand-in for FreeRTOS semaphores
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct {
+  void* reserved;
+} StaticSemaphore_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t* buffer);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t timeout);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+
+#ifdef __cplusplus
+}
+#endif
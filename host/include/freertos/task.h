@@ -0,0 +1,27 @@
+// Host stand-in for FreeRTOS tasks. Created tasks are recorded, not run.
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef void (*TaskFunction_t)(void*);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char* name,
+                       uint32_t stack_depth, void* parameters,
+                       UBaseType_t priority, TaskHandle_t* created_task);
+TaskHandle_t xTaskCreateStatic(TaskFunction_t function, const char* name,
+                               uint32_t stack_depth, void* parameters,
+                               UBaseType_t priority, StackType_t* stack_buffer,
+                               StaticTask_t* task_buffer);
+char* pcTaskGetName(TaskHandle_t task);
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t timeout);
+void xTaskNotifyGive(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+
+#ifdef __cplusplus
+}
+#endif
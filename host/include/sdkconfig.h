@@ -0,0 +1,44 @@
+// Configuration of the host simulation build. Mirrors the Kconfig defaults,
+// except that light changes are applied inline instead of on a render task
+// so that runs are deterministic.
+#pragma once
+
+#define CONFIG_IDF_TARGET "linux"
+
+#define CONFIG_LED_PIN 8
+#define CONFIG_LED_PIXEL_COUNT 3
+#define CONFIG_LIGHT_ENDPOINT 10
+#define CONFIG_LIGHT_ENDPOINT_COUNT 3
+#define CONFIG_LIGHT_DEFAULT_ACTIVE 0
+#define CONFIG_LIGHT_DEFAULT_BRIGHTNESS 100
+#define CONFIG_LIGHT_DEFAULT_COLOR_X 30
+#define CONFIG_LIGHT_DEFAULT_COLOR_Y 30
+#define CONFIG_LIGHT_COLOR_TEMP_MIN_MIREDS 153
+#define CONFIG_LIGHT_COLOR_TEMP_MAX_MIREDS 500
+#define CONFIG_LIGHT_DEFAULT_COLOR_TEMP_MIREDS 370
+#define CONFIG_LIGHT_COLOR_FIXED_POINT 1
+#define CONFIG_LIGHT_TRANSITION_FPS 50
+#define CONFIG_LIGHT_TRANSITION_SMOOTHING_MS 250
+#define CONFIG_LIGHT_BOOT_FRAME 1
+#define CONFIG_LIGHT_BOOT_FRAME_PARTITION "boot_frame"
+#define CONFIG_LIGHT_EFFECT_TICK_BUDGET_US 50
+#define CONFIG_LIGHT_GAMMA_X10 22
+#define CONFIG_LIGHT_MAX_SCENES 16
+#define CONFIG_ZIGBEE_CALLBACK_STATS_INTERVAL 0
+#define CONFIG_REPORTING_MIN_INTERVAL_S 1
+#define CONFIG_REPORTING_MAX_INTERVAL_S 300
+#define CONFIG_LATENCY_TRACE 1
+#define CONFIG_APP_LOG_LEVEL 3
+#define CONFIG_APP_LOG_DEFERRED 1
+#define CONFIG_APP_LOG_BUFFER_RECORDS 64
+#define CONFIG_ZIGBEE_TASK_STACK_SIZE 4096
+#define CONFIG_ZIGBEE_MAX_ENDPOINTS 8
+#define CONFIG_ZIGBEE_MAX_GROUPS 16
+#define CONFIG_ZIGBEE_MAX_ATTRIBUTE_GROUPS 4
+#define CONFIG_MEMORY_REPORT_INTERVAL_S 0
+#define CONFIG_STORAGE_BACKEND_NVS 1
+#define CONFIG_STORAGE_WRITE_BEHIND 1
+#define CONFIG_STORAGE_FLUSH_QUIET_MS 1000
+#define CONFIG_STORAGE_FLUSH_MAX_LATENCY_MS 5000
+#define CONFIG_DEVICE_MANUFACTURER "Alex Chebotarsky"
+#define CONFIG_DEVICE_MODEL "Zigbee Light Device"
@@ -0,0 +1,4 @@
+// Host stand-in for soc/soc_caps.h, with the capabilities of ESP32-H2
+#pragma once
+
+#define SOC_RMT_SUPPORT_DMA 0
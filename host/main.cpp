@@ -0,0 +1,689 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <thread>
+
+#include "BootFrame.hpp"
+#include "Color.hpp"
+#include "DiagnosticsCluster.hpp"
+#include "EffectEngine.hpp"
+#include "LatencyTrace.hpp"
+#include "LightEndpoint.hpp"
+#include "LightState.hpp"
+#include "Log.hpp"
+#include "RenderScheduler.hpp"
+#include "Simulator.hpp"
+#include "SingleLED.hpp"
+#include "Storage.hpp"
+#include "ZigbeeStack.hpp"
+#include "tests/Check.hpp"
+
+extern "C" void app_main(void);
+extern std::array<LightEndpoint, MAX_LIGHTS> lights;
+extern RenderScheduler scheduler;
+
+constexpr uint8_t ENDPOINT = CONFIG_LIGHT_ENDPOINT;
+// NVS namespaces of the lights, as LightEndpoint names them
+constexpr const char* STORAGE_NAMESPACES[] = {"zigbee_device", "light_1",
+                                              "light_2"};
+static_assert(MAX_LIGHTS <= std::size(STORAGE_NAMESPACES));
+
+// Level Control commands
+constexpr uint8_t LEVEL_CMD_MOVE_TO_LEVEL = 0x00;
+constexpr uint8_t LEVEL_CMD_STOP = 0x03;
+// Scenes commands
+constexpr uint8_t SCENES_CMD_ADD_SCENE = 0x00;
+constexpr uint8_t SCENES_CMD_REMOVE_SCENE = 0x02;
+constexpr uint16_t SCENE_TRANSITION_DEFAULT = 0xFFFF;
+
+static void print_last_frame(const char* label) {
+  // Decode the log records the firmware buffered meanwhile
+  Log.flush();
+
+  const auto& frames = Sim.get_frames();
+  if (frames.empty()) {
+    printf("%s: no frames\n", label);
+    return;
+  }
+
+  const ColorRGB& pixel = frames.back().pixels[0];
+  printf("%s: R=%u, G=%u, B=%u at %lld ms\n", label, pixel.r, pixel.g, pixel.b,
+         static_cast<long long>(frames.back().time_us / 1000));
+}
+
+static void print_records(const char* label) {
+  FlashStats flash = Sim.get_flash_stats();
+  printf("%s: frames=%zu, nvs sets=%zu, nvs commits=%zu, flash writes=%u, "
+         "flash erases=%u, reports=%zu\n",
+         label, Sim.get_frames().size(), Sim.count_nvs(NVSOperation::SET),
+         Sim.count_nvs(NVSOperation::COMMIT), flash.writes, flash.erases,
+         Sim.get_reports().size());
+}
+
+// Checks that a handler call succeeded
+#define EXPECT_OK(call) check_ok((call), #call, __FILE__, __LINE__)
+
+static bool check_ok(esp_err_t err, const char* expression, const char* file,
+                     int line) {
+  bool ok = check_condition(err == ESP_OK, expression, file, line);
+  if (!ok) printf("Handler failed: %s\n", esp_err_to_name(err));
+  return ok;
+}
+
+static ColorRGB last_pixel(size_t index = 0) {
+  const auto& frames = Sim.get_frames();
+  if (frames.empty()) return ColorRGB{0, 0, 0};
+  return frames.back().pixels[index];
+}
+
+static bool same_color(ColorRGB a, ColorRGB b) {
+  return a.r == b.r && a.g == b.g && a.b == b.b;
+}
+
+static bool same_color(ColorRGB16 a, ColorRGB16 b) {
+  return a.r == b.r && a.g == b.g && a.b == b.b;
+}
+
+// Prints the last frame and checks its first pixel
+#define EXPECT_FRAME(label, ...)                  \
+  do {                                            \
+    print_last_frame(label);                      \
+    CHECK(!Sim.get_frames().empty());             \
+    CHECK(same_color(last_pixel(), __VA_ARGS__)); \
+  } while (0)
+
+int main() {
+  app_main();
+  SingleLED& led = lights[0].get_led();
+  Sim.signal(ESP_ZB_BDB_SIGNAL_DEVICE_REBOOT, ESP_OK);
+  EXPECT_FRAME("Boot", ColorRGB{0, 0, 0});
+  print_records("Boot");
+  // Nothing was retained or saved for a cold boot, so the first frame on the
+  // strip is the stored state and boot to light measures it
+  CHECK(!led.has_boot_frame());
+  CHECK(Sim.get_frames().size() == 1 &&
+        Sim.get_frames().front().time_us == scheduler.get_boot_to_light_us());
+  Sim.clear_records();
+
+  // On
+  EXPECT_OK(Sim.write_bool(ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_ON_OFF,
+                           ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID, true));
+  Sim.advance(2000 * 1000);
+  EXPECT_FRAME("On", ColorRGB{167, 141, 255});
+  print_records("On");
+  CHECK(Sim.count_nvs(NVSOperation::COMMIT) == 1);
+  Sim.clear_records();
+
+  // Move to Level over 2 s, stepped by the stack every 100 ms. The command
+  // carries the transition time, so the light fades straight to the target
+  // instead of following the steps.
+  Sim.send_command(ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL,
+                   LEVEL_CMD_MOVE_TO_LEVEL, {14, 20, 0});
+  for (int level = 254; level >= 14; level -= 12) {
+    EXPECT_OK(Sim.write_u8(ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL,
+                           ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID,
+                           static_cast<uint8_t>(level)));
+    Sim.advance(100 * 1000);
+    if (level == 254 - 12 * 9) {
+      EXPECT_FRAME("Move to Level halfway", ColorRGB{42, 35, 63});
+    }
+  }
+  Sim.advance(10 * 1000 * 1000);
+  EXPECT_FRAME("Move to Level", ColorRGB{1, 1, 1});
+  print_records("Move to Level");
+  // One fade over the 2 s of the command
+  CHECK(Sim.get_frames().size() >= 2 * CONFIG_LIGHT_TRANSITION_FPS - 5);
+  CHECK(led.get_brightness() == 14);
+  Sim.clear_records();
+
+  // Stop halfway through a Move to Level, the light goes to the level the
+  // stack stepped to
+  Sim.send_command(ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL,
+                   LEVEL_CMD_MOVE_TO_LEVEL, {254, 20, 0});
+  for (int level = 14; level <= 134; level += 12) {
+    EXPECT_OK(Sim.write_u8(ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL,
+                           ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID,
+                           static_cast<uint8_t>(level)));
+    Sim.advance(100 * 1000);
+  }
+  Sim.send_command(ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL,
+                   LEVEL_CMD_STOP, {});
+  Sim.advance(10 * 1000 * 1000);
+  EXPECT_FRAME("Move to Level stopped", ColorRGB{42, 35, 63});
+  printf("Level after Stop: %u\n", led.get_brightness());
+  CHECK(led.get_brightness() == 134);
+  Sim.clear_records();
+
+  // Move to Color writes X and Y in one command
+  EXPECT_OK(Sim.write_u16(ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+                          ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_X_ID, 45000));
+  EXPECT_OK(Sim.write_u16(ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+                          ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_Y_ID, 19000));
+  Sim.advance(0);
+  HandlerLatency latency = Sim.get_handler_latency();
+  Sim.advance(10 * 1000 * 1000);
+  EXPECT_FRAME("Move to Color", ColorRGB{63, 0, 0});
+  print_records("Move to Color");
+  // X and Y are applied and stored together
+  CHECK(Sim.get_frames().size() == 1);
+  CHECK(Sim.count_nvs(NVSOperation::COMMIT) == 1);
+  CHECK(led.get_state().color_x == 45000 && led.get_state().color_y == 19000);
+  // X and Y are reported in one Report Attributes frame
+  if (CHECK(Sim.get_reports().size() == 1)) {
+    const ReportRecord& report = Sim.get_reports()[0];
+    CHECK(report.cluster_id == ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL);
+    CHECK(report.attr_ids.size() >= 2);
+  }
+
+  // Once Configure Reporting set up an attribute, the stack reports it and
+  // the light does not report it again
+  Sim.clear_records();
+  Sim.configure_reporting(ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_ON_OFF,
+                          ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID, 1, 300, 0);
+  EXPECT_OK(Sim.write_bool(ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_ON_OFF,
+                           ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID, false));
+  EXPECT_OK(Sim.write_bool(ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_ON_OFF,
+                           ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID, true));
+  Sim.advance(10 * 1000 * 1000);
+  print_records("Configured reporting");
+  CHECK(Sim.get_reports().empty());
+
+  // A write that changes nothing gives no end-to-end sample, and doesn't
+  // leave its start for the next write to be measured from
+  LatencyHistogram before = trace_get_histogram(TraceStage::END_TO_END);
+  EXPECT_OK(Sim.write_bool(ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_ON_OFF,
+                           ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID, true));
+  Sim.advance(10 * 1000 * 1000);
+  // Real time, which the cycle counter follows
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_OK(Sim.write_u8(ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL,
+                         ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID, 100));
+  Sim.advance(10 * 1000 * 1000);
+  LatencyHistogram after = trace_get_histogram(TraceStage::END_TO_END);
+  printf("End-to-end after an unchanged write: samples=%lu, over 16 ms=%lu\n",
+         static_cast<unsigned long>(after.count - before.count),
+         static_cast<unsigned long>(after.buckets[LATENCY_BUCKETS - 1] -
+                                    before.buckets[LATENCY_BUCKETS - 1]));
+  CHECK(after.count == before.count + 1);
+  CHECK(after.buckets[LATENCY_BUCKETS - 1] ==
+        before.buckets[LATENCY_BUCKETS - 1]);
+  EXPECT_OK(Sim.write_u8(ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL,
+                         ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID, 134));
+  Sim.advance(10 * 1000 * 1000);
+
+  printf("Handler latency: count=%u, min=%llu ns, avg=%llu ns, max=%llu ns\n",
+         latency.count, static_cast<unsigned long long>(latency.min_ns),
+         static_cast<unsigned long long>(latency.total_ns / latency.count),
+         static_cast<unsigned long long>(latency.max_ns));
+
+  // Stage histograms, as read from the diagnostics cluster
+  trace_print();
+  const Attribute* end_to_end = Sim.get_attribute(
+      ENDPOINT, DIAGNOSTICS_CLUSTER_ID,
+      static_cast<uint16_t>(TraceStage::END_TO_END));
+  if (end_to_end != nullptr) {
+    uint32_t count = end_to_end->value[1] | end_to_end->value[2] << 8 |
+                     end_to_end->value[3] << 16 | end_to_end->value[4] << 24;
+    printf("Diagnostics end-to-end attribute: %zu bytes, count=%lu\n",
+           end_to_end->value.size(), static_cast<unsigned long>(count));
+  }
+
+  // Scenes: one stored from the current state, one added with its values
+  // in the extension fields, as the stack passes them on recall
+  Sim.clear_records();
+  EXPECT_OK(Sim.store_scene(ENDPOINT, 0, 1));
+  uint8_t on_off_values[] = {1};
+  uint8_t level_values[] = {254};
+  uint8_t color_values[] = {0x80, 0x2e, 0xa0, 0x86};  // x=11904, y=34464
+  esp_zb_zcl_scenes_extension_field_t color_field = {
+      ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, sizeof(color_values), color_values,
+      nullptr};
+  esp_zb_zcl_scenes_extension_field_t level_field = {
+      ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL, sizeof(level_values), level_values,
+      &color_field};
+  esp_zb_zcl_scenes_extension_field_t on_off_field = {
+      ESP_ZB_ZCL_CLUSTER_ID_ON_OFF, sizeof(on_off_values), on_off_values,
+      &level_field};
+  EXPECT_OK(Sim.recall_scene(ENDPOINT, 0, 2, 0, &on_off_field));
+  Sim.advance(10 * 1000 * 1000);
+  EXPECT_FRAME("Recall Scene 2", ColorRGB{0, 255, 14});
+  EXPECT_OK(Sim.recall_scene(ENDPOINT, 0, 1, 0));
+  Sim.advance(10 * 1000 * 1000);
+  EXPECT_FRAME("Recall Scene 1", ColorRGB{63, 0, 0});
+  print_records("Scenes");
+
+  // Add Scene with a 1 s transition, a recall that leaves the time to the
+  // scene fades over it: group 0, scene 3, an empty name and the level
+  Sim.send_command(ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_SCENES, SCENES_CMD_ADD_SCENE,
+                   {0, 0, 3, 1, 0, 0, 0x08, 0x00, 1, 254});
+  Sim.clear_records();
+  EXPECT_OK(Sim.recall_scene(ENDPOINT, 0, 3, SCENE_TRANSITION_DEFAULT));
+  Sim.advance(10 * 1000 * 1000);
+  size_t scene_frames = Sim.get_frames().size();
+  int64_t scene_fade_us =
+      Sim.get_frames().back().time_us - Sim.get_frames().front().time_us;
+  printf("Recall Scene 3: frames=%zu, fade=%lld ms\n", scene_frames,
+         static_cast<long long>(scene_fade_us / 1000));
+  CHECK(scene_frames > 10 && scene_fade_us >= 900 * 1000);
+  EXPECT_OK(Sim.recall_scene(ENDPOINT, 0, 1, 0));
+  Sim.advance(10 * 1000 * 1000);
+  EXPECT_FRAME("Recall Scene 1 again", ColorRGB{63, 0, 0});
+
+  // Remove Scene reaches the light's table as well, which saves the scenes
+  // left. Removing it again changes nothing.
+  Sim.clear_records();
+  Sim.send_command(ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_SCENES,
+                   SCENES_CMD_REMOVE_SCENE, {0, 0, 1});
+  Sim.send_command(ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_SCENES,
+                   SCENES_CMD_REMOVE_SCENE, {0, 0, 1});
+  CHECK(Sim.count_nvs(NVSOperation::SET) == 1);
+  EXPECT_OK(Sim.store_scene(ENDPOINT, 0, 1));
+
+  // Recall to refresh, alternating between the scenes so every recall
+  // changes the output. Light changes are applied inline on the host and
+  // shown together by the next advance().
+  constexpr int RECALLS = 1000;
+  uint64_t recall_total_ns = 0;
+  uint64_t recall_max_ns = 0;
+  size_t frames_before = Sim.get_frames().size();
+  for (int i = 0; i < RECALLS; i++) {
+    auto start = std::chrono::steady_clock::now();
+    if (i % 2 == 0) {
+      EXPECT_OK(Sim.recall_scene(ENDPOINT, 0, 2, 0, &on_off_field));
+    } else {
+      EXPECT_OK(Sim.recall_scene(ENDPOINT, 0, 1, 0));
+    }
+    Sim.advance(0);
+    auto end = std::chrono::steady_clock::now();
+
+    uint64_t duration_ns =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+            .count();
+    recall_total_ns += duration_ns;
+    recall_max_ns = std::max(recall_max_ns, duration_ns);
+    Sim.advance(1000 * 1000);
+  }
+  Log.flush();
+  printf("Recall to refresh: recalls=%d, frames=%zu, avg=%llu ns, "
+         "max=%llu ns\n",
+         RECALLS, Sim.get_frames().size() - frames_before,
+         static_cast<unsigned long long>(recall_total_ns / RECALLS),
+         static_cast<unsigned long long>(recall_max_ns));
+  CHECK(Sim.get_frames().size() - frames_before == RECALLS);
+
+  // Groups: the light joins group 1, multicasts to other groups are dropped
+  // before the stack parses them
+  Sim.clear_records();
+  EXPECT_OK(Sim.send_groups_command(ENDPOINT, GROUPS_CMD_ADD_GROUP, 1));
+  EXPECT_OK(Sim.write_group_bool(1, ESP_ZB_ZCL_CLUSTER_ID_ON_OFF,
+                                 ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID, false));
+  Sim.advance(1000 * 1000);
+  EXPECT_FRAME("Group 1 Off", ColorRGB{0, 0, 0});
+  esp_err_t err = Sim.write_group_bool(2, ESP_ZB_ZCL_CLUSTER_ID_ON_OFF,
+                                       ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID, true);
+  Sim.advance(1000 * 1000);
+  EXPECT_FRAME("Group 2 On", ColorRGB{0, 0, 0});
+  GroupStats group_stats = Zigbee.get_group_stats();
+  printf("Groups: group 2 %s, received=%lu, dropped=%lu, nvs sets=%zu\n",
+         err == ESP_ERR_NOT_FOUND ? "dropped" : "delivered",
+         static_cast<unsigned long>(group_stats.received),
+         static_cast<unsigned long>(group_stats.dropped),
+         Sim.count_nvs(NVSOperation::SET));
+  CHECK(err == ESP_ERR_NOT_FOUND);
+  CHECK(group_stats.received == 2 && group_stats.dropped == 1);
+  CHECK(!led.get_active());
+
+  // Every light joins group 3, one group write switches all of them and the
+  // strip is refreshed once for the lot. Each light stores its state in its
+  // own namespace.
+  Sim.clear_records();
+  for (size_t i = 0; i < MAX_LIGHTS; i++) {
+    EXPECT_OK(Sim.send_groups_command(static_cast<uint8_t>(ENDPOINT + i),
+                                      GROUPS_CMD_ADD_GROUP, 3));
+  }
+  size_t frames_before_group = Sim.get_frames().size();
+  EXPECT_OK(Sim.write_group_bool(3, ESP_ZB_ZCL_CLUSTER_ID_ON_OFF,
+                                 ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID, true));
+  Sim.advance(0);
+  size_t group_frames = Sim.get_frames().size() - frames_before_group;
+  Sim.advance(1000 * 1000);
+  printf("All lights On: lights=%zu, frames for the write=%zu, pixels=",
+         static_cast<size_t>(MAX_LIGHTS), group_frames);
+  for (const ColorRGB& pixel : Sim.get_frames().back().pixels) {
+    printf(" (%u, %u, %u)", pixel.r, pixel.g, pixel.b);
+  }
+  printf("\n");
+  CHECK(group_frames == 1);
+  for (size_t i = 0; i < MAX_LIGHTS; i++) {
+    CHECK(lights[i].get_led().get_active());
+    CHECK(!same_color(last_pixel(i), ColorRGB{0, 0, 0}));
+  }
+  Sim.advance(10 * 1000 * 1000);
+
+  std::map<std::string, size_t> sets_per_namespace;
+  for (const NVSRecord& record : Sim.get_nvs_records()) {
+    if (record.operation == NVSOperation::SET) {
+      sets_per_namespace[record.name_space]++;
+    }
+  }
+  printf("NVS sets per namespace:");
+  for (const auto& [name_space, sets] : sets_per_namespace) {
+    printf(" %s=%zu", name_space.c_str(), sets);
+  }
+  printf("\n");
+  for (size_t i = 0; i < MAX_LIGHTS; i++) {
+    CHECK(sets_per_namespace[STORAGE_NAMESPACES[i]] == 1);
+  }
+
+  // A unicast write after the group write reaches the light: nothing of the
+  // group frame is left to filter it
+  ColorRGB before_level = last_pixel(1);
+  EXPECT_OK(Sim.write_u8(ENDPOINT + 1, ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL,
+                         ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID, 50));
+  Sim.advance(10 * 1000 * 1000);
+  printf("Light 2 level after the group write: R=%u, G=%u, B=%u\n",
+         last_pixel(1).r, last_pixel(1).g, last_pixel(1).b);
+  CHECK(!same_color(last_pixel(1), before_level));
+
+  // Light 2 fills its group table. One more Add Group is dropped and
+  // answered with INSUFFICIENT_SPACE in place of the stack.
+  Sim.clear_records();
+  for (uint16_t group_id = 100; group_id < 100 + CONFIG_ZIGBEE_MAX_GROUPS - 1;
+       group_id++) {
+    EXPECT_OK(Sim.send_groups_command(ENDPOINT + 1, GROUPS_CMD_ADD_GROUP,
+                                      group_id));
+  }
+  err = Sim.send_groups_command(ENDPOINT + 1, GROUPS_CMD_ADD_GROUP, 200);
+  const std::vector<SentFrame>& sent = Sim.get_sent_frames();
+  printf("Add Group to a full table: %s, responses=%zu",
+         err == ESP_ERR_NOT_FOUND ? "dropped" : "delivered", sent.size());
+  if (!sent.empty()) {
+    printf(", status=0x%02x", sent.back().asdu.size() > 3
+                                  ? sent.back().asdu[3]
+                                  : 0);
+  }
+  printf("\n");
+  CHECK(err == ESP_ERR_NOT_FOUND);
+  if (CHECK(sent.size() == 1)) {
+    const SentFrame& response = sent.back();
+    CHECK(response.src_endpoint == ENDPOINT + 1 &&
+          response.cluster_id == ESP_ZB_ZCL_CLUSTER_ID_GROUPS);
+    CHECK(response.asdu == std::vector<uint8_t>({0x19, response.asdu[1], 0x00,
+                                                  0x89, 200, 0}));
+  }
+
+  // Add Group to the broadcast endpoint with light 2's table full: light 1
+  // and 3 have room, but the frame is dropped for all, so neither adds it
+  err = Sim.send_groups_command(0xFF, GROUPS_CMD_ADD_GROUP, 201);
+  esp_err_t group_err =
+      Sim.write_group_bool(201, ESP_ZB_ZCL_CLUSTER_ID_ON_OFF,
+                           ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID, true);
+  printf("Broadcast Add Group with one table full: %s, group 201 %s\n",
+         err == ESP_ERR_NOT_FOUND ? "dropped" : "delivered",
+         group_err == ESP_ERR_NOT_FOUND ? "dropped" : "delivered");
+  CHECK(err == ESP_ERR_NOT_FOUND);
+  CHECK(group_err == ESP_ERR_NOT_FOUND);
+
+  // Leaving the network clears the group tables with the stack's
+  Sim.leave_network();
+  err = Sim.write_group_bool(3, ESP_ZB_ZCL_CLUSTER_ID_ON_OFF,
+                             ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID, false);
+  printf("Group 3 after leaving: %s\n",
+         err == ESP_ERR_NOT_FOUND ? "dropped" : "delivered");
+  CHECK(err == ESP_ERR_NOT_FOUND);
+  EXPECT_OK(Sim.send_groups_command(ENDPOINT + 1, GROUPS_CMD_ADD_GROUP, 200));
+
+  // Color temperature: Move to Color Temperature writes the mireds, the light
+  // goes back to XY when the color mode is written
+  EXPECT_OK(Sim.write_bool(ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_ON_OFF,
+                           ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID, true));
+  EXPECT_OK(Sim.write_u8(ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL,
+                         ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID, 254));
+  EXPECT_OK(Sim.write_u16(ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+                          ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMPERATURE_ID,
+                          COLOR_TEMP_MIN_MIREDS));
+  Sim.advance(10 * 1000 * 1000);
+  print_last_frame("Cool white");
+  ColorRGB cool = last_pixel();
+  EXPECT_OK(Sim.write_u16(ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+                          ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMPERATURE_ID,
+                          COLOR_TEMP_MAX_MIREDS));
+  Sim.advance(10 * 1000 * 1000);
+  print_last_frame("Warm white");
+  ColorRGB warm = last_pixel();
+  CHECK(cool.b > warm.b && cool.g > warm.g && warm.r == 255);
+  EXPECT_OK(Sim.write_u8(ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+                         ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_MODE_ID,
+                         static_cast<uint8_t>(ColorMode::XY)));
+  Sim.advance(10 * 1000 * 1000);
+  EXPECT_FRAME("Back to XY", ColorRGB{255, 0, 1});
+
+  // Hue and saturation: Move to Hue and Saturation writes both values and the
+  // color modes, Enhanced Move to Hue the hue in both precisions. Each is
+  // one refresh.
+  Sim.clear_records();
+  EXPECT_OK(Sim.write_u8(ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+                         ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_HUE_ID, 85));
+  EXPECT_OK(Sim.write_u8(ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+                         ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_SATURATION_ID,
+                         254));
+  EXPECT_OK(Sim.write_u8(ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+                         ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_MODE_ID,
+                         color_mode_attribute(ColorMode::HUE_SATURATION)));
+  EXPECT_OK(Sim.write_u8(ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+                         ESP_ZB_ZCL_ATTR_COLOR_CONTROL_ENHANCED_COLOR_MODE_ID,
+                         static_cast<uint8_t>(ColorMode::HUE_SATURATION)));
+  Sim.advance(10 * 1000 * 1000);
+  EXPECT_FRAME("Hue and Saturation", ColorRGB{1, 255, 0});
+  EXPECT_OK(Sim.write_u16(
+      ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+      ESP_ZB_ZCL_ATTR_COLOR_CONTROL_ENHANCED_CURRENT_HUE_ID, 43690));
+  EXPECT_OK(Sim.write_u8(ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+                         ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_HUE_ID, 170));
+  EXPECT_OK(Sim.write_u8(
+      ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+      ESP_ZB_ZCL_ATTR_COLOR_CONTROL_ENHANCED_COLOR_MODE_ID,
+      static_cast<uint8_t>(ColorMode::ENHANCED_HUE_SATURATION)));
+  Sim.advance(10 * 1000 * 1000);
+  EXPECT_FRAME("Enhanced Hue", ColorRGB{0, 0, 255});
+  print_records("Hue");
+  CHECK(Sim.get_frames().size() == 2);
+
+  // Effects run on the frame timer. Breathe fades out and in, Finish lets
+  // the current breath complete.
+  EXPECT_OK(Sim.trigger_effect(ENDPOINT, IDENTIFY_EFFECT_BREATHE, 0));
+  Sim.advance(250 * 1000);
+  print_last_frame("Breathe rising");
+  Sim.advance(250 * 1000);
+  EXPECT_FRAME("Breathe peak", ColorRGB{0, 0, 255});
+  EXPECT_OK(Sim.trigger_effect(ENDPOINT, IDENTIFY_EFFECT_FINISH, 0));
+  Sim.advance(1000 * 1000);
+  print_last_frame("Breathe finished");
+  printf("Effect after Finish: %u\n", static_cast<uint8_t>(led.get_effect()));
+  CHECK(led.get_effect() == Effect::NONE);
+
+  // Color Loop Set: 4 s per loop, incrementing the hue. A level write
+  // cancels the loop at once.
+  EXPECT_OK(Sim.write_u16(ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+                          ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_LOOP_TIME_ID,
+                          4));
+  EXPECT_OK(Sim.write_u8(ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+                         ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_LOOP_DIRECTION_ID,
+                         1));
+  EXPECT_OK(Sim.write_u8(ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+                         ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_LOOP_ACTIVE_ID,
+                         1));
+  ColorRGB loop_pixel = last_pixel();
+  for (int second = 1; second <= 3; second++) {
+    Sim.advance(1000 * 1000);
+    char label[32];
+    snprintf(label, sizeof(label), "Color loop %d s", second);
+    print_last_frame(label);
+    // The hue moves on every second
+    CHECK(!same_color(last_pixel(), loop_pixel));
+    loop_pixel = last_pixel();
+  }
+  EXPECT_OK(Sim.write_u8(ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL,
+                         ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID, 200));
+  Sim.advance(0);
+  printf("Effect after level write: %u\n",
+         static_cast<uint8_t>(led.get_effect()));
+  CHECK(led.get_effect() == Effect::NONE);
+  Sim.advance(10 * 1000 * 1000);
+  EXPECT_FRAME("Level after loop", ColorRGB{0, 0, 151});
+
+  // A loop over an XY color without saturation runs at full saturation. A
+  // write of the level the light already has still ends it.
+  EXPECT_OK(Sim.write_u8(ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+                         ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_SATURATION_ID,
+                         0));
+  EXPECT_OK(Sim.write_u8(ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+                         ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_MODE_ID,
+                         static_cast<uint8_t>(ColorMode::XY)));
+  Sim.advance(10 * 1000 * 1000);
+  ColorRGB xy_pixel = last_pixel();
+  EXPECT_OK(Sim.write_u8(ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+                         ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_LOOP_ACTIVE_ID,
+                         1));
+  Sim.advance(1000 * 1000);
+  print_last_frame("XY color loop");
+  ColorRGB xy_loop = last_pixel();
+  CHECK(std::max({xy_loop.r, xy_loop.g, xy_loop.b}) -
+            std::min({xy_loop.r, xy_loop.g, xy_loop.b}) >
+        100);
+  EXPECT_OK(Sim.write_u8(ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL,
+                         ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID, 200));
+  Sim.advance(0);
+  printf("Effect after the same level: %u\n",
+         static_cast<uint8_t>(led.get_effect()));
+  CHECK(led.get_effect() == Effect::NONE);
+  CHECK(same_color(last_pixel(), xy_pixel));
+
+  // A loop started while the light is off keeps it dark, On ends it
+  EXPECT_OK(Sim.write_bool(ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_ON_OFF,
+                           ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID, false));
+  Sim.advance(10 * 1000 * 1000);
+  EXPECT_OK(Sim.write_u8(ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+                         ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_LOOP_ACTIVE_ID,
+                         1));
+  Sim.advance(1000 * 1000);
+  EXPECT_FRAME("Color loop while off", ColorRGB{0, 0, 0});
+  EXPECT_OK(Sim.write_bool(ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_ON_OFF,
+                           ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID, true));
+  Sim.advance(10 * 1000 * 1000);
+  CHECK(led.get_effect() == Effect::NONE);
+  CHECK(same_color(last_pixel(), xy_pixel));
+
+  // Back to the blue the identify checks expect
+  EXPECT_OK(Sim.write_u8(ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+                         ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_SATURATION_ID,
+                         254));
+  EXPECT_OK(Sim.write_u8(
+      ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+      ESP_ZB_ZCL_ATTR_COLOR_CONTROL_ENHANCED_COLOR_MODE_ID,
+      static_cast<uint8_t>(ColorMode::ENHANCED_HUE_SATURATION)));
+  Sim.advance(10 * 1000 * 1000);
+  EXPECT_FRAME("Blue again", ColorRGB{0, 0, 151});
+
+  // Identify blinks for as long as the stack is identifying
+  Sim.identify(ENDPOINT, true);
+  Sim.advance(250 * 1000);
+  print_last_frame("Identify on");
+  Sim.advance(500 * 1000);
+  EXPECT_FRAME("Identify off phase", ColorRGB{0, 0, 0});
+  Sim.identify(ENDPOINT, false);
+  Sim.advance(0);
+  EXPECT_FRAME("Identify stopped", ColorRGB{0, 0, 151});
+
+  // What a reset now would light the LED with before reading storage
+  BootFrame boot_frame;
+  bool retained = load_boot_frame(0, &boot_frame);
+  printf("Boot frame: retained=%s, matches state=%s, R=%u, G=%u, B=%u\n",
+         retained ? "yes" : "no",
+         retained && boot_frame.state == led.get_state() ? "yes" : "no",
+         boot_frame.target.r, boot_frame.target.g, boot_frame.target.b);
+  CHECK(retained && boot_frame.state == led.get_state());
+
+  // After a power cycle each light loads the state it last showed, and its
+  // cold boot state renders to the same color before NVS is read
+  Sim.advance(10 * 1000 * 1000);
+  for (size_t i = 0; i < MAX_LIGHTS; i++) {
+    SingleLED& light = lights[i].get_led();
+    Storage stored(STORAGE_NAMESPACES[i], LightState{});
+    CHECK(stored.init() == ESP_OK);
+    CHECK(stored.get_state() == light.get_state());
+
+    LightState cold_boot;
+    CHECK(load_cold_boot_state(i, LightState{}, &cold_boot));
+    CHECK(same_color(SingleLED::render_state(cold_boot).output,
+                     SingleLED::render_state(light.get_state()).output));
+  }
+  printf("Power cycle: stored and cold boot state of %zu lights checked\n",
+         static_cast<size_t>(MAX_LIGHTS));
+
+  EffectStats effect_stats = led.get_effect_stats();
+  printf("Effect ticks: ticks=%u, over budget=%u, avg=%.1f cycles, "
+         "max=%u cycles\n",
+         effect_stats.ticks, effect_stats.ticks_over_budget,
+         effect_stats.ticks > 0
+             ? static_cast<double>(effect_stats.total_cycles) /
+                   effect_stats.ticks
+             : 0.0,
+         effect_stats.max_tick_cycles);
+
+  // Integer HSV against the double-precision reference, over the full hue
+  // range at a few saturations and levels
+  constexpr uint32_t HUE_STEP = 7;
+  constexpr uint8_t SATURATIONS[] = {0, 64, 127, 200, 254};
+  constexpr uint8_t LEVELS[] = {1, 32, 127, 254};
+  int max_error = 0;
+  uint64_t error_total = 0;
+  uint64_t conversions = 0;
+  uint64_t checksum = 0;
+  for (uint8_t level : LEVELS) {
+    for (uint8_t saturation : SATURATIONS) {
+      for (uint32_t hue = 0; hue <= 65535; hue += HUE_STEP) {
+        ColorRGB16 fixed = hsv_to_rgb16(hue, saturation, level);
+        ColorRGB16 reference = hsv_to_rgb16_double(hue, saturation, level);
+        for (int error : {fixed.r - reference.r, fixed.g - reference.g,
+                          fixed.b - reference.b}) {
+          max_error = std::max(max_error, std::abs(error));
+          error_total += std::abs(error);
+        }
+        conversions++;
+      }
+    }
+  }
+
+  auto time_conversions = [&](auto convert) {
+    auto start = std::chrono::steady_clock::now();
+    for (uint8_t level : LEVELS) {
+      for (uint8_t saturation : SATURATIONS) {
+        for (uint32_t hue = 0; hue <= 65535; hue += HUE_STEP) {
+          ColorRGB16 rgb = convert(hue, saturation, level);
+          checksum += rgb.r + rgb.g + rgb.b;
+        }
+      }
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+               .count() /
+           static_cast<double>(conversions);
+  };
+  double fixed_ns = time_conversions(hsv_to_rgb16);
+  double double_ns = time_conversions(hsv_to_rgb16_double);
+  printf("HSV to RGB16: conversions=%llu, max error=%d, mean error=%.3f, "
+         "integer=%.1f ns, double=%.1f ns (checksum %llu)\n",
+         static_cast<unsigned long long>(conversions), max_error,
+         error_total / (3.0 * conversions), fixed_ns, double_ns,
+         static_cast<unsigned long long>(checksum));
+  // Within 1 LSB of the reference, as the x/y conversions
+  CHECK(max_error <= 1);
+
+  return check_result();
+}
@@ -0,0 +1,18 @@
+#include <chrono>
+
+#include "esp_cpu.h"
+#include "esp_rom_sys.h"
+
+// Unlike esp_timer this is real time, stage durations are measured on the
+// host CPU
+extern "C" {
+
+esp_cpu_cycle_count_t esp_cpu_get_cycle_count(void) {
+  auto now = std::chrono::steady_clock::now().time_since_epoch();
+  return static_cast<esp_cpu_cycle_count_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(now).count());
+}
+
+uint32_t esp_rom_get_cpu_ticks_per_us(void) { return 1000; }
+
+}  // extern "C"
@@ -0,0 +1,61 @@
+#include "esp_partition.h"
+
+#include <cstring>
+
+#include "Simulator.hpp"
+
+static Simulator::Partition* as_partition(const esp_partition_t* partition) {
+  return Sim.find_partition(partition->label);
+}
+
+extern "C" {
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type,
+                                                esp_partition_subtype_t subtype,
+                                                const char* label) {
+  Simulator::Partition* partition = Sim.find_partition(label);
+  return partition != nullptr ? &partition->info : nullptr;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t* partition,
+                             size_t src_offset, void* dst, size_t size) {
+  Simulator::Partition* part = as_partition(partition);
+  if (src_offset + size > part->data.size()) return ESP_ERR_INVALID_SIZE;
+
+  memcpy(dst, &part->data[src_offset], size);
+  Sim.flash_stats().reads++;
+  return ESP_OK;
+}
+
+// Like NOR flash, writes can only clear bits
+esp_err_t esp_partition_write(const esp_partition_t* partition,
+                              size_t dst_offset, const void* src, size_t size) {
+  Simulator::Partition* part = as_partition(partition);
+  if (dst_offset + size > part->data.size()) return ESP_ERR_INVALID_SIZE;
+
+  const auto* bytes = static_cast<const uint8_t*>(src);
+  for (size_t i = 0; i < size; i++) {
+    part->data[dst_offset + i] &= bytes[i];
+  }
+
+  FlashStats& stats = Sim.flash_stats();
+  stats.writes++;
+  stats.bytes_written += size;
+  return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t* partition,
+                                    size_t offset, size_t size) {
+  Simulator::Partition* part = as_partition(partition);
+  if (offset % partition->erase_size != 0 ||
+      size % partition->erase_size != 0 ||
+      offset + size > part->data.size()) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  memset(&part->data[offset], 0xff, size);
+  Sim.flash_stats().erases += size / partition->erase_size;
+  return ESP_OK;
+}
+
+}  // extern "C"
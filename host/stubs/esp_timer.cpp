@@ -0,0 +1,66 @@
+#include "esp_timer.h"
+
+#include "Simulator.hpp"
+
+static Simulator::Timer* as_timer(esp_timer_handle_t handle) {
+  return reinterpret_cast<Simulator::Timer*>(handle);
+}
+
+extern "C" {
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* create_args,
+                           esp_timer_handle_t* out_handle) {
+  if (create_args == nullptr || create_args->callback == nullptr) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  *out_handle = reinterpret_cast<esp_timer_handle_t>(
+      Sim.create_timer(*create_args));
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t handle,
+                               uint64_t timeout_us) {
+  Simulator::Timer* timer = as_timer(handle);
+  if (timer->active) return ESP_ERR_INVALID_STATE;
+
+  timer->active = true;
+  timer->deadline = Sim.now() + static_cast<int64_t>(timeout_us);
+  timer->period = 0;
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t handle,
+                                   uint64_t period) {
+  Simulator::Timer* timer = as_timer(handle);
+  if (timer->active) return ESP_ERR_INVALID_STATE;
+
+  timer->active = true;
+  timer->deadline = Sim.now() + static_cast<int64_t>(period);
+  timer->period = static_cast<int64_t>(period);
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t handle) {
+  Simulator::Timer* timer = as_timer(handle);
+  if (!timer->active) return ESP_ERR_INVALID_STATE;
+
+  timer->active = false;
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t handle) {
+  Simulator::Timer* timer = as_timer(handle);
+  if (timer->active) return ESP_ERR_INVALID_STATE;
+
+  // Timers are owned by the simulator and stay allocated
+  return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t handle) {
+  return as_timer(handle)->active;
+}
+
+int64_t esp_timer_get_time(void) { return Sim.now(); }
+
+}  // extern "C"
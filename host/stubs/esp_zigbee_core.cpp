@@ -0,0 +1,307 @@
+#include "esp_zigbee_core.h"
+
+#include <utility>
+#include <vector>
+
+#include "Simulator.hpp"
+
+// Only custom attributes are modelled, standard clusters carry no attributes.
+// They are defined in the simulator once their endpoint is registered.
+struct CustomAttribute {
+  uint16_t id;
+  esp_zb_zcl_attr_type_t type;
+  std::vector<uint8_t> value;
+};
+struct esp_zb_attribute_list_s {
+  uint16_t cluster_id;
+  std::vector<CustomAttribute> attributes;
+};
+struct esp_zb_cluster_list_s {
+  std::vector<esp_zb_attribute_list_t*> clusters;
+};
+struct esp_zb_ep_list_s {
+  uint32_t count;
+};
+
+static esp_zb_attribute_list_t* create_attr_list(uint16_t cluster_id) {
+  return new esp_zb_attribute_list_t{cluster_id, {}};
+}
+
+static esp_err_t add_cluster(esp_zb_cluster_list_t* cluster_list,
+                             esp_zb_attribute_list_t* attr_list) {
+  if (cluster_list == nullptr || attr_list == nullptr) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  cluster_list->clusters.push_back(attr_list);
+  return ESP_OK;
+}
+
+extern "C" {
+
+esp_zb_attribute_list_t* esp_zb_basic_cluster_create(
+    esp_zb_basic_cluster_cfg_t* basic_cfg) {
+  return create_attr_list(ESP_ZB_ZCL_CLUSTER_ID_BASIC);
+}
+
+esp_zb_attribute_list_t* esp_zb_identify_cluster_create(
+    esp_zb_identify_cluster_cfg_t* identify_cfg) {
+  return create_attr_list(ESP_ZB_ZCL_CLUSTER_ID_IDENTIFY);
+}
+
+esp_zb_attribute_list_t* esp_zb_on_off_cluster_create(
+    esp_zb_on_off_cluster_cfg_t* on_off_cfg) {
+  return create_attr_list(ESP_ZB_ZCL_CLUSTER_ID_ON_OFF);
+}
+
+esp_zb_attribute_list_t* esp_zb_groups_cluster_create(
+    esp_zb_groups_cluster_cfg_t* groups_cfg) {
+  return create_attr_list(ESP_ZB_ZCL_CLUSTER_ID_GROUPS);
+}
+
+esp_zb_attribute_list_t* esp_zb_scenes_cluster_create(
+    esp_zb_scenes_cluster_cfg_t* scenes_cfg) {
+  return create_attr_list(ESP_ZB_ZCL_CLUSTER_ID_SCENES);
+}
+
+esp_zb_attribute_list_t* esp_zb_level_cluster_create(
+    esp_zb_level_cluster_cfg_t* level_cfg) {
+  return create_attr_list(ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL);
+}
+
+esp_zb_attribute_list_t* esp_zb_color_control_cluster_create(
+    esp_zb_color_cluster_cfg_t* color_cfg) {
+  return create_attr_list(ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL);
+}
+
+esp_err_t esp_zb_basic_cluster_add_attr(esp_zb_attribute_list_t* attr_list,
+                                        uint16_t attr_id, void* value_p) {
+  return attr_list != nullptr ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t esp_zb_color_control_cluster_add_attr(
+    esp_zb_attribute_list_t* attr_list, uint16_t attr_id, void* value_p) {
+  return attr_list != nullptr ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_zb_attribute_list_t* esp_zb_zcl_attr_list_create(uint16_t cluster_id) {
+  return create_attr_list(cluster_id);
+}
+
+esp_err_t esp_zb_custom_cluster_add_custom_attr(
+    esp_zb_attribute_list_t* attr_list, uint16_t attr_id, uint8_t attr_type,
+    uint8_t attr_access, void* value_p) {
+  if (attr_list == nullptr || value_p == nullptr) return ESP_ERR_INVALID_ARG;
+
+  auto type = static_cast<esp_zb_zcl_attr_type_t>(attr_type);
+  size_t size = Simulator::attribute_size(type, value_p);
+  if (size == 0) return ESP_ERR_NOT_SUPPORTED;
+
+  const auto* value = static_cast<const uint8_t*>(value_p);
+  attr_list->attributes.push_back(CustomAttribute{
+      .id = attr_id,
+      .type = type,
+      .value = std::vector<uint8_t>(value, value + size),
+  });
+  return ESP_OK;
+}
+
+esp_zb_cluster_list_t* esp_zb_zcl_cluster_list_create(void) {
+  return new esp_zb_cluster_list_t{};
+}
+
+esp_err_t esp_zb_cluster_list_add_basic_cluster(
+    esp_zb_cluster_list_t* cluster_list, esp_zb_attribute_list_t* attr_list,
+    uint8_t role_mask) {
+  return add_cluster(cluster_list, attr_list);
+}
+
+esp_err_t esp_zb_cluster_list_add_identify_cluster(
+    esp_zb_cluster_list_t* cluster_list, esp_zb_attribute_list_t* attr_list,
+    uint8_t role_mask) {
+  return add_cluster(cluster_list, attr_list);
+}
+
+esp_err_t esp_zb_cluster_list_add_groups_cluster(
+    esp_zb_cluster_list_t* cluster_list, esp_zb_attribute_list_t* attr_list,
+    uint8_t role_mask) {
+  return add_cluster(cluster_list, attr_list);
+}
+
+esp_err_t esp_zb_cluster_list_add_scenes_cluster(
+    esp_zb_cluster_list_t* cluster_list, esp_zb_attribute_list_t* attr_list,
+    uint8_t role_mask) {
+  return add_cluster(cluster_list, attr_list);
+}
+
+esp_err_t esp_zb_cluster_list_add_on_off_cluster(
+    esp_zb_cluster_list_t* cluster_list, esp_zb_attribute_list_t* attr_list,
+    uint8_t role_mask) {
+  return add_cluster(cluster_list, attr_list);
+}
+
+esp_err_t esp_zb_cluster_list_add_level_cluster(
+    esp_zb_cluster_list_t* cluster_list, esp_zb_attribute_list_t* attr_list,
+    uint8_t role_mask) {
+  return add_cluster(cluster_list, attr_list);
+}
+
+esp_err_t esp_zb_cluster_list_add_color_control_cluster(
+    esp_zb_cluster_list_t* cluster_list, esp_zb_attribute_list_t* attr_list,
+    uint8_t role_mask) {
+  return add_cluster(cluster_list, attr_list);
+}
+
+esp_err_t esp_zb_cluster_list_add_custom_cluster(
+    esp_zb_cluster_list_t* cluster_list, esp_zb_attribute_list_t* attr_list,
+    uint8_t role_mask) {
+  return add_cluster(cluster_list, attr_list);
+}
+
+esp_zb_ep_list_t* esp_zb_ep_list_create(void) {
+  return new esp_zb_ep_list_t{0};
+}
+
+esp_err_t esp_zb_ep_list_add_ep(esp_zb_ep_list_t* ep_list,
+                                esp_zb_cluster_list_t* cluster_list,
+                                esp_zb_endpoint_config_t endpoint_config) {
+  if (ep_list == nullptr || cluster_list == nullptr) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  for (const auto* attr_list : cluster_list->clusters) {
+    for (const auto& attr : attr_list->attributes) {
+      Sim.define_attribute(endpoint_config.endpoint, attr_list->cluster_id,
+                           attr.id, attr.type, attr.value.data());
+    }
+  }
+
+  ep_list->count++;
+  return ESP_OK;
+}
+
+esp_err_t esp_zb_platform_config(esp_zb_platform_config_t* config) {
+  return ESP_OK;
+}
+
+void esp_zb_init(esp_zb_cfg_t* nwk_cfg) {}
+
+esp_err_t esp_zb_device_register(esp_zb_ep_list_t* ep_list) { return ESP_OK; }
+
+esp_err_t esp_zb_start(bool autostart) { return ESP_OK; }
+
+void esp_zb_stack_main_loop(void) {}
+
+void esp_zb_core_action_handler_register(esp_zb_core_action_callback_t cb) {
+  Sim.set_action_handler(cb);
+}
+
+void esp_zb_aps_data_indication_handler_register(
+    esp_zb_aps_data_indication_callback_t cb) {
+  Sim.set_aps_handler(cb);
+}
+
+void esp_zb_identify_notify_handler_register(
+    uint8_t endpoint, esp_zb_identify_notify_callback_t cb) {
+  Sim.set_identify_handler(endpoint, cb);
+}
+
+void esp_zb_scheduler_alarm(esp_zb_callback_t cb, uint8_t param,
+                            uint32_t time) {
+  Sim.schedule_alarm(cb, param, time);
+}
+
+void esp_zb_scheduler_alarm_cancel(esp_zb_callback_t cb, uint8_t param) {
+  Sim.cancel_alarm(cb, param);
+}
+
+// Stand-ins run on a single thread
+bool esp_zb_lock_acquire(TickType_t block_ticks) { return true; }
+
+void esp_zb_lock_release(void) {}
+
+esp_zb_zcl_status_t esp_zb_zcl_set_attribute_val(uint8_t endpoint,
+                                                 uint16_t cluster_id,
+                                                 uint8_t cluster_role,
+                                                 uint16_t attr_id,
+                                                 void* value_p, bool check) {
+  esp_err_t err = Sim.set_attribute(endpoint, cluster_id, attr_id, value_p);
+  return err == ESP_OK ? ESP_ZB_ZCL_STATUS_SUCCESS : ESP_ZB_ZCL_STATUS_FAIL;
+}
+
+esp_err_t esp_zb_zcl_report_attr_cmd_req(esp_zb_zcl_report_attr_cmd_t* cmd_req) {
+  if (cmd_req == nullptr) return ESP_ERR_INVALID_ARG;
+
+  Sim.record_report(cmd_req->zcl_basic_cmd.src_endpoint, cmd_req->clusterID,
+                    {cmd_req->attributeID});
+  return ESP_OK;
+}
+
+// Records the attributes of Report Attributes frames, and any other frame as
+// it was sent
+esp_err_t esp_zb_aps_data_request(esp_zb_apsde_data_req_t* req) {
+  constexpr uint8_t ZCL_FRAME_TYPE_MASK = 0x03;
+  constexpr uint8_t ZCL_CMD_REPORT_ATTRIBUTES = 0x0a;
+  if (req == nullptr || req->asdu == nullptr || req->asdu_length < 3) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  // Profile wide
+  if ((req->asdu[0] & ZCL_FRAME_TYPE_MASK) != 0 ||
+      req->asdu[2] != ZCL_CMD_REPORT_ATTRIBUTES) {
+    Sim.record_sent_frame(*req);
+    return ESP_OK;
+  }
+
+  std::vector<uint16_t> attr_ids;
+  size_t offset = 3;
+  while (offset + 3 <= req->asdu_length) {
+    uint16_t attr_id = req->asdu[offset] | req->asdu[offset + 1] << 8;
+    uint8_t type = req->asdu[offset + 2];
+    attr_ids.push_back(attr_id);
+    offset += 3 + (type == ESP_ZB_ZCL_ATTR_TYPE_U16 ? 2 : 1);
+  }
+  if (offset != req->asdu_length) return ESP_ERR_INVALID_SIZE;
+
+  Sim.record_report(req->src_endpoint, req->cluster_id, std::move(attr_ids));
+  return ESP_OK;
+}
+
+// Only custom attributes are stored, the pointer is valid until the next call
+esp_zb_zcl_attr_t* esp_zb_zcl_get_attribute(uint8_t endpoint,
+                                            uint16_t cluster_id,
+                                            uint8_t cluster_role,
+                                            uint16_t attr_id) {
+  static esp_zb_zcl_attr_t attr;
+  const Attribute* value = Sim.get_attribute(endpoint, cluster_id, attr_id);
+  if (value == nullptr) return nullptr;
+
+  attr = esp_zb_zcl_attr_t{
+      .id = attr_id,
+      .type = static_cast<uint8_t>(value->type),
+      .access = ESP_ZB_ZCL_ATTR_ACCESS_READ_WRITE,
+      .manuf_code = ESP_ZB_ZCL_ATTR_NON_MANUFACTURER_SPECIFIC,
+      .data_p = const_cast<uint8_t*>(value->value.data()),
+  };
+  return &attr;
+}
+
+esp_zb_zcl_reporting_info_t* esp_zb_zcl_find_reporting_info(
+    esp_zb_zcl_attr_location_info_t attr_info) {
+  return Sim.find_reporting_info(attr_info.endpoint_id, attr_info.cluster_id,
+                                 attr_info.attr_id);
+}
+
+esp_err_t esp_zb_bdb_start_top_level_commissioning(uint8_t mode_mask) {
+  return ESP_OK;
+}
+
+bool esp_zb_bdb_is_factory_new(void) { return false; }
+
+const char* esp_zb_zdo_signal_to_string(esp_zb_app_signal_type_t signal) {
+  return "SIMULATED";
+}
+
+// The parameters follow the signal type
+void* esp_zb_app_signal_get_params(uint32_t* signal_p) { return signal_p + 1; }
+
+}  // extern "C"
@@ -0,0 +1,58 @@
+#include <string>
+#include <vector>
+
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+// Names of created tasks, handles index this
+static std::vector<std::string> task_names;
+
+static TaskHandle_t record_task(const char* name) {
+  task_names.push_back(name);
+  return reinterpret_cast<TaskHandle_t>(task_names.size());
+}
+
+extern "C" {
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char* name,
+                       uint32_t stack_depth, void* parameters,
+                       UBaseType_t priority, TaskHandle_t* created_task) {
+  TaskHandle_t task = record_task(name);
+  if (created_task != nullptr) *created_task = task;
+  return pdPASS;
+}
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t function, const char* name,
+                               uint32_t stack_depth, void* parameters,
+                               UBaseType_t priority, StackType_t* stack_buffer,
+                               StaticTask_t* task_buffer) {
+  return record_task(name);
+}
+
+char* pcTaskGetName(TaskHandle_t task) {
+  size_t index = reinterpret_cast<size_t>(task);
+  if (index == 0 || index > task_names.size()) return nullptr;
+  return task_names[index - 1].data();
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) { return 0; }
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t timeout) {
+  return 0;
+}
+
+void xTaskNotifyGive(TaskHandle_t task) {}
+
+void vTaskDelay(TickType_t ticks) {}
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t* buffer) {
+  return buffer;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t timeout) {
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) { return pdTRUE; }
+
+}  // extern "C"
@@ -0,0 +1,47 @@
+#include "led_strip.h"
+
+#include "Simulator.hpp"
+
+static Simulator::Strip* as_strip(led_strip_handle_t handle) {
+  return reinterpret_cast<Simulator::Strip*>(handle);
+}
+
+extern "C" {
+
+esp_err_t led_strip_new_rmt_device(const led_strip_config_t* led_config,
+                                   const led_strip_rmt_config_t* rmt_config,
+                                   led_strip_handle_t* ret_strip) {
+  if (led_config->max_leds == 0) return ESP_ERR_INVALID_ARG;
+
+  *ret_strip = reinterpret_cast<led_strip_handle_t>(
+      Sim.create_strip(led_config->max_leds));
+  return ESP_OK;
+}
+
+esp_err_t led_strip_set_pixel(led_strip_handle_t handle, uint32_t index,
+                              uint32_t red, uint32_t green, uint32_t blue) {
+  Simulator::Strip* strip = as_strip(handle);
+  if (index >= strip->pixels.size()) return ESP_ERR_INVALID_ARG;
+
+  strip->pixels[index] = ColorRGB{
+      .r = static_cast<uint8_t>(red),
+      .g = static_cast<uint8_t>(green),
+      .b = static_cast<uint8_t>(blue),
+  };
+  return ESP_OK;
+}
+
+esp_err_t led_strip_refresh(led_strip_handle_t handle) {
+  Sim.record_frame(*as_strip(handle));
+  return ESP_OK;
+}
+
+esp_err_t led_strip_clear(led_strip_handle_t handle) {
+  Simulator::Strip* strip = as_strip(handle);
+  for (auto& pixel : strip->pixels) pixel = ColorRGB{0, 0, 0};
+
+  Sim.record_frame(*strip);
+  return ESP_OK;
+}
+
+}  // extern "C"
@@ -0,0 +1,126 @@
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "Simulator.hpp"
+#include "nvs_flash.h"
+
+// Namespace of each handle, handle values index this
+static std::vector<std::string> handles;
+
+static bool get_namespace(nvs_handle_t handle, std::string& name) {
+  if (handle == 0 || handle > handles.size()) return false;
+  name = handles[handle - 1];
+  return true;
+}
+
+static esp_err_t get_value(nvs_handle_t handle, const char* key, void* value,
+                           size_t size) {
+  std::string name;
+  if (!get_namespace(handle, name)) return ESP_ERR_INVALID_ARG;
+
+  auto& entries = Sim.nvs_namespace(name);
+  auto iter = entries.find(key);
+  Sim.record_nvs(NVSOperation::GET, name, key, size);
+  if (iter == entries.end()) return ESP_ERR_NVS_NOT_FOUND;
+  if (iter->second.size() != size) return ESP_ERR_INVALID_SIZE;
+
+  memcpy(value, iter->second.data(), size);
+  return ESP_OK;
+}
+
+static esp_err_t set_value(nvs_handle_t handle, const char* key,
+                           const void* value, size_t size) {
+  std::string name;
+  if (!get_namespace(handle, name)) return ESP_ERR_INVALID_ARG;
+
+  const auto* bytes = static_cast<const uint8_t*>(value);
+  Sim.nvs_namespace(name)[key] = std::vector<uint8_t>(bytes, bytes + size);
+  Sim.record_nvs(NVSOperation::SET, name, key, size);
+  return ESP_OK;
+}
+
+extern "C" {
+
+esp_err_t nvs_flash_init(void) { return ESP_OK; }
+
+esp_err_t nvs_open(const char* namespace_name, nvs_open_mode_t open_mode,
+                   nvs_handle_t* out_handle) {
+  handles.push_back(namespace_name);
+  *out_handle = static_cast<nvs_handle_t>(handles.size());
+  return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle) {}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+  std::string name;
+  if (!get_namespace(handle, name)) return ESP_ERR_INVALID_ARG;
+
+  Sim.record_nvs(NVSOperation::COMMIT, name, "", 0);
+  return ESP_OK;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char* key) {
+  std::string name;
+  if (!get_namespace(handle, name)) return ESP_ERR_INVALID_ARG;
+
+  Sim.record_nvs(NVSOperation::ERASE, name, key, 0);
+  return Sim.nvs_namespace(name).erase(key) > 0 ? ESP_OK
+                                                : ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char* key, uint8_t* out_value) {
+  return get_value(handle, key, out_value, sizeof(*out_value));
+}
+
+esp_err_t nvs_get_u16(nvs_handle_t handle, const char* key,
+                      uint16_t* out_value) {
+  return get_value(handle, key, out_value, sizeof(*out_value));
+}
+
+esp_err_t nvs_get_u64(nvs_handle_t handle, const char* key,
+                      uint64_t* out_value) {
+  return get_value(handle, key, out_value, sizeof(*out_value));
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char* key, void* out_value,
+                       size_t* length) {
+  std::string name;
+  if (!get_namespace(handle, name)) return ESP_ERR_INVALID_ARG;
+
+  auto& entries = Sim.nvs_namespace(name);
+  auto iter = entries.find(key);
+  Sim.record_nvs(NVSOperation::GET, name, key, *length);
+  if (iter == entries.end()) return ESP_ERR_NVS_NOT_FOUND;
+
+  const auto& stored = iter->second;
+  if (out_value == nullptr) {
+    *length = stored.size();
+    return ESP_OK;
+  }
+  if (*length < stored.size()) return ESP_ERR_NVS_INVALID_LENGTH;
+
+  memcpy(out_value, stored.data(), stored.size());
+  *length = stored.size();
+  return ESP_OK;
+}
+
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char* key, uint8_t value) {
+  return set_value(handle, key, &value, sizeof(value));
+}
+
+esp_err_t nvs_set_u16(nvs_handle_t handle, const char* key, uint16_t value) {
+  return set_value(handle, key, &value, sizeof(value));
+}
+
+esp_err_t nvs_set_u64(nvs_handle_t handle, const char* key, uint64_t value) {
+  return set_value(handle, key, &value, sizeof(value));
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char* key, const void* value,
+                       size_t length) {
+  return set_value(handle, key, value, length);
+}
+
+}  // extern "C"
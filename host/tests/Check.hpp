@@ -0,0 +1,34 @@
+#ifndef CHECK_HPP
+#define CHECK_HPP
+
+#include <cstdio>
+
+// Checks for the host tests. A failed check prints its location and the
+// expression, and makes check_result() return non-zero, so that the test
+// fails under ctest. Checks return the condition, so that a caller can print
+// the values involved.
+#define CHECK(condition) \
+  check_condition((condition), #condition, __FILE__, __LINE__)
+
+inline int check_failures = 0;
+
+inline bool check_condition(bool condition, const char* expression,
+                            const char* file, int line) {
+  if (!condition) {
+    printf("%s:%d: check failed: %s\n", file, line, expression);
+    check_failures++;
+  }
+  return condition;
+}
+
+// Exit code of the test
+inline int check_result() {
+  if (check_failures > 0) {
+    printf("%d check(s) failed\n", check_failures);
+    return 1;
+  }
+  printf("All checks passed\n");
+  return 0;
+}
+
+#endif
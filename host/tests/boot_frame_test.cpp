@@ -0,0 +1,125 @@
+// Cold boot state: what Storage persists for a light is saved to the raw
+// boot frame partition, survives many wraps of the light's journal without
+// touching the other lights, and a SingleLED without a retained frame, as
+// after a power cycle, shows it at init before any storage is loaded.
+#include <cstdint>
+#include <cstdio>
+
+#include "BootFrame.hpp"
+#include "Check.hpp"
+#include "LightState.hpp"
+#include "RenderScheduler.hpp"
+#include "Simulator.hpp"
+#include "SingleLED.hpp"
+#include "Storage.hpp"
+
+// Enough appends to wrap a light's two-sector journal of 16-byte records
+// several times
+constexpr int WRAP_WRITES = 4 * 2 * 4096 / 16;
+
+// Full level, so that no dithering changes the pixel
+constexpr LightState XY_STATE = {
+    .active = true,
+    .level = COLOR_MAX_LEVEL,
+    .color_x = 20000,
+    .color_y = 24000,
+    .color_mode = ColorMode::XY,
+    .color_temperature = CONFIG_LIGHT_DEFAULT_COLOR_TEMP_MIREDS,
+    .enhanced_hue = 0,
+    .saturation = 0,
+};
+
+constexpr LightState HUE_STATE = {
+    .active = true,
+    .level = COLOR_MAX_LEVEL,
+    .color_x = 30000,
+    .color_y = 30000,
+    .color_mode = ColorMode::ENHANCED_HUE_SATURATION,
+    .color_temperature = CONFIG_LIGHT_DEFAULT_COLOR_TEMP_MIREDS,
+    .enhanced_hue = 40000,
+    .saturation = 200,
+};
+
+static bool same_color(ColorRGB a, ColorRGB b) {
+  return a.r == b.r && a.g == b.g && a.b == b.b;
+}
+
+static ColorRGB output_of(const LightState& state) {
+  ColorRGB16 output = SingleLED::render_state(state).output;
+  return ColorRGB{static_cast<uint8_t>(output.r >> 8),
+                  static_cast<uint8_t>(output.g >> 8),
+                  static_cast<uint8_t>(output.b >> 8)};
+}
+
+// Values of the current color mode, the ones a cold boot state carries
+static bool same_color_state(const LightState& a, const LightState& b) {
+  return a.active == b.active && a.level == b.level &&
+         a.color_mode == b.color_mode &&
+         same_color(output_of(a), output_of(b));
+}
+
+int main() {
+  LightState cold_boot;
+  CHECK(!load_cold_boot_state(0, XY_STATE, &cold_boot));
+
+  // Light 1 is persisted once, light 0 many times after it
+  Storage hue_storage("boot_hue", XY_STATE, 1);
+  CHECK(hue_storage.init() == ESP_OK);
+  CHECK(hue_storage.set_state(HUE_STATE) == ESP_OK);
+  CHECK(hue_storage.flush() == ESP_OK);
+
+  Storage xy_storage("boot_xy", XY_STATE, 0);
+  CHECK(xy_storage.init() == ESP_OK);
+  LightState state = XY_STATE;
+  for (int i = 0; i < WRAP_WRITES; i++) {
+    state.level = static_cast<uint8_t>(1 + i % COLOR_MAX_LEVEL);
+    CHECK(xy_storage.set_state(state) == ESP_OK);
+    CHECK(xy_storage.flush() == ESP_OK);
+  }
+  CHECK(xy_storage.set_state(XY_STATE) == ESP_OK);
+  CHECK(xy_storage.flush() == ESP_OK);
+  FlashStats flash = Sim.get_flash_stats();
+  printf("Cold boot state: %d writes, flash writes=%u, flash erases=%u\n",
+         WRAP_WRITES + 1, flash.writes, flash.erases);
+
+  CHECK(load_cold_boot_state(0, LightState{}, &cold_boot));
+  CHECK(same_color_state(cold_boot, XY_STATE));
+  CHECK(load_cold_boot_state(1, LightState{}, &cold_boot));
+  CHECK(same_color_state(cold_boot, HUE_STATE));
+
+  // Storage of no light saves nothing
+  Storage unlinked("boot_none", XY_STATE);
+  CHECK(unlinked.init() == ESP_OK);
+  CHECK(unlinked.set_state(HUE_STATE) == ESP_OK);
+  CHECK(unlinked.flush() == ESP_OK);
+  CHECK(load_cold_boot_state(0, LightState{}, &cold_boot));
+  CHECK(same_color_state(cold_boot, XY_STATE));
+
+  // Nothing is retained in RTC memory in a new process, as after a power
+  // cycle. Lights 0 and 1 show their cold boot state, light 2 has none.
+  RenderScheduler scheduler(CONFIG_LED_PIN, 3);
+  SingleLED xy_led(scheduler, StripSegment{.start = 0, .length = 1}, 0);
+  SingleLED hue_led(scheduler, StripSegment{.start = 1, .length = 1}, 1);
+  SingleLED new_led(scheduler, StripSegment{.start = 2, .length = 1}, 2);
+  CHECK(scheduler.init() == ESP_OK);
+  CHECK(xy_led.init() == ESP_OK);
+  CHECK(hue_led.init() == ESP_OK);
+  CHECK(new_led.init() == ESP_OK);
+  CHECK(scheduler.show() == ESP_OK);
+
+  CHECK(xy_led.has_boot_frame() && hue_led.has_boot_frame());
+  CHECK(!new_led.has_boot_frame());
+  CHECK(same_color_state(xy_led.get_state(), XY_STATE));
+  CHECK(same_color_state(hue_led.get_state(), HUE_STATE));
+  if (CHECK(!Sim.get_frames().empty())) {
+    const auto& pixels = Sim.get_frames().back().pixels;
+    printf("Cold boot frame: R=%u, G=%u, B=%u and R=%u, G=%u, B=%u\n",
+           pixels[0].r, pixels[0].g, pixels[0].b, pixels[1].r, pixels[1].g,
+           pixels[1].b);
+    CHECK(same_color(pixels[0], output_of(XY_STATE)));
+    CHECK(same_color(pixels[1], output_of(HUE_STATE)));
+    CHECK(same_color(pixels[2], ColorRGB{0, 0, 0}));
+  }
+
+  return check_result();
+}
@@ -0,0 +1,78 @@
+// Sweeps x and y over the ZCL range at several levels and checks the
+// fixed-point xy conversions against the double-precision reference. The
+// default grid takes every 131st coordinate plus both ends of the range.
+// With --full, every coordinate is checked at full level, which takes a long
+// time and runs only as the opt-in color_test_full.
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "Check.hpp"
+#include "Color.hpp"
+
+constexpr uint32_t COORD_MAX = 65535;
+constexpr uint32_t COORD_STEP = 131;
+constexpr uint8_t LEVELS[] = {1, 32, 64, 127, 200, 254};
+constexpr uint8_t FULL_SWEEP_LEVELS[] = {254};
+
+// Largest channel difference, in output LSBs
+template <typename RGB>
+static int channel_error(const RGB& a, const RGB& b) {
+  return std::max({std::abs(a.r - b.r), std::abs(a.g - b.g),
+                   std::abs(a.b - b.b)});
+}
+
+// Every step-th coordinate, and the last one even if the step skips it
+static std::vector<uint32_t> coordinates(uint32_t step) {
+  std::vector<uint32_t> values;
+  for (uint32_t value = 0; value <= COORD_MAX; value += step) {
+    values.push_back(value);
+  }
+  if (values.back() != COORD_MAX) values.push_back(COORD_MAX);
+  return values;
+}
+
+int main(int argc, char** argv) {
+  bool full = argc > 1 && strcmp(argv[1], "--full") == 0;
+  std::vector<uint32_t> coords = coordinates(full ? 1 : COORD_STEP);
+  std::vector<uint8_t> levels;
+  if (full) {
+    levels.assign(std::begin(FULL_SWEEP_LEVELS), std::end(FULL_SWEEP_LEVELS));
+  } else {
+    levels.assign(std::begin(LEVELS), std::end(LEVELS));
+  }
+
+  int max_error = 0;
+  int max_error16 = 0;
+  for (uint8_t level : levels) {
+    for (uint32_t x : coords) {
+      for (uint32_t y : coords) {
+        int error = channel_error(xy_to_rgb_fixed(x, y, level),
+                                  xy_to_rgb_double(x, y, level));
+        if (!CHECK(error <= 1)) {
+          printf("  x=%lu, y=%lu, level=%u: 8-bit error %d\n",
+                 static_cast<unsigned long>(x), static_cast<unsigned long>(y),
+                 level, error);
+        }
+        max_error = std::max(max_error, error);
+
+        int error16 = channel_error(xy_to_rgb16_fixed(x, y, level),
+                                    xy_to_rgb16_double(x, y, level));
+        if (!CHECK(error16 <= 1)) {
+          printf("  x=%lu, y=%lu, level=%u: 16-bit error %d\n",
+                 static_cast<unsigned long>(x), static_cast<unsigned long>(y),
+                 level, error16);
+        }
+        max_error16 = std::max(max_error16, error16);
+      }
+    }
+  }
+  printf("xy to RGB: %zu x %zu coordinates at %zu levels, max error=%d "
+         "(8-bit), %d (16-bit)\n",
+         coords.size(), coords.size(), levels.size(), max_error, max_error16);
+
+  return check_result();
+}
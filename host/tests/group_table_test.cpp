@@ -0,0 +1,68 @@
+// GroupTable persistence and capacity: membership survives a reload, a full
+// table is detected before it changes, and groups stored by a build with a
+// larger table don't keep the endpoint from starting.
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "Check.hpp"
+#include "GroupTable.hpp"
+#include "Simulator.hpp"
+#include "nvs.h"
+
+constexpr uint8_t ENDPOINT = 20;
+constexpr uint8_t OVERSIZED_ENDPOINT = 21;
+
+int main() {
+  GroupTable table(ENDPOINT);
+  CHECK(table.init() == ESP_OK);
+  CHECK(table.add(5) == ESP_OK);
+  CHECK(table.add(3) == ESP_OK);
+
+  GroupTable reloaded(ENDPOINT);
+  CHECK(reloaded.init() == ESP_OK);
+  CHECK(reloaded.get_count() == 2);
+  CHECK(reloaded.contains(3) && reloaded.contains(5));
+
+  // has_room tells a full table apart without changing it
+  const uint8_t new_group[] = {0x00, 0x10, 0x00};
+  const uint8_t member_group[] = {0x05, 0x00, 0x00};
+  GroupTable full(ENDPOINT + 2);
+  CHECK(full.init() == ESP_OK);
+  for (size_t i = 0; i < MAX_GROUPS; i++) {
+    CHECK(full.add(static_cast<uint16_t>(i + 1)) == ESP_OK);
+  }
+  CHECK(!full.has_room(GROUPS_CMD_ADD_GROUP, new_group, sizeof(new_group)));
+  CHECK(full.has_room(GROUPS_CMD_ADD_GROUP, member_group,
+                      sizeof(member_group)));
+  CHECK(full.has_room(GROUPS_CMD_REMOVE_GROUP, new_group, sizeof(new_group)));
+  CHECK(full.get_count() == MAX_GROUPS);
+  CHECK(reloaded.has_room(GROUPS_CMD_ADD_GROUP, new_group, sizeof(new_group)));
+
+  // More groups than MAX_GROUPS, as a build with a higher limit stores them
+  std::vector<uint16_t> stored(MAX_GROUPS + 4);
+  for (size_t i = 0; i < stored.size(); i++) {
+    stored[i] = static_cast<uint16_t>(100 + i);
+  }
+  nvs_handle_t handle;
+  CHECK(nvs_open("zigbee_groups", NVS_READWRITE, &handle) == ESP_OK);
+  CHECK(nvs_set_blob(handle, "ep_21", stored.data(),
+                     stored.size() * sizeof(uint16_t)) == ESP_OK);
+  CHECK(nvs_commit(handle) == ESP_OK);
+  nvs_close(handle);
+
+  GroupTable oversized(OVERSIZED_ENDPOINT);
+  esp_err_t err = oversized.init();
+  printf("Oversized stored groups: init=%s, count=%zu\n", esp_err_to_name(err),
+         oversized.get_count());
+  CHECK(err == ESP_OK);
+  CHECK(oversized.get_count() == 0);
+
+  // The table works from there, and its next save replaces the blob
+  CHECK(oversized.add(7) == ESP_OK);
+  GroupTable oversized_reloaded(OVERSIZED_ENDPOINT);
+  CHECK(oversized_reloaded.init() == ESP_OK);
+  CHECK(oversized_reloaded.get_count() == 1 && oversized_reloaded.contains(7));
+
+  return check_result();
+}
@@ -0,0 +1,122 @@
+// SceneTable following the stack's scene table: a full table takes new
+// scenes again once scenes are removed, removals by group keep the other
+// groups' scenes, every change is persisted along with the transition time
+// from Add Scene, and scenes stored by a build with a larger table don't keep
+// the light from starting.
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "Check.hpp"
+#include "LightState.hpp"
+#include "SceneTable.hpp"
+#include "Simulator.hpp"
+#include "Storage.hpp"
+#include "nvs.h"
+
+constexpr LightState STATE = {
+    .active = true,
+    .level = 200,
+    .color_x = 20000,
+    .color_y = 24000,
+    .color_mode = ColorMode::XY,
+    .color_temperature = CONFIG_LIGHT_DEFAULT_COLOR_TEMP_MIREDS,
+    .enhanced_hue = 0,
+    .saturation = 0,
+};
+
+constexpr uint16_t GROUP = 7;
+
+static size_t stored_count(Storage& storage) {
+  SceneTable reloaded(storage);
+  CHECK(reloaded.init() == ESP_OK);
+  return reloaded.get_count();
+}
+
+static bool has_scene(SceneTable& scenes, uint16_t group_id,
+                      uint8_t scene_id) {
+  Scene scene;
+  return scenes.recall(group_id, scene_id, nullptr, STATE, &scene) == ESP_OK;
+}
+
+int main() {
+  static Storage storage("scene_test", STATE);
+  CHECK(storage.init() == ESP_OK);
+  static SceneTable scenes(storage);
+  CHECK(scenes.init() == ESP_OK);
+
+  // Half the scenes in group 0, the rest in GROUP, until the table is full
+  for (size_t i = 0; i < MAX_SCENES; i++) {
+    uint16_t group_id = i < MAX_SCENES / 2 ? 0 : GROUP;
+    CHECK(scenes.store(group_id, static_cast<uint8_t>(i), STATE) == ESP_OK);
+  }
+  CHECK(scenes.store(0, 100, STATE) == ESP_ERR_NO_MEM);
+
+  // Remove Scene makes room
+  CHECK(scenes.remove(0, 0) == ESP_OK);
+  CHECK(!has_scene(scenes, 0, 0));
+  CHECK(scenes.get_count() == MAX_SCENES - 1);
+  CHECK(scenes.store(0, 100, STATE) == ESP_OK);
+  CHECK(has_scene(scenes, 0, 100));
+  CHECK(stored_count(storage) == MAX_SCENES);
+
+  // Removing a scene the table doesn't have changes nothing
+  CHECK(scenes.remove(GROUP, 0) == ESP_OK);
+  CHECK(scenes.get_count() == MAX_SCENES);
+
+  // Remove All Scenes or Remove Group of GROUP
+  CHECK(scenes.remove_group(GROUP) == ESP_OK);
+  CHECK(scenes.get_count() == MAX_SCENES / 2);
+  CHECK(!has_scene(scenes, GROUP, MAX_SCENES - 1));
+  CHECK(has_scene(scenes, 0, 100));
+  CHECK(stored_count(storage) == MAX_SCENES / 2);
+
+  // Remove All Groups keeps the scenes of group 0
+  CHECK(scenes.store(GROUP, 1, STATE) == ESP_OK);
+  CHECK(scenes.remove_all_groups() == ESP_OK);
+  CHECK(!has_scene(scenes, GROUP, 1));
+  CHECK(scenes.get_count() == MAX_SCENES / 2);
+  CHECK(stored_count(storage) == MAX_SCENES / 2);
+  printf("Scenes: max=%zu, left=%zu\n", static_cast<size_t>(MAX_SCENES),
+         scenes.get_count());
+
+  // Add Scene keeps the transition time through Store Scene, recall and a
+  // reload
+  uint8_t level_values[] = {50};
+  esp_zb_zcl_scenes_extension_field_t level_field = {
+      ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL, sizeof(level_values), level_values,
+      nullptr};
+  CHECK(scenes.add(GROUP, 2, 1500, &level_field, STATE) == ESP_OK);
+  Scene scene;
+  CHECK(scenes.recall(GROUP, 2, nullptr, STATE, &scene) == ESP_OK);
+  CHECK(scene.state.level == 50 && scene.transition_ms == 1500);
+  CHECK(scenes.store(GROUP, 2, STATE) == ESP_OK);
+  SceneTable transition_reloaded(storage);
+  CHECK(transition_reloaded.init() == ESP_OK);
+  CHECK(transition_reloaded.recall(GROUP, 2, nullptr, STATE, &scene) ==
+        ESP_OK);
+  printf("Scene transition after store and reload: %lu ms\n",
+         static_cast<unsigned long>(scene.transition_ms));
+  CHECK(scene.state == STATE && scene.transition_ms == 1500);
+
+  // Scenes stored by a build with a larger table are dropped, the light
+  // still starts
+  constexpr size_t HEADER_SIZE = 6;  // Version, count and CRC
+  std::vector<uint8_t> oversized(
+      HEADER_SIZE + (MAX_SCENES + 4) * sizeof(StoredScene), 0);
+  nvs_handle_t handle;
+  CHECK(nvs_open("scene_big", NVS_READWRITE, &handle) == ESP_OK);
+  CHECK(nvs_set_blob(handle, "scenes", oversized.data(), oversized.size()) ==
+        ESP_OK);
+  CHECK(nvs_commit(handle) == ESP_OK);
+  nvs_close(handle);
+  static Storage big_storage("scene_big", STATE);
+  CHECK(big_storage.init() == ESP_OK);
+  SceneTable big_scenes(big_storage);
+  esp_err_t err = big_scenes.init();
+  printf("Oversized stored scenes: init=%s, count=%zu\n",
+         esp_err_to_name(err), big_scenes.get_count());
+  CHECK(err == ESP_OK && big_scenes.get_count() == 0);
+
+  return check_result();
+}
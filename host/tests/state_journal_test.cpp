@@ -0,0 +1,278 @@
+// StateJournal on a RAM flash emulator: recovery after every append across
+// several wraps, power loss in the middle of a write, failed writes at run
+// time, and the write amplification of the ring.
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "Check.hpp"
+#include "Flash.hpp"
+#include "LightState.hpp"
+#include "StateJournal.hpp"
+
+constexpr size_t SECTOR_SIZE = 4096;
+constexpr size_t SECTOR_COUNT = 4;
+constexpr size_t RECORD_SIZE = 16;
+constexpr size_t SLOTS_PER_SECTOR = SECTOR_SIZE / RECORD_SIZE;
+constexpr size_t SLOT_COUNT = SECTOR_COUNT * SLOTS_PER_SECTOR;
+
+constexpr LightState DEFAULTS = {
+    .active = false,
+    .level = 100,
+    .color_x = 20000,
+    .color_y = 20000,
+    .color_mode = ColorMode::XY,
+    .color_temperature = 370,
+    .enhanced_hue = 0,
+    .saturation = 0,
+};
+
+// NOR flash in RAM: writes only clear bits, erases set whole sectors to
+// 0xFF. A write can be made to fail, optionally after programming part of
+// it, the way power loss or a flash error leaves a slot.
+class RamFlash : public Flash {
+ public:
+  RamFlash() : data(SECTOR_SIZE * SECTOR_COUNT, 0xFF) {}
+
+  size_t get_size() override { return data.size(); }
+  size_t get_sector_size() override { return SECTOR_SIZE; }
+
+  esp_err_t read(size_t offset, void* dst, size_t size) override {
+    if (offset + size > data.size()) return ESP_ERR_INVALID_SIZE;
+    memcpy(dst, &data[offset], size);
+    return ESP_OK;
+  }
+
+  esp_err_t write(size_t offset, const void* src, size_t size) override {
+    if (offset + size > data.size()) return ESP_ERR_INVALID_SIZE;
+    const auto* bytes = static_cast<const uint8_t*>(src);
+    size_t programmed = size;
+    bool fail = writes == fail_write;
+    if (fail) programmed = fail_after_bytes;
+    writes++;
+
+    for (size_t i = 0; i < programmed; i++) data[offset + i] &= bytes[i];
+    return fail ? ESP_FAIL : ESP_OK;
+  }
+
+  esp_err_t erase_sector(size_t sector) override {
+    if (sector >= SECTOR_COUNT) return ESP_ERR_INVALID_ARG;
+    memset(&data[sector * SECTOR_SIZE], 0xFF, SECTOR_SIZE);
+    erases++;
+    return ESP_OK;
+  }
+
+  // Fails the write with the given index, after programming bytes of it
+  void fail_write_at(uint32_t index, size_t bytes) {
+    fail_write = index;
+    fail_after_bytes = bytes;
+  }
+
+  std::vector<uint8_t> data;
+  uint32_t writes = 0;
+  uint32_t erases = 0;
+  uint32_t fail_write = UINT32_MAX;
+  size_t fail_after_bytes = 0;
+};
+
+// A distinct state for every record, covering the color modes
+static LightState make_state(uint32_t n) {
+  LightState state = DEFAULTS;
+  state.active = n % 2 == 0;
+  state.level = static_cast<uint8_t>(1 + n % 254);
+  switch (n % 3) {
+    case 0:
+      state.color_mode = ColorMode::XY;
+      state.color_x = static_cast<uint16_t>(n * 7);
+      state.color_y = static_cast<uint16_t>(n * 13);
+      break;
+    case 1:
+      state.color_mode = ColorMode::TEMPERATURE;
+      state.color_temperature = static_cast<uint16_t>(153 + n % 300);
+      break;
+    default:
+      state.color_mode = ColorMode::ENHANCED_HUE_SATURATION;
+      state.enhanced_hue = static_cast<uint16_t>(n * 31);
+      state.saturation = static_cast<uint8_t>(n % 255);
+      break;
+  }
+  return state;
+}
+
+// The fields a record keeps for its color mode
+static bool same_state(const LightState& a, const LightState& b) {
+  if (a.active != b.active || a.level != b.level ||
+      a.color_mode != b.color_mode) {
+    return false;
+  }
+  switch (a.color_mode) {
+    case ColorMode::TEMPERATURE:
+      return a.color_temperature == b.color_temperature;
+    case ColorMode::HUE_SATURATION:
+    case ColorMode::ENHANCED_HUE_SATURATION:
+      return a.enhanced_hue == b.enhanced_hue && a.saturation == b.saturation;
+    default:
+      return a.color_x == b.color_x && a.color_y == b.color_y;
+  }
+}
+
+// Boots a new journal on the flash and checks that it finds the expected
+// state, or nothing if expected is nullptr
+static bool check_boot(RamFlash& flash, const LightState* expected,
+                       const char* label, uint32_t n) {
+  StateJournal journal(flash);
+  bool ok = CHECK(journal.init() == ESP_OK);
+  if (expected == nullptr) {
+    ok = CHECK(!journal.has_state()) && ok;
+  } else {
+    ok = CHECK(journal.has_state()) &&
+         CHECK(same_state(journal.get_state(DEFAULTS), *expected)) && ok;
+  }
+  if (!ok) printf("  %s, record %lu\n", label, static_cast<unsigned long>(n));
+  return ok;
+}
+
+// Every record is found by the boot scan right after it is written, through
+// three wraps of the ring, and the scan reads O(log n) slots
+static void test_recovery() {
+  RamFlash flash;
+  check_boot(flash, nullptr, "empty", 0);
+
+  StateJournal journal(flash);
+  CHECK(journal.init() == ESP_OK);
+  uint32_t max_reads = 0;
+  for (uint32_t n = 0; n < 3 * SLOT_COUNT + 5; n++) {
+    LightState state = make_state(n);
+    CHECK(journal.append(state) == ESP_OK);
+
+    StateJournal booted(flash);
+    CHECK(booted.init() == ESP_OK);
+    if (!CHECK(booted.has_state() &&
+               same_state(booted.get_state(DEFAULTS), state))) {
+      printf("  recovery, record %lu\n", static_cast<unsigned long>(n));
+      break;
+    }
+    max_reads = std::max(max_reads, booted.get_stats().scan_reads);
+  }
+  CHECK(max_reads <= 2 * 12);
+  printf("Recovery: records=%zu, max scan reads=%lu\n", 3 * SLOT_COUNT + 5,
+         static_cast<unsigned long>(max_reads));
+}
+
+// Power is lost while a record is written, after any number of its bytes.
+// The boot finds the record before it, and appends after the boot are found
+// as well. Covers the first and last slot of a sector, the middle of one and
+// the wrap to sector 0.
+static void test_power_loss() {
+  const uint32_t POSITIONS[] = {
+      0,
+      1,
+      SLOTS_PER_SECTOR / 2,
+      SLOTS_PER_SECTOR - 1,
+      SLOTS_PER_SECTOR,
+      2 * SLOTS_PER_SECTOR + 1,
+      SLOT_COUNT - 1,
+      SLOT_COUNT,
+      SLOT_COUNT + SLOTS_PER_SECTOR,
+  };
+
+  int cases = 0;
+  for (uint32_t position : POSITIONS) {
+    for (size_t torn = 0; torn < RECORD_SIZE; torn++) {
+      RamFlash flash;
+      StateJournal journal(flash);
+      CHECK(journal.init() == ESP_OK);
+      for (uint32_t n = 0; n < position; n++) {
+        journal.append(make_state(n));
+      }
+
+      flash.fail_write_at(flash.writes, torn);
+      CHECK(journal.append(make_state(position)) != ESP_OK);
+      LightState before = make_state(position - 1);
+      if (!check_boot(flash, position > 0 ? &before : nullptr,
+                      "power loss", position)) {
+        break;
+      }
+
+      // Continue after the reboot, through the next sector boundary
+      StateJournal rebooted(flash);
+      CHECK(rebooted.init() == ESP_OK);
+      for (uint32_t n = 1; n <= SLOTS_PER_SECTOR + 2; n++) {
+        LightState state = make_state(position + n);
+        CHECK(rebooted.append(state) == ESP_OK);
+        if (!check_boot(flash, &state, "after power loss", position + n)) {
+          break;
+        }
+      }
+      cases++;
+    }
+  }
+  printf("Power loss: cases=%d\n", cases);
+}
+
+// A write fails at run time and the journal carries on without a reboot.
+// The records after it must still be found, also when the failed slot was
+// the first of a sector, which the boot scan checks first.
+static void test_failed_write() {
+  const uint32_t POSITIONS[] = {
+      SLOTS_PER_SECTOR,
+      SLOTS_PER_SECTOR + 3,
+      SLOT_COUNT,
+  };
+
+  for (uint32_t position : POSITIONS) {
+    for (size_t torn : {size_t{0}, RECORD_SIZE / 2}) {
+      RamFlash flash;
+      StateJournal journal(flash);
+      CHECK(journal.init() == ESP_OK);
+      for (uint32_t n = 0; n < position; n++) {
+        journal.append(make_state(n));
+      }
+
+      flash.fail_write_at(flash.writes, torn);
+      CHECK(journal.append(make_state(position)) != ESP_OK);
+      for (uint32_t n = 1; n <= 3; n++) {
+        LightState state = make_state(position + n);
+        CHECK(journal.append(state) == ESP_OK);
+        check_boot(flash, &state, "failed write", position + n);
+      }
+    }
+  }
+}
+
+// Each 16-byte record carries 8 bytes of state and costs its share of a
+// sector erase, which is at most 4x the state written. Sectors are erased
+// only when the ring wraps.
+static void test_write_amplification() {
+  RamFlash flash;
+  StateJournal journal(flash);
+  CHECK(journal.init() == ESP_OK);
+
+  constexpr uint32_t WRAPS = 3;
+  for (uint32_t n = 0; n < WRAPS * SLOT_COUNT; n++) {
+    CHECK(journal.append(make_state(n)) == ESP_OK);
+  }
+
+  JournalStats stats = journal.get_stats();
+  uint32_t amplification = journal.get_write_amplification();
+  // The first pass runs on blank sectors
+  CHECK(stats.sectors_erased == (WRAPS - 1) * SECTOR_COUNT);
+  CHECK(flash.erases == stats.sectors_erased);
+  CHECK(stats.records_written == WRAPS * SLOT_COUNT);
+  CHECK(amplification <= 400);
+  printf("Write amplification: records=%lu, sectors erased=%lu, %lu%%\n",
+         static_cast<unsigned long>(stats.records_written),
+         static_cast<unsigned long>(stats.sectors_erased),
+         static_cast<unsigned long>(amplification));
+}
+
+int main() {
+  test_recovery();
+  test_power_loss();
+  test_failed_write();
+  test_write_amplification();
+
+  return check_result();
+}
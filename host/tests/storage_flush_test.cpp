@@ -0,0 +1,132 @@
+// Counts NVS commits for bursts of Storage setters on the simulated clock.
+// With write-behind, a burst is committed once, a quiet period after its last
+// write, and a steady stream of writes no later than the max latency after
+// its first.
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "Check.hpp"
+#include "FlushPolicy.hpp"
+#include "LightState.hpp"
+#include "Simulator.hpp"
+#include "Storage.hpp"
+
+constexpr int64_t MS = 1000;
+constexpr int64_t QUIET_US = CONFIG_STORAGE_FLUSH_QUIET_MS * MS;
+constexpr int64_t MAX_LATENCY_US = CONFIG_STORAGE_FLUSH_MAX_LATENCY_MS * MS;
+
+constexpr LightState DEFAULTS = {
+    .active = false,
+    .level = 100,
+    .color_x = 20000,
+    .color_y = 20000,
+    .color_mode = ColorMode::XY,
+    .color_temperature = CONFIG_LIGHT_DEFAULT_COLOR_TEMP_MIREDS,
+    .enhanced_hue = 0,
+    .saturation = 0,
+};
+
+// Simulated times of the recorded commits
+static std::vector<int64_t> commit_times() {
+  std::vector<int64_t> times;
+  for (const NVSRecord& record : Sim.get_nvs_records()) {
+    if (record.operation == NVSOperation::COMMIT) {
+      times.push_back(record.time_us);
+    }
+  }
+  return times;
+}
+
+// The deadline is min(now + quiet, first + max latency), counted from the
+// first write after a flush
+static void test_policy() {
+  FlushPolicy policy(QUIET_US, MAX_LATENCY_US);
+  CHECK(!policy.is_pending());
+
+  CHECK(policy.on_write(0) == QUIET_US);
+  CHECK(policy.is_pending());
+  CHECK(policy.on_write(500 * MS) == 500 * MS + QUIET_US);
+  // Past first + max latency - quiet, the max latency wins
+  int64_t late = MAX_LATENCY_US - QUIET_US / 2;
+  CHECK(policy.on_write(late) == MAX_LATENCY_US);
+  CHECK(policy.get_deadline() == MAX_LATENCY_US);
+
+  policy.on_flush();
+  CHECK(!policy.is_pending());
+  int64_t next = MAX_LATENCY_US + 100 * MS;
+  CHECK(policy.on_write(next) == next + QUIET_US);
+}
+
+// Ten setters 100 ms apart are committed once, a quiet period after the last
+static void test_burst(Storage& storage) {
+  Sim.clear_records();
+  int64_t last_write = 0;
+  for (int i = 0; i < 10; i++) {
+    CHECK(storage.set_brightness(static_cast<uint8_t>(10 + i)) == ESP_OK);
+    last_write = Sim.now();
+    Sim.advance(100 * MS);
+  }
+  CHECK(commit_times().empty());
+
+  Sim.advance(QUIET_US);
+  std::vector<int64_t> times = commit_times();
+  if (CHECK(times.size() == 1)) {
+    CHECK(times[0] == last_write + QUIET_US);
+  }
+  printf("Burst: commits=%zu\n", times.size());
+
+  // Nothing is left to flush
+  Sim.advance(MAX_LATENCY_US);
+  CHECK(commit_times().size() == 1);
+}
+
+// Writes every half quiet period never settle, so they are committed at the
+// max latency after the first one, and again after the next
+static void test_max_latency(Storage& storage) {
+  Sim.clear_records();
+  int64_t first_write = Sim.now();
+  int64_t duration = 2 * MAX_LATENCY_US + QUIET_US / 2;
+  for (int64_t t = 0; t < duration; t += QUIET_US / 2) {
+    CHECK(storage.set_active((t / (QUIET_US / 2)) % 2 == 0) == ESP_OK);
+    Sim.advance(QUIET_US / 2);
+  }
+
+  std::vector<int64_t> times = commit_times();
+  if (CHECK(times.size() == 2)) {
+    CHECK(times[0] == first_write + MAX_LATENCY_US);
+    // The first write after a flush starts the next latency period
+    CHECK(times[1] <= times[0] + QUIET_US / 2 + MAX_LATENCY_US);
+  }
+  printf("Steady writes over %lld ms: commits=%zu\n",
+         static_cast<long long>(duration / MS), times.size());
+}
+
+// An explicit flush commits at once and cancels the pending one
+static void test_explicit_flush(Storage& storage) {
+  Sim.advance(2 * MAX_LATENCY_US);
+  Sim.clear_records();
+  CHECK(storage.set_color(30000, 25000) == ESP_OK);
+  CHECK(storage.flush() == ESP_OK);
+  CHECK(commit_times().size() == 1);
+  Sim.advance(MAX_LATENCY_US);
+  CHECK(commit_times().size() == 1);
+
+  // What a power cycle would load
+  Storage reloaded("flush_test", DEFAULTS);
+  CHECK(reloaded.init() == ESP_OK);
+  CHECK(reloaded.get_color_x() == 30000);
+  CHECK(reloaded.get_color_y() == 25000);
+}
+
+int main() {
+  test_policy();
+
+  Storage storage("flush_test", DEFAULTS);
+  CHECK(storage.init() == ESP_OK);
+  test_burst(storage);
+  test_max_latency(storage);
+  test_explicit_flush(storage);
+
+  return check_result();
+}
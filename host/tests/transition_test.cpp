@@ -0,0 +1,137 @@
+// SingleLED transitions on the simulated clock: an update right after boot
+// is immediate, an explicit transition time fades over that time, stack
+// steps are smoothed over their interval, and the scheduler measures the
+// jitter of the frames it renders.
+#include <cstdint>
+#include <cstdio>
+
+#include "Check.hpp"
+#include "Gamma.hpp"
+#include "LightState.hpp"
+#include "RenderScheduler.hpp"
+#include "Simulator.hpp"
+#include "SingleLED.hpp"
+
+constexpr int64_t MS = 1000;
+constexpr int64_t FRAME_PERIOD_US = 1000000 / CONFIG_LIGHT_TRANSITION_FPS;
+
+// Full level, so that no dithering keeps the frame timer running
+constexpr LightState STATE = {
+    .active = true,
+    .level = COLOR_MAX_LEVEL,
+    .color_x = 20000,
+    .color_y = 24000,
+    .color_mode = ColorMode::XY,
+    .color_temperature = CONFIG_LIGHT_DEFAULT_COLOR_TEMP_MIREDS,
+    .enhanced_hue = 0,
+    .saturation = 0,
+};
+
+static RenderScheduler scheduler(CONFIG_LED_PIN, 1);
+static SingleLED led(scheduler, StripSegment{.start = 0, .length = 1}, 0);
+
+static ColorRGB last_pixel() { return Sim.get_frames().back().pixels[0]; }
+
+static bool same_color(ColorRGB a, ColorRGB b) {
+  return a.r == b.r && a.g == b.g && a.b == b.b;
+}
+
+// The output of a state, without dithering, as the LED shows it once the
+// transition is done
+static ColorRGB output_of(const LightState& state) {
+  ColorRGB16 output = SingleLED::render_state(state).output;
+  return ColorRGB{static_cast<uint8_t>(output.r >> 8),
+                  static_cast<uint8_t>(output.g >> 8),
+                  static_cast<uint8_t>(output.b >> 8)};
+}
+
+// The first update after boot has no earlier one to be a step of
+static void test_first_update() {
+  Sim.advance(100 * MS);
+  CHECK(led.set_state(STATE) == ESP_OK);
+  CHECK(scheduler.show() == ESP_OK);
+  CHECK(!led.needs_frames());
+  if (CHECK(!Sim.get_frames().empty())) {
+    CHECK(same_color(last_pixel(), output_of(STATE)));
+  }
+}
+
+// An explicit transition time fades over that many frames, whatever the
+// time since the last update
+static void test_explicit_transition() {
+  Sim.advance(10 * MS);
+  Sim.clear_records();
+  LightState dim = STATE;
+  dim.level = 20;
+  CHECK(led.set_state(dim, 1000) == ESP_OK);
+  CHECK(led.needs_frames());
+
+  Sim.advance(500 * MS);
+  size_t halfway = Sim.get_frames().size();
+  ColorRGB middle = last_pixel();
+  CHECK(!same_color(middle, output_of(STATE)));
+  CHECK(!same_color(middle, output_of(dim)));
+
+  Sim.advance(600 * MS);
+  size_t frames = Sim.get_frames().size();
+  CHECK(halfway * 2 >= frames - 2 && halfway * 2 <= frames + 2);
+  CHECK(frames >= 1000 * MS / FRAME_PERIOD_US - 1);
+  printf("Explicit transition: frames=%zu, halfway=%zu\n", frames, halfway);
+
+  FrameStats stats = scheduler.get_frame_stats();
+  CHECK(stats.frames > 0);
+  CHECK(stats.max_jitter_us == 0);
+}
+
+// Stack steps 100 ms apart each fade over their interval, an isolated
+// update after a pause is immediate
+static void test_auto_steps() {
+  Sim.advance(2000 * MS);
+  LightState state = STATE;
+  for (int step = 0; step < 5; step++) {
+    state.level = static_cast<uint8_t>(100 + step * 20);
+    CHECK(led.set_state(state) == ESP_OK);
+    // The first one is isolated, the others steps
+    CHECK(led.needs_frames() == (step > 0));
+    Sim.advance(100 * MS);
+  }
+
+  Sim.advance(2000 * MS);
+  CHECK(led.set_state(STATE) == ESP_OK);
+  CHECK(!led.needs_frames());
+}
+
+// Frames rendered late or early by the frame timer show up in the stats
+static void test_frame_jitter() {
+  FrameStats before = scheduler.get_frame_stats();
+  // Renders once to set the time of the last frame, then 3 frames late by
+  // 0, 2 and 5 ms
+  int64_t now = Sim.now();
+  CHECK(scheduler.render_frame(now) == ESP_OK);
+  for (int64_t late : {0, 2, 5}) {
+    now += FRAME_PERIOD_US + late * MS;
+    CHECK(scheduler.render_frame(now) == ESP_OK);
+  }
+
+  FrameStats after = scheduler.get_frame_stats();
+  CHECK(after.frames - before.frames == 4 ||
+        after.frames - before.frames == 3);
+  CHECK(after.max_jitter_us == 5 * MS);
+  CHECK(after.total_jitter_us - before.total_jitter_us >= 7 * MS);
+  printf("Frame jitter: frames=%lu, max=%lld us, total=%lld us\n",
+         static_cast<unsigned long>(after.frames),
+         static_cast<long long>(after.max_jitter_us),
+         static_cast<long long>(after.total_jitter_us));
+}
+
+int main() {
+  CHECK(scheduler.init() == ESP_OK);
+  CHECK(led.init() == ESP_OK);
+
+  test_first_update();
+  test_explicit_transition();
+  test_auto_steps();
+  test_frame_jitter();
+
+  return check_result();
+}
@@ -0,0 +1,89 @@
+#ifndef ACTION_TABLE_HPP
+#define ACTION_TABLE_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+#include "esp_err.h"
+
+using ActionKey = uint64_t;
+using ActionInvoker = esp_err_t (*)(const void* msg);
+
+constexpr ActionKey make_action_key(uint16_t cluster_id, uint32_t callback_id) {
+  return (static_cast<uint64_t>(callback_id) << 16) |
+         static_cast<uint64_t>(cluster_id);
+}
+
+template <auto Handler>
+struct ActionMessage;
+
+template <typename T, esp_err_t (*Handler)(const T*)>
+struct ActionMessage<Handler> {
+  using type = T;
+};
+
+// Handler for a cluster and core callback ID. The message type is taken from
+// the handler signature, esp_err_t handler(const T* msg).
+template <uint16_t ClusterId, uint32_t CallbackId, auto Handler>
+struct Action {
+  static constexpr ActionKey key = make_action_key(ClusterId, CallbackId);
+
+  static esp_err_t invoke(const void* msg) {
+    using Message = typename ActionMessage<Handler>::type;
+    return Handler(static_cast<const Message*>(msg));
+  }
+};
+
+// Actions sorted by key at compile time. Dispatching is a binary search over
+// a flat array followed by a direct call of the handler, without any heap
+// allocation.
+template <typename... Actions>
+class ActionTable {
+ public:
+  // Returns ESP_ERR_NOT_FOUND if no action matches
+  static esp_err_t dispatch(uint16_t cluster_id, uint32_t callback_id,
+                            const void* msg) {
+    ActionKey key = make_action_key(cluster_id, callback_id);
+
+    size_t low = 0;
+    size_t high = entries.size();
+    while (low < high) {
+      size_t mid = (low + high) / 2;
+      if (entries[mid].key < key) {
+        low = mid + 1;
+      } else {
+        high = mid;
+      }
+    }
+
+    if (low == entries.size() || entries[low].key != key) {
+      return ESP_ERR_NOT_FOUND;
+    }
+    return entries[low].invoke(msg);
+  }
+
+ private:
+  struct Entry {
+    ActionKey key;
+    ActionInvoker invoke;
+  };
+
+  static constexpr std::array<Entry, sizeof...(Actions)> entries = [] {
+    std::array<Entry, sizeof...(Actions)> sorted = {
+        Entry{Actions::key, &Actions::invoke}...};
+    std::sort(sorted.begin(), sorted.end(),
+              [](const Entry& a, const Entry& b) { return a.key < b.key; });
+    return sorted;
+  }();
+
+  static constexpr bool has_unique_keys() {
+    for (size_t i = 1; i < entries.size(); i++) {
+      if (entries[i - 1].key == entries[i].key) return false;
+    }
+    return true;
+  }
+  static_assert(has_unique_keys(), "Action is handled more than once");
+};
+
+#endif
@@ -0,0 +1,191 @@
+#include "BootFrame.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <utility>
+
+#include "FlashRegion.hpp"
+#include "Log.hpp"
+#include "PartitionFlash.hpp"
+#include "StateJournal.hpp"
+#include "esp_attr.h"
+#include "esp_rom_crc.h"
+#include "sdkconfig.h"
+
+// Tells a retained frame from whatever RTC memory holds after a power cycle
+constexpr uint32_t BOOT_FRAME_MAGIC = 0x4C464246;
+
+struct __attribute__((packed)) RetainedFrame {
+  uint32_t magic;
+  uint8_t active;
+  uint8_t level;
+  uint16_t color_x;
+  uint16_t color_y;
+  uint8_t color_mode;
+  uint16_t color_temperature;
+  uint16_t enhanced_hue;
+  uint8_t saturation;
+  uint16_t target[3];
+  // Covers the state and the frame
+  uint32_t crc;
+};
+
+static RTC_NOINIT_ATTR std::array<RetainedFrame, CONFIG_LIGHT_ENDPOINT_COUNT>
+    retained_frames;
+
+#ifdef CONFIG_LIGHT_BOOT_FRAME
+// Two, so that one can be erased while the latest record is kept in the other
+constexpr size_t COLD_BOOT_SECTORS = 2;
+
+static PartitionFlash cold_boot_flash(CONFIG_LIGHT_BOOT_FRAME_PARTITION);
+static esp_err_t cold_boot_flash_err = ESP_ERR_INVALID_STATE;
+
+// Journal of a light, scanned when it is first used
+struct ColdBootJournal {
+  explicit ColdBootJournal(size_t light)
+      : flash(cold_boot_flash, light * COLD_BOOT_SECTORS, COLD_BOOT_SECTORS),
+        journal(flash),
+        ready(false) {}
+
+  FlashRegion flash;
+  StateJournal journal;
+  bool ready;
+};
+
+template <size_t... Lights>
+static std::array<ColdBootJournal, CONFIG_LIGHT_ENDPOINT_COUNT>
+make_cold_boot_journals(std::index_sequence<Lights...>) {
+  return {ColdBootJournal(Lights)...};
+}
+
+static std::array<ColdBootJournal, CONFIG_LIGHT_ENDPOINT_COUNT>
+    cold_boot_journals = make_cold_boot_journals(
+        std::make_index_sequence<CONFIG_LIGHT_ENDPOINT_COUNT>{});
+
+static esp_err_t open_cold_boot_journal(uint8_t light,
+                                        StateJournal** journal) {
+  if (light >= cold_boot_journals.size()) return ESP_ERR_INVALID_ARG;
+
+  // Looked up once, a partition table from before the partition existed
+  // keeps failing the same way
+  if (cold_boot_flash_err == ESP_ERR_INVALID_STATE) {
+    cold_boot_flash_err = cold_boot_flash.init();
+    if (cold_boot_flash_err == ESP_ERR_NOT_FOUND) {
+      log_warn("No %s partition, a power cycle lights up from storage",
+               CONFIG_LIGHT_BOOT_FRAME_PARTITION);
+    }
+  }
+  if (cold_boot_flash_err != ESP_OK) return cold_boot_flash_err;
+
+  ColdBootJournal& cold_boot = cold_boot_journals[light];
+  if (!cold_boot.ready) {
+    esp_err_t err = cold_boot.flash.init();
+    if (err != ESP_OK) return err;
+
+    err = cold_boot.journal.init();
+    if (err != ESP_OK) return err;
+    cold_boot.ready = true;
+  }
+
+  *journal = &cold_boot.journal;
+  return ESP_OK;
+}
+#endif
+
+static uint32_t frame_crc(const RetainedFrame& frame) {
+  return esp_rom_crc32_le(0, reinterpret_cast<const uint8_t*>(&frame),
+                          offsetof(RetainedFrame, crc));
+}
+
+void save_boot_frame(uint8_t light, const BootFrame& frame) {
+  if (light >= retained_frames.size()) return;
+
+  RetainedFrame& retained = retained_frames[light];
+  const LightState& state = frame.state;
+  retained = RetainedFrame{
+      .magic = BOOT_FRAME_MAGIC,
+      .active = static_cast<uint8_t>(state.active ? 1 : 0),
+      .level = state.level,
+      .color_x = state.color_x,
+      .color_y = state.color_y,
+      .color_mode = static_cast<uint8_t>(state.color_mode),
+      .color_temperature = state.color_temperature,
+      .enhanced_hue = state.enhanced_hue,
+      .saturation = state.saturation,
+      .target = {frame.target.r, frame.target.g, frame.target.b},
+      .crc = 0,
+  };
+  retained.crc = frame_crc(retained);
+}
+
+bool load_boot_frame(uint8_t light, BootFrame* frame) {
+  if (light >= retained_frames.size()) return false;
+
+  const RetainedFrame& retained = retained_frames[light];
+  if (retained.magic != BOOT_FRAME_MAGIC) return false;
+  if (retained.crc != frame_crc(retained)) return false;
+  if (retained.level > COLOR_MAX_LEVEL ||
+      retained.color_mode >
+          static_cast<uint8_t>(ColorMode::ENHANCED_HUE_SATURATION)) {
+    return false;
+  }
+
+  *frame = BootFrame{
+      .state =
+          LightState{
+              .active = retained.active != 0,
+              .level = retained.level,
+              .color_x = retained.color_x,
+              .color_y = retained.color_y,
+              .color_mode = static_cast<ColorMode>(retained.color_mode),
+              .color_temperature = retained.color_temperature,
+              .enhanced_hue = retained.enhanced_hue,
+              .saturation = retained.saturation,
+          },
+      .target =
+          ColorRGB16{
+              .r = retained.target[0],
+              .g = retained.target[1],
+              .b = retained.target[2],
+          },
+  };
+  return true;
+}
+
+esp_err_t save_cold_boot_state(uint8_t light, const LightState& state) {
+#ifdef CONFIG_LIGHT_BOOT_FRAME
+  StateJournal* journal;
+  esp_err_t err = open_cold_boot_journal(light, &journal);
+  if (err != ESP_OK) return err;
+
+  // The record carries only the values of the current color mode
+  if (journal->has_state() && journal->get_state(state) == state) {
+    return ESP_OK;
+  }
+
+  return journal->append(state);
+#else
+  return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+bool load_cold_boot_state(uint8_t light, const LightState& defaults,
+                          LightState* state) {
+#ifdef CONFIG_LIGHT_BOOT_FRAME
+  StateJournal* journal;
+  if (open_cold_boot_journal(light, &journal) != ESP_OK) return false;
+  if (!journal->has_state()) return false;
+
+  LightState stored = journal->get_state(defaults);
+  stored.level = std::min(stored.level, COLOR_MAX_LEVEL);
+  stored.saturation = std::min(stored.saturation, COLOR_MAX_LEVEL);
+  stored.color_temperature =
+      std::clamp(stored.color_temperature, COLOR_TEMP_MIN_MIREDS,
+                 COLOR_TEMP_MAX_MIREDS);
+  *state = stored;
+  return true;
+#else
+  return false;
+#endif
+}
@@ -0,0 +1,37 @@
+#ifndef BOOT_FRAME_HPP
+#define BOOT_FRAME_HPP
+
+#include <cstdint>
+
+#include "Color.hpp"
+#include "LightState.hpp"
+#include "esp_err.h"
+
+// Light state and the linear color it rendered to, as last shown
+struct BootFrame {
+  LightState state;
+  ColorRGB16 target;
+};
+
+// Keeps the frame of each light in RTC memory that startup does not
+// initialize, so it survives software, panic and watchdog resets and the LED
+// can be lit again before NVS is read. Saving is a copy and a CRC of a few
+// bytes, cheap enough for every refresh.
+void save_boot_frame(uint8_t light, const BootFrame& frame);
+
+// False if no intact frame was retained
+bool load_boot_frame(uint8_t light, BootFrame* frame);
+
+// A power cycle loses the retained frame, so the state each light persists is
+// also kept in the raw CONFIG_LIGHT_BOOT_FRAME_PARTITION, readable without
+// NVS and whatever the storage backend. Each light has a state journal in two
+// sectors of it. Called by Storage when it persists the state, from one task
+// at a time.
+esp_err_t save_cold_boot_state(uint8_t light, const LightState& state);
+
+// Values of the color modes other than the stored one are taken from
+// defaults. False if the light has no intact stored state.
+bool load_cold_boot_state(uint8_t light, const LightState& defaults,
+                          LightState* state);
+
+#endif
@@ -0,0 +1,363 @@
+#include "Color.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#include "sdkconfig.h"
+
+// Wide RGB D65 conversion matrix scaled by 10^4, which makes it exact in
+// integer arithmetic
+constexpr int64_t XYZ_TO_RGB[3][3] = {
+    {32406, -15372, -4986},
+    {-9689, 18758, 415},
+    {557, -2040, 10570},
+};
+
+constexpr uint32_t COORD_MAX = 65535;
+
+// Level scale factors in Q8, so that (LEVEL_SCALE[level] >> 8) is the 8-bit
+// value of a fully saturated channel at that level
+constexpr uint32_t LEVEL_SCALE_SHIFT = 8;
+constexpr auto LEVEL_SCALE = [] {
+  std::array<uint32_t, COLOR_MAX_LEVEL + 1> table{};
+  for (uint32_t level = 0; level <= COLOR_MAX_LEVEL; level++) {
+    uint32_t scaled = level * 255 << LEVEL_SCALE_SHIFT;
+    table[level] = (scaled + COLOR_MAX_LEVEL / 2) / COLOR_MAX_LEVEL;
+  }
+  return table;
+}();
+
+// Level scale factors for 16-bit output
+constexpr auto LEVEL_SCALE16 = [] {
+  std::array<uint32_t, COLOR_MAX_LEVEL + 1> table{};
+  for (uint32_t level = 0; level <= COLOR_MAX_LEVEL; level++) {
+    table[level] = (level * 65535 + COLOR_MAX_LEVEL / 2) / COLOR_MAX_LEVEL;
+  }
+  return table;
+}();
+
+// Color temperature table entries, every MIREDS_STEP from the minimum. One
+// extra entry past the maximum keeps interpolation in bounds.
+constexpr uint32_t MIREDS_STEP = 8;
+constexpr uint32_t MIREDS_STEPS =
+    (COLOR_TEMP_MAX_MIREDS - COLOR_TEMP_MIN_MIREDS + MIREDS_STEP - 1) /
+    MIREDS_STEP;
+
+// Range of the Planckian locus approximation below
+constexpr double MIN_KELVIN = 1667.0;
+constexpr double MAX_KELVIN = 25000.0;
+
+// Full-level RGB of a color temperature, evaluated at compile time only. The
+// locus is approximated by the cubic splines of Kim et al., which are plain
+// polynomials in 1 / T, and converted with the same matrix as xy colors.
+constexpr ColorRGB16 const_kelvin_to_rgb16(double kelvin) {
+  if (kelvin < MIN_KELVIN) kelvin = MIN_KELVIN;
+  if (kelvin > MAX_KELVIN) kelvin = MAX_KELVIN;
+
+  double t = 1000.0 / kelvin;
+  double x = kelvin <= 4000.0
+                 ? -0.2661239 * t * t * t - 0.2343589 * t * t +
+                       0.8776956 * t + 0.179910
+                 : -3.0258469 * t * t * t + 2.1070379 * t * t +
+                       0.2226347 * t + 0.240390;
+
+  double y;
+  if (kelvin <= 2222.0) {
+    y = -1.1063814 * x * x * x - 1.34811020 * x * x + 2.18555832 * x -
+        0.20219683;
+  } else if (kelvin <= 4000.0) {
+    y = -0.9549476 * x * x * x - 1.37418593 * x * x + 2.09137015 * x -
+        0.16748867;
+  } else {
+    y = 3.0817580 * x * x * x - 5.87338670 * x * x + 3.75112997 * x -
+        0.37001483;
+  }
+
+  double xyz[3] = {x, y, 1.0 - x - y};
+  double channels[3] = {};
+  double maxc = 0;
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      channels[i] += static_cast<double>(XYZ_TO_RGB[i][j]) * xyz[j];
+    }
+    if (channels[i] < 0) channels[i] = 0;
+    if (channels[i] > maxc) maxc = channels[i];
+  }
+
+  return ColorRGB16{
+      .r = static_cast<uint16_t>(channels[0] / maxc * 65535.0 + 0.5),
+      .g = static_cast<uint16_t>(channels[1] / maxc * 65535.0 + 0.5),
+      .b = static_cast<uint16_t>(channels[2] / maxc * 65535.0 + 0.5),
+  };
+}
+
+constexpr auto MIREDS_TABLE = [] {
+  std::array<ColorRGB16, MIREDS_STEPS + 2> table{};
+  for (uint32_t i = 0; i < table.size(); i++) {
+    double mireds = COLOR_TEMP_MIN_MIREDS + i * MIREDS_STEP;
+    table[i] = const_kelvin_to_rgb16(1000000.0 / mireds);
+  }
+  return table;
+}();
+
+// Converts xy to linear RGB in the matrix scale, negative values clamped.
+// Returns the largest channel.
+static int64_t xy_to_channels(uint16_t x, uint16_t y, int64_t channels[3]) {
+  // XYZ with Y = 1 is (x / y, 1, z / y). The common 1 / y factor cancels out
+  // in the normalization by the largest channel, so the matrix is applied to
+  // (x, y, z).
+  int64_t X = x;
+  int64_t Y = y;
+  int64_t Z = static_cast<int64_t>(COORD_MAX) - x - y;
+
+  for (int i = 0; i < 3; i++) {
+    int64_t c =
+        XYZ_TO_RGB[i][0] * X + XYZ_TO_RGB[i][1] * Y + XYZ_TO_RGB[i][2] * Z;
+    channels[i] = c < 0 ? 0 : c;
+  }
+
+  return std::max({channels[0], channels[1], channels[2]});
+}
+
+ColorRGB xy_to_rgb(uint16_t x, uint16_t y, uint8_t level) {
+#ifdef CONFIG_LIGHT_COLOR_FIXED_POINT
+  return xy_to_rgb_fixed(x, y, level);
+#else
+  return xy_to_rgb_double(x, y, level);
+#endif
+}
+
+ColorRGB16 xy_to_rgb16(uint16_t x, uint16_t y, uint8_t level) {
+#ifdef CONFIG_LIGHT_COLOR_FIXED_POINT
+  return xy_to_rgb16_fixed(x, y, level);
+#else
+  return xy_to_rgb16_double(x, y, level);
+#endif
+}
+
+ColorRGB xy_to_rgb_fixed(uint16_t x, uint16_t y, uint8_t level) {
+  if (y == 0 || level == 0) return ColorRGB{0, 0, 0};
+  if (level > COLOR_MAX_LEVEL) level = COLOR_MAX_LEVEL;
+
+  // Scale according to max value
+  int64_t channels[3];
+  int64_t maxc = xy_to_channels(x, y, channels);
+  if (maxc == 0) return ColorRGB{0, 0, 0};
+
+  // Apply brightness and round to 8-bit values
+  int64_t scale = LEVEL_SCALE[level];
+  int64_t divisor = maxc << LEVEL_SCALE_SHIFT;
+  uint8_t out[3];
+  for (int i = 0; i < 3; i++) {
+    int64_t value = (channels[i] * scale + divisor / 2) / divisor;
+    out[i] = static_cast<uint8_t>(value);
+  }
+
+  return ColorRGB{out[0], out[1], out[2]};
+}
+
+ColorRGB16 xy_to_rgb16_fixed(uint16_t x, uint16_t y, uint8_t level) {
+  if (y == 0 || level == 0) return ColorRGB16{0, 0, 0};
+  if (level > COLOR_MAX_LEVEL) level = COLOR_MAX_LEVEL;
+
+  int64_t channels[3];
+  int64_t maxc = xy_to_channels(x, y, channels);
+  if (maxc == 0) return ColorRGB16{0, 0, 0};
+
+  int64_t scale = LEVEL_SCALE16[level];
+  uint16_t out[3];
+  for (int i = 0; i < 3; i++) {
+    int64_t value = (channels[i] * scale + maxc / 2) / maxc;
+    out[i] = static_cast<uint16_t>(value);
+  }
+
+  return ColorRGB16{out[0], out[1], out[2]};
+}
+
+ColorRGB16 mireds_to_rgb16(uint16_t mireds, uint8_t level) {
+  if (level == 0) return ColorRGB16{0, 0, 0};
+  if (level > COLOR_MAX_LEVEL) level = COLOR_MAX_LEVEL;
+  mireds = std::clamp(mireds, COLOR_TEMP_MIN_MIREDS, COLOR_TEMP_MAX_MIREDS);
+
+  uint32_t offset = mireds - COLOR_TEMP_MIN_MIREDS;
+  uint32_t index = offset / MIREDS_STEP;
+  uint32_t fraction = offset % MIREDS_STEP;
+  const ColorRGB16& low = MIREDS_TABLE[index];
+  const ColorRGB16& high = MIREDS_TABLE[index + 1];
+
+  uint64_t scale = LEVEL_SCALE16[level];
+  auto channel = [&](uint32_t low, uint32_t high) {
+    uint32_t value =
+        (low * (MIREDS_STEP - fraction) + high * fraction) / MIREDS_STEP;
+    return static_cast<uint16_t>((value * scale + 32767) / 65535);
+  };
+
+  return ColorRGB16{
+      .r = channel(low.r, high.r),
+      .g = channel(low.g, high.g),
+      .b = channel(low.b, high.b),
+  };
+}
+
+// Multiplies two values in 0..65535 as fractions of 65535, the product and
+// rounding fit in 32 bits
+static uint32_t scale16(uint32_t a, uint32_t b) {
+  return (a * b + 32767) / 65535;
+}
+
+ColorRGB16 hsv_to_rgb16(uint16_t hue, uint8_t saturation, uint8_t level) {
+  if (level == 0) return ColorRGB16{0, 0, 0};
+  if (level > COLOR_MAX_LEVEL) level = COLOR_MAX_LEVEL;
+  if (saturation > COLOR_MAX_LEVEL) saturation = COLOR_MAX_LEVEL;
+
+  // Saturation has the same range as level
+  uint32_t value = LEVEL_SCALE16[level];
+  uint32_t sat = LEVEL_SCALE16[saturation];
+
+  // Six sectors of the color wheel, with the position within the sector in
+  // 16 bits
+  uint32_t position = hue * 6u;
+  uint32_t sector = position >> 16;
+  uint32_t fraction = position & 0xFFFF;
+
+  auto p = static_cast<uint16_t>(scale16(value, 65535 - sat));
+  auto q = static_cast<uint16_t>(
+      scale16(value, 65535 - scale16(sat, fraction)));
+  auto t = static_cast<uint16_t>(
+      scale16(value, 65535 - scale16(sat, 65535 - fraction)));
+  auto v = static_cast<uint16_t>(value);
+
+  switch (sector) {
+    case 0:
+      return ColorRGB16{v, t, p};
+    case 1:
+      return ColorRGB16{q, v, p};
+    case 2:
+      return ColorRGB16{p, v, t};
+    case 3:
+      return ColorRGB16{p, q, v};
+    case 4:
+      return ColorRGB16{t, p, v};
+    default:
+      return ColorRGB16{v, p, q};
+  }
+}
+
+// Converts to RGB channels between 0.0 and 1.0 in double precision
+static void xy_to_unit_rgb(uint16_t x_value, uint16_t y_value, uint8_t level,
+                           double rgb[3]) {
+  double x = x_value / 65535.0;
+  double y = y_value / 65535.0;
+  double brightness = std::min(level, COLOR_MAX_LEVEL) / 254.0;
+
+  rgb[0] = rgb[1] = rgb[2] = 0;
+  if (y == 0) return;
+
+  // Convert xy to XYZ color space
+  double Y = 1.0;
+  double X = (Y / y) * x;
+  double Z = (Y / y) * (1.0 - x - y);
+
+  // Convert XYZ to RGB using Wide RGB D65 conversion matrix
+  double r = 3.2406 * X - 1.5372 * Y - 0.4986 * Z;
+  double g = -0.9689 * X + 1.8758 * Y + 0.0415 * Z;
+  double b = 0.0557 * X - 0.2040 * Y + 1.0570 * Z;
+
+  // Normalize negative values
+  if (r < 0) r = 0;
+  if (g < 0) g = 0;
+  if (b < 0) b = 0;
+
+  // Scale according to max value
+  double maxc = std::max({r, g, b});
+  if (maxc == 0) return;
+
+  r /= maxc;
+  g /= maxc;
+  b /= maxc;
+
+  // Apply brightness
+  rgb[0] = r * brightness;
+  rgb[1] = g * brightness;
+  rgb[2] = b * brightness;
+}
+
+ColorRGB xy_to_rgb_double(uint16_t x, uint16_t y, uint8_t level) {
+  double unit[3];
+  xy_to_unit_rgb(x, y, level, unit);
+
+  // Convert to 8-bit RGB values
+  ColorRGB rgb;
+  rgb.r = static_cast<uint8_t>(std::round(unit[0] * 255.0));
+  rgb.g = static_cast<uint8_t>(std::round(unit[1] * 255.0));
+  rgb.b = static_cast<uint8_t>(std::round(unit[2] * 255.0));
+
+  return rgb;
+}
+
+ColorRGB16 xy_to_rgb16_double(uint16_t x, uint16_t y, uint8_t level) {
+  double unit[3];
+  xy_to_unit_rgb(x, y, level, unit);
+
+  ColorRGB16 rgb;
+  rgb.r = static_cast<uint16_t>(std::round(unit[0] * 65535.0));
+  rgb.g = static_cast<uint16_t>(std::round(unit[1] * 65535.0));
+  rgb.b = static_cast<uint16_t>(std::round(unit[2] * 65535.0));
+
+  return rgb;
+}
+
+ColorRGB16 hsv_to_rgb16_double(uint16_t hue, uint8_t saturation,
+                               uint8_t level) {
+  double h = hue / 65536.0 * 6.0;
+  double s = std::min(saturation, COLOR_MAX_LEVEL) / 254.0;
+  double v = std::min(level, COLOR_MAX_LEVEL) / 254.0;
+
+  int sector = static_cast<int>(h);
+  double f = h - sector;
+  double p = v * (1.0 - s);
+  double q = v * (1.0 - s * f);
+  double t = v * (1.0 - s * (1.0 - f));
+
+  double rgb[3];
+  switch (sector) {
+    case 0:
+      rgb[0] = v;
+      rgb[1] = t;
+      rgb[2] = p;
+      break;
+    case 1:
+      rgb[0] = q;
+      rgb[1] = v;
+      rgb[2] = p;
+      break;
+    case 2:
+      rgb[0] = p;
+      rgb[1] = v;
+      rgb[2] = t;
+      break;
+    case 3:
+      rgb[0] = p;
+      rgb[1] = q;
+      rgb[2] = v;
+      break;
+    case 4:
+      rgb[0] = t;
+      rgb[1] = p;
+      rgb[2] = v;
+      break;
+    default:
+      rgb[0] = v;
+      rgb[1] = p;
+      rgb[2] = q;
+      break;
+  }
+
+  ColorRGB16 result;
+  result.r = static_cast<uint16_t>(std::round(rgb[0] * 65535.0));
+  result.g = static_cast<uint16_t>(std::round(rgb[1] * 65535.0));
+  result.b = static_cast<uint16_t>(std::round(rgb[2] * 65535.0));
+
+  return result;
+}
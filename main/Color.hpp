@@ -0,0 +1,63 @@
+#ifndef COLOR_HPP
+#define COLOR_HPP
+
+#include <cstdint>
+
+#include "sdkconfig.h"
+
+constexpr uint8_t COLOR_MAX_LEVEL = 254;
+
+// Physical color temperature range of the light in mireds (10^6 / kelvin)
+constexpr uint16_t COLOR_TEMP_MIN_MIREDS = CONFIG_LIGHT_COLOR_TEMP_MIN_MIREDS;
+constexpr uint16_t COLOR_TEMP_MAX_MIREDS = CONFIG_LIGHT_COLOR_TEMP_MAX_MIREDS;
+static_assert(COLOR_TEMP_MIN_MIREDS < COLOR_TEMP_MAX_MIREDS,
+              "Color temperature range must not be empty");
+
+struct ColorRGB {
+  uint8_t r;
+  uint8_t g;
+  uint8_t b;
+};
+
+// RGB with 16 bits per channel, used between color conversion and output
+struct ColorRGB16 {
+  uint16_t r;
+  uint16_t g;
+  uint16_t b;
+};
+
+// Color coordinates in ZCL units (0..65535 maps to 0.0..1.0)
+struct ColorXY {
+  uint16_t x;
+  uint16_t y;
+};
+
+// Converts CIE xy coordinates and a ZCL level (0..254) to 8-bit RGB. The
+// implementation is selected at build time with CONFIG_LIGHT_COLOR_FIXED_POINT.
+ColorRGB xy_to_rgb(uint16_t x, uint16_t y, uint8_t level);
+
+// Converts to 16-bit RGB, which keeps low levels apart before gamma
+// correction and dithering
+ColorRGB16 xy_to_rgb16(uint16_t x, uint16_t y, uint8_t level);
+
+// Converts a color temperature in mireds, clamped to the physical range, and
+// a ZCL level to 16-bit RGB. Interpolates a table of the Planckian locus
+// computed at build time, so it takes a few integer operations.
+ColorRGB16 mireds_to_rgb16(uint16_t mireds, uint8_t level);
+
+// Converts a hue in ZCL enhanced hue units (0..65535 maps to 0..360 degrees),
+// a saturation and a ZCL level (both 0..254) to 16-bit RGB. Integer only, with
+// no floating point or trigonometry.
+ColorRGB16 hsv_to_rgb16(uint16_t hue, uint8_t saturation, uint8_t level);
+
+// Integer implementations, suitable for targets without an FPU
+ColorRGB xy_to_rgb_fixed(uint16_t x, uint16_t y, uint8_t level);
+ColorRGB16 xy_to_rgb16_fixed(uint16_t x, uint16_t y, uint8_t level);
+
+// Double-precision reference implementations
+ColorRGB xy_to_rgb_double(uint16_t x, uint16_t y, uint8_t level);
+ColorRGB16 xy_to_rgb16_double(uint16_t x, uint16_t y, uint8_t level);
+ColorRGB16 hsv_to_rgb16_double(uint16_t hue, uint8_t saturation,
+                               uint8_t level);
+
+#endif
@@ -0,0 +1,92 @@
+#include "DiagnosticsCluster.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "freertos/FreeRTOS.h"
+
+constexpr uint64_t REFRESH_INTERVAL_US = 10 * 1000 * 1000;
+
+static void put_u16(uint8_t* buf, uint16_t value) {
+  buf[0] = static_cast<uint8_t>(value);
+  buf[1] = static_cast<uint8_t>(value >> 8);
+}
+
+static void put_u32(uint8_t* buf, uint32_t value) {
+  put_u16(buf, static_cast<uint16_t>(value));
+  put_u16(buf + 2, static_cast<uint16_t>(value >> 16));
+}
+
+// ZCL octet string: length byte followed by the histogram
+static void encode_histogram(TraceStage stage, uint8_t* buf) {
+  buf[0] = DIAGNOSTICS_HISTOGRAM_SIZE;
+
+#ifdef CONFIG_LATENCY_TRACE
+  LatencyHistogram histogram = trace_get_histogram(stage);
+  put_u32(&buf[1], histogram.count);
+  put_u32(&buf[5], histogram.max_us);
+  for (size_t i = 0; i < LATENCY_BUCKETS; i++) {
+    uint32_t count = std::min<uint32_t>(histogram.buckets[i], UINT16_MAX);
+    put_u16(&buf[9 + 2 * i], static_cast<uint16_t>(count));
+  }
+#else
+  memset(&buf[1], 0, DIAGNOSTICS_HISTOGRAM_SIZE);
+#endif
+}
+
+DiagnosticsCluster::DiagnosticsCluster(uint8_t endpoint)
+    : endpoint(endpoint), refresh_timer(nullptr) {}
+
+esp_err_t DiagnosticsCluster::setup(esp_zb_cluster_list_t* clusters) {
+  auto* attrs = esp_zb_zcl_attr_list_create(DIAGNOSTICS_CLUSTER_ID);
+
+  for (size_t i = 0; i < TRACE_STAGE_COUNT; i++) {
+    uint8_t value[DIAGNOSTICS_HISTOGRAM_SIZE + 1];
+    encode_histogram(static_cast<TraceStage>(i), value);
+
+    esp_err_t err = esp_zb_custom_cluster_add_custom_attr(
+        attrs, static_cast<uint16_t>(i), ESP_ZB_ZCL_ATTR_TYPE_OCTET_STRING,
+        ESP_ZB_ZCL_ATTR_ACCESS_READ_ONLY, value);
+    if (err != ESP_OK) return err;
+  }
+
+  esp_err_t err = esp_zb_cluster_list_add_custom_cluster(
+      clusters, attrs, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE);
+  if (err != ESP_OK) return err;
+
+  return ESP_OK;
+}
+
+esp_err_t DiagnosticsCluster::start() {
+  esp_timer_create_args_t timer_args = {
+      .callback = refresh_timer_callback,
+      .arg = this,
+      .dispatch_method = ESP_TIMER_TASK,
+      .name = "diagnostics",
+      .skip_unhandled_events = true,
+  };
+  esp_err_t err = esp_timer_create(&timer_args, &refresh_timer);
+  if (err != ESP_OK) return err;
+
+  return esp_timer_start_periodic(refresh_timer, REFRESH_INTERVAL_US);
+}
+
+// PRIVATE METHODS
+void DiagnosticsCluster::refresh_timer_callback(void* arg) {
+  static_cast<DiagnosticsCluster*>(arg)->refresh();
+}
+
+void DiagnosticsCluster::refresh() {
+  esp_zb_lock_acquire(portMAX_DELAY);
+
+  for (size_t i = 0; i < TRACE_STAGE_COUNT; i++) {
+    uint8_t value[DIAGNOSTICS_HISTOGRAM_SIZE + 1];
+    encode_histogram(static_cast<TraceStage>(i), value);
+
+    esp_zb_zcl_set_attribute_val(endpoint, DIAGNOSTICS_CLUSTER_ID,
+                                 ESP_ZB_ZCL_CLUSTER_SERVER_ROLE,
+                                 static_cast<uint16_t>(i), value, false);
+  }
+
+  esp_zb_lock_release();
+}
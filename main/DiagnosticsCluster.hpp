@@ -0,0 +1,36 @@
+#ifndef DIAGNOSTICS_CLUSTER_HPP
+#define DIAGNOSTICS_CLUSTER_HPP
+
+#include <cstdint>
+
+#include "LatencyTrace.hpp"
+#include "esp_timer.h"
+#include "esp_zigbee_core.h"
+
+// Manufacturer-specific cluster exposing the latency histograms
+constexpr uint16_t DIAGNOSTICS_CLUSTER_ID = 0xFC00;
+
+// Attribute IDs 0x0000 onwards hold one TraceStage each, in enum order. The
+// value is an octet string of count (u32), max_us (u32) and then
+// LATENCY_BUCKETS bucket counts (u16, saturating), all little-endian.
+constexpr size_t DIAGNOSTICS_HISTOGRAM_SIZE = 8 + 2 * LATENCY_BUCKETS;
+
+class DiagnosticsCluster {
+ public:
+  DiagnosticsCluster(uint8_t endpoint);
+
+  esp_err_t setup(esp_zb_cluster_list_t* clusters);
+
+  // Refreshes the attributes from the histograms periodically. Must be called
+  // after the Zigbee stack has been started.
+  esp_err_t start();
+
+ private:
+  static void refresh_timer_callback(void* arg);
+  void refresh();
+
+  const uint8_t endpoint;
+  esp_timer_handle_t refresh_timer;
+};
+
+#endif
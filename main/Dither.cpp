@@ -0,0 +1,39 @@
+#include "Dither.hpp"
+
+#include "sdkconfig.h"
+
+#ifdef CONFIG_LIGHT_DITHERING
+constexpr uint32_t FRACTION_BITS = CONFIG_LIGHT_DITHER_BITS - 8;
+constexpr uint32_t FRACTION_MASK = (1 << FRACTION_BITS) - 1;
+
+// Full scale at dithering resolution, chosen so that the error carried over
+// from the previous frame never pushes the output past 255
+constexpr uint32_t FULL_SCALE = 255 << FRACTION_BITS;
+#endif
+
+Dither::Dither() : error{}, active(false) {}
+
+ColorRGB Dither::apply(ColorRGB16 color) {
+  const uint16_t input[3] = {color.r, color.g, color.b};
+  uint8_t out[3];
+
+#ifdef CONFIG_LIGHT_DITHERING
+  active = false;
+  for (int i = 0; i < 3; i++) {
+    uint32_t value = (input[i] * FULL_SCALE + 32767) / 65535;
+    if ((value & FRACTION_MASK) != 0) active = true;
+
+    uint32_t sum = error[i] + value;
+    out[i] = static_cast<uint8_t>(sum >> FRACTION_BITS);
+    error[i] = sum & FRACTION_MASK;
+  }
+#else
+  for (int i = 0; i < 3; i++) {
+    out[i] = static_cast<uint8_t>((input[i] * 255 + 32767) / 65535);
+  }
+#endif
+
+  return ColorRGB{out[0], out[1], out[2]};
+}
+
+bool Dither::is_active() { return active; }
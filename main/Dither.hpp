@@ -0,0 +1,27 @@
+#ifndef DITHER_HPP
+#define DITHER_HPP
+
+#include <cstdint>
+
+#include "Color.hpp"
+
+// Reduces 16-bit channels to the 8 bits sent to the LEDs. With
+// CONFIG_LIGHT_DITHERING the value is kept at CONFIG_LIGHT_DITHER_BITS and
+// the rounding error is carried into the next frame, so that the average over
+// a few frames matches the higher resolution value. Otherwise the value is
+// rounded.
+class Dither {
+ public:
+  Dither();
+
+  ColorRGB apply(ColorRGB16 color);
+
+  // Whether the last color needs further frames to be reproduced
+  bool is_active();
+
+ private:
+  uint32_t error[3];
+  bool active;
+};
+
+#endif
@@ -0,0 +1,164 @@
+#include "EffectEngine.hpp"
+
+#include <algorithm>
+
+#include "esp_cpu.h"
+#include "esp_rom_sys.h"
+
+constexpr uint32_t TICK_BUDGET_US = CONFIG_LIGHT_EFFECT_TICK_BUDGET_US;
+constexpr uint32_t HALF_PHASE = 1u << 31;
+
+// Hues in enhanced hue units
+constexpr uint16_t HUE_GREEN = 21845;
+constexpr uint16_t HUE_ORANGE = 5461;
+
+struct EffectTiming {
+  uint32_t period_ms;
+  // 0 runs until stopped
+  uint32_t cycles;
+};
+
+static EffectTiming get_timing(const EffectRequest& request) {
+  switch (request.effect) {
+    case Effect::BLINK:
+      return EffectTiming{.period_ms = 1000, .cycles = 1};
+    case Effect::BREATHE:
+      return EffectTiming{.period_ms = 1000, .cycles = 15};
+    case Effect::OKAY:
+      return EffectTiming{.period_ms = 1000, .cycles = 1};
+    case Effect::CHANNEL_CHANGE:
+      return EffectTiming{.period_ms = 8000, .cycles = 1};
+    case Effect::IDENTIFY:
+      return EffectTiming{.period_ms = 1000, .cycles = 0};
+    case Effect::COLOR_LOOP: {
+      uint32_t loop_time_s = std::max<uint32_t>(request.loop_time_s, 1);
+      return EffectTiming{.period_ms = loop_time_s * 1000, .cycles = 0};
+    }
+    default:
+      return EffectTiming{.period_ms = 1000, .cycles = 1};
+  }
+}
+
+// Multiplies a channel by a 16-bit fraction
+static uint16_t scale_channel(uint32_t value, uint32_t fraction) {
+  return static_cast<uint16_t>((value * fraction + 32767) / 65535);
+}
+
+EffectEngine::EffectEngine(uint32_t tick_period_us)
+    : tick_period_us(tick_period_us),
+      effect(Effect::NONE),
+      base{},
+      color{},
+      phase(0),
+      phase_step(0),
+      cycles_left(0),
+      finishing(false),
+      loop_reverse(false),
+      stats{} {}
+
+// PUBLIC METHODS
+void EffectEngine::start(const EffectRequest& request, const LightState& base,
+                         ColorRGB16 base_color) {
+  if (request.effect == Effect::NONE) {
+    if (request.finish) {
+      finishing = true;
+    } else {
+      stop();
+    }
+    return;
+  }
+
+  EffectTiming timing = get_timing(request);
+  uint64_t period_us = timing.period_ms * 1000ULL;
+  uint64_t step = ((1ULL << 32) * tick_period_us) / period_us;
+
+  this->effect = request.effect;
+  this->base = base;
+  this->phase = 0;
+  this->phase_step = static_cast<uint32_t>(std::clamp<uint64_t>(
+      step, 1, UINT32_MAX));
+  this->cycles_left = timing.cycles;
+  this->finishing = false;
+  this->loop_reverse = request.loop_reverse;
+
+  switch (request.effect) {
+    case Effect::OKAY:
+      color = hsv_to_rgb16(HUE_GREEN, COLOR_MAX_LEVEL, COLOR_MAX_LEVEL);
+      break;
+    case Effect::CHANNEL_CHANGE:
+      color = hsv_to_rgb16(HUE_ORANGE, COLOR_MAX_LEVEL, COLOR_MAX_LEVEL);
+      break;
+    default:
+      color = base_color;
+      break;
+  }
+}
+
+void EffectEngine::stop() {
+  effect = Effect::NONE;
+  finishing = false;
+}
+
+bool EffectEngine::is_active() { return effect != Effect::NONE; }
+
+Effect EffectEngine::get_effect() { return effect; }
+
+bool EffectEngine::tick(ColorRGB16* output) {
+  if (effect == Effect::NONE) return false;
+
+  uint32_t start = esp_cpu_get_cycle_count();
+
+  // The accumulator wraps around at the end of each cycle
+  uint32_t previous = phase;
+  phase += phase_step;
+  bool cycle_done = phase < previous;
+  if (cycle_done && (finishing || (cycles_left > 0 && --cycles_left == 0))) {
+    stop();
+  } else {
+    *output = render();
+  }
+
+  uint32_t cycles = esp_cpu_get_cycle_count() - start;
+  stats.ticks++;
+  stats.total_cycles += cycles;
+  stats.max_tick_cycles = std::max(stats.max_tick_cycles, cycles);
+  if (cycles > TICK_BUDGET_US * esp_rom_get_cpu_ticks_per_us()) {
+    stats.ticks_over_budget++;
+  }
+
+  return effect != Effect::NONE;
+}
+
+EffectStats EffectEngine::get_stats() { return stats; }
+
+// PRIVATE METHODS
+ColorRGB16 EffectEngine::render() {
+  switch (effect) {
+    case Effect::BLINK:
+    case Effect::IDENTIFY:
+      return phase < HALF_PHASE ? color : ColorRGB16{0, 0, 0};
+    case Effect::BREATHE: {
+      // Triangle wave over the cycle, 0 to 65535 and back
+      uint32_t fraction = (phase < HALF_PHASE ? phase : ~phase) >> 15;
+      return ColorRGB16{
+          .r = scale_channel(color.r, fraction),
+          .g = scale_channel(color.g, fraction),
+          .b = scale_channel(color.b, fraction),
+      };
+    }
+    case Effect::COLOR_LOOP: {
+      // The loop only changes the hue of a light that is on. A light in XY or
+      // temperature mode may have no saturation, it loops at full.
+      if (!base.active) return ColorRGB16{0, 0, 0};
+      // The high half of the phase is the hue offset
+      auto offset = static_cast<uint16_t>(phase >> 16);
+      uint16_t hue = loop_reverse ? base.enhanced_hue - offset
+                                  : base.enhanced_hue + offset;
+      uint8_t saturation =
+          base.saturation != 0 ? base.saturation : COLOR_MAX_LEVEL;
+      return hsv_to_rgb16(hue, saturation, base.level);
+    }
+    default:
+      return color;
+  }
+}
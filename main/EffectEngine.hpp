@@ -0,0 +1,95 @@
+#ifndef EFFECT_ENGINE_HPP
+#define EFFECT_ENGINE_HPP
+
+#include <cstdint>
+
+#include "Color.hpp"
+#include "LightState.hpp"
+#include "sdkconfig.h"
+
+// Identify cluster Trigger Effect identifiers
+constexpr uint8_t IDENTIFY_EFFECT_BLINK = 0x00;
+constexpr uint8_t IDENTIFY_EFFECT_BREATHE = 0x01;
+constexpr uint8_t IDENTIFY_EFFECT_OKAY = 0x02;
+constexpr uint8_t IDENTIFY_EFFECT_CHANNEL_CHANGE = 0x0b;
+constexpr uint8_t IDENTIFY_EFFECT_FINISH = 0xfe;
+constexpr uint8_t IDENTIFY_EFFECT_STOP = 0xff;
+
+enum class Effect : uint8_t {
+  NONE,
+  // On and off once
+  BLINK,
+  // Fades in and out 15 times
+  BREATHE,
+  // Green for a second
+  OKAY,
+  // Orange for 8 seconds
+  CHANNEL_CHANGE,
+  // Blinks until stopped, while the Identify cluster is identifying
+  IDENTIFY,
+  // Cycles through the hues from the current one until stopped
+  COLOR_LOOP,
+};
+
+// Effect to start. Effect::NONE stops the running one.
+struct EffectRequest {
+  Effect effect;
+  // Lets the running effect complete its current cycle before it ends,
+  // instead of stopping it at once. Only with Effect::NONE.
+  bool finish;
+  // Color loop only: seconds per loop and direction
+  uint16_t loop_time_s;
+  bool loop_reverse;
+};
+
+// Cost of the ticks, measured with the CPU cycle counter
+struct EffectStats {
+  uint32_t ticks;
+  uint32_t ticks_over_budget;
+  uint32_t max_tick_cycles;
+  uint64_t total_cycles;
+};
+
+// Advances light effects one tick at a time with 32-bit phase accumulators,
+// which wrap around once per effect cycle. A tick takes a few integer
+// operations, colors are converted once when an effect starts, apart from the
+// hue of a color loop.
+//
+// Not thread-safe, the owner serializes calls.
+class EffectEngine {
+ public:
+  EffectEngine(uint32_t tick_period_us);
+
+  // Starts an effect over base, replacing the running one. base_color is the
+  // base state's color at full level.
+  void start(const EffectRequest& request, const LightState& base,
+             ColorRGB16 base_color);
+  // Stops the running effect at once
+  void stop();
+
+  bool is_active();
+  Effect get_effect();
+
+  // Advances the running effect by one tick and writes its output. Returns
+  // false once the effect has ended, output is not written then.
+  bool tick(ColorRGB16* output);
+
+  EffectStats get_stats();
+
+ private:
+  ColorRGB16 render();
+
+  const uint32_t tick_period_us;
+  Effect effect;
+  LightState base;
+  ColorRGB16 color;
+  uint32_t phase;
+  uint32_t phase_step;
+  // Cycles left, 0 runs until stopped
+  uint32_t cycles_left;
+  bool finishing;
+  bool loop_reverse;
+  EffectStats stats;
+};
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef FLASH_HPP
+#define FLASH_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include "esp_err.h"
+
+// Minimal NOR flash interface: erased bytes read as 0xFF, writes can only
+// clear bits, and erasing works on whole sectors. Offsets are relative to
+// the start of the region.
+class Flash {
+ public:
+  virtual ~Flash() = default;
+
+  virtual size_t get_size() = 0;
+  virtual size_t get_sector_size() = 0;
+
+  virtual esp_err_t read(size_t offset, void* dst, size_t size) = 0;
+  virtual esp_err_t write(size_t offset, const void* src, size_t size) = 0;
+  virtual esp_err_t erase_sector(size_t sector) = 0;
+};
+
+#endif
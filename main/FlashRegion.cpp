@@ -0,0 +1,43 @@
+#include "FlashRegion.hpp"
+
+FlashRegion::FlashRegion(Flash& flash, size_t first_sector,
+                         size_t sector_count)
+    : flash(flash), first_sector(first_sector), sector_count(sector_count) {}
+
+esp_err_t FlashRegion::init() {
+  if ((first_sector + sector_count) * flash.get_sector_size() >
+      flash.get_size()) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+
+  return ESP_OK;
+}
+
+size_t FlashRegion::get_size() {
+  return sector_count * flash.get_sector_size();
+}
+
+size_t FlashRegion::get_sector_size() { return flash.get_sector_size(); }
+
+esp_err_t FlashRegion::read(size_t offset, void* dst, size_t size) {
+  if (offset + size > get_size()) return ESP_ERR_INVALID_SIZE;
+
+  return flash.read(get_offset() + offset, dst, size);
+}
+
+esp_err_t FlashRegion::write(size_t offset, const void* src, size_t size) {
+  if (offset + size > get_size()) return ESP_ERR_INVALID_SIZE;
+
+  return flash.write(get_offset() + offset, src, size);
+}
+
+esp_err_t FlashRegion::erase_sector(size_t sector) {
+  if (sector >= sector_count) return ESP_ERR_INVALID_ARG;
+
+  return flash.erase_sector(first_sector + sector);
+}
+
+// PRIVATE METHODS
+size_t FlashRegion::get_offset() {
+  return first_sector * flash.get_sector_size();
+}
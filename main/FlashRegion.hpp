@@ -0,0 +1,29 @@
+#ifndef FLASH_REGION_HPP
+#define FLASH_REGION_HPP
+
+#include "Flash.hpp"
+
+// Whole sectors of another flash region, so that several users can share a
+// partition
+class FlashRegion : public Flash {
+ public:
+  FlashRegion(Flash& flash, size_t first_sector, size_t sector_count);
+  // Fails if the sectors don't fit in the underlying region
+  esp_err_t init();
+
+  size_t get_size() override;
+  size_t get_sector_size() override;
+
+  esp_err_t read(size_t offset, void* dst, size_t size) override;
+  esp_err_t write(size_t offset, const void* src, size_t size) override;
+  esp_err_t erase_sector(size_t sector) override;
+
+ private:
+  size_t get_offset();
+
+  Flash& flash;
+  const size_t first_sector;
+  const size_t sector_count;
+};
+
+#endif
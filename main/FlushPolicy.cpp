@@ -0,0 +1,26 @@
+#include "FlushPolicy.hpp"
+
+#include <algorithm>
+
+FlushPolicy::FlushPolicy(int64_t quiet_us, int64_t max_latency_us)
+    : quiet_us(quiet_us),
+      max_latency_us(max_latency_us),
+      pending(false),
+      first_write(0),
+      deadline(0) {}
+
+int64_t FlushPolicy::on_write(int64_t now) {
+  if (!pending) {
+    pending = true;
+    first_write = now;
+  }
+
+  deadline = std::min(now + quiet_us, first_write + max_latency_us);
+  return deadline;
+}
+
+void FlushPolicy::on_flush() { pending = false; }
+
+bool FlushPolicy::is_pending() { return pending; }
+
+int64_t FlushPolicy::get_deadline() { return deadline; }
@@ -0,0 +1,28 @@
+#ifndef FLUSH_POLICY_HPP
+#define FLUSH_POLICY_HPP
+
+#include <cstdint>
+
+// Decides when coalesced writes should be flushed: after a quiet period
+// without new writes, but never later than a maximum latency after the first
+// unflushed write. Times are in microseconds from an arbitrary monotonic clock.
+class FlushPolicy {
+ public:
+  FlushPolicy(int64_t quiet_us, int64_t max_latency_us);
+
+  // Registers a write and returns the time the flush is due
+  int64_t on_write(int64_t now);
+  void on_flush();
+
+  bool is_pending();
+  int64_t get_deadline();
+
+ private:
+  const int64_t quiet_us;
+  const int64_t max_latency_us;
+  bool pending;
+  int64_t first_write;
+  int64_t deadline;
+};
+
+#endif
@@ -0,0 +1,97 @@
+#include "Gamma.hpp"
+
+#include <array>
+
+#include "sdkconfig.h"
+
+constexpr double GAMMA = CONFIG_LIGHT_GAMMA_X10 / 10.0;
+
+// Table entries cover the input range in steps of 257, so that full scale
+// falls exactly on the last entry. Values in between are interpolated.
+constexpr uint32_t STEP = 257;
+constexpr uint32_t STEPS = 65535 / STEP;
+
+// Output of the first non-zero step, one 8-bit LSB. Without it the bottom of
+// the curve rounds to zero and low levels turn the light off.
+constexpr double MIN_OUTPUT = 257.0;
+
+constexpr double LN2 = 0.69314718055994530942;
+
+// Natural logarithm for x > 0, evaluated at compile time only
+constexpr double const_ln(double x) {
+  int exponent = 0;
+  while (x < 0.5) {
+    x *= 2;
+    exponent--;
+  }
+  while (x > 1.0) {
+    x /= 2;
+    exponent++;
+  }
+
+  // ln(x) = 2 * atanh((x - 1) / (x + 1)), which converges fast on [0.5, 1]
+  double t = (x - 1) / (x + 1);
+  double term = t;
+  double sum = 0;
+  for (int n = 1; n < 64; n += 2) {
+    sum += term / n;
+    term *= t * t;
+  }
+
+  return 2 * sum + exponent * LN2;
+}
+
+// Exponential for x <= 0, evaluated at compile time only
+constexpr double const_exp(double x) {
+  int halvings = 0;
+  while (x < -0.5) {
+    x += LN2;
+    halvings++;
+  }
+
+  double term = 1;
+  double sum = 1;
+  for (int n = 1; n < 32; n++) {
+    term *= x / n;
+    sum += term;
+  }
+
+  for (int i = 0; i < halvings; i++) {
+    sum /= 2;
+  }
+  return sum;
+}
+
+constexpr auto GAMMA_TABLE = [] {
+  // One extra entry past full scale keeps interpolation in bounds
+  std::array<uint16_t, STEPS + 2> table{};
+  table[0] = 0;
+  table[STEPS + 1] = 65535;
+  for (uint32_t i = 1; i <= STEPS; i++) {
+    double curve = const_exp(GAMMA * const_ln(static_cast<double>(i) / STEPS));
+    double value = MIN_OUTPUT + (65535.0 - MIN_OUTPUT) * curve;
+    table[i] = static_cast<uint16_t>(value + 0.5);
+  }
+  return table;
+}();
+
+static_assert(GAMMA_TABLE[STEPS] == 65535, "Gamma must end at full scale");
+
+uint16_t gamma_correct(uint16_t value) {
+  uint32_t index = value / STEP;
+  uint32_t fraction = value % STEP;
+
+  uint32_t low = GAMMA_TABLE[index];
+  uint32_t high = GAMMA_TABLE[index + 1];
+  uint32_t interpolated = (low * (STEP - fraction) + high * fraction) / STEP;
+
+  return static_cast<uint16_t>(interpolated);
+}
+
+ColorRGB16 gamma_correct(ColorRGB16 color) {
+  return ColorRGB16{
+      .r = gamma_correct(color.r),
+      .g = gamma_correct(color.g),
+      .b = gamma_correct(color.b),
+  };
+}
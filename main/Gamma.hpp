@@ -0,0 +1,15 @@
+#ifndef GAMMA_HPP
+#define GAMMA_HPP
+
+#include <cstdint>
+
+#include "Color.hpp"
+
+// Maps a 16-bit channel value onto the perceptual brightness curve set by
+// CONFIG_LIGHT_GAMMA_X10. Any non-zero input of a full step or more stays
+// visible at 8-bit output.
+uint16_t gamma_correct(uint16_t value);
+
+ColorRGB16 gamma_correct(ColorRGB16 color);
+
+#endif
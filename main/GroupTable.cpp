@@ -0,0 +1,167 @@
+#include "GroupTable.hpp"
+
+#include <cstdio>
+
+#include "Log.hpp"
+#include "esp_zigbee_core.h"
+#include "nvs.h"
+
+constexpr char NVS_NAMESPACE[] = "zigbee_groups";
+
+// Endpoint IDs go up to 240, "ep_240" and the terminator
+constexpr size_t NVS_KEY_SIZE = 8;
+
+static void make_nvs_key(uint8_t endpoint, char* key) {
+  snprintf(key, NVS_KEY_SIZE, "ep_%u", endpoint);
+}
+
+static uint16_t read_u16(const uint8_t* data) {
+  return static_cast<uint16_t>(data[0] | data[1] << 8);
+}
+
+GroupTable::GroupTable(uint8_t endpoint)
+    : endpoint(endpoint), groups{}, count(0) {}
+
+esp_err_t GroupTable::init() {
+  char key[NVS_KEY_SIZE];
+  make_nvs_key(endpoint, key);
+
+  nvs_handle_t nvs_groups;
+  esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_groups);
+  if (err != ESP_OK) return err;
+
+  // The blob is the sorted group IDs, its size gives the count
+  size_t size = sizeof(groups);
+  err = nvs_get_blob(nvs_groups, key, groups.data(), &size);
+  nvs_close(nvs_groups);
+  if (err == ESP_ERR_NVS_NOT_FOUND) return ESP_OK;
+  // Stored by a build with a higher CONFIG_ZIGBEE_MAX_GROUPS. The device
+  // keeps running without the groups rather than not starting at all.
+  if (err == ESP_ERR_NVS_INVALID_LENGTH) {
+    log_warn("Ignoring stored groups beyond the table size: endpoint=%u",
+             endpoint);
+    return ESP_OK;
+  }
+  if (err != ESP_OK) return err;
+
+  if (size % sizeof(uint16_t) != 0 ||
+      !std::is_sorted(groups.begin(),
+                      groups.begin() + size / sizeof(uint16_t))) {
+    log_warn("Ignoring invalid stored groups: endpoint=%u, size=%u", endpoint,
+             static_cast<unsigned>(size));
+    return ESP_OK;
+  }
+  count = static_cast<uint8_t>(size / sizeof(uint16_t));
+
+  return ESP_OK;
+}
+
+esp_err_t GroupTable::add(uint16_t group_id) {
+  auto end = groups.begin() + count;
+  auto it = std::lower_bound(groups.begin(), end, group_id);
+  if (it != end && *it == group_id) return ESP_OK;
+  if (count == MAX_GROUPS) return ESP_ERR_NO_MEM;
+
+  std::copy_backward(it, end, end + 1);
+  *it = group_id;
+  count++;
+
+  return save();
+}
+
+esp_err_t GroupTable::remove(uint16_t group_id) {
+  auto end = groups.begin() + count;
+  auto it = std::lower_bound(groups.begin(), end, group_id);
+  if (it == end || *it != group_id) return ESP_ERR_NOT_FOUND;
+
+  std::copy(it + 1, end, it);
+  count--;
+
+  return save();
+}
+
+esp_err_t GroupTable::remove_all() {
+  if (count == 0) return ESP_OK;
+
+  count = 0;
+  return save();
+}
+
+esp_err_t GroupTable::handle_command(uint8_t command_id,
+                                     const uint8_t* payload, size_t length) {
+  switch (command_id) {
+    case GROUPS_CMD_ADD_GROUP:
+      if (length < sizeof(uint16_t)) return ESP_ERR_INVALID_SIZE;
+      return add(read_u16(payload));
+    case GROUPS_CMD_ADD_GROUP_IF_IDENTIFYING:
+      if (length < sizeof(uint16_t)) return ESP_ERR_INVALID_SIZE;
+      if (!is_identifying()) return ESP_OK;
+      return add(read_u16(payload));
+    case GROUPS_CMD_REMOVE_GROUP: {
+      if (length < sizeof(uint16_t)) return ESP_ERR_INVALID_SIZE;
+      esp_err_t err = remove(read_u16(payload));
+      return err == ESP_ERR_NOT_FOUND ? ESP_OK : err;
+    }
+    case GROUPS_CMD_REMOVE_ALL_GROUPS:
+      return remove_all();
+    default:
+      return ESP_OK;
+  }
+}
+
+bool GroupTable::has_room(uint8_t command_id, const uint8_t* payload,
+                          size_t length) const {
+  if (command_id != GROUPS_CMD_ADD_GROUP &&
+      command_id != GROUPS_CMD_ADD_GROUP_IF_IDENTIFYING) {
+    return true;
+  }
+  if (length < sizeof(uint16_t)) return true;
+  if (command_id == GROUPS_CMD_ADD_GROUP_IF_IDENTIFYING && !is_identifying()) {
+    return true;
+  }
+
+  return count < MAX_GROUPS || contains(read_u16(payload));
+}
+
+size_t GroupTable::get_count() { return count; }
+
+// PRIVATE METHODS
+bool GroupTable::is_identifying() const {
+  esp_zb_zcl_attr_t* attr = esp_zb_zcl_get_attribute(
+      endpoint, ESP_ZB_ZCL_CLUSTER_ID_IDENTIFY, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE,
+      ESP_ZB_ZCL_ATTR_IDENTIFY_IDENTIFY_TIME_ID);
+  if (attr == nullptr || attr->data_p == nullptr) return false;
+
+  return *static_cast<uint16_t*>(attr->data_p) > 0;
+}
+
+esp_err_t GroupTable::save() {
+  char key[NVS_KEY_SIZE];
+  make_nvs_key(endpoint, key);
+
+  nvs_handle_t nvs_groups;
+  esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_groups);
+  if (err != ESP_OK) return err;
+
+  // Nothing is stored for an empty table
+  if (count == 0) {
+    err = nvs_erase_key(nvs_groups, key);
+    if (err == ESP_ERR_NVS_NOT_FOUND) err = ESP_OK;
+  } else {
+    err = nvs_set_blob(nvs_groups, key, groups.data(),
+                       count * sizeof(uint16_t));
+  }
+  if (err != ESP_OK) {
+    nvs_close(nvs_groups);
+    return err;
+  }
+
+  err = nvs_commit(nvs_groups);
+  if (err != ESP_OK) {
+    nvs_close(nvs_groups);
+    return err;
+  }
+
+  nvs_close(nvs_groups);
+  return ESP_OK;
+}
@@ -0,0 +1,61 @@
+#ifndef GROUP_TABLE_HPP
+#define GROUP_TABLE_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+constexpr size_t MAX_GROUPS = CONFIG_ZIGBEE_MAX_GROUPS;
+
+// Groups cluster commands, client to server
+constexpr uint8_t GROUPS_CMD_ADD_GROUP = 0x00;
+constexpr uint8_t GROUPS_CMD_REMOVE_GROUP = 0x03;
+constexpr uint8_t GROUPS_CMD_REMOVE_ALL_GROUPS = 0x04;
+constexpr uint8_t GROUPS_CMD_ADD_GROUP_IF_IDENTIFYING = 0x05;
+
+// Groups an endpoint is a member of, kept sorted so membership is a binary
+// search, and persisted in NVS so the endpoint stays in its groups across
+// restarts.
+//
+// All methods must be called from the Zigbee task.
+class GroupTable {
+ public:
+  GroupTable(uint8_t endpoint);
+  esp_err_t init();
+
+  // Adding a group twice is a no-op, ESP_ERR_NO_MEM if the table is full
+  esp_err_t add(uint16_t group_id);
+  // ESP_ERR_NOT_FOUND if the endpoint is not a member
+  esp_err_t remove(uint16_t group_id);
+  esp_err_t remove_all();
+
+  // Applies a Groups cluster command addressed to the endpoint, ignoring
+  // commands that don't change membership
+  esp_err_t handle_command(uint8_t command_id, const uint8_t* payload,
+                           size_t length);
+  // False if handle_command would fail with ESP_ERR_NO_MEM, without changing
+  // the table
+  bool has_room(uint8_t command_id, const uint8_t* payload,
+                size_t length) const;
+
+  bool contains(uint16_t group_id) const {
+    return std::binary_search(groups.begin(), groups.begin() + count,
+                              group_id);
+  }
+
+  size_t get_count();
+
+ private:
+  bool is_identifying() const;
+  esp_err_t save();
+
+  const uint8_t endpoint;
+  std::array<uint16_t, MAX_GROUPS> groups;
+  uint8_t count;
+};
+
+#endif
@@ -0,0 +1,155 @@
+#include "LEDStrip.hpp"
+
+#include <algorithm>
+#include <new>
+
+#include "LatencyTrace.hpp"
+#include "soc/soc_caps.h"
+
+constexpr size_t BYTES_PER_PIXEL = 3;
+
+#ifdef CONFIG_STATIC_ALLOCATION
+// Framebuffers of all strips are taken from here
+static uint8_t framebuffer_arena[CONFIG_LED_PIXEL_COUNT * BYTES_PER_PIXEL];
+static size_t framebuffer_arena_used = 0;
+#endif
+
+// Strips longer than this are transmitted with DMA when the RMT supports it,
+// so refreshing them doesn't depend on interrupts refilling RMT memory
+constexpr uint16_t DMA_MIN_PIXELS = 16;
+
+LEDStrip::LEDStrip(const int gpio_pin, const uint16_t pixel_count)
+    : gpio(static_cast<gpio_num_t>(gpio_pin)),
+      pixel_count(pixel_count),
+      led(nullptr),
+      framebuffer(nullptr),
+      dirty_start(0),
+      dirty_end(0) {}
+
+esp_err_t LEDStrip::init() {
+  if (pixel_count == 0) return ESP_ERR_INVALID_ARG;
+
+  size_t framebuffer_size = pixel_count * BYTES_PER_PIXEL;
+#ifdef CONFIG_STATIC_ALLOCATION
+  if (framebuffer_arena_used + framebuffer_size > sizeof(framebuffer_arena)) {
+    return ESP_ERR_NO_MEM;
+  }
+  framebuffer = &framebuffer_arena[framebuffer_arena_used];
+  framebuffer_arena_used += framebuffer_size;
+#else
+  framebuffer = new (std::nothrow) uint8_t[framebuffer_size];
+  if (framebuffer == nullptr) return ESP_ERR_NO_MEM;
+#endif
+  std::fill_n(framebuffer, framebuffer_size, 0);
+
+#if SOC_RMT_SUPPORT_DMA
+  bool with_dma = pixel_count >= DMA_MIN_PIXELS;
+#else
+  bool with_dma = false;
+#endif
+
+  led_strip_config_t led_config = {
+      .strip_gpio_num = gpio,
+      .max_leds = pixel_count,
+      .led_model = LED_MODEL_WS2812,
+      .color_component_format = LED_STRIP_COLOR_COMPONENT_FMT_GRB,
+      .flags = {
+          .invert_out = false,
+      }};
+
+  led_strip_rmt_config_t rmt_config = {
+      .clk_src = RMT_CLK_SRC_DEFAULT,
+      .resolution_hz = 10 * 1000 * 1000,  // 10 MHz
+      // DMA needs a larger buffer, without it the RMT memory block is used
+      .mem_block_symbols = static_cast<size_t>(with_dma ? 1024 : 64),
+      .flags = {
+          .with_dma = with_dma,
+      }};
+
+  esp_err_t err = led_strip_new_rmt_device(&led_config, &rmt_config, &led);
+  if (err != ESP_OK) return err;
+
+  // Make sure the whole strip is transmitted on the first show
+  dirty_start = 0;
+  dirty_end = pixel_count;
+
+  return ESP_OK;
+}
+
+uint16_t LEDStrip::get_pixel_count() { return pixel_count; }
+
+esp_err_t LEDStrip::set_pixel(uint16_t index, ColorRGB rgb) {
+  if (index >= pixel_count) return ESP_ERR_INVALID_ARG;
+
+  write_pixel(index, rgb.r, rgb.g, rgb.b);
+
+  return ESP_OK;
+}
+
+ColorRGB LEDStrip::get_pixel(uint16_t index) {
+  if (index >= pixel_count) return ColorRGB{0, 0, 0};
+
+  const uint8_t* pixel = &framebuffer[index * BYTES_PER_PIXEL];
+  return ColorRGB{.r = pixel[1], .g = pixel[0], .b = pixel[2]};
+}
+
+esp_err_t LEDStrip::fill(const StripSegment& segment, ColorRGB rgb,
+                         uint8_t brightness) {
+  if (segment.start + segment.length > pixel_count) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  // Scale once for the whole segment
+  uint8_t r = (rgb.r * brightness + 127) / 255;
+  uint8_t g = (rgb.g * brightness + 127) / 255;
+  uint8_t b = (rgb.b * brightness + 127) / 255;
+
+  uint16_t end = segment.start + segment.length;
+  for (uint16_t i = segment.start; i < end; i++) {
+    write_pixel(i, r, g, b);
+  }
+
+  return ESP_OK;
+}
+
+esp_err_t LEDStrip::show() {
+  if (!is_dirty()) return ESP_OK;
+
+  uint32_t start = trace_now();
+  for (uint16_t i = dirty_start; i < dirty_end; i++) {
+    const uint8_t* pixel = &framebuffer[i * BYTES_PER_PIXEL];
+    esp_err_t err = led_strip_set_pixel(led, i, pixel[1], pixel[0], pixel[2]);
+    if (err != ESP_OK) return err;
+  }
+
+  esp_err_t err = led_strip_refresh(led);
+  if (err != ESP_OK) return err;
+
+  dirty_start = 0;
+  dirty_end = 0;
+
+  trace_record(TraceStage::LED_REFRESH, start);
+  trace_frame_shown();
+
+  return ESP_OK;
+}
+
+bool LEDStrip::is_dirty() { return dirty_start != dirty_end; }
+
+// PRIVATE METHODS
+void LEDStrip::write_pixel(uint16_t index, uint8_t r, uint8_t g, uint8_t b) {
+  uint8_t* pixel = &framebuffer[index * BYTES_PER_PIXEL];
+  if (pixel[0] == g && pixel[1] == r && pixel[2] == b) return;
+
+  pixel[0] = g;
+  pixel[1] = r;
+  pixel[2] = b;
+
+  if (!is_dirty()) {
+    dirty_start = index;
+    dirty_end = index + 1;
+  } else {
+    dirty_start = std::min(dirty_start, index);
+    dirty_end = std::max(dirty_end, static_cast<uint16_t>(index + 1));
+  }
+}
@@ -0,0 +1,49 @@
+#ifndef LED_STRIP_HPP
+#define LED_STRIP_HPP
+
+#include <cstdint>
+
+#include "Color.hpp"
+#include "driver/gpio.h"
+#include "led_strip.h"
+
+struct StripSegment {
+  uint16_t start;
+  uint16_t length;
+};
+
+// Addressable LED strip with a packed GRB framebuffer. Only pixels that
+// changed are copied to the driver, and unchanged frames are not transmitted.
+class LEDStrip {
+ public:
+  LEDStrip(const int gpio_pin, const uint16_t pixel_count);
+  esp_err_t init();
+
+  uint16_t get_pixel_count();
+
+  esp_err_t set_pixel(uint16_t index, ColorRGB rgb);
+  ColorRGB get_pixel(uint16_t index);
+
+  // Sets every pixel of the segment to rgb scaled by brightness (0-255)
+  esp_err_t fill(const StripSegment& segment, ColorRGB rgb,
+                 uint8_t brightness = 255);
+
+  // Transmits the framebuffer if any pixel changed since the last call
+  esp_err_t show();
+  bool is_dirty();
+
+ private:
+  void write_pixel(uint16_t index, uint8_t r, uint8_t g, uint8_t b);
+
+  const gpio_num_t gpio;
+  const uint16_t pixel_count;
+  led_strip_handle_t led;
+  // Allocated once in init and never freed
+  uint8_t* framebuffer;
+
+  // Range of pixels changed since the last show, empty when equal
+  uint16_t dirty_start;
+  uint16_t dirty_end;
+};
+
+#endif
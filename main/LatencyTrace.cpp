@@ -0,0 +1,90 @@
+#include "LatencyTrace.hpp"
+
+#ifdef CONFIG_LATENCY_TRACE
+
+#include <atomic>
+#include <cstdio>
+
+#include "esp_cpu.h"
+#include "esp_rom_sys.h"
+
+constexpr const char* STAGE_NAMES[TRACE_STAGE_COUNT] = {
+    "dispatch", "handler", "storage commit", "LED refresh", "end-to-end",
+};
+
+// Stages are recorded from different tasks without locking. An increment
+// lost to preemption only makes a count off by one.
+static LatencyHistogram histograms[TRACE_STAGE_COUNT];
+
+// Cycle count of the latest command awaiting its first frame, 0 when there is
+// none. Keeping an older one would measure from it once a command changes
+// nothing, and past a counter wrap the sample would be meaningless.
+static std::atomic<uint32_t> pending_command(0);
+
+static size_t get_bucket(uint32_t duration_us) {
+  size_t bucket = 0;
+  while (duration_us != 0 && bucket < LATENCY_BUCKETS - 1) {
+    duration_us >>= 1;
+    bucket++;
+  }
+  return bucket;
+}
+
+uint32_t trace_now() { return esp_cpu_get_cycle_count(); }
+
+void trace_record(TraceStage stage, uint32_t start) {
+  // Unsigned subtraction stays correct across a counter wrap
+  uint32_t cycles = esp_cpu_get_cycle_count() - start;
+  uint32_t duration_us = cycles / esp_rom_get_cpu_ticks_per_us();
+
+  LatencyHistogram& histogram = histograms[static_cast<size_t>(stage)];
+  histogram.count++;
+  histogram.buckets[get_bucket(duration_us)]++;
+  if (duration_us > histogram.max_us) histogram.max_us = duration_us;
+}
+
+void trace_command_received(uint32_t start) {
+  // 0 marks no pending command, a start that happens to be 0 is moved by one
+  // cycle
+  if (start == 0) start = 1;
+
+  pending_command.store(start);
+}
+
+void trace_command_dropped() { pending_command.store(0); }
+
+void trace_frame_shown() {
+  uint32_t start = pending_command.exchange(0);
+  if (start != 0) trace_record(TraceStage::END_TO_END, start);
+}
+
+LatencyHistogram trace_get_histogram(TraceStage stage) {
+  return histograms[static_cast<size_t>(stage)];
+}
+
+const char* trace_stage_name(TraceStage stage) {
+  return STAGE_NAMES[static_cast<size_t>(stage)];
+}
+
+void trace_print() {
+  for (size_t i = 0; i < TRACE_STAGE_COUNT; i++) {
+    const LatencyHistogram& histogram = histograms[i];
+    printf("Latency %s: count=%lu, max=%lu us, buckets(us)=", STAGE_NAMES[i],
+           static_cast<unsigned long>(histogram.count),
+           static_cast<unsigned long>(histogram.max_us));
+
+    for (size_t bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+      if (histogram.buckets[bucket] == 0) continue;
+
+      unsigned long count = histogram.buckets[bucket];
+      if (bucket == LATENCY_BUCKETS - 1) {
+        printf(" >=%lu:%lu", 1UL << (bucket - 1), count);
+      } else {
+        printf(" <%lu:%lu", 1UL << bucket, count);
+      }
+    }
+    printf("\n");
+  }
+}
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef LATENCY_TRACE_HPP
+#define LATENCY_TRACE_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include "sdkconfig.h"
+
+enum class TraceStage : uint8_t {
+  // Whole core action callback on the Zigbee task
+  DISPATCH,
+  // Device handler of an action, without routing
+  HANDLER,
+  // Writing the light state to flash
+  STORAGE_COMMIT,
+  // Copying pixels to the driver and transmitting them
+  LED_REFRESH,
+  // Latest attribute write received until the first LED refresh after it
+  END_TO_END,
+  COUNT,
+};
+
+constexpr size_t TRACE_STAGE_COUNT = static_cast<size_t>(TraceStage::COUNT);
+
+// Bucket 0 counts durations under 1 us and bucket i durations from 2^(i-1)
+// up to 2^i us. The last bucket also takes everything longer.
+constexpr size_t LATENCY_BUCKETS = 16;
+
+struct LatencyHistogram {
+  uint32_t count;
+  uint32_t max_us;
+  uint32_t buckets[LATENCY_BUCKETS];
+};
+
+// Stage timestamps come from the CPU cycle counter. With
+// CONFIG_LATENCY_TRACE disabled every call compiles to nothing.
+#ifdef CONFIG_LATENCY_TRACE
+uint32_t trace_now();
+void trace_record(TraceStage stage, uint32_t start);
+
+// Starts the end-to-end measurement, over one in progress that no frame has
+// shown yet
+void trace_command_received(uint32_t start);
+// Ends the measurement without a sample, for a command that sends no frame
+void trace_command_dropped();
+// Completes the end-to-end measurement, if one is in progress
+void trace_frame_shown();
+
+LatencyHistogram trace_get_histogram(TraceStage stage);
+const char* trace_stage_name(TraceStage stage);
+void trace_print();
+#else
+inline uint32_t trace_now() { return 0; }
+inline void trace_record(TraceStage stage, uint32_t start) {}
+inline void trace_command_received(uint32_t start) {}
+inline void trace_command_dropped() {}
+inline void trace_frame_shown() {}
+inline void trace_print() {}
+#endif
+
+#endif
@@ -0,0 +1,973 @@
+#include "LightEndpoint.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <utility>
+
+#include "Color.hpp"
+#include "EffectEngine.hpp"
+#include "Log.hpp"
+
+// Hue and saturation, enhanced hue, color loop, XY and color temperature
+constexpr uint16_t COLOR_CAPABILITIES = 0x001F;
+constexpr ReportingConfig REPORTING_DEFAULTS = {
+    .min_interval_s = CONFIG_REPORTING_MIN_INTERVAL_S,
+    .max_interval_s = CONFIG_REPORTING_MAX_INTERVAL_S,
+    .reportable_change = 0,
+};
+// Smaller steps only go out together with other changes
+constexpr uint16_t LEVEL_REPORTABLE_CHANGE = 2;
+constexpr uint16_t COLOR_REPORTABLE_CHANGE = 65;
+constexpr uint16_t COLOR_TEMPERATURE_REPORTABLE_CHANGE = 5;
+constexpr uint16_t HUE_REPORTABLE_CHANGE = 1;
+constexpr uint16_t ENHANCED_HUE_REPORTABLE_CHANGE = 256;
+constexpr uint16_t SATURATION_REPORTABLE_CHANGE = 2;
+// Recall Scene transition time that defers to the scene's own
+constexpr uint16_t SCENE_TRANSITION_DEFAULT = 0xFFFF;
+// Scenes, Level Control and Color Control commands, client to server
+constexpr uint8_t SCENES_CMD_ADD_SCENE = 0x00;
+constexpr uint8_t SCENES_CMD_REMOVE_SCENE = 0x02;
+constexpr uint8_t SCENES_CMD_REMOVE_ALL_SCENES = 0x03;
+constexpr uint8_t SCENES_CMD_ENHANCED_ADD_SCENE = 0x40;
+constexpr uint8_t LEVEL_CMD_MOVE_TO_LEVEL = 0x00;
+constexpr uint8_t LEVEL_CMD_MOVE_TO_LEVEL_WITH_ON_OFF = 0x04;
+constexpr uint8_t COLOR_CMD_MOVE_TO_COLOR = 0x07;
+constexpr uint8_t COLOR_CMD_MOVE_TO_COLOR_TEMPERATURE = 0x0A;
+// Command transition time that leaves it to the device
+constexpr uint16_t TRANSITION_TIME_DEFAULT = 0xFFFF;
+// A command the stack hasn't started stepping by then was not executed, e.g.
+// Move to Level while the light is off
+constexpr int64_t COMMAND_START_TIMEOUT_US = 1000 * 1000;
+constexpr uint16_t COLOR_LOOP_TIME_DEFAULT_S = 25;
+constexpr uint16_t COLOR_LOOP_START_HUE_DEFAULT = 0x2300;
+
+// The first light keeps the namespace used before there were several
+constexpr const char* STORAGE_NAMESPACES[] = {
+    "zigbee_device", "light_1", "light_2", "light_3",
+    "light_4",       "light_5", "light_6", "light_7",
+};
+static_assert(MAX_LIGHTS <= std::size(STORAGE_NAMESPACES),
+              "Every light needs a storage namespace");
+static_assert(MAX_LIGHTS <= CONFIG_ZIGBEE_MAX_ENDPOINTS,
+              "Every light needs an endpoint");
+static_assert(MAX_LIGHTS <= CONFIG_LED_PIXEL_COUNT,
+              "Every light needs at least one pixel");
+
+constexpr uint16_t PIXELS_PER_LIGHT = CONFIG_LED_PIXEL_COUNT / MAX_LIGHTS;
+
+// Equal segments, the last one takes the remaining pixels
+static StripSegment get_segment(uint8_t index) {
+  uint16_t start = index * PIXELS_PER_LIGHT;
+  uint16_t length = index + 1 == MAX_LIGHTS ? CONFIG_LED_PIXEL_COUNT - start
+                                            : PIXELS_PER_LIGHT;
+  return StripSegment{.start = start, .length = length};
+}
+
+std::array<LightEndpoint*, MAX_LIGHTS> LightEndpoint::lights = {};
+
+LightEndpoint::LightEndpoint(uint8_t index, RenderScheduler& scheduler,
+                             LightWorker& worker, const LightState& defaults)
+    : index(index),
+      endpoint(CONFIG_LIGHT_ENDPOINT + index),
+      worker(worker),
+      led(scheduler, get_segment(index), index),
+      storage(STORAGE_NAMESPACES[index], defaults, index),
+      scenes(storage),
+      device(DeviceConfig{
+          .endpoint = endpoint,
+          .app_device_id = ESP_ZB_HA_ON_OFF_LIGHT_DEVICE_ID,
+          .power_source = ESP_ZB_ZCL_BASIC_POWER_SOURCE_BATTERY,
+          .manufacturer = CONFIG_DEVICE_MANUFACTURER,
+          .model = CONFIG_DEVICE_MODEL,
+      }),
+      reporter(endpoint),
+      color_loop{
+          .active = false,
+          .reverse = true,
+          .time_s = COLOR_LOOP_TIME_DEFAULT_S,
+      },
+      level_command{},
+      color_command{} {
+  if (index < lights.size()) lights[index] = this;
+}
+
+// PUBLIC METHODS
+esp_err_t LightEndpoint::init_led() { return led.init(); }
+
+esp_err_t LightEndpoint::load() {
+  esp_err_t err = storage.init();
+  if (err != ESP_OK) return err;
+
+  err = scenes.init();
+  if (err != ESP_OK) return err;
+
+  err = worker.add_light(led, storage);
+  if (err != ESP_OK) return err;
+
+  return led.restore(storage.get_state());
+}
+
+esp_err_t LightEndpoint::start(ClustersSetupHandler setup_extra) {
+  esp_err_t err = device.init([this, setup_extra](auto* clusters) {
+    esp_err_t err = setup_clusters(clusters);
+    if (err != ESP_OK || setup_extra == nullptr) return err;
+    return setup_extra(clusters);
+  });
+  if (err != ESP_OK) return err;
+
+  device.handle_actions<
+      Action<ESP_ZB_ZCL_CLUSTER_ID_ON_OFF, ESP_ZB_CORE_SET_ATTR_VALUE_CB_ID,
+             dispatch<esp_zb_zcl_set_attr_value_message_t,
+                      &LightEndpoint::handle_on_off>>,
+      Action<ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL,
+             ESP_ZB_CORE_SET_ATTR_VALUE_CB_ID,
+             dispatch<esp_zb_zcl_set_attr_value_message_t,
+                      &LightEndpoint::handle_level>>,
+      Action<ESP_ZB_ZCL_CLUSTER_ID_SCENES,
+             ESP_ZB_CORE_SCENES_STORE_SCENE_CB_ID,
+             dispatch<esp_zb_zcl_store_scene_message_t,
+                      &LightEndpoint::handle_store_scene>>,
+      Action<ESP_ZB_ZCL_CLUSTER_ID_SCENES,
+             ESP_ZB_CORE_SCENES_RECALL_SCENE_CB_ID,
+             dispatch<esp_zb_zcl_recall_scene_message_t,
+                      &LightEndpoint::handle_recall_scene>>,
+      Action<ESP_ZB_ZCL_CLUSTER_ID_IDENTIFY, ESP_ZB_CORE_IDENTIFY_EFFECT_CB_ID,
+             dispatch<esp_zb_zcl_identify_effect_message_t,
+                      &LightEndpoint::handle_identify_effect>>>();
+
+  esp_zb_identify_notify_handler_register(endpoint,
+                                          get_identify_handler(index));
+
+  err = Zigbee.handle_commands(endpoint, dispatch_command, this);
+  if (err != ESP_OK) return err;
+
+  // Color commands write their values and the color mode separately, so
+  // they are handled together
+  err = device.handle_attribute_group(
+      ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+      {
+          ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_X_ID,
+          ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_Y_ID,
+          ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMPERATURE_ID,
+          ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_HUE_ID,
+          ESP_ZB_ZCL_ATTR_COLOR_CONTROL_ENHANCED_CURRENT_HUE_ID,
+          ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_SATURATION_ID,
+          ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_MODE_ID,
+          ESP_ZB_ZCL_ATTR_COLOR_CONTROL_ENHANCED_COLOR_MODE_ID,
+      },
+      dispatch_batch<&LightEndpoint::handle_color>);
+  if (err != ESP_OK) return err;
+
+  err = device.handle_attribute_group(
+      ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+      {
+          ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_LOOP_ACTIVE_ID,
+          ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_LOOP_DIRECTION_ID,
+          ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_LOOP_TIME_ID,
+      },
+      dispatch_batch<&LightEndpoint::handle_color_loop>);
+  if (err != ESP_OK) return err;
+
+  return setup_reporting();
+}
+
+uint8_t LightEndpoint::get_endpoint() { return endpoint; }
+
+SingleLED& LightEndpoint::get_led() { return led; }
+
+// PRIVATE METHODS
+LightEndpoint* LightEndpoint::find(uint8_t endpoint) {
+  for (LightEndpoint* light : lights) {
+    if (light != nullptr && light->endpoint == endpoint) return light;
+  }
+  return nullptr;
+}
+
+template <typename T, esp_err_t (LightEndpoint::*Handler)(const T*)>
+esp_err_t LightEndpoint::dispatch(const T* msg) {
+  LightEndpoint* light = find(msg->info.dst_endpoint);
+  if (light == nullptr) return ESP_ERR_NOT_FOUND;
+
+  return (light->*Handler)(msg);
+}
+
+template <esp_err_t (LightEndpoint::*Handler)(const AttributeBatch&)>
+esp_err_t LightEndpoint::dispatch_batch(const AttributeBatch& batch) {
+  LightEndpoint* light = find(batch.endpoint);
+  if (light == nullptr) return ESP_ERR_NOT_FOUND;
+
+  return (light->*Handler)(batch);
+}
+
+// The stack passes nothing but the identify state, so each light has a
+// handler of its own
+template <size_t Index>
+void LightEndpoint::dispatch_identify(uint8_t identify_on) {
+  if (lights[Index] != nullptr) lights[Index]->handle_identify(identify_on);
+}
+
+esp_zb_identify_notify_callback_t LightEndpoint::get_identify_handler(
+    size_t index) {
+  static constexpr auto handlers = []<size_t... Indices>(
+                                       std::index_sequence<Indices...>) {
+    return std::array<esp_zb_identify_notify_callback_t, MAX_LIGHTS>{
+        &dispatch_identify<Indices>...};
+  }(std::make_index_sequence<MAX_LIGHTS>{});
+
+  return handlers[index];
+}
+
+void LightEndpoint::dispatch_command(void* context, uint16_t cluster_id,
+                                     uint8_t command_id,
+                                     const uint8_t* payload, size_t length) {
+  static_cast<LightEndpoint*>(context)->handle_command(cluster_id, command_id,
+                                                       payload, length);
+}
+
+esp_err_t LightEndpoint::post(StateChange change) {
+  change.light = index;
+  return worker.post(change);
+}
+
+// The values of a step that a command transition can change
+static void merge_step(StateChange& into, const StateChange& change) {
+  into.fields |= change.fields;
+  if (change.fields & STATE_FIELD_LEVEL) into.level = change.level;
+  if (change.fields & STATE_FIELD_COLOR_X) into.color_x = change.color_x;
+  if (change.fields & STATE_FIELD_COLOR_Y) into.color_y = change.color_y;
+  if (change.fields & STATE_FIELD_COLOR_MODE) {
+    into.color_mode = change.color_mode;
+  }
+  if (change.fields & STATE_FIELD_COLOR_TEMPERATURE) {
+    into.color_temperature = change.color_temperature;
+  }
+}
+
+// Posts a value the stack wrote, unless it is a step of a command transition.
+// The first step posts the command's target with the rest of its transition
+// time, the others are left out so they don't retarget the fade.
+esp_err_t LightEndpoint::post_step(CommandTransition& command,
+                                   const StateChange& change) {
+  using Stage = CommandTransition::Stage;
+
+  int64_t now = esp_timer_get_time();
+  int64_t end_us = command.received_us + command.transition_ms * 1000LL;
+  if (command.stage == Stage::PENDING &&
+      now - command.received_us > COMMAND_START_TIMEOUT_US) {
+    command.stage = Stage::NONE;
+  }
+  if (command.stage == Stage::RUNNING && now >= end_us) {
+    command.stage = Stage::NONE;
+  }
+
+  switch (command.stage) {
+    case Stage::PENDING: {
+      command.stage = Stage::RUNNING;
+      command.stepped = change;
+
+      StateChange target = command.target;
+      target.fields |= STATE_FIELD_TRANSITION;
+      target.transition_ms =
+          static_cast<uint32_t>(std::max<int64_t>(end_us - now, 0) / 1000);
+      return post(target);
+    }
+    case Stage::RUNNING:
+      merge_step(command.stepped, change);
+      return ESP_OK;
+    default:
+      return post(change);
+  }
+}
+
+void LightEndpoint::start_command(CommandTransition& command,
+                                  const StateChange& target,
+                                  uint16_t transition_time) {
+  // Left to the stack's steps
+  if (transition_time == TRANSITION_TIME_DEFAULT) {
+    interrupt_command(command);
+    return;
+  }
+
+  // A running command is retargeted by the first step of the new one
+  command = CommandTransition{
+      .stage = CommandTransition::Stage::PENDING,
+      .target = target,
+      // Transition time is in tenths of a second
+      .transition_ms = transition_time * 100U,
+      .received_us = esp_timer_get_time(),
+      .stepped = {},
+  };
+}
+
+// Any other command of the cluster, e.g. Stop, ends the command transition.
+// The light goes to the value the stack stepped to, which the command
+// continues from.
+void LightEndpoint::interrupt_command(CommandTransition& command) {
+  using Stage = CommandTransition::Stage;
+
+  bool running = command.stage == Stage::RUNNING &&
+                 esp_timer_get_time() <
+                     command.received_us + command.transition_ms * 1000LL;
+  command.stage = Stage::NONE;
+  if (!running || command.stepped.fields == 0) return;
+
+  esp_err_t err = post(command.stepped);
+  if (err != ESP_OK) {
+    log_error("Error posting stopped transition: %s", esp_err_to_name(err));
+  }
+}
+
+esp_err_t LightEndpoint::setup_clusters(esp_zb_cluster_list_t* clusters) {
+  esp_zb_scenes_cluster_cfg_t scenes_cfg = {};
+  auto* scenes_attrs = esp_zb_scenes_cluster_create(&scenes_cfg);
+  esp_err_t err = esp_zb_cluster_list_add_scenes_cluster(
+      clusters, scenes_attrs, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE);
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  esp_zb_on_off_cluster_cfg_t on_off_cfg = {
+      .on_off = storage.get_active(),
+  };
+  auto* on_off_attrs = esp_zb_on_off_cluster_create(&on_off_cfg);
+  err = esp_zb_cluster_list_add_on_off_cluster(clusters, on_off_attrs,
+                                               ESP_ZB_ZCL_CLUSTER_SERVER_ROLE);
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  esp_zb_level_cluster_cfg_t level_cfg = {
+      .current_level = storage.get_brightness(),
+  };
+  auto* level_attrs = esp_zb_level_cluster_create(&level_cfg);
+  err = esp_zb_cluster_list_add_level_cluster(clusters, level_attrs,
+                                              ESP_ZB_ZCL_CLUSTER_SERVER_ROLE);
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  esp_zb_color_cluster_cfg_t color_cfg = {
+      .current_x = storage.get_color_x(),
+      .current_y = storage.get_color_y(),
+      .color_mode = color_mode_attribute(storage.get_color_mode()),
+      .options = ESP_ZB_ZCL_COLOR_CONTROL_OPTIONS_DEFAULT_VALUE,
+      .enhanced_color_mode = static_cast<uint8_t>(storage.get_color_mode()),
+      .color_capabilities = COLOR_CAPABILITIES,
+  };
+  auto* color_attrs = esp_zb_color_control_cluster_create(&color_cfg);
+
+  LightState state = storage.get_state();
+  uint8_t hue = state.enhanced_hue >> 8;
+  err = esp_zb_color_control_cluster_add_attr(
+      color_attrs, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_HUE_ID, &hue);
+  if (err != ESP_OK) {
+    return err;
+  }
+  err = esp_zb_color_control_cluster_add_attr(
+      color_attrs, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_SATURATION_ID,
+      &state.saturation);
+  if (err != ESP_OK) {
+    return err;
+  }
+  err = esp_zb_color_control_cluster_add_attr(
+      color_attrs, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_ENHANCED_CURRENT_HUE_ID,
+      &state.enhanced_hue);
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  uint8_t loop_active = 0;
+  uint8_t loop_direction = 0;
+  uint16_t loop_time = COLOR_LOOP_TIME_DEFAULT_S;
+  uint16_t loop_start_hue = COLOR_LOOP_START_HUE_DEFAULT;
+  err = esp_zb_color_control_cluster_add_attr(
+      color_attrs, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_LOOP_ACTIVE_ID,
+      &loop_active);
+  if (err != ESP_OK) {
+    return err;
+  }
+  err = esp_zb_color_control_cluster_add_attr(
+      color_attrs, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_LOOP_DIRECTION_ID,
+      &loop_direction);
+  if (err != ESP_OK) {
+    return err;
+  }
+  err = esp_zb_color_control_cluster_add_attr(
+      color_attrs, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_LOOP_TIME_ID,
+      &loop_time);
+  if (err != ESP_OK) {
+    return err;
+  }
+  err = esp_zb_color_control_cluster_add_attr(
+      color_attrs,
+      ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_LOOP_START_ENHANCED_HUE_ID,
+      &loop_start_hue);
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  uint16_t color_temp_min = COLOR_TEMP_MIN_MIREDS;
+  uint16_t color_temp_max = COLOR_TEMP_MAX_MIREDS;
+  err = esp_zb_color_control_cluster_add_attr(
+      color_attrs, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMPERATURE_ID,
+      &state.color_temperature);
+  if (err != ESP_OK) {
+    return err;
+  }
+  err = esp_zb_color_control_cluster_add_attr(
+      color_attrs,
+      ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMP_PHYSICAL_MIN_MIREDS_ID,
+      &color_temp_min);
+  if (err != ESP_OK) {
+    return err;
+  }
+  err = esp_zb_color_control_cluster_add_attr(
+      color_attrs,
+      ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMP_PHYSICAL_MAX_MIREDS_ID,
+      &color_temp_max);
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  err = esp_zb_cluster_list_add_color_control_cluster(
+      clusters, color_attrs, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE);
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  return ESP_OK;
+}
+
+esp_err_t LightEndpoint::setup_reporting() {
+  ReportingConfig level_config = REPORTING_DEFAULTS;
+  level_config.reportable_change = LEVEL_REPORTABLE_CHANGE;
+  ReportingConfig color_config = REPORTING_DEFAULTS;
+  color_config.reportable_change = COLOR_REPORTABLE_CHANGE;
+  ReportingConfig color_temperature_config = REPORTING_DEFAULTS;
+  color_temperature_config.reportable_change =
+      COLOR_TEMPERATURE_REPORTABLE_CHANGE;
+  ReportingConfig hue_config = REPORTING_DEFAULTS;
+  hue_config.reportable_change = HUE_REPORTABLE_CHANGE;
+  ReportingConfig enhanced_hue_config = REPORTING_DEFAULTS;
+  enhanced_hue_config.reportable_change = ENHANCED_HUE_REPORTABLE_CHANGE;
+  ReportingConfig saturation_config = REPORTING_DEFAULTS;
+  saturation_config.reportable_change = SATURATION_REPORTABLE_CHANGE;
+  LightState state = storage.get_state();
+
+  esp_err_t err = reporter.add_attribute(
+      ESP_ZB_ZCL_CLUSTER_ID_ON_OFF, ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID,
+      ESP_ZB_ZCL_ATTR_TYPE_BOOL, storage.get_active(), REPORTING_DEFAULTS);
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  err = reporter.add_attribute(ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL,
+                               ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID,
+                               ESP_ZB_ZCL_ATTR_TYPE_U8,
+                               storage.get_brightness(), level_config);
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  err = reporter.add_attribute(ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+                               ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_X_ID,
+                               ESP_ZB_ZCL_ATTR_TYPE_U16, storage.get_color_x(),
+                               color_config);
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  err = reporter.add_attribute(ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+                               ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_Y_ID,
+                               ESP_ZB_ZCL_ATTR_TYPE_U16, storage.get_color_y(),
+                               color_config);
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  err = reporter.add_attribute(
+      ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+      ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMPERATURE_ID,
+      ESP_ZB_ZCL_ATTR_TYPE_U16, state.color_temperature,
+      color_temperature_config);
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  err = reporter.add_attribute(ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+                               ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_HUE_ID,
+                               ESP_ZB_ZCL_ATTR_TYPE_U8, state.enhanced_hue >> 8,
+                               hue_config);
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  err = reporter.add_attribute(
+      ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+      ESP_ZB_ZCL_ATTR_COLOR_CONTROL_ENHANCED_CURRENT_HUE_ID,
+      ESP_ZB_ZCL_ATTR_TYPE_U16, state.enhanced_hue, enhanced_hue_config);
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  err = reporter.add_attribute(
+      ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+      ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_SATURATION_ID,
+      ESP_ZB_ZCL_ATTR_TYPE_U8, state.saturation, saturation_config);
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  err = reporter.add_attribute(
+      ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+      ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_MODE_ID,
+      ESP_ZB_ZCL_ATTR_TYPE_8BIT_ENUM, color_mode_attribute(state.color_mode),
+      REPORTING_DEFAULTS);
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  return ESP_OK;
+}
+
+// A new explicit state cancels the color loop, the attribute follows
+void LightEndpoint::end_color_loop() {
+  if (!color_loop.active) return;
+  color_loop.active = false;
+
+  uint8_t loop_active = 0;
+  esp_zb_zcl_set_attribute_val(
+      endpoint, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+      ESP_ZB_ZCL_CLUSTER_SERVER_ROLE,
+      ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_LOOP_ACTIVE_ID, &loop_active, false);
+}
+
+// Sees Level Control and Color Control commands before the stack runs them.
+// Move to Level, Move to Color and Move to Color Temperature carry the
+// transition time, which the attribute writes of their steps don't. Hue and
+// saturation commands are left to the steps, a fade in RGB would cut across
+// the hue circle.
+void LightEndpoint::handle_command(uint16_t cluster_id, uint8_t command_id,
+                                   const uint8_t* payload, size_t length) {
+  auto read_u16 = [payload](size_t offset) {
+    return static_cast<uint16_t>(payload[offset] | payload[offset + 1] << 8);
+  };
+
+  // The stack has no callbacks for added or removed scenes, the table
+  // follows the commands that add and remove them
+  esp_err_t err = ESP_OK;
+  switch (cluster_id) {
+    case ESP_ZB_ZCL_CLUSTER_ID_SCENES:
+      if (command_id == SCENES_CMD_ADD_SCENE ||
+          command_id == SCENES_CMD_ENHANCED_ADD_SCENE) {
+        err = handle_add_scene(command_id, payload, length);
+      } else if (command_id == SCENES_CMD_REMOVE_SCENE && length >= 3) {
+        err = scenes.remove(read_u16(0), payload[2]);
+      } else if (command_id == SCENES_CMD_REMOVE_ALL_SCENES && length >= 2) {
+        err = scenes.remove_group(read_u16(0));
+      }
+      break;
+    case ESP_ZB_ZCL_CLUSTER_ID_GROUPS:
+      if (command_id == GROUPS_CMD_REMOVE_GROUP && length >= 2) {
+        err = scenes.remove_group(read_u16(0));
+      } else if (command_id == GROUPS_CMD_REMOVE_ALL_GROUPS) {
+        err = scenes.remove_all_groups();
+      }
+      break;
+    case ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL:
+      if ((command_id == LEVEL_CMD_MOVE_TO_LEVEL ||
+           command_id == LEVEL_CMD_MOVE_TO_LEVEL_WITH_ON_OFF) &&
+          length >= 3) {
+        StateChange target = {
+            .fields = STATE_FIELD_LEVEL,
+            .level = std::min(payload[0], COLOR_MAX_LEVEL),
+        };
+        start_command(level_command, target, read_u16(1));
+      } else {
+        interrupt_command(level_command);
+      }
+      break;
+    case ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL:
+      if (command_id == COLOR_CMD_MOVE_TO_COLOR && length >= 6) {
+        StateChange target = {
+            .fields = STATE_FIELD_COLOR_X | STATE_FIELD_COLOR_Y |
+                      STATE_FIELD_COLOR_MODE,
+            .color_x = read_u16(0),
+            .color_y = read_u16(2),
+            .color_mode = ColorMode::XY,
+        };
+        start_command(color_command, target, read_u16(4));
+      } else if (command_id == COLOR_CMD_MOVE_TO_COLOR_TEMPERATURE &&
+                 length >= 4) {
+        StateChange target = {
+            .fields = STATE_FIELD_COLOR_TEMPERATURE | STATE_FIELD_COLOR_MODE,
+            .color_mode = ColorMode::TEMPERATURE,
+            .color_temperature = std::clamp(
+                read_u16(0), COLOR_TEMP_MIN_MIREDS, COLOR_TEMP_MAX_MIREDS),
+        };
+        start_command(color_command, target, read_u16(2));
+      } else {
+        interrupt_command(color_command);
+      }
+      break;
+  }
+  if (err != ESP_OK) {
+    log_error("Error updating scenes: %s", esp_err_to_name(err));
+  }
+}
+
+esp_err_t LightEndpoint::handle_on_off(
+    const esp_zb_zcl_set_attr_value_message_t* msg) {
+  switch (msg->attribute.id) {
+    case ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID: {
+      bool active = *static_cast<bool*>(msg->attribute.data.value);
+      reporter.update(msg->info.cluster, msg->attribute.id, active);
+      end_color_loop();
+
+      return post(StateChange{
+          .fields = STATE_FIELD_ACTIVE,
+          .active = active,
+      });
+    }
+    default:
+      log_warn("Unsupported action: cluster_id=%u, attribute_id=%u",
+               msg->info.cluster, msg->attribute.id);
+      return ESP_ERR_NOT_SUPPORTED;
+  }
+}
+
+esp_err_t LightEndpoint::handle_level(
+    const esp_zb_zcl_set_attr_value_message_t* msg) {
+  switch (msg->attribute.id) {
+    case ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID: {
+      uint8_t level = *static_cast<uint8_t*>(msg->attribute.data.value);
+      reporter.update(msg->info.cluster, msg->attribute.id, level);
+      end_color_loop();
+
+      StateChange change = {
+          .fields = STATE_FIELD_LEVEL,
+          .level = level,
+      };
+      return post_step(level_command, change);
+    }
+    default:
+      log_warn("Unsupported action: cluster_id=%u, attribute_id=%u",
+               msg->info.cluster, msg->attribute.id);
+      return ESP_ERR_NOT_SUPPORTED;
+  }
+}
+
+void LightEndpoint::report_color_mode(ColorMode mode) {
+  reporter.update(ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+                  ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_MODE_ID,
+                  color_mode_attribute(mode));
+}
+
+void LightEndpoint::report_hue_saturation(uint16_t enhanced_hue,
+                                          uint8_t saturation) {
+  reporter.update(ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+                  ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_HUE_ID,
+                  enhanced_hue >> 8);
+  reporter.update(ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+                  ESP_ZB_ZCL_ATTR_COLOR_CONTROL_ENHANCED_CURRENT_HUE_ID,
+                  enhanced_hue);
+  reporter.update(ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+                  ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_SATURATION_ID,
+                  saturation);
+}
+
+// Keeps the mode attributes in line with the values written by a command
+void LightEndpoint::set_color_mode_attributes(ColorMode mode) {
+  uint8_t color_mode = color_mode_attribute(mode);
+  uint8_t enhanced_color_mode = static_cast<uint8_t>(mode);
+  esp_zb_zcl_set_attribute_val(endpoint,
+                               ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+                               ESP_ZB_ZCL_CLUSTER_SERVER_ROLE,
+                               ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_MODE_ID,
+                               &color_mode, false);
+  esp_zb_zcl_set_attribute_val(
+      endpoint, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+      ESP_ZB_ZCL_CLUSTER_SERVER_ROLE,
+      ESP_ZB_ZCL_ATTR_COLOR_CONTROL_ENHANCED_COLOR_MODE_ID,
+      &enhanced_color_mode, false);
+}
+
+// Color commands write the values of their mode along with the mode
+// attributes. They arrive as one batch, so the light refreshes once even
+// when the mode changes.
+esp_err_t LightEndpoint::handle_color(const AttributeBatch& batch) {
+  constexpr uint16_t X_ID = ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_X_ID;
+  constexpr uint16_t Y_ID = ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_Y_ID;
+  constexpr uint16_t TEMPERATURE_ID =
+      ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMPERATURE_ID;
+  constexpr uint16_t HUE_ID = ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_HUE_ID;
+  constexpr uint16_t ENHANCED_HUE_ID =
+      ESP_ZB_ZCL_ATTR_COLOR_CONTROL_ENHANCED_CURRENT_HUE_ID;
+  constexpr uint16_t SATURATION_ID =
+      ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_SATURATION_ID;
+  constexpr uint16_t MODE_ID = ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_MODE_ID;
+  constexpr uint16_t ENHANCED_MODE_ID =
+      ESP_ZB_ZCL_ATTR_COLOR_CONTROL_ENHANCED_COLOR_MODE_ID;
+
+  LightState current = worker.get_state(index);
+  StateChange change = {
+      .fields = 0,
+      .color_mode = current.color_mode,
+      .enhanced_hue = current.enhanced_hue,
+      .saturation = current.saturation,
+  };
+  auto set_mode = [&change](ColorMode mode) {
+    change.fields |= STATE_FIELD_COLOR_MODE;
+    change.color_mode = mode;
+  };
+
+  // The mode follows the values that were written
+  if (batch.has(X_ID)) {
+    change.fields |= STATE_FIELD_COLOR_X;
+    change.color_x = batch.get<uint16_t>(X_ID, 0);
+    reporter.update(batch.cluster_id, X_ID, change.color_x);
+    set_mode(ColorMode::XY);
+  }
+  if (batch.has(Y_ID)) {
+    change.fields |= STATE_FIELD_COLOR_Y;
+    change.color_y = batch.get<uint16_t>(Y_ID, 0);
+    reporter.update(batch.cluster_id, Y_ID, change.color_y);
+    set_mode(ColorMode::XY);
+  }
+  if (batch.has(TEMPERATURE_ID)) {
+    change.fields |= STATE_FIELD_COLOR_TEMPERATURE;
+    change.color_temperature = batch.get<uint16_t>(TEMPERATURE_ID, 0);
+    reporter.update(batch.cluster_id, TEMPERATURE_ID,
+                    change.color_temperature);
+    set_mode(ColorMode::TEMPERATURE);
+  }
+  if (batch.has(SATURATION_ID)) {
+    change.fields |= STATE_FIELD_SATURATION;
+    change.saturation = std::min(batch.get<uint8_t>(SATURATION_ID, 0),
+                                 COLOR_MAX_LEVEL);
+    if (change.color_mode != ColorMode::ENHANCED_HUE_SATURATION) {
+      set_mode(ColorMode::HUE_SATURATION);
+    }
+  }
+  // The stack updates Current Hue along with Enhanced Current Hue, which
+  // carries the full precision
+  if (batch.has(ENHANCED_HUE_ID)) {
+    change.fields |= STATE_FIELD_HUE;
+    change.enhanced_hue = batch.get<uint16_t>(ENHANCED_HUE_ID, 0);
+    set_mode(ColorMode::ENHANCED_HUE_SATURATION);
+  } else if (batch.has(HUE_ID)) {
+    change.fields |= STATE_FIELD_HUE;
+    change.enhanced_hue = batch.get<uint8_t>(HUE_ID, 0) << 8;
+    set_mode(ColorMode::HUE_SATURATION);
+  }
+  if (change.fields & (STATE_FIELD_HUE | STATE_FIELD_SATURATION)) {
+    report_hue_saturation(change.enhanced_hue, change.saturation);
+  }
+
+  // A mode written on its own switches to the values the light already has
+  bool values_written = change.fields != 0;
+  if (!values_written && batch.has(ENHANCED_MODE_ID)) {
+    uint8_t mode = batch.get<uint8_t>(ENHANCED_MODE_ID, 0);
+    if (mode <= static_cast<uint8_t>(ColorMode::ENHANCED_HUE_SATURATION)) {
+      set_mode(static_cast<ColorMode>(mode));
+    }
+  } else if (!values_written && batch.has(MODE_ID)) {
+    uint8_t mode = batch.get<uint8_t>(MODE_ID, 0);
+    if (mode <= static_cast<uint8_t>(ColorMode::TEMPERATURE)) {
+      set_mode(static_cast<ColorMode>(mode));
+    }
+  }
+  if (!(change.fields & STATE_FIELD_COLOR_MODE)) return ESP_OK;
+
+  end_color_loop();
+  report_color_mode(change.color_mode);
+  if (change.color_mode != current.color_mode) {
+    set_color_mode_attributes(change.color_mode);
+  }
+
+  return post_step(color_command, change);
+}
+
+// Color Loop Set writes the attributes it updates together. The loop runs
+// on the LED's frame timer, the Zigbee task is only involved to start and
+// stop it.
+esp_err_t LightEndpoint::handle_color_loop(const AttributeBatch& batch) {
+  constexpr uint16_t ACTIVE_ID =
+      ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_LOOP_ACTIVE_ID;
+  constexpr uint16_t DIRECTION_ID =
+      ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_LOOP_DIRECTION_ID;
+  constexpr uint16_t TIME_ID = ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_LOOP_TIME_ID;
+
+  if (batch.has(DIRECTION_ID)) {
+    color_loop.reverse = batch.get<uint8_t>(DIRECTION_ID, 0) == 0;
+  }
+  if (batch.has(TIME_ID)) {
+    color_loop.time_s =
+        batch.get<uint16_t>(TIME_ID, COLOR_LOOP_TIME_DEFAULT_S);
+  }
+
+  // A running loop picks up a new direction or time right away
+  bool was_active = color_loop.active;
+  if (batch.has(ACTIVE_ID)) {
+    color_loop.active = batch.get<uint8_t>(ACTIVE_ID, 0) != 0;
+  }
+  if (!color_loop.active && !was_active) return ESP_OK;
+
+  return post(StateChange{
+      .fields = STATE_FIELD_EFFECT,
+      .effect =
+          EffectRequest{
+              .effect =
+                  color_loop.active ? Effect::COLOR_LOOP : Effect::NONE,
+              .loop_time_s = color_loop.time_s,
+              .loop_reverse = color_loop.reverse,
+          },
+  });
+}
+
+esp_err_t LightEndpoint::handle_identify_effect(
+    const esp_zb_zcl_identify_effect_message_t* msg) {
+  EffectRequest request = {.effect = Effect::NONE};
+  switch (msg->effect_id) {
+    case IDENTIFY_EFFECT_BLINK:
+      request.effect = Effect::BLINK;
+      break;
+    case IDENTIFY_EFFECT_BREATHE:
+      request.effect = Effect::BREATHE;
+      break;
+    case IDENTIFY_EFFECT_OKAY:
+      request.effect = Effect::OKAY;
+      break;
+    case IDENTIFY_EFFECT_CHANNEL_CHANGE:
+      request.effect = Effect::CHANNEL_CHANGE;
+      break;
+    case IDENTIFY_EFFECT_FINISH:
+      request.finish = true;
+      break;
+    case IDENTIFY_EFFECT_STOP:
+      break;
+    default:
+      log_warn("Unsupported effect: effect_id=%u", msg->effect_id);
+      return ESP_ERR_NOT_SUPPORTED;
+  }
+
+  color_loop.active = false;
+  return post(StateChange{
+      .fields = STATE_FIELD_EFFECT,
+      .effect = request,
+  });
+}
+
+// Blinks for as long as the stack is identifying
+void LightEndpoint::handle_identify(uint8_t identify_on) {
+  esp_err_t err = post(StateChange{
+      .fields = STATE_FIELD_EFFECT,
+      .effect = EffectRequest{.effect = identify_on != 0 ? Effect::IDENTIFY
+                                                         : Effect::NONE},
+  });
+  if (err != ESP_OK) {
+    log_error("Error posting identify effect: %s", esp_err_to_name(err));
+  }
+}
+
+// Add Scene carries the scene's transition time, which the stack doesn't
+// pass on recall. The scene is taken from the command's extension fields.
+esp_err_t LightEndpoint::handle_add_scene(uint8_t command_id,
+                                          const uint8_t* payload,
+                                          size_t length) {
+  // Group ID, scene ID, transition time and the length of the name
+  constexpr size_t HEADER_SIZE = 6;
+  // Cluster ID and length
+  constexpr size_t FIELD_HEADER_SIZE = 3;
+  constexpr size_t MAX_FIELD_SETS = 4;
+  constexpr uint8_t INVALID_STRING_LENGTH = 0xFF;
+  if (length < HEADER_SIZE) return ESP_ERR_INVALID_SIZE;
+
+  auto read_u16 = [payload](size_t offset) {
+    return static_cast<uint16_t>(payload[offset] | payload[offset + 1] << 8);
+  };
+  // Seconds, tenths of a second for Enhanced Add Scene
+  uint32_t transition_time = read_u16(3);
+  uint32_t transition_ms = command_id == SCENES_CMD_ENHANCED_ADD_SCENE
+                               ? transition_time * 100
+                               : transition_time * 1000;
+
+  uint8_t name_length = payload[5];
+  size_t offset =
+      HEADER_SIZE + (name_length != INVALID_STRING_LENGTH ? name_length : 0);
+  esp_zb_zcl_scenes_extension_field_t fields[MAX_FIELD_SETS];
+  size_t field_count = 0;
+  while (offset + FIELD_HEADER_SIZE <= length &&
+         field_count < MAX_FIELD_SETS) {
+    uint8_t field_length = payload[offset + 2];
+    if (offset + FIELD_HEADER_SIZE + field_length > length) break;
+
+    fields[field_count] = esp_zb_zcl_scenes_extension_field_t{
+        .cluster_id = read_u16(offset),
+        .length = field_length,
+        .extension_field_attribute_value_list =
+            const_cast<uint8_t*>(&payload[offset + FIELD_HEADER_SIZE]),
+        .next = nullptr,
+    };
+    if (field_count > 0) fields[field_count - 1].next = &fields[field_count];
+    field_count++;
+    offset += FIELD_HEADER_SIZE + field_length;
+  }
+
+  return scenes.add(read_u16(0), payload[2], transition_ms,
+                    field_count > 0 ? fields : nullptr,
+                    worker.get_state(index));
+}
+
+esp_err_t LightEndpoint::handle_store_scene(
+    const esp_zb_zcl_store_scene_message_t* msg) {
+  return scenes.store(msg->group_id, msg->scene_id, worker.get_state(index));
+}
+
+esp_err_t LightEndpoint::handle_recall_scene(
+    const esp_zb_zcl_recall_scene_message_t* msg) {
+  Scene scene;
+  esp_err_t err = scenes.recall(msg->group_id, msg->scene_id, msg->field_set,
+                                worker.get_state(index), &scene);
+  if (err != ESP_OK) {
+    log_warn("Unknown scene: group_id=%u, scene_id=%u", msg->group_id,
+             msg->scene_id);
+    return err;
+  }
+
+  const LightState& state = scene.state;
+  reporter.update(ESP_ZB_ZCL_CLUSTER_ID_ON_OFF,
+                  ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID, state.active);
+  reporter.update(ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL,
+                  ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID, state.level);
+  reporter.update(ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+                  ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_X_ID, state.color_x);
+  reporter.update(ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+                  ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_Y_ID, state.color_y);
+  reporter.update(ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+                  ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMPERATURE_ID,
+                  state.color_temperature);
+  report_hue_saturation(state.enhanced_hue, state.saturation);
+  report_color_mode(state.color_mode);
+  end_color_loop();
+
+  // Transition time is in tenths of a second
+  uint32_t transition_ms = msg->transition_time != SCENE_TRANSITION_DEFAULT
+                               ? msg->transition_time * 100
+                               : scene.transition_ms;
+
+  return post(StateChange{
+      .fields = STATE_FIELD_ALL | STATE_FIELD_RENDER,
+      .active = state.active,
+      .level = state.level,
+      .color_x = state.color_x,
+      .color_y = state.color_y,
+      .color_mode = state.color_mode,
+      .color_temperature = state.color_temperature,
+      .enhanced_hue = state.enhanced_hue,
+      .saturation = state.saturation,
+      .render = scene.render,
+      .transition_ms = transition_ms,
+  });
+}
+
@@ -0,0 +1,117 @@
+#ifndef LIGHT_ENDPOINT_HPP
+#define LIGHT_ENDPOINT_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "LightState.hpp"
+#include "LightWorker.hpp"
+#include "RenderScheduler.hpp"
+#include "ReportingManager.hpp"
+#include "SceneTable.hpp"
+#include "SingleLED.hpp"
+#include "Storage.hpp"
+#include "ZigbeeDevice.hpp"
+#include "esp_zigbee_core.h"
+
+// One light of the device: a Zigbee endpoint with its clusters and handlers,
+// a segment of the shared strip, and its own stored state and scenes. Light
+// index i is endpoint CONFIG_LIGHT_ENDPOINT + i.
+//
+// Handlers are static and find the light by the endpoint a message is
+// addressed to, so every light shares the same compile-time action table.
+class LightEndpoint {
+ public:
+  LightEndpoint(uint8_t index, RenderScheduler& scheduler, LightWorker& worker,
+                const LightState& defaults);
+
+  // Joins the scheduler and writes the boot frame, before NVS is initialized
+  esp_err_t init_led();
+  // Loads the stored state and scenes and reconciles the LED with them
+  esp_err_t load();
+  // Registers the endpoint, its handlers and reports. setup_extra adds any
+  // clusters besides the light's own.
+  esp_err_t start(ClustersSetupHandler setup_extra = nullptr);
+
+  uint8_t get_endpoint();
+  SingleLED& get_led();
+
+ private:
+  // Parameters of Color Loop Set, kept between commands like the attributes
+  struct ColorLoop {
+    bool active;
+    // Color Loop Direction 0 decrements the hue
+    bool reverse;
+    uint16_t time_s;
+  };
+
+  // A Move to command with a transition time, which the stack runs by
+  // writing intermediate values. The light fades to the target over the
+  // transition time instead of following the steps.
+  struct CommandTransition {
+    enum class Stage { NONE, PENDING, RUNNING };
+
+    Stage stage;
+    StateChange target;
+    uint32_t transition_ms;
+    int64_t received_us;
+    // The values the stack has stepped to, shown if the command is stopped
+    StateChange stepped;
+  };
+
+  static std::array<LightEndpoint*, MAX_LIGHTS> lights;
+  static LightEndpoint* find(uint8_t endpoint);
+
+  template <typename T, esp_err_t (LightEndpoint::*Handler)(const T*)>
+  static esp_err_t dispatch(const T* msg);
+  template <esp_err_t (LightEndpoint::*Handler)(const AttributeBatch&)>
+  static esp_err_t dispatch_batch(const AttributeBatch& batch);
+  template <size_t Index>
+  static void dispatch_identify(uint8_t identify_on);
+  static esp_zb_identify_notify_callback_t get_identify_handler(size_t index);
+  static void dispatch_command(void* context, uint16_t cluster_id,
+                               uint8_t command_id, const uint8_t* payload,
+                               size_t length);
+
+  esp_err_t setup_clusters(esp_zb_cluster_list_t* clusters);
+  esp_err_t setup_reporting();
+
+  esp_err_t post(StateChange change);
+  esp_err_t post_step(CommandTransition& command, const StateChange& change);
+  void start_command(CommandTransition& command, const StateChange& target,
+                     uint16_t transition_time);
+  void interrupt_command(CommandTransition& command);
+  void report_color_mode(ColorMode mode);
+  void report_hue_saturation(uint16_t enhanced_hue, uint8_t saturation);
+  void set_color_mode_attributes(ColorMode mode);
+  void end_color_loop();
+
+  void handle_command(uint16_t cluster_id, uint8_t command_id,
+                      const uint8_t* payload, size_t length);
+  esp_err_t handle_on_off(const esp_zb_zcl_set_attr_value_message_t* msg);
+  esp_err_t handle_level(const esp_zb_zcl_set_attr_value_message_t* msg);
+  esp_err_t handle_color(const AttributeBatch& batch);
+  esp_err_t handle_color_loop(const AttributeBatch& batch);
+  esp_err_t handle_identify_effect(
+      const esp_zb_zcl_identify_effect_message_t* msg);
+  void handle_identify(uint8_t identify_on);
+  esp_err_t handle_add_scene(uint8_t command_id, const uint8_t* payload,
+                             size_t length);
+  esp_err_t handle_store_scene(const esp_zb_zcl_store_scene_message_t* msg);
+  esp_err_t handle_recall_scene(const esp_zb_zcl_recall_scene_message_t* msg);
+
+  const uint8_t index;
+  const uint8_t endpoint;
+  LightWorker& worker;
+  SingleLED led;
+  Storage storage;
+  SceneTable scenes;
+  ZigbeeDevice device;
+  ReportingManager reporter;
+  ColorLoop color_loop;
+  CommandTransition level_command;
+  CommandTransition color_command;
+};
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef LIGHT_STATE_HPP
+#define LIGHT_STATE_HPP
+
+#include <cstdint>
+
+// ZCL color modes, the values of the Enhanced Color Mode attribute. The Color
+// Mode attribute has the same values, except that enhanced hue shows as
+// HUE_SATURATION.
+enum class ColorMode : uint8_t {
+  HUE_SATURATION = 0,
+  XY = 1,
+  TEMPERATURE = 2,
+  ENHANCED_HUE_SATURATION = 3,
+};
+
+// Value of the Color Mode attribute for a mode
+constexpr uint8_t color_mode_attribute(ColorMode mode) {
+  return mode == ColorMode::ENHANCED_HUE_SATURATION
+             ? static_cast<uint8_t>(ColorMode::HUE_SATURATION)
+             : static_cast<uint8_t>(mode);
+}
+
+// Light state in ZCL units
+struct LightState {
+  bool active;
+  uint8_t level;
+  uint16_t color_x;
+  uint16_t color_y;
+  ColorMode color_mode = ColorMode::XY;
+  // Mireds, shown in ColorMode::TEMPERATURE
+  uint16_t color_temperature;
+  // Shown in the hue modes. Hue is kept in enhanced hue units, the 8-bit
+  // Current Hue is its high byte.
+  uint16_t enhanced_hue;
+  uint8_t saturation;
+
+  bool operator==(const LightState& other) const = default;
+};
+
+#endif
@@ -0,0 +1,196 @@
+#include "LightWorker.hpp"
+
+#include "Log.hpp"
+#include "esp_zigbee_core.h"
+
+constexpr char TASK_NAME[] = "LightWorker";
+
+LightWorker* LightWorker::show_scheduled = nullptr;
+
+LightWorker::LightWorker(RenderScheduler& scheduler)
+    : scheduler(scheduler),
+      lights{},
+      light_count(0),
+      task_handle(nullptr) {}
+
+esp_err_t LightWorker::add_light(SingleLED& led, Storage& storage) {
+  if (light_count == lights.size()) return ESP_ERR_NO_MEM;
+
+  lights[light_count++] = Light{
+      .led = &led,
+      .storage = &storage,
+      .posted = storage.get_state(),
+  };
+  return ESP_OK;
+}
+
+esp_err_t LightWorker::start() {
+#if defined(CONFIG_LIGHT_RENDER_TASK) && defined(CONFIG_STATIC_ALLOCATION)
+  task_handle = xTaskCreateStatic(task, TASK_NAME, TASK_STACK_SIZE, this,
+                                  CONFIG_LIGHT_RENDER_TASK_PRIORITY, task_stack,
+                                  &task_buffer);
+  return (task_handle != nullptr) ? ESP_OK : ESP_FAIL;
+#elif defined(CONFIG_LIGHT_RENDER_TASK)
+  BaseType_t result =
+      xTaskCreate(task, TASK_NAME, TASK_STACK_SIZE, this,
+                  CONFIG_LIGHT_RENDER_TASK_PRIORITY, &task_handle);
+  return (result == pdPASS) ? ESP_OK : ESP_FAIL;
+#else
+  return ESP_OK;
+#endif
+}
+
+esp_err_t LightWorker::post(const StateChange& change) {
+  if (change.light >= light_count) return ESP_ERR_INVALID_ARG;
+
+#ifdef CONFIG_LIGHT_RENDER_TASK
+  if (!queue.push(change)) return ESP_ERR_NO_MEM;
+  merge(lights[change.light].posted, change);
+
+  xTaskNotifyGive(task_handle);
+  return ESP_OK;
+#else
+  merge(lights[change.light].posted, change);
+  esp_err_t err = apply(&change, 1);
+  if (err != ESP_OK) return err;
+
+  // Runs on the Zigbee task once the current command has been processed, so
+  // a command to several lights, e.g. a group multicast, is shown at once
+  if (show_scheduled == nullptr) {
+    show_scheduled = this;
+    esp_zb_scheduler_alarm(show_pending, 0, 0);
+  }
+  return ESP_OK;
+#endif
+}
+
+LightState LightWorker::get_state(uint8_t light) {
+  return light < light_count ? lights[light].posted : LightState{};
+}
+
+TaskHandle_t LightWorker::get_task_handle() { return task_handle; }
+
+// PRIVATE METHODS
+void LightWorker::show_pending(uint8_t param) {
+  LightWorker* worker = show_scheduled;
+  show_scheduled = nullptr;
+
+  esp_err_t err = worker->scheduler.show();
+  if (err != ESP_OK) {
+    log_error("Error showing light state: %s", esp_err_to_name(err));
+  }
+}
+
+void LightWorker::task(void* pvParameters) {
+  auto* worker = static_cast<LightWorker*>(pvParameters);
+  auto& batch = worker->batch;
+
+  while (true) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    size_t count = 0;
+    while (count < batch.size() && worker->queue.pop(&batch[count])) {
+      count++;
+    }
+    if (count == 0) continue;
+
+    // Leave the rest for the next iteration
+    if (count == batch.size()) xTaskNotifyGive(worker->task_handle);
+
+    esp_err_t err = worker->apply(batch.data(), count);
+    if (err == ESP_OK) err = worker->scheduler.show();
+    if (err != ESP_OK) {
+      log_error("Error applying light state: %s", esp_err_to_name(err));
+    }
+  }
+}
+
+void LightWorker::merge(LightState& state, const StateChange& change) {
+  if (change.fields & STATE_FIELD_ACTIVE) state.active = change.active;
+  if (change.fields & STATE_FIELD_LEVEL) state.level = change.level;
+  if (change.fields & STATE_FIELD_COLOR_X) state.color_x = change.color_x;
+  if (change.fields & STATE_FIELD_COLOR_Y) state.color_y = change.color_y;
+  if (change.fields & STATE_FIELD_COLOR_MODE) {
+    state.color_mode = change.color_mode;
+  }
+  if (change.fields & STATE_FIELD_COLOR_TEMPERATURE) {
+    state.color_temperature = change.color_temperature;
+  }
+  if (change.fields & STATE_FIELD_HUE) {
+    state.enhanced_hue = change.enhanced_hue;
+  }
+  if (change.fields & STATE_FIELD_SATURATION) {
+    state.saturation = change.saturation;
+  }
+}
+
+esp_err_t LightWorker::apply(const StateChange* changes, size_t count) {
+  for (uint8_t i = 0; i < light_count; i++) {
+    esp_err_t err = apply_light(i, changes, count);
+    if (err != ESP_OK) return err;
+  }
+
+  return ESP_OK;
+}
+
+esp_err_t LightWorker::apply_light(uint8_t index, const StateChange* changes,
+                                   size_t count) {
+  SingleLED& led = *lights[index].led;
+  Storage& storage = *lights[index].storage;
+
+  LightState current = led.get_state();
+  LightState state = current;
+
+  // Queued changes are merged, so the LED refreshes and storage persists
+  // once no matter how many changes arrived in the meantime. A render only
+  // stays valid if no later change touched the state, and an effect only
+  // starts if no later change set a new state.
+  const StateChange* rendered = nullptr;
+  const StateChange* effect = nullptr;
+  bool explicit_change = false;
+  uint32_t transition_ms = TRANSITION_AUTO;
+  for (size_t i = 0; i < count; i++) {
+    const StateChange& change = changes[i];
+    if (change.light != index) continue;
+
+    merge(state, change);
+    // The transition of the latest change to the state applies
+    if (change.fields & STATE_FIELD_ALL) {
+      transition_ms = change.fields & STATE_FIELD_TRANSITION
+                          ? change.transition_ms
+                          : TRANSITION_AUTO;
+    }
+    if (change.fields & STATE_FIELD_RENDER) {
+      rendered = &change;
+    } else if (change.fields & STATE_FIELD_ALL) {
+      rendered = nullptr;
+    }
+    if (change.fields & STATE_FIELD_EFFECT) {
+      effect = &change;
+    } else if (change.fields & STATE_FIELD_ALL) {
+      effect = nullptr;
+      explicit_change = true;
+    }
+  }
+
+  // Nothing changed is not applied, e.g. the stack echoing the color mode of
+  // a command that was already applied
+  if (rendered != nullptr || state != current) {
+    esp_err_t err = storage.set_state(state);
+    if (err != ESP_OK) return err;
+
+    err = rendered != nullptr
+              ? led.set_rendered_state(state, rendered->render,
+                                       rendered->transition_ms)
+              : led.set_state(state, transition_ms);
+    if (err != ESP_OK) return err;
+  } else if (explicit_change && effect == nullptr &&
+             led.get_effect() != Effect::NONE) {
+    // It still ends a running effect, e.g. On while a color loop runs
+    return led.start_effect(EffectRequest{.effect = Effect::NONE});
+  }
+
+  if (effect != nullptr) return led.start_effect(effect->effect);
+
+  return ESP_OK;
+}
@@ -0,0 +1,117 @@
+#ifndef LIGHT_WORKER_HPP
+#define LIGHT_WORKER_HPP
+
+#include <array>
+#include <cstdint>
+
+#include "LightState.hpp"
+#include "RenderScheduler.hpp"
+#include "SingleLED.hpp"
+#include "SpscQueue.hpp"
+#include "Storage.hpp"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+constexpr uint16_t STATE_FIELD_ACTIVE = 1 << 0;
+constexpr uint16_t STATE_FIELD_LEVEL = 1 << 1;
+constexpr uint16_t STATE_FIELD_COLOR_X = 1 << 2;
+constexpr uint16_t STATE_FIELD_COLOR_Y = 1 << 3;
+constexpr uint16_t STATE_FIELD_COLOR_MODE = 1 << 4;
+constexpr uint16_t STATE_FIELD_COLOR_TEMPERATURE = 1 << 5;
+constexpr uint16_t STATE_FIELD_HUE = 1 << 6;
+constexpr uint16_t STATE_FIELD_SATURATION = 1 << 7;
+constexpr uint16_t STATE_FIELD_ALL =
+    STATE_FIELD_ACTIVE | STATE_FIELD_LEVEL | STATE_FIELD_COLOR_X |
+    STATE_FIELD_COLOR_Y | STATE_FIELD_COLOR_MODE |
+    STATE_FIELD_COLOR_TEMPERATURE | STATE_FIELD_HUE | STATE_FIELD_SATURATION;
+// A complete state shown from its precomputed render, e.g. a recalled scene
+constexpr uint16_t STATE_FIELD_RENDER = 1 << 8;
+// Not part of the state: starts or stops an effect over it. Any later change
+// of the state cancels the effect.
+constexpr uint16_t STATE_FIELD_EFFECT = 1 << 9;
+// The state change fades over transition_ms, e.g. the transition time of a
+// Move to Level command. Without it the LED uses TRANSITION_AUTO.
+constexpr uint16_t STATE_FIELD_TRANSITION = 1 << 10;
+
+// Partial light state update, fields marks which values are set
+struct StateChange {
+  // Index of the light, see LightWorker::add_light()
+  uint8_t light;
+  uint16_t fields;
+  bool active;
+  uint8_t level;
+  uint16_t color_x;
+  uint16_t color_y;
+  ColorMode color_mode;
+  uint16_t color_temperature;
+  // Enhanced hue units
+  uint16_t enhanced_hue;
+  uint8_t saturation;
+  // Only with STATE_FIELD_RENDER
+  LightRender render;
+  // Only with STATE_FIELD_RENDER or STATE_FIELD_TRANSITION
+  uint32_t transition_ms;
+  // Only with STATE_FIELD_EFFECT
+  EffectRequest effect;
+};
+
+// Applies state changes to the lights and their storage. With
+// CONFIG_LIGHT_RENDER_TASK the changes are queued and applied by a dedicated
+// task, so Zigbee callbacks don't wait for LED refreshes or flash commits.
+// Changes to any number of lights applied together are shown with one strip
+// refresh: the queued ones of a task wakeup, otherwise those of one Zigbee
+// command.
+class LightWorker {
+ public:
+  LightWorker(RenderScheduler& scheduler);
+  // Lights must be added before start(), in the order of their indices
+  esp_err_t add_light(SingleLED& led, Storage& storage);
+  esp_err_t start();
+
+  // Must only be called from a single task (the Zigbee task)
+  esp_err_t post(const StateChange& change);
+
+  // State of a light with every change posted so far, which the LED shows
+  // once the worker applied them. Unlike Storage it is never behind a change
+  // still in the queue. Must only be called from the task that posts.
+  LightState get_state(uint8_t light);
+
+  // Null when the render task is disabled
+  TaskHandle_t get_task_handle();
+
+ private:
+  static constexpr uint32_t TASK_STACK_SIZE = 3072;
+  // Room for a change to every light from a few commands in a row
+  static constexpr size_t QUEUE_SIZE = MAX_LIGHTS > 2 ? 64 : 16;
+
+  struct Light {
+    SingleLED* led;
+    Storage* storage;
+    // Owned by the posting task
+    LightState posted;
+  };
+
+  // Worker with a show scheduled on the Zigbee task, without the render task
+  static LightWorker* show_scheduled;
+  static void show_pending(uint8_t param);
+  static void task(void* pvParameters);
+  static void merge(LightState& state, const StateChange& change);
+
+  esp_err_t apply(const StateChange* changes, size_t count);
+  esp_err_t apply_light(uint8_t index, const StateChange* changes,
+                        size_t count);
+
+  RenderScheduler& scheduler;
+  std::array<Light, MAX_LIGHTS> lights;
+  uint8_t light_count;
+  SpscQueue<StateChange, QUEUE_SIZE> queue;
+  // Drained by the task, kept off its stack
+  std::array<StateChange, QUEUE_SIZE> batch;
+  TaskHandle_t task_handle;
+#ifdef CONFIG_STATIC_ALLOCATION
+  StackType_t task_stack[TASK_STACK_SIZE];
+  StaticTask_t task_buffer;
+#endif
+};
+
+#endif
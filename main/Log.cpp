@@ -0,0 +1,153 @@
+#include "Log.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+#include "esp_timer.h"
+
+constexpr char TASK_NAME[] = "DeferredLog";
+constexpr uint32_t TASK_PRIORITY = 1;
+constexpr uint32_t FLUSH_INTERVAL_MS = 50;
+
+constexpr char LEVEL_LETTERS[] = {'-', 'E', 'W', 'I', 'D'};
+
+// Longest printf conversion spec we pass through, e.g. "%-08lu"
+constexpr size_t MAX_SPEC_LENGTH = 16;
+
+// Globally accessible singleton instance
+DeferredLog& Log = DeferredLog::instance();
+
+// Private singleton constructor
+DeferredLog::DeferredLog() : task_handle(nullptr) {}
+
+// Singleton instance accessor
+DeferredLog& DeferredLog::instance() {
+  static DeferredLog instance;
+  return instance;
+}
+
+// PUBLIC METHODS
+esp_err_t DeferredLog::start() {
+#if defined(CONFIG_APP_LOG_DEFERRED) && defined(CONFIG_STATIC_ALLOCATION)
+  task_handle = xTaskCreateStatic(task, TASK_NAME, TASK_STACK_SIZE, this,
+                                  TASK_PRIORITY, task_stack, &task_buffer);
+  return (task_handle != nullptr) ? ESP_OK : ESP_FAIL;
+#elif defined(CONFIG_APP_LOG_DEFERRED)
+  BaseType_t result = xTaskCreate(task, TASK_NAME, TASK_STACK_SIZE, this,
+                                  TASK_PRIORITY, &task_handle);
+  return (result == pdPASS) ? ESP_OK : ESP_FAIL;
+#else
+  return ESP_OK;
+#endif
+}
+
+size_t DeferredLog::flush() {
+  size_t count = 0;
+
+#ifdef CONFIG_APP_LOG_DEFERRED
+  LogRecord record;
+  while (queue.pop(&record)) {
+    print(record);
+    count++;
+  }
+
+  uint32_t dropped = this->dropped.exchange(0, std::memory_order_relaxed);
+  if (dropped > 0) {
+    printf("W Log buffer full, dropped %lu records\n",
+           static_cast<unsigned long>(dropped));
+  }
+#endif
+
+  return count;
+}
+
+TaskHandle_t DeferredLog::get_task_handle() { return task_handle; }
+
+// PRIVATE METHODS
+void DeferredLog::task(void* pvParameters) {
+  auto* log = static_cast<DeferredLog*>(pvParameters);
+
+  // Polling keeps writers from paying for a task notification
+  while (true) {
+    vTaskDelay(pdMS_TO_TICKS(FLUSH_INTERVAL_MS));
+    log->flush();
+  }
+}
+
+void DeferredLog::submit(const LogRecord& record) {
+  LogRecord stamped = record;
+  stamped.time_us = static_cast<uint32_t>(esp_timer_get_time());
+
+#ifdef CONFIG_APP_LOG_DEFERRED
+  if (!queue.push(stamped)) dropped.fetch_add(1, std::memory_order_relaxed);
+#else
+  print(stamped);
+#endif
+}
+
+void DeferredLog::print(const LogRecord& record) {
+  printf("%c (%lu) ", LEVEL_LETTERS[static_cast<size_t>(record.level)],
+         static_cast<unsigned long>(record.time_us / 1000));
+
+  // Print literal text as is and each conversion with its argument read back
+  // as the type the conversion expects
+  const char* text = record.format;
+  size_t arg = 0;
+  while (*text != '\0') {
+    const char* percent = strchr(text, '%');
+    if (percent == nullptr) {
+      fputs(text, stdout);
+      break;
+    }
+    fwrite(text, 1, percent - text, stdout);
+
+    size_t length = strcspn(percent + 1, "diouxXcsp%") + 2;
+    if (percent[length - 1] == '\0' || length >= MAX_SPEC_LENGTH) {
+      fputs(percent, stdout);
+      break;
+    }
+    text = percent + length;
+
+    char spec[MAX_SPEC_LENGTH];
+    memcpy(spec, percent, length);
+    spec[length] = '\0';
+
+    char conversion = spec[length - 1];
+    if (conversion == '%') {
+      putchar('%');
+      continue;
+    }
+    if (arg == record.arg_count) {
+      fputs(spec, stdout);
+      continue;
+    }
+
+    uintptr_t value = record.args[arg++];
+    bool is_long = spec[length - 2] == 'l';
+    switch (conversion) {
+      case 's':
+        printf(spec, reinterpret_cast<const char*>(value));
+        break;
+      case 'p':
+        printf(spec, reinterpret_cast<void*>(value));
+        break;
+      case 'd':
+      case 'i':
+        if (is_long) {
+          printf(spec, static_cast<long>(static_cast<intptr_t>(value)));
+        } else {
+          printf(spec, static_cast<int>(value));
+        }
+        break;
+      default:
+        if (is_long) {
+          printf(spec, static_cast<unsigned long>(value));
+        } else {
+          printf(spec, static_cast<unsigned>(value));
+        }
+        break;
+    }
+  }
+
+  putchar('\n');
+}
@@ -0,0 +1,146 @@
+#ifndef LOG_HPP
+#define LOG_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include "MpscQueue.hpp"
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+
+enum class LogLevel : uint8_t { NONE, ERROR, WARN, INFO, DEBUG };
+
+// Calls above this level are compiled out
+constexpr LogLevel APP_LOG_LEVEL = static_cast<LogLevel>(CONFIG_APP_LOG_LEVEL);
+
+constexpr size_t LOG_MAX_ARGS = 4;
+
+// A log call as it is buffered. The format string pointer doubles as the
+// format ID: it points to the literal in flash, so formatting can be left
+// for later. Arguments are stored raw and decoded by the format string.
+struct LogRecord {
+  const char* format;
+  uint32_t time_us;
+  LogLevel level;
+  uint8_t arg_count;
+  uintptr_t args[LOG_MAX_ARGS];
+};
+
+// Collects log records in a lock-free ring buffer and formats them on a
+// low-priority task. Without CONFIG_APP_LOG_DEFERRED records are formatted
+// and printed straight away.
+class DeferredLog {
+ public:
+  esp_err_t start();
+
+  // Format strings use printf conversions of up to 32 bits, and %s arguments
+  // must outlive the record (literals and esp_err_to_name() results do)
+  template <typename... Args>
+  void write(LogLevel level, const char* format, Args... args);
+
+  // Formats and prints the buffered records, returns how many it printed
+  size_t flush();
+
+  // Null when deferred logging is disabled
+  TaskHandle_t get_task_handle();
+
+  // Singleton instance accessor
+  static DeferredLog& instance();
+
+  // Prevent singleton copying
+  DeferredLog(const DeferredLog&) = delete;
+  DeferredLog& operator=(const DeferredLog&) = delete;
+
+  // Prevent singleton moving
+  DeferredLog(DeferredLog&&) = delete;
+  DeferredLog& operator=(DeferredLog&&) = delete;
+
+ private:
+  static constexpr uint32_t TASK_STACK_SIZE = 3072;
+
+  // Private singleton constructor
+  DeferredLog();
+
+  template <typename T>
+  static uintptr_t to_arg(T value);
+
+  static void task(void* pvParameters);
+
+  void submit(const LogRecord& record);
+  void print(const LogRecord& record);
+
+  TaskHandle_t task_handle;
+#ifdef CONFIG_APP_LOG_DEFERRED
+  MpscQueue<LogRecord, CONFIG_APP_LOG_BUFFER_RECORDS> queue;
+  std::atomic<uint32_t> dropped{0};
+#endif
+#if defined(CONFIG_APP_LOG_DEFERRED) && defined(CONFIG_STATIC_ALLOCATION)
+  StackType_t task_stack[TASK_STACK_SIZE];
+  StaticTask_t task_buffer;
+#endif
+};
+
+extern DeferredLog& Log;
+
+template <typename... Args>
+void DeferredLog::write(LogLevel level, const char* format, Args... args) {
+  static_assert(sizeof...(Args) <= LOG_MAX_ARGS, "Too many log arguments");
+
+  LogRecord record = {
+      .format = format,
+      .time_us = 0,
+      .level = level,
+      .arg_count = sizeof...(Args),
+      .args = {to_arg(args)...},
+  };
+  submit(record);
+}
+
+template <typename T>
+uintptr_t DeferredLog::to_arg(T value) {
+  if constexpr (std::is_pointer_v<T>) {
+    return reinterpret_cast<uintptr_t>(value);
+  } else {
+    static_assert(std::is_integral_v<T> || std::is_enum_v<T>,
+                  "Log arguments must be integers, enums or pointers");
+    static_assert(sizeof(T) <= sizeof(uint32_t),
+                  "Log arguments must fit in 32 bits");
+    // Sign-extend, so that %ld reads negative values back on 64-bit hosts
+    if constexpr (std::is_signed_v<T>) {
+      return static_cast<uintptr_t>(static_cast<intptr_t>(value));
+    } else {
+      return static_cast<uintptr_t>(value);
+    }
+  }
+}
+
+template <LogLevel level, typename... Args>
+inline void log_write(const char* format, Args... args) {
+  if constexpr (level <= APP_LOG_LEVEL) Log.write(level, format, args...);
+}
+
+template <typename... Args>
+inline void log_error(const char* format, Args... args) {
+  log_write<LogLevel::ERROR>(format, args...);
+}
+
+template <typename... Args>
+inline void log_warn(const char* format, Args... args) {
+  log_write<LogLevel::WARN>(format, args...);
+}
+
+template <typename... Args>
+inline void log_info(const char* format, Args... args) {
+  log_write<LogLevel::INFO>(format, args...);
+}
+
+template <typename... Args>
+inline void log_debug(const char* format, Args... args) {
+  log_write<LogLevel::DEBUG>(format, args...);
+}
+
+#endif
@@ -0,0 +1,126 @@
+#include "MemoryMonitor.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#include "esp_system.h"
+#include "sdkconfig.h"
+
+#ifdef CONFIG_STATIC_ALLOCATION
+static std::atomic<bool> heap_locked(false);
+
+static void* guarded_alloc(size_t size, size_t alignment = 0) {
+  if (heap_locked.load(std::memory_order_relaxed)) {
+    printf("Heap allocation of %u bytes after initialization\n",
+           static_cast<unsigned>(size));
+    abort();
+  }
+  if (alignment == 0) return malloc(size);
+  // aligned_alloc takes a size that is a multiple of the alignment
+  return aligned_alloc(alignment, (size + alignment - 1) & ~(alignment - 1));
+}
+
+// Replacements of the global allocation functions, so that every C++
+// allocation in the firmware goes through the guard. The std::align_val_t
+// overloads are for types aligned beyond the default.
+void* operator new(size_t size) {
+  void* ptr = guarded_alloc(size);
+  if (ptr == nullptr) abort();
+  return ptr;
+}
+
+void* operator new[](size_t size) { return operator new(size); }
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  return guarded_alloc(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+  return guarded_alloc(size);
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+  void* ptr = guarded_alloc(size, static_cast<size_t>(alignment));
+  if (ptr == nullptr) abort();
+  return ptr;
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+  return operator new(size, alignment);
+}
+
+void* operator new(size_t size, std::align_val_t alignment,
+                   const std::nothrow_t&) noexcept {
+  return guarded_alloc(size, static_cast<size_t>(alignment));
+}
+
+void* operator new[](size_t size, std::align_val_t alignment,
+                     const std::nothrow_t&) noexcept {
+  return guarded_alloc(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void* ptr) noexcept { free(ptr); }
+void operator delete[](void* ptr) noexcept { free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { free(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { free(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { free(ptr); }
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept {
+  free(ptr);
+}
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept {
+  free(ptr);
+}
+#endif
+
+MemoryMonitor::MemoryMonitor() : tasks{}, task_count(0), timer(nullptr) {}
+
+esp_err_t MemoryMonitor::add_task(TaskHandle_t task) {
+  if (task == nullptr) return ESP_OK;
+  if (task_count == MAX_MONITORED_TASKS) return ESP_ERR_NO_MEM;
+
+  tasks[task_count++] = task;
+  return ESP_OK;
+}
+
+esp_err_t MemoryMonitor::start(uint32_t interval_ms) {
+  if (interval_ms == 0) return ESP_OK;
+
+  esp_timer_create_args_t timer_args = {
+      .callback = timer_callback,
+      .arg = this,
+      .dispatch_method = ESP_TIMER_TASK,
+      .name = "memory_report",
+      .skip_unhandled_events = true,
+  };
+  esp_err_t err = esp_timer_create(&timer_args, &timer);
+  if (err != ESP_OK) return err;
+
+  return esp_timer_start_periodic(timer, interval_ms * 1000ULL);
+}
+
+void MemoryMonitor::report() {
+  printf("Memory: free heap=%lu, min free heap=%lu\n",
+         static_cast<unsigned long>(esp_get_free_heap_size()),
+         static_cast<unsigned long>(esp_get_minimum_free_heap_size()));
+
+  // ESP-IDF reports the high-water mark in bytes
+  for (uint8_t i = 0; i < task_count; i++) {
+    printf("Task %s: stack high-water mark=%u bytes\n",
+           pcTaskGetName(tasks[i]),
+           static_cast<unsigned>(uxTaskGetStackHighWaterMark(tasks[i])));
+  }
+}
+
+void MemoryMonitor::lock_heap() {
+#ifdef CONFIG_STATIC_ALLOCATION
+  heap_locked.store(true, std::memory_order_relaxed);
+#endif
+}
+
+// PRIVATE METHODS
+void MemoryMonitor::timer_callback(void* arg) {
+  static_cast<MemoryMonitor*>(arg)->report();
+}
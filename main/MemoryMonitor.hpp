@@ -0,0 +1,38 @@
+#ifndef MEMORY_MONITOR_HPP
+#define MEMORY_MONITOR_HPP
+
+#include <array>
+#include <cstdint>
+
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+constexpr size_t MAX_MONITORED_TASKS = 4;
+
+// Reports heap usage and task stack high-water marks, and guards against
+// heap allocations after initialization in static allocation mode
+class MemoryMonitor {
+ public:
+  MemoryMonitor();
+
+  // Ignores null handles, such as tasks that are disabled in the config
+  esp_err_t add_task(TaskHandle_t task);
+
+  // Prints a report every interval_ms, 0 disables the periodic report
+  esp_err_t start(uint32_t interval_ms);
+  void report();
+
+  // With CONFIG_STATIC_ALLOCATION any C++ heap allocation from now on aborts
+  void lock_heap();
+
+ private:
+  static void timer_callback(void* arg);
+
+  std::array<TaskHandle_t, MAX_MONITORED_TASKS> tasks;
+  uint8_t task_count;
+  esp_timer_handle_t timer;
+};
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef MPSC_QUEUE_HPP
+#define MPSC_QUEUE_HPP
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Lock-free ring buffer for any number of producer tasks and exactly one
+// consumer task. Each slot carries a sequence number that tells whether it is
+// free for the producer that claimed its position or holds an item for the
+// consumer, so producers only contend on claiming a position.
+template <typename T, size_t N>
+class MpscQueue {
+  static_assert(N > 0 && (N & (N - 1)) == 0, "N must be a power of two");
+
+ public:
+  MpscQueue() {
+    for (size_t i = 0; i < N; i++) {
+      slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  bool push(const T& item) {
+    size_t head = this->head.load(std::memory_order_relaxed);
+    Slot* slot;
+    while (true) {
+      slot = &slots[head & (N - 1)];
+      size_t sequence = slot->sequence.load(std::memory_order_acquire);
+      auto diff = static_cast<ptrdiff_t>(sequence - head);
+      if (diff == 0) {
+        if (this->head.compare_exchange_weak(head, head + 1,
+                                             std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        // The consumer hasn't freed this slot yet
+        return false;
+      } else {
+        head = this->head.load(std::memory_order_relaxed);
+      }
+    }
+
+    slot->item = item;
+    slot->sequence.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool pop(T* item) {
+    Slot& slot = slots[tail & (N - 1)];
+    size_t sequence = slot.sequence.load(std::memory_order_acquire);
+    if (sequence != tail + 1) return false;
+
+    *item = slot.item;
+    slot.sequence.store(tail + N, std::memory_order_release);
+    tail++;
+    return true;
+  }
+
+ private:
+  struct Slot {
+    std::atomic<size_t> sequence;
+    T item;
+  };
+
+  std::array<Slot, N> slots;
+  std::atomic<size_t> head{0};
+  // Only touched by the consumer
+  size_t tail = 0;
+};
+
+#endif
@@ -0,0 +1,30 @@
+#include "PartitionFlash.hpp"
+
+PartitionFlash::PartitionFlash(const char* label)
+    : label(label), partition(nullptr) {}
+
+esp_err_t PartitionFlash::init() {
+  partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                       ESP_PARTITION_SUBTYPE_ANY, label);
+  if (partition == nullptr) return ESP_ERR_NOT_FOUND;
+
+  return ESP_OK;
+}
+
+size_t PartitionFlash::get_size() { return partition->size; }
+
+size_t PartitionFlash::get_sector_size() { return partition->erase_size; }
+
+esp_err_t PartitionFlash::read(size_t offset, void* dst, size_t size) {
+  return esp_partition_read(partition, offset, dst, size);
+}
+
+esp_err_t PartitionFlash::write(size_t offset, const void* src, size_t size) {
+  return esp_partition_write(partition, offset, src, size);
+}
+
+esp_err_t PartitionFlash::erase_sector(size_t sector) {
+  size_t sector_size = partition->erase_size;
+  return esp_partition_erase_range(partition, sector * sector_size,
+                                   sector_size);
+}
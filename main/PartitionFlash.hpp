@@ -0,0 +1,25 @@
+#ifndef PARTITION_FLASH_HPP
+#define PARTITION_FLASH_HPP
+
+#include "Flash.hpp"
+#include "esp_partition.h"
+
+// Flash region backed by a data partition from the partition table
+class PartitionFlash : public Flash {
+ public:
+  PartitionFlash(const char* label);
+  esp_err_t init();
+
+  size_t get_size() override;
+  size_t get_sector_size() override;
+
+  esp_err_t read(size_t offset, void* dst, size_t size) override;
+  esp_err_t write(size_t offset, const void* src, size_t size) override;
+  esp_err_t erase_sector(size_t sector) override;
+
+ private:
+  const char* label;
+  const esp_partition_t* partition;
+};
+
+#endif
@@ -0,0 +1,137 @@
+#include "RenderScheduler.hpp"
+
+#include <cstdlib>
+
+#include "LatencyTrace.hpp"
+#include "Log.hpp"
+#include "SingleLED.hpp"
+
+constexpr int64_t FRAME_PERIOD_US = 1000000 / CONFIG_LIGHT_TRANSITION_FPS;
+
+RenderScheduler::RenderScheduler(const int gpio_pin,
+                                 const uint16_t pixel_count)
+    : strip(gpio_pin, pixel_count),
+      lights{},
+      light_count(0),
+      frame_timer(nullptr),
+      mutex(nullptr),
+      last_frame(0),
+      frame_stats{},
+      first_show_us(-1) {}
+
+// PUBLIC METHODS
+esp_err_t RenderScheduler::init() {
+  esp_err_t err = strip.init();
+  if (err != ESP_OK) return err;
+
+  mutex = xSemaphoreCreateMutexStatic(&mutex_buffer);
+
+  esp_timer_create_args_t timer_args = {
+      .callback = frame_timer_callback,
+      .arg = this,
+      .dispatch_method = ESP_TIMER_TASK,
+      .name = "led_frame",
+      .skip_unhandled_events = true,
+  };
+  err = esp_timer_create(&timer_args, &frame_timer);
+  if (err != ESP_OK) return err;
+
+  return ESP_OK;
+}
+
+esp_err_t RenderScheduler::add_light(SingleLED* light) {
+  if (light_count == lights.size()) return ESP_ERR_NO_MEM;
+
+  lock();
+  lights[light_count++] = light;
+  unlock();
+
+  return ESP_OK;
+}
+
+void RenderScheduler::lock() { xSemaphoreTake(mutex, portMAX_DELAY); }
+
+void RenderScheduler::unlock() { xSemaphoreGive(mutex); }
+
+LEDStrip& RenderScheduler::get_strip() { return strip; }
+
+// Frames are needed while any light runs a transition or an effect, or
+// dithers between neighbouring values
+esp_err_t RenderScheduler::update_frame_timer() {
+  bool needed = false;
+  for (size_t i = 0; i < light_count && !needed; i++) {
+    needed = lights[i]->needs_frames();
+  }
+  bool running = esp_timer_is_active(frame_timer);
+
+  if (needed && !running) {
+    return esp_timer_start_periodic(frame_timer, FRAME_PERIOD_US);
+  }
+
+  if (!needed && running) {
+    esp_timer_stop(frame_timer);
+    last_frame = 0;
+  }
+
+  return ESP_OK;
+}
+
+esp_err_t RenderScheduler::show() {
+  lock();
+  // The commands since the last show changed nothing that will reach the
+  // LEDs, now or on the frame timer
+  if (!strip.is_dirty() && !esp_timer_is_active(frame_timer)) {
+    trace_command_dropped();
+  }
+  esp_err_t err = transmit();
+  unlock();
+
+  return err;
+}
+
+esp_err_t RenderScheduler::render_frame(int64_t now) {
+  lock();
+
+  if (last_frame != 0) {
+    int64_t jitter = std::llabs(now - last_frame - FRAME_PERIOD_US);
+    frame_stats.frames++;
+    frame_stats.total_jitter_us += jitter;
+    if (jitter > frame_stats.max_jitter_us) frame_stats.max_jitter_us = jitter;
+  }
+  last_frame = now;
+
+  esp_err_t err = ESP_OK;
+  for (size_t i = 0; i < light_count && err == ESP_OK; i++) {
+    err = lights[i]->render_frame();
+  }
+  if (err == ESP_OK) err = transmit();
+  if (err == ESP_OK) err = update_frame_timer();
+
+  unlock();
+  return err;
+}
+
+FrameStats RenderScheduler::get_frame_stats() { return frame_stats; }
+
+int64_t RenderScheduler::get_boot_to_light_us() { return first_show_us; }
+
+// PRIVATE METHODS
+void RenderScheduler::frame_timer_callback(void* arg) {
+  auto* scheduler = static_cast<RenderScheduler*>(arg);
+
+  esp_err_t err = scheduler->render_frame(esp_timer_get_time());
+  if (err != ESP_OK) {
+    log_error("Error rendering LED frame: %s", esp_err_to_name(err));
+  }
+}
+
+esp_err_t RenderScheduler::transmit() {
+  // A show with nothing written sends no frame, which doesn't light anything
+  bool sending = strip.is_dirty();
+  esp_err_t err = strip.show();
+  if (err != ESP_OK) return err;
+
+  if (sending && first_show_us < 0) first_show_us = esp_timer_get_time();
+
+  return ESP_OK;
+}
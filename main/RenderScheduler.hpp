@@ -0,0 +1,75 @@
+#ifndef RENDER_SCHEDULER_HPP
+#define RENDER_SCHEDULER_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "LEDStrip.hpp"
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "sdkconfig.h"
+
+constexpr size_t MAX_LIGHTS = CONFIG_LIGHT_ENDPOINT_COUNT;
+
+class SingleLED;
+
+struct FrameStats {
+  uint32_t frames;
+  int64_t max_jitter_us;
+  int64_t total_jitter_us;
+};
+
+// Drives the LED strip shared by all lights. Lights write their segment of
+// the framebuffer and the strip is transmitted once per show() or frame, in
+// a single RMT transaction however many lights changed. The frame timer runs
+// while any light needs frames.
+class RenderScheduler {
+ public:
+  RenderScheduler(const int gpio_pin, const uint16_t pixel_count);
+  esp_err_t init();
+
+  // Called by SingleLED::init()
+  esp_err_t add_light(SingleLED* light);
+
+  // Serializes the lights and the strip between the tasks changing lights
+  // and the frame timer
+  void lock();
+  void unlock();
+
+  // For the lights, with the lock held
+  LEDStrip& get_strip();
+  esp_err_t update_frame_timer();
+
+  // Transmits whatever the lights changed since the last show
+  esp_err_t show();
+
+  // Renders the next frame of every light and shows them. Called from the
+  // frame timer, now is the time of the frame in microseconds.
+  esp_err_t render_frame(int64_t now);
+  FrameStats get_frame_stats();
+
+  // Time since startup of the first frame sent to the strip, in
+  // microseconds, -1 before that. Startup is when esp_timer starts, the
+  // bootloader runs before it.
+  int64_t get_boot_to_light_us();
+
+ private:
+  static void frame_timer_callback(void* arg);
+
+  esp_err_t transmit();
+
+  LEDStrip strip;
+  std::array<SingleLED*, MAX_LIGHTS> lights;
+  size_t light_count;
+  esp_timer_handle_t frame_timer;
+  SemaphoreHandle_t mutex;
+  StaticSemaphore_t mutex_buffer;
+  int64_t last_frame;
+  FrameStats frame_stats;
+  int64_t first_show_us;
+};
+
+#endif
@@ -0,0 +1,252 @@
+#include "ReportingManager.hpp"
+
+#include <climits>
+#include <cstdlib>
+
+#include "Log.hpp"
+#include "esp_timer.h"
+
+constexpr int64_t NO_DEADLINE = INT64_MAX;
+
+// ZCL header of a Report Attributes frame: profile-wide, server to client,
+// without a Default Response
+constexpr uint8_t ZCL_FRAME_CONTROL_REPORT = 0x18;
+constexpr uint8_t ZCL_CMD_REPORT_ATTRIBUTES = 0x0a;
+constexpr size_t ZCL_HEADER_SIZE = 3;
+// Attribute ID, type and a value of at most 16 bits
+constexpr size_t MAX_RECORD_SIZE = 5;
+
+ReportingManager* ReportingManager::managers = nullptr;
+int64_t ReportingManager::poll_deadline = NO_DEADLINE;
+uint8_t ReportingManager::sequence = 0;
+
+static bool is_discrete(esp_zb_zcl_attr_type_t type) {
+  return type == ESP_ZB_ZCL_ATTR_TYPE_BOOL ||
+         type == ESP_ZB_ZCL_ATTR_TYPE_8BIT_ENUM;
+}
+
+static size_t value_size(esp_zb_zcl_attr_type_t type) {
+  return type == ESP_ZB_ZCL_ATTR_TYPE_U16 ? 2 : 1;
+}
+
+ReportingManager::ReportingManager(uint8_t endpoint)
+    : endpoint(endpoint),
+      attributes{},
+      attribute_count(0),
+      stats{},
+      next(nullptr) {}
+
+// PUBLIC METHODS
+esp_err_t ReportingManager::add_attribute(uint16_t cluster_id,
+                                          uint16_t attr_id,
+                                          esp_zb_zcl_attr_type_t type,
+                                          uint16_t value,
+                                          ReportingConfig defaults) {
+  if (attribute_count == MAX_REPORTED_ATTRIBUTES) return ESP_ERR_NO_MEM;
+
+  attributes[attribute_count] = ReportedAttribute{
+      .cluster_id = cluster_id,
+      .attr_id = attr_id,
+      .type = type,
+      .defaults = defaults,
+      .value = value,
+      .reported_value = value,
+      .reported_at = esp_timer_get_time(),
+      .changed = false,
+  };
+  if (attribute_count == 0) {
+    next = managers;
+    managers = this;
+  }
+  attribute_count++;
+
+  return ESP_OK;
+}
+
+esp_err_t ReportingManager::update(uint16_t cluster_id, uint16_t attr_id,
+                                   uint16_t value) {
+  for (uint8_t i = 0; i < attribute_count; i++) {
+    ReportedAttribute& attr = attributes[i];
+    if (attr.cluster_id != cluster_id || attr.attr_id != attr_id) continue;
+
+    if (attr.value == value) return ESP_OK;
+
+    // The stack reports the new value itself
+    if (is_configured(attr)) {
+      attr.value = value;
+      attr.reported_value = value;
+      attr.changed = false;
+      return ESP_OK;
+    }
+
+    // An unreported value is overwritten, e.g. a transition step
+    if (attr.changed) stats.coalesced++;
+    attr.value = value;
+    attr.changed = attr.value != attr.reported_value;
+
+    schedule_poll();
+    return ESP_OK;
+  }
+
+  return ESP_ERR_NOT_FOUND;
+}
+
+ReportingStats ReportingManager::get_stats() { return stats; }
+
+void ReportingManager::start_all() { schedule_poll(); }
+
+// PRIVATE METHODS
+void ReportingManager::poll_all(uint8_t param) {
+  poll_deadline = NO_DEADLINE;
+
+  int64_t now = esp_timer_get_time();
+  for (ReportingManager* manager = managers; manager != nullptr;
+       manager = manager->next) {
+    manager->poll(now);
+  }
+
+  schedule_poll();
+}
+
+// One alarm serves all managers, it is moved earlier when an update needs it
+void ReportingManager::schedule_poll() {
+  int64_t now = esp_timer_get_time();
+  int64_t deadline = NO_DEADLINE;
+  for (ReportingManager* manager = managers; manager != nullptr;
+       manager = manager->next) {
+    int64_t manager_deadline = manager->next_deadline(now);
+    if (manager_deadline < deadline) deadline = manager_deadline;
+  }
+  if (deadline >= poll_deadline) return;
+
+  if (poll_deadline != NO_DEADLINE) esp_zb_scheduler_alarm_cancel(poll_all, 0);
+  poll_deadline = deadline;
+
+  int64_t delay_us = deadline > now ? deadline - now : 0;
+  esp_zb_scheduler_alarm(poll_all, 0,
+                         static_cast<uint32_t>((delay_us + 999) / 1000));
+}
+
+bool ReportingManager::is_configured(const ReportedAttribute& attr) {
+  esp_zb_zcl_attr_location_info_t location = {};
+  location.endpoint_id = endpoint;
+  location.cluster_id = attr.cluster_id;
+  location.cluster_role = ESP_ZB_ZCL_CLUSTER_SERVER_ROLE;
+  location.manuf_code = ESP_ZB_ZCL_ATTR_NON_MANUFACTURER_SPECIFIC;
+  location.attr_id = attr.attr_id;
+  return esp_zb_zcl_find_reporting_info(location) != nullptr;
+}
+
+bool ReportingManager::is_due(const ReportedAttribute& attr, int64_t now) {
+  if (is_configured(attr)) return false;
+
+  const ReportingConfig& config = attr.defaults;
+  int64_t elapsed = now - attr.reported_at;
+  if (config.max_interval_s != 0 &&
+      elapsed >= config.max_interval_s * 1000000LL) {
+    return true;
+  }
+
+  return elapsed >= config.min_interval_s * 1000000LL && exceeds_change(attr);
+}
+
+bool ReportingManager::exceeds_change(const ReportedAttribute& attr) {
+  if (!attr.changed) return false;
+  if (is_discrete(attr.type) || attr.defaults.reportable_change == 0) {
+    return true;
+  }
+
+  int change = std::abs(attr.value - attr.reported_value);
+  return change >= attr.defaults.reportable_change;
+}
+
+int64_t ReportingManager::next_deadline(int64_t now) {
+  int64_t deadline = NO_DEADLINE;
+
+  for (uint8_t i = 0; i < attribute_count; i++) {
+    const ReportedAttribute& attr = attributes[i];
+    if (is_configured(attr)) continue;
+
+    const ReportingConfig& config = attr.defaults;
+    if (config.max_interval_s != 0) {
+      int64_t periodic = attr.reported_at + config.max_interval_s * 1000000LL;
+      if (periodic < deadline) deadline = periodic;
+    }
+
+    // Changes below the threshold only go out with other reports
+    if (exceeds_change(attr)) {
+      int64_t change = attr.reported_at + config.min_interval_s * 1000000LL;
+      if (change < deadline) deadline = change;
+    }
+  }
+
+  return deadline;
+}
+
+void ReportingManager::poll(int64_t now) {
+  for (uint8_t i = 0; i < attribute_count; i++) {
+    if (!is_due(attributes[i], now)) continue;
+
+    // Reports the other attributes of the cluster too, so the attributes of
+    // one cluster each poll are sent together
+    report_cluster(attributes[i].cluster_id, now);
+  }
+}
+
+void ReportingManager::report_cluster(uint16_t cluster_id, int64_t now) {
+  std::array<uint8_t, ZCL_HEADER_SIZE +
+                          MAX_REPORTED_ATTRIBUTES * MAX_RECORD_SIZE>
+      frame;
+  size_t size = 0;
+  frame[size++] = ZCL_FRAME_CONTROL_REPORT;
+  frame[size++] = sequence;
+  frame[size++] = ZCL_CMD_REPORT_ATTRIBUTES;
+
+  std::array<uint8_t, MAX_REPORTED_ATTRIBUTES> reported;
+  uint8_t reported_count = 0;
+  for (uint8_t i = 0; i < attribute_count; i++) {
+    const ReportedAttribute& attr = attributes[i];
+    if (attr.cluster_id != cluster_id || is_configured(attr)) continue;
+
+    // Pending changes below the threshold ride along once the minimum
+    // interval has passed, unchanged attributes only when periodic
+    bool ride_along =
+        attr.changed &&
+        now - attr.reported_at >= attr.defaults.min_interval_s * 1000000LL;
+    if (!is_due(attr, now) && !ride_along) continue;
+
+    frame[size++] = attr.attr_id & 0xff;
+    frame[size++] = attr.attr_id >> 8;
+    frame[size++] = attr.type;
+    frame[size++] = attr.value & 0xff;
+    if (value_size(attr.type) == 2) frame[size++] = attr.value >> 8;
+    reported[reported_count++] = i;
+  }
+  if (reported_count == 0) return;
+
+  // Without a destination the frame goes to the bindings of the cluster
+  esp_zb_apsde_data_req_t req = {};
+  req.dst_addr_mode = ESP_ZB_APS_ADDR_MODE_DST_ADDR_ENDP_NOT_PRESENT;
+  req.profile_id = ESP_ZB_AF_HA_PROFILE_ID;
+  req.cluster_id = cluster_id;
+  req.src_endpoint = endpoint;
+  req.asdu_length = size;
+  req.asdu = frame.data();
+  esp_err_t err = esp_zb_aps_data_request(&req);
+  if (err != ESP_OK) {
+    log_error("Error reporting attributes: cluster_id=%u, count=%u, %s",
+              cluster_id, reported_count, esp_err_to_name(err));
+    return;
+  }
+  sequence++;
+
+  for (uint8_t i = 0; i < reported_count; i++) {
+    ReportedAttribute& attr = attributes[reported[i]];
+    attr.reported_value = attr.value;
+    attr.reported_at = now;
+    attr.changed = false;
+  }
+
+  stats.reports++;
+  stats.attributes += reported_count;
+}
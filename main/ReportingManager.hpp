@@ -0,0 +1,88 @@
+#ifndef REPORTING_MANAGER_HPP
+#define REPORTING_MANAGER_HPP
+
+#include <array>
+#include <cstdint>
+
+#include "esp_zigbee_core.h"
+
+constexpr size_t MAX_REPORTED_ATTRIBUTES = 12;
+
+// ZCL reporting configuration of one attribute. A max_interval_s of 0
+// disables periodic reports, a reportable_change of 0 reports any change.
+struct ReportingConfig {
+  uint16_t min_interval_s;
+  uint16_t max_interval_s;
+  uint16_t reportable_change;
+};
+
+struct ReportingStats {
+  // Report Attributes frames sent, at most one per cluster and poll
+  uint32_t reports;
+  // Attribute records across those frames
+  uint32_t attributes;
+  // Changes that were overwritten before they were reported
+  uint32_t coalesced;
+};
+
+// Sends attribute reports for an endpoint to its bindings. Changes within
+// the minimum interval are coalesced into the next report, the attributes
+// of a cluster that changed are reported together in one Report Attributes
+// frame, and values the coordinator already has are never reported again
+// outside the maximum interval. Attributes that Configure Reporting set up
+// are reported by the stack itself, with the intervals and thresholds it
+// was given, and are left out here so that they are not reported twice.
+//
+// All methods must be called from the Zigbee task.
+class ReportingManager {
+ public:
+  ReportingManager(uint8_t endpoint);
+
+  // The current value is treated as already reported
+  esp_err_t add_attribute(uint16_t cluster_id, uint16_t attr_id,
+                          esp_zb_zcl_attr_type_t type, uint16_t value,
+                          ReportingConfig defaults);
+
+  // Records a new attribute value, reported once its interval allows
+  esp_err_t update(uint16_t cluster_id, uint16_t attr_id, uint16_t value);
+
+  ReportingStats get_stats();
+
+  // Starts the periodic reports of all managers once the stack is running
+  static void start_all();
+
+ private:
+  struct ReportedAttribute {
+    uint16_t cluster_id;
+    uint16_t attr_id;
+    esp_zb_zcl_attr_type_t type;
+    ReportingConfig defaults;
+    uint16_t value;
+    uint16_t reported_value;
+    int64_t reported_at;
+    bool changed;
+  };
+
+  // Managers with attributes, linked through next
+  static ReportingManager* managers;
+  static int64_t poll_deadline;
+  // ZCL sequence number of the next report
+  static uint8_t sequence;
+  static void poll_all(uint8_t param);
+  static void schedule_poll();
+
+  bool is_configured(const ReportedAttribute& attr);
+  bool is_due(const ReportedAttribute& attr, int64_t now);
+  bool exceeds_change(const ReportedAttribute& attr);
+  int64_t next_deadline(int64_t now);
+  void poll(int64_t now);
+  void report_cluster(uint16_t cluster_id, int64_t now);
+
+  const uint8_t endpoint;
+  std::array<ReportedAttribute, MAX_REPORTED_ATTRIBUTES> attributes;
+  uint8_t attribute_count;
+  ReportingStats stats;
+  ReportingManager* next;
+};
+
+#endif
@@ -0,0 +1,237 @@
+#include "SceneTable.hpp"
+
+#include <algorithm>
+
+#include "Color.hpp"
+#include "Log.hpp"
+
+// Leading attribute values of the extension field sets, see ZCL 3.7.2.4.2
+constexpr uint8_t ON_OFF_FIELDS_SIZE = 1;
+constexpr uint8_t LEVEL_FIELDS_SIZE = 1;
+constexpr uint8_t COLOR_FIELDS_SIZE = 4;
+
+// Offsets of the values after x and y in the Color Control extension fields,
+// the color loop attributes in between are not used
+constexpr uint8_t ENHANCED_HUE_OFFSET = 4;
+constexpr uint8_t SATURATION_OFFSET = 6;
+constexpr uint8_t COLOR_TEMPERATURE_OFFSET = 11;
+constexpr uint8_t ENHANCED_COLOR_MODE_OFFSET = 13;
+
+static uint16_t read_u16(const uint8_t* data) {
+  return static_cast<uint16_t>(data[0] | data[1] << 8);
+}
+
+static bool is_valid_mode(uint8_t mode) {
+  return mode <= static_cast<uint8_t>(ColorMode::ENHANCED_HUE_SATURATION);
+}
+
+static LightState apply_fields(
+    LightState state, const esp_zb_zcl_scenes_extension_field_t* field_set) {
+  for (const auto* field = field_set; field != nullptr; field = field->next) {
+    const uint8_t* values = field->extension_field_attribute_value_list;
+    if (values == nullptr) continue;
+
+    switch (field->cluster_id) {
+      case ESP_ZB_ZCL_CLUSTER_ID_ON_OFF:
+        if (field->length >= ON_OFF_FIELDS_SIZE) state.active = values[0] != 0;
+        break;
+      case ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL:
+        if (field->length >= LEVEL_FIELDS_SIZE) state.level = values[0];
+        break;
+      case ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL:
+        if (field->length >= COLOR_FIELDS_SIZE) {
+          state.color_x = read_u16(&values[0]);
+          state.color_y = read_u16(&values[2]);
+          state.color_mode = ColorMode::XY;
+        }
+        if (field->length > SATURATION_OFFSET) {
+          state.enhanced_hue = read_u16(&values[ENHANCED_HUE_OFFSET]);
+          state.saturation =
+              std::min(values[SATURATION_OFFSET], COLOR_MAX_LEVEL);
+        }
+        if (field->length >= COLOR_TEMPERATURE_OFFSET + sizeof(uint16_t)) {
+          state.color_temperature =
+              read_u16(&values[COLOR_TEMPERATURE_OFFSET]);
+        }
+        if (field->length > ENHANCED_COLOR_MODE_OFFSET) {
+          uint8_t mode = values[ENHANCED_COLOR_MODE_OFFSET];
+          if (is_valid_mode(mode)) {
+            state.color_mode = static_cast<ColorMode>(mode);
+          }
+        }
+        break;
+      default:
+        break;
+    }
+  }
+
+  return state;
+}
+
+SceneTable::SceneTable(Storage& storage)
+    : storage(storage), scenes{}, count(0) {}
+
+esp_err_t SceneTable::init() {
+  StoredScene stored[MAX_SCENES];
+  size_t stored_count;
+  esp_err_t err = storage.load_scenes(stored, &stored_count);
+  if (err != ESP_OK) return err;
+
+  for (size_t i = 0; i < stored_count; i++) {
+    LightState state = {
+        .active = stored[i].active != 0,
+        .level = stored[i].level,
+        .color_x = stored[i].color_x,
+        .color_y = stored[i].color_y,
+        .color_mode = is_valid_mode(stored[i].color_mode)
+                          ? static_cast<ColorMode>(stored[i].color_mode)
+                          : ColorMode::XY,
+        .color_temperature = stored[i].color_temperature,
+        .enhanced_hue = stored[i].enhanced_hue,
+        .saturation = stored[i].saturation,
+    };
+    scenes[i] = Scene{
+        .group_id = stored[i].group_id,
+        .scene_id = stored[i].scene_id,
+        .state = state,
+        .render = SingleLED::render_state(state),
+        .transition_ms = stored[i].transition_ms,
+    };
+  }
+  count = stored_count;
+
+  return ESP_OK;
+}
+
+esp_err_t SceneTable::store(uint16_t group_id, uint8_t scene_id,
+                            const LightState& state) {
+  const Scene* scene = find(group_id, scene_id);
+  return put(group_id, scene_id, state,
+             scene != nullptr ? scene->transition_ms : 0);
+}
+
+esp_err_t SceneTable::add(
+    uint16_t group_id, uint8_t scene_id, uint32_t transition_ms,
+    const esp_zb_zcl_scenes_extension_field_t* field_set,
+    const LightState& current) {
+  return put(group_id, scene_id, apply_fields(current, field_set),
+             transition_ms);
+}
+
+esp_err_t SceneTable::recall(
+    uint16_t group_id, uint8_t scene_id,
+    const esp_zb_zcl_scenes_extension_field_t* field_set,
+    const LightState& current, Scene* scene) {
+  const Scene* cached = find(group_id, scene_id);
+  if (field_set == nullptr) {
+    if (cached == nullptr) return ESP_ERR_NOT_FOUND;
+
+    *scene = *cached;
+    return ESP_OK;
+  }
+
+  LightState state = apply_fields(current, field_set);
+  if (cached != nullptr && cached->state == state) {
+    *scene = *cached;
+    return ESP_OK;
+  }
+
+  *scene = Scene{
+      .group_id = group_id,
+      .scene_id = scene_id,
+      .state = state,
+      .render = SingleLED::render_state(state),
+      .transition_ms = cached != nullptr ? cached->transition_ms : 0,
+  };
+
+  // A full table only costs the next recall the color conversion
+  esp_err_t err = store(group_id, scene_id, state);
+  if (err == ESP_ERR_NO_MEM) {
+    log_warn("Scene table full, not caching scene: group_id=%u, scene_id=%u",
+             group_id, scene_id);
+  } else if (err != ESP_OK) {
+    log_error("Error storing scene: %s", esp_err_to_name(err));
+  }
+
+  return ESP_OK;
+}
+
+esp_err_t SceneTable::remove(uint16_t group_id, uint8_t scene_id) {
+  return remove_if([group_id, scene_id](const Scene& scene) {
+    return scene.group_id == group_id && scene.scene_id == scene_id;
+  });
+}
+
+esp_err_t SceneTable::remove_group(uint16_t group_id) {
+  return remove_if(
+      [group_id](const Scene& scene) { return scene.group_id == group_id; });
+}
+
+esp_err_t SceneTable::remove_all_groups() {
+  return remove_if([](const Scene& scene) { return scene.group_id != 0; });
+}
+
+size_t SceneTable::get_count() { return count; }
+
+// PRIVATE METHODS
+template <typename Predicate>
+esp_err_t SceneTable::remove_if(Predicate predicate) {
+  Scene* end = std::remove_if(scenes.begin(), scenes.begin() + count,
+                              predicate);
+  size_t remaining = end - scenes.begin();
+  if (remaining == count) return ESP_OK;
+
+  count = remaining;
+  return save();
+}
+
+Scene* SceneTable::find(uint16_t group_id, uint8_t scene_id) {
+  for (size_t i = 0; i < count; i++) {
+    if (scenes[i].group_id == group_id && scenes[i].scene_id == scene_id) {
+      return &scenes[i];
+    }
+  }
+
+  return nullptr;
+}
+
+esp_err_t SceneTable::put(uint16_t group_id, uint8_t scene_id,
+                          const LightState& state, uint32_t transition_ms) {
+  Scene* scene = find(group_id, scene_id);
+  if (scene == nullptr) {
+    if (count == MAX_SCENES) return ESP_ERR_NO_MEM;
+    scene = &scenes[count++];
+  }
+
+  *scene = Scene{
+      .group_id = group_id,
+      .scene_id = scene_id,
+      .state = state,
+      .render = SingleLED::render_state(state),
+      .transition_ms = transition_ms,
+  };
+
+  return save();
+}
+
+esp_err_t SceneTable::save() {
+  StoredScene stored[MAX_SCENES];
+  for (size_t i = 0; i < count; i++) {
+    const Scene& scene = scenes[i];
+    stored[i] = StoredScene{
+        .group_id = scene.group_id,
+        .scene_id = scene.scene_id,
+        .active = static_cast<uint8_t>(scene.state.active ? 1 : 0),
+        .level = scene.state.level,
+        .color_x = scene.state.color_x,
+        .color_y = scene.state.color_y,
+        .color_mode = static_cast<uint8_t>(scene.state.color_mode),
+        .color_temperature = scene.state.color_temperature,
+        .enhanced_hue = scene.state.enhanced_hue,
+        .saturation = scene.state.saturation,
+        .transition_ms = scene.transition_ms,
+    };
+  }
+
+  return storage.save_scenes(stored, count);
+}
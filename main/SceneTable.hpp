@@ -0,0 +1,74 @@
+#ifndef SCENE_TABLE_HPP
+#define SCENE_TABLE_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "LightState.hpp"
+#include "SingleLED.hpp"
+#include "Storage.hpp"
+#include "esp_zigbee_core.h"
+
+struct Scene {
+  uint16_t group_id;
+  uint8_t scene_id;
+  LightState state;
+  LightRender render;
+  // From Add Scene, recalls that leave the time to the scene use it
+  uint32_t transition_ms;
+};
+
+// Scenes of the light endpoint with their LED output computed when they are
+// stored, so that recalling one involves no color conversion. The stack keeps
+// the Scenes cluster table itself, this one mirrors it for the light and is
+// persisted through Storage.
+//
+// All methods must be called from the Zigbee task.
+class SceneTable {
+ public:
+  SceneTable(Storage& storage);
+  esp_err_t init();
+
+  // Replaces a scene with the same IDs, keeping its transition time.
+  // ESP_ERR_NO_MEM if the table is full.
+  esp_err_t store(uint16_t group_id, uint8_t scene_id,
+                  const LightState& state);
+  // Add Scene: replaces a scene with the one in the extension fields, values
+  // they leave out are taken from current
+  esp_err_t add(uint16_t group_id, uint8_t scene_id, uint32_t transition_ms,
+                const esp_zb_zcl_scenes_extension_field_t* field_set,
+                const LightState& current);
+
+  // Resolves a scene for Recall Scene. The stack passes the extension fields
+  // it stored, values they leave out are taken from current. A scene that
+  // differs from them (e.g. after Add Scene) is rendered and stored again.
+  // Returns ESP_ERR_NOT_FOUND if neither has the scene.
+  esp_err_t recall(uint16_t group_id, uint8_t scene_id,
+                   const esp_zb_zcl_scenes_extension_field_t* field_set,
+                   const LightState& current, Scene* scene);
+
+  // Mirror the stack removing scenes: Remove Scene, Remove All Scenes or
+  // Remove Group for the scenes of one group, and Remove All Groups for
+  // those of every group but 0. Removing scenes the table doesn't have is a
+  // no-op.
+  esp_err_t remove(uint16_t group_id, uint8_t scene_id);
+  esp_err_t remove_group(uint16_t group_id);
+  esp_err_t remove_all_groups();
+
+  size_t get_count();
+
+ private:
+  Scene* find(uint16_t group_id, uint8_t scene_id);
+  esp_err_t put(uint16_t group_id, uint8_t scene_id, const LightState& state,
+                uint32_t transition_ms);
+  template <typename Predicate>
+  esp_err_t remove_if(Predicate predicate);
+  esp_err_t save();
+
+  Storage& storage;
+  std::array<Scene, MAX_SCENES> scenes;
+  size_t count;
+};
+
+#endif
@@ -1,136 +1,311 @@
 #include "SingleLED.hpp"
 
-#include <algorithm>
-#include <cmath>
-
-SingleLED::SingleLED(const int gpio_pin)
-    : gpio(static_cast<gpio_num_t>(gpio_pin)),
-      active(false),
-      brightness(1),
-      x(0.5),
-      y(0.5) {}
-
-esp_err_t SingleLED::init(bool active, double brightness, double x, double y) {
-  led_strip_config_t led_config = {
-      .strip_gpio_num = gpio,
-      .max_leds = 1,
-      .led_model = LED_MODEL_WS2812,
-      .color_component_format = LED_STRIP_COLOR_COMPONENT_FMT_GRB,
-      .flags = {
-          .invert_out = false,
-      }};
-
-  led_strip_rmt_config_t rmt_config = {
-      .clk_src = RMT_CLK_SRC_DEFAULT,
-      .resolution_hz = 10 * 1000 * 1000,  // 10 MHz
-      .mem_block_symbols = 64,
-      .flags = {
-          .with_dma = false,
-      }};
-
-  esp_err_t err = led_strip_new_rmt_device(&led_config, &rmt_config, &led);
-  if (err != ESP_OK) return err;
+#include "Gamma.hpp"
+#include "Log.hpp"
+
+constexpr int64_t FRAME_PERIOD_US = 1000000 / CONFIG_LIGHT_TRANSITION_FPS;
+constexpr int64_t SMOOTHING_WINDOW_US =
+    CONFIG_LIGHT_TRANSITION_SMOOTHING_MS * 1000LL;
+// last_update before the first automatic transition
+constexpr int64_t NO_UPDATE = -1;
+
+// Only the conversion of the current mode runs, color temperature and hue
+// never go through the xy conversion
+static ColorRGB16 state_to_rgb16(const LightState& state) {
+  switch (state.color_mode) {
+    case ColorMode::TEMPERATURE:
+      return mireds_to_rgb16(state.color_temperature, state.level);
+    case ColorMode::HUE_SATURATION:
+    case ColorMode::ENHANCED_HUE_SATURATION:
+      return hsv_to_rgb16(state.enhanced_hue, state.saturation, state.level);
+    default:
+      return xy_to_rgb16(state.color_x, state.color_y, state.level);
+  }
+}
 
-  this->active = active;
-  this->brightness = brightness;
-  this->x = x;
-  this->y = y;
+SingleLED::SingleLED(RenderScheduler& scheduler, StripSegment segment,
+                     uint8_t index)
+    : scheduler(scheduler),
+      segment(segment),
+      index(index),
+      state{
+          .active = false,
+          .level = COLOR_MAX_LEVEL,
+          .color_x = 32768,
+          .color_y = 32768,
+          .color_mode = ColorMode::XY,
+          .color_temperature = COLOR_TEMP_MAX_MIREDS,
+          .enhanced_hue = 0,
+          .saturation = 0,
+      },
+      effects(FRAME_PERIOD_US),
+      last_update(NO_UPDATE),
+      boot_frame_shown(false) {}
+
+esp_err_t SingleLED::init() {
+  esp_err_t err = scheduler.add_light(this);
+  if (err != ESP_OK) return err;
 
-  err = refresh();
+#ifdef CONFIG_LIGHT_BOOT_FRAME
+  // A power cycle loses the retained frame, the state persisted last is
+  // rendered instead
+  BootFrame frame;
+  bool retained = load_boot_frame(index, &frame);
+  LightState stored;
+  bool cold = !retained && load_cold_boot_state(index, state, &stored);
+
+  scheduler.lock();
+  if (retained) {
+    state = frame.state;
+    boot_frame_shown = true;
+    transition.set(frame.target);
+    err = write_pixel(frame.target);
+    if (err == ESP_OK) err = scheduler.update_frame_timer();
+  } else if (cold) {
+    state = stored;
+    boot_frame_shown = true;
+    err = refresh(0);
+  }
+  scheduler.unlock();
   if (err != ESP_OK) return err;
+#endif
 
   return ESP_OK;
 }
 
-esp_err_t SingleLED::set_active(bool active) {
-  this->active = active;
+esp_err_t SingleLED::restore(const LightState& state) {
+  scheduler.lock();
+
+  // Reconciles a retained frame that no longer matches what was stored, e.g.
+  // after a change that was never persisted
+  esp_err_t err = ESP_OK;
+  if (!boot_frame_shown || this->state != state) {
+    this->state = state;
+    err = refresh(0);
+  }
+  scheduler.unlock();
+
+  return err;
+}
+
+esp_err_t SingleLED::set_active(bool active, uint32_t transition_ms) {
+  scheduler.lock();
+  state.active = active;
 
-  esp_err_t err = refresh();
+  esp_err_t err = refresh(transition_ms);
+  scheduler.unlock();
   if (err != ESP_OK) return err;
 
   return ESP_OK;
 }
 
-bool SingleLED::get_active() { return active; }
+bool SingleLED::get_active() { return state.active; }
 
-esp_err_t SingleLED::set_brightness(double brightness) {
-  if (brightness < 0.0 || brightness > 1.0) {
+esp_err_t SingleLED::set_brightness(uint8_t level, uint32_t transition_ms) {
+  if (level > COLOR_MAX_LEVEL) {
     return ESP_ERR_INVALID_ARG;
   }
 
-  this->brightness = brightness;
+  scheduler.lock();
+  state.level = level;
 
-  esp_err_t err = refresh();
+  esp_err_t err = refresh(transition_ms);
+  scheduler.unlock();
   if (err != ESP_OK) return err;
 
   return ESP_OK;
 }
 
-double SingleLED::get_brightness() { return brightness; }
+uint8_t SingleLED::get_brightness() { return state.level; }
 
-esp_err_t SingleLED::set_color(double x, double y) {
-  this->x = x;
-  this->y = y;
+esp_err_t SingleLED::set_color(uint16_t x, uint16_t y,
+                               uint32_t transition_ms) {
+  scheduler.lock();
+  state.color_x = x;
+  state.color_y = y;
+  state.color_mode = ColorMode::XY;
 
-  esp_err_t err = refresh();
+  esp_err_t err = refresh(transition_ms);
+  scheduler.unlock();
   if (err != ESP_OK) return err;
 
   return ESP_OK;
 }
 
-ColorXY SingleLED::get_color() { return ColorXY{.x = x, .y = y}; }
+ColorXY SingleLED::get_color() {
+  return ColorXY{.x = state.color_x, .y = state.color_y};
+}
 
-// PRIVATE METHODS
-esp_err_t SingleLED::refresh() {
-  ColorRGB rgb = active ? get_color_rgb() : ColorRGB{0, 0, 0};
+esp_err_t SingleLED::set_color_temperature(uint16_t mireds,
+                                           uint32_t transition_ms) {
+  scheduler.lock();
+  state.color_temperature = mireds;
+  state.color_mode = ColorMode::TEMPERATURE;
 
-  printf("Updating LED: R=%d, G=%d, B=%d\n", rgb.r, rgb.g, rgb.b);
+  esp_err_t err = refresh(transition_ms);
+  scheduler.unlock();
+  if (err != ESP_OK) return err;
+
+  return ESP_OK;
+}
 
-  esp_err_t err = led_strip_set_pixel(led, 0, rgb.r, rgb.g, rgb.b);
+uint16_t SingleLED::get_color_temperature() {
+  return state.color_temperature;
+}
+
+ColorMode SingleLED::get_color_mode() { return state.color_mode; }
+
+LightState SingleLED::get_state() {
+  scheduler.lock();
+  LightState state = this->state;
+  scheduler.unlock();
+
+  return state;
+}
+
+esp_err_t SingleLED::set_state(const LightState& state,
+                               uint32_t transition_ms) {
+  if (state.level > COLOR_MAX_LEVEL) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  scheduler.lock();
+  this->state = state;
+
+  esp_err_t err = refresh(transition_ms);
+  scheduler.unlock();
   if (err != ESP_OK) return err;
 
-  err = led_strip_refresh(led);
+  return ESP_OK;
+}
+
+esp_err_t SingleLED::set_rendered_state(const LightState& state,
+                                        const LightRender& render,
+                                        uint32_t transition_ms) {
+  if (state.level > COLOR_MAX_LEVEL) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  scheduler.lock();
+  this->state = state;
+  effects.stop();
+
+  uint32_t frames = get_transition_frames(transition_ms, esp_timer_get_time());
+  transition.retarget(render.target, frames);
+  retain_frame(render.target);
+
+  esp_err_t err = ESP_OK;
+  if (!transition.is_running()) err = write_output(render.output);
+  if (err == ESP_OK) err = scheduler.update_frame_timer();
+  scheduler.unlock();
   if (err != ESP_OK) return err;
 
   return ESP_OK;
 }
 
-ColorRGB SingleLED::get_color_rgb() {
-  if (y == 0) return ColorRGB{0, 0, 0};
+LightRender SingleLED::render_state(const LightState& state) {
+  if (!state.active) return LightRender{};
+
+  ColorRGB16 target = state_to_rgb16(state);
+  return LightRender{.target = target, .output = gamma_correct(target)};
+}
+
+esp_err_t SingleLED::start_effect(const EffectRequest& request) {
+  scheduler.lock();
 
-  // Convert xy to XYZ color space
-  double Y = 1.0;
-  double X = (Y / y) * x;
-  double Z = (Y / y) * (1.0 - x - y);
+  // Effects show an active light at its level and an inactive one at full
+  LightState base = state;
+  if (!base.active) base.level = COLOR_MAX_LEVEL;
+  effects.start(request, base, state_to_rgb16(base));
 
-  // Convert XYZ to RGB using Wide RGB D65 conversion matrix
-  double r = 3.2406 * X - 1.5372 * Y - 0.4986 * Z;
-  double g = -0.9689 * X + 1.8758 * Y + 0.0415 * Z;
-  double b = 0.0557 * X - 0.2040 * Y + 1.0570 * Z;
+  // Stopped at once, back to the state
+  esp_err_t err = ESP_OK;
+  if (!effects.is_active()) err = write_pixel(transition.get_output());
+  if (err == ESP_OK) err = scheduler.update_frame_timer();
+  scheduler.unlock();
 
-  // Normalize negative values
-  if (r < 0) r = 0;
-  if (g < 0) g = 0;
-  if (b < 0) b = 0;
+  return err;
+}
 
-  // Scale according to max value
-  double maxc = std::max({r, g, b});
-  if (maxc == 0) return ColorRGB{0, 0, 0};
+Effect SingleLED::get_effect() { return effects.get_effect(); }
 
-  r /= maxc;
-  g /= maxc;
-  b /= maxc;
+EffectStats SingleLED::get_effect_stats() { return effects.get_stats(); }
 
-  // Apply brightness
-  r *= brightness;
-  g *= brightness;
-  b *= brightness;
+esp_err_t SingleLED::render_frame() {
+  // A light that needs no frames has its output in the framebuffer already
+  if (!needs_frames()) return ESP_OK;
 
-  // Convert to 8-bit RGB values
-  ColorRGB rgb;
-  rgb.r = static_cast<uint8_t>(std::round(r * 255.0));
-  rgb.g = static_cast<uint8_t>(std::round(g * 255.0));
-  rgb.b = static_cast<uint8_t>(std::round(b * 255.0));
+  // The transition keeps going underneath an effect, so the light is at its
+  // state when the effect ends
+  transition.step();
+  ColorRGB16 effect_output;
+  return effects.tick(&effect_output) ? write_pixel(effect_output)
+                                      : write_pixel(transition.get_output());
+}
 
-  return rgb;
+bool SingleLED::needs_frames() {
+  return transition.is_running() || effects.is_active() || dither.is_active();
 }
+
+bool SingleLED::has_boot_frame() { return boot_frame_shown; }
+
+// PRIVATE METHODS
+
+esp_err_t SingleLED::refresh(uint32_t transition_ms) {
+  effects.stop();
+
+  ColorRGB16 value = state.active ? get_color_rgb() : ColorRGB16{0, 0, 0};
+
+  log_debug("Updating LED: R=%u, G=%u, B=%u", value.r, value.g, value.b);
+
+  uint32_t frames = get_transition_frames(transition_ms, esp_timer_get_time());
+  transition.retarget(value, frames);
+  retain_frame(value);
+
+  if (!transition.is_running()) {
+    esp_err_t err = write_pixel(value);
+    if (err != ESP_OK) return err;
+  }
+
+  return scheduler.update_frame_timer();
+}
+
+esp_err_t SingleLED::write_pixel(ColorRGB16 value) {
+  return write_output(gamma_correct(value));
+}
+
+esp_err_t SingleLED::write_output(ColorRGB16 output) {
+  ColorRGB rgb = dither.apply(output);
+
+  return scheduler.get_strip().fill(segment, rgb);
+}
+
+// The state's color, not a transition or effect frame, is what the light
+// should come back to after a reset
+void SingleLED::retain_frame(ColorRGB16 target) {
+#ifdef CONFIG_LIGHT_BOOT_FRAME
+  save_boot_frame(index, BootFrame{.state = state, .target = target});
+#endif
+}
+
+uint32_t SingleLED::get_transition_frames(uint32_t transition_ms,
+                                          int64_t now) {
+  int64_t duration_us;
+  if (transition_ms == TRANSITION_AUTO) {
+    // The Zigbee stack runs Move and Step transitions by writing a series of
+    // intermediate values. Interpolating over the interval between them
+    // turns those steps into a smooth fade, while isolated updates, such as
+    // the first one after boot, are still applied immediately. Updates with
+    // an explicit transition time are not steps, and don't count.
+    bool stepping =
+        last_update != NO_UPDATE && now - last_update <= SMOOTHING_WINDOW_US;
+    duration_us = stepping ? now - last_update : 0;
+    last_update = now;
+  } else {
+    duration_us = transition_ms * 1000LL;
+  }
+
+  return static_cast<uint32_t>(duration_us / FRAME_PERIOD_US);
+}
+
+ColorRGB16 SingleLED::get_color_rgb() { return state_to_rgb16(state); }
@@ -3,45 +3,107 @@
 
 #include <cstdint>
 
-#include "driver/gpio.h"
-#include "led_strip.h"
+#include "BootFrame.hpp"
+#include "Color.hpp"
+#include "Dither.hpp"
+#include "EffectEngine.hpp"
+#include "LEDStrip.hpp"
+#include "LightState.hpp"
+#include "RenderScheduler.hpp"
+#include "Transition.hpp"
 
-struct ColorRGB {
-  uint8_t r;
-  uint8_t g;
-  uint8_t b;
-};
+// Derive the transition time from how quickly updates arrive, for values
+// the Zigbee stack steps through without telling the transition time
+constexpr uint32_t TRANSITION_AUTO = UINT32_MAX;
 
-struct ColorXY {
-  double x;
-  double y;
+// LED output of a light state, computed ahead of time so that it can be
+// shown without any color conversion
+struct LightRender {
+  // Linear color the transition targets
+  ColorRGB16 target;
+  // Gamma-corrected color written when there is no transition
+  ColorRGB16 output;
 };
 
+// A single light rendered to every pixel of its segment of the shared
+// strip, a lone LED is the one-pixel case. Changes are written to the
+// framebuffer and reach the LED on the scheduler's next show() or frame.
 class SingleLED {
  public:
-  SingleLED(const int gpio_pin);
-  esp_err_t init(bool active, double brightness, double x, double y);
+  // index tells the lights apart, e.g. for their boot frames
+  SingleLED(RenderScheduler& scheduler, StripSegment segment, uint8_t index);
+  // Joins the scheduler and writes the boot frame if there is one, before
+  // storage is read. The frame retained in RTC memory comes first, the cold
+  // boot state stored with the last persisted state after a power cycle.
+  esp_err_t init();
+  // Shows the stored state, unless the boot frame already does
+  esp_err_t restore(const LightState& state);
 
-  esp_err_t set_active(bool active);
+  esp_err_t set_active(bool active, uint32_t transition_ms = TRANSITION_AUTO);
   bool get_active();
 
-  esp_err_t set_brightness(double value);
-  double get_brightness();
+  esp_err_t set_brightness(uint8_t level,
+                           uint32_t transition_ms = TRANSITION_AUTO);
+  uint8_t get_brightness();
 
-  esp_err_t set_color(double x, double y);
+  // Switches to ColorMode::XY
+  esp_err_t set_color(uint16_t x, uint16_t y,
+                      uint32_t transition_ms = TRANSITION_AUTO);
   ColorXY get_color();
 
+  // Switches to ColorMode::TEMPERATURE
+  esp_err_t set_color_temperature(uint16_t mireds,
+                                  uint32_t transition_ms = TRANSITION_AUTO);
+  uint16_t get_color_temperature();
+
+  ColorMode get_color_mode();
+  LightState get_state();
+
+  // Applies all values at once with a single refresh
+  esp_err_t set_state(const LightState& state,
+                      uint32_t transition_ms = TRANSITION_AUTO);
+
+  // Applies all values at once and shows a render of them computed earlier
+  // by render_state()
+  esp_err_t set_rendered_state(const LightState& state,
+                               const LightRender& render,
+                               uint32_t transition_ms);
+
+  static LightRender render_state(const LightState& state);
+
+  // Runs an effect over the current state on the frame timer, until it ends
+  // or any of the setters above applies a new state
+  esp_err_t start_effect(const EffectRequest& request);
+  Effect get_effect();
+  EffectStats get_effect_stats();
+
+  // Called by the scheduler with its lock held. Writes the next transition or
+  // effect frame.
+  esp_err_t render_frame();
+  bool needs_frames();
+
+  // Whether init() wrote a boot frame
+  bool has_boot_frame();
+
  private:
-  esp_err_t refresh();
+  esp_err_t refresh(uint32_t transition_ms);
+  esp_err_t write_pixel(ColorRGB16 value);
+  esp_err_t write_output(ColorRGB16 output);
+  void retain_frame(ColorRGB16 target);
+  uint32_t get_transition_frames(uint32_t transition_ms, int64_t now);
+
+  ColorRGB16 get_color_rgb();
 
-  ColorRGB get_color_rgb();
+  RenderScheduler& scheduler;
+  const StripSegment segment;
+  const uint8_t index;
+  LightState state;
 
-  const gpio_num_t gpio;
-  led_strip_handle_t led;
-  bool active;
-  double brightness;
-  double x;
-  double y;
+  Transition transition;
+  EffectEngine effects;
+  Dither dither;
+  int64_t last_update;
+  bool boot_frame_shown;
 };
 
 #endif
@@ -0,0 +1,40 @@
+#ifndef SPSC_QUEUE_HPP
+#define SPSC_QUEUE_HPP
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+// Lock-free ring buffer for exactly one producer and one consumer task
+template <typename T, size_t N>
+class SpscQueue {
+  static_assert(N > 0 && (N & (N - 1)) == 0, "N must be a power of two");
+
+ public:
+  bool push(const T& item) {
+    size_t head = this->head.load(std::memory_order_relaxed);
+    size_t tail = this->tail.load(std::memory_order_acquire);
+    if (head - tail == N) return false;
+
+    items[head & (N - 1)] = item;
+    this->head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool pop(T* item) {
+    size_t tail = this->tail.load(std::memory_order_relaxed);
+    size_t head = this->head.load(std::memory_order_acquire);
+    if (head == tail) return false;
+
+    *item = items[tail & (N - 1)];
+    this->tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+ private:
+  std::array<T, N> items;
+  std::atomic<size_t> head{0};
+  std::atomic<size_t> tail{0};
+};
+
+#endif
@@ -0,0 +1,283 @@
+#include "StateJournal.hpp"
+
+#include <cstring>
+
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+
+constexpr uint32_t ERASED_BYTE = 0xFF;
+constexpr size_t STATE_PAYLOAD_SIZE = 8;
+
+// Record flags, the active bit and the color mode. Records written before
+// color temperature support have only the active bit, and are read as XY.
+constexpr uint8_t RECORD_FLAG_ACTIVE = 1 << 0;
+constexpr uint8_t RECORD_MODE_SHIFT = 1;
+constexpr uint8_t RECORD_MODE_MASK = 0x3 << RECORD_MODE_SHIFT;
+
+// Record color modes. In the hue modes the x and y fields carry the enhanced
+// hue and the saturation, which keeps records at 16 bytes.
+constexpr uint8_t RECORD_MODE_XY = 0;
+constexpr uint8_t RECORD_MODE_TEMPERATURE = 1;
+constexpr uint8_t RECORD_MODE_HUE_SATURATION = 2;
+constexpr uint8_t RECORD_MODE_ENHANCED_HUE_SATURATION = 3;
+
+constexpr uint16_t NO_COLOR_TEMPERATURE = 0xFFFF;
+
+static uint8_t to_record_mode(ColorMode mode) {
+  switch (mode) {
+    case ColorMode::TEMPERATURE:
+      return RECORD_MODE_TEMPERATURE;
+    case ColorMode::HUE_SATURATION:
+      return RECORD_MODE_HUE_SATURATION;
+    case ColorMode::ENHANCED_HUE_SATURATION:
+      return RECORD_MODE_ENHANCED_HUE_SATURATION;
+    default:
+      return RECORD_MODE_XY;
+  }
+}
+
+static ColorMode from_record_mode(uint8_t mode) {
+  switch (mode) {
+    case RECORD_MODE_TEMPERATURE:
+      return ColorMode::TEMPERATURE;
+    case RECORD_MODE_HUE_SATURATION:
+      return ColorMode::HUE_SATURATION;
+    case RECORD_MODE_ENHANCED_HUE_SATURATION:
+      return ColorMode::ENHANCED_HUE_SATURATION;
+    default:
+      return ColorMode::XY;
+  }
+}
+
+static bool is_hue_mode(uint8_t mode) {
+  return mode == RECORD_MODE_HUE_SATURATION ||
+         mode == RECORD_MODE_ENHANCED_HUE_SATURATION;
+}
+constexpr size_t BLANK_CHECK_CHUNK = 64;
+
+StateJournal::StateJournal(Flash& flash)
+    : flash(flash),
+      slot_count(0),
+      slots_per_sector(0),
+      has_record(false),
+      latest{},
+      next_slot(0),
+      stats{} {}
+
+esp_err_t StateJournal::init() {
+  static_assert(sizeof(Record) == 16, "Record must stay 16 bytes");
+  static_assert(BLANK_CHECK_CHUNK % sizeof(Record) == 0);
+
+  size_t sector_size = flash.get_sector_size();
+  if (sector_size == 0 || sector_size % BLANK_CHECK_CHUNK != 0) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+
+  // At least two sectors are needed, so that one can be erased while the
+  // latest record is kept in another one
+  size_t sector_count = flash.get_size() / sector_size;
+  if (sector_count < 2) return ESP_ERR_INVALID_SIZE;
+
+  slots_per_sector = sector_size / sizeof(Record);
+  slot_count = sector_count * slots_per_sector;
+
+  int64_t start = esp_timer_get_time();
+  esp_err_t err = recover();
+  stats.scan_time_us = esp_timer_get_time() - start;
+  if (err != ESP_OK) return err;
+
+  return ESP_OK;
+}
+
+esp_err_t StateJournal::append(const LightState& state) {
+  uint8_t mode = to_record_mode(state.color_mode);
+  bool hue = is_hue_mode(mode);
+  Record record = {
+      .sequence = has_record ? latest.sequence + 1 : 0,
+      .flags = static_cast<uint8_t>((state.active ? RECORD_FLAG_ACTIVE : 0) |
+                                    mode << RECORD_MODE_SHIFT),
+      .level = state.level,
+      .color_x = hue ? state.enhanced_hue : state.color_x,
+      .color_y = hue ? uint16_t{state.saturation} : state.color_y,
+      .color_temperature = state.color_temperature,
+      .crc = 0,
+  };
+  record.crc = esp_rom_crc32_le(0, reinterpret_cast<const uint8_t*>(&record),
+                                offsetof(Record, crc));
+
+  size_t slot = next_slot;
+  esp_err_t err = ESP_OK;
+  if (slot % slots_per_sector == 0) {
+    err = prepare_sector(slot / slots_per_sector);
+  } else {
+    Record existing;
+    if (read_slot(slot, &existing) != SlotStatus::ERASED) {
+      // An interrupted write left this slot unusable. Continue in the next
+      // sector, so that records within a sector stay contiguous.
+      slot = ((slot / slots_per_sector + 1) * slots_per_sector) % slot_count;
+      err = prepare_sector(slot / slots_per_sector);
+    }
+  }
+  if (err != ESP_OK) return err;
+
+  // A failed write keeps next_slot on the slot. If the write left it
+  // unusable, the next append moves on to the next sector, which keeps the
+  // first slot of every sector valid for the boot scan.
+  err = flash.write(slot * sizeof(Record), &record, sizeof(record));
+  stats.bytes_programmed += sizeof(record);
+  if (err != ESP_OK) {
+    next_slot = slot;
+    return err;
+  }
+  next_slot = (slot + 1) % slot_count;
+
+  stats.records_written++;
+  latest = record;
+  has_record = true;
+
+  return ESP_OK;
+}
+
+bool StateJournal::has_state() { return has_record; }
+
+LightState StateJournal::get_state(const LightState& defaults) {
+  LightState state = defaults;
+  state.active = (latest.flags & RECORD_FLAG_ACTIVE) != 0;
+  state.level = latest.level;
+  if (latest.color_temperature != NO_COLOR_TEMPERATURE) {
+    state.color_temperature = latest.color_temperature;
+  }
+
+  uint8_t mode = (latest.flags & RECORD_MODE_MASK) >> RECORD_MODE_SHIFT;
+  state.color_mode = from_record_mode(mode);
+  if (is_hue_mode(mode)) {
+    state.enhanced_hue = latest.color_x;
+    state.saturation = static_cast<uint8_t>(latest.color_y);
+  } else {
+    state.color_x = latest.color_x;
+    state.color_y = latest.color_y;
+  }
+
+  return state;
+}
+
+JournalStats StateJournal::get_stats() { return stats; }
+
+uint32_t StateJournal::get_write_amplification() {
+  uint64_t logical = stats.records_written * STATE_PAYLOAD_SIZE;
+  if (logical == 0) return 0;
+
+  uint64_t physical = stats.bytes_programmed + stats.bytes_erased;
+  return static_cast<uint32_t>(physical * 100 / logical);
+}
+
+// PRIVATE METHODS
+StateJournal::SlotStatus StateJournal::read_slot(size_t slot,
+                                                 Record* record) {
+  esp_err_t err = flash.read(slot * sizeof(Record), record, sizeof(Record));
+  if (err != ESP_OK) return SlotStatus::INVALID;
+
+  const auto* bytes = reinterpret_cast<const uint8_t*>(record);
+  bool erased = true;
+  for (size_t i = 0; i < sizeof(Record); i++) {
+    if (bytes[i] != ERASED_BYTE) {
+      erased = false;
+      break;
+    }
+  }
+  if (erased) return SlotStatus::ERASED;
+
+  uint32_t crc = esp_rom_crc32_le(0, bytes, offsetof(Record, crc));
+  if (crc != record->crc) return SlotStatus::INVALID;
+
+  return SlotStatus::VALID;
+}
+
+esp_err_t StateJournal::recover() {
+  size_t sector_count = slot_count / slots_per_sector;
+  Record record;
+  auto scan_slot = [this](size_t slot, Record* record) {
+    stats.scan_reads++;
+    return read_slot(slot, record);
+  };
+
+  // Every sector is erased right before its first record is written, so the
+  // first records of the sectors written since the last wrap have sequence
+  // numbers no lower than the one in sector 0. Older sectors follow them.
+  size_t newest_sector;
+  Record first;
+  if (scan_slot(0, &first) == SlotStatus::VALID) {
+    size_t low = 0;
+    size_t high = sector_count;
+    while (high - low > 1) {
+      size_t mid = low + (high - low) / 2;
+      if (scan_slot(mid * slots_per_sector, &record) == SlotStatus::VALID &&
+          record.sequence >= first.sequence) {
+        low = mid;
+      } else {
+        high = mid;
+      }
+    }
+    newest_sector = low;
+  } else if (scan_slot((sector_count - 1) * slots_per_sector, &record) ==
+             SlotStatus::VALID) {
+    // Sector 0 was erased for a wrap, but nothing was written to it yet
+    newest_sector = sector_count - 1;
+  } else {
+    has_record = false;
+    next_slot = 0;
+    return ESP_OK;
+  }
+
+  // Records within a sector are contiguous, so the latest one is the last
+  // valid slot
+  size_t base = newest_sector * slots_per_sector;
+  size_t low = 0;
+  size_t high = slots_per_sector;
+  while (high - low > 1) {
+    size_t mid = low + (high - low) / 2;
+    if (scan_slot(base + mid, &record) == SlotStatus::VALID) {
+      low = mid;
+    } else {
+      high = mid;
+    }
+  }
+
+  if (scan_slot(base + low, &latest) != SlotStatus::VALID) {
+    return ESP_ERR_INVALID_CRC;
+  }
+  has_record = true;
+  next_slot = (base + low + 1) % slot_count;
+
+  return ESP_OK;
+}
+
+esp_err_t StateJournal::prepare_sector(size_t sector) {
+  size_t sector_size = slots_per_sector * sizeof(Record);
+  size_t offset = sector * sector_size;
+
+  // Skip the erase if the sector is still blank, e.g. on the first pass
+  // through a new partition
+  uint8_t chunk[BLANK_CHECK_CHUNK];
+  bool blank = true;
+  for (size_t i = 0; i < sector_size && blank; i += sizeof(chunk)) {
+    esp_err_t err = flash.read(offset + i, chunk, sizeof(chunk));
+    if (err != ESP_OK) return err;
+
+    for (size_t j = 0; j < sizeof(chunk); j++) {
+      if (chunk[j] != ERASED_BYTE) {
+        blank = false;
+        break;
+      }
+    }
+  }
+  if (blank) return ESP_OK;
+
+  esp_err_t err = flash.erase_sector(sector);
+  if (err != ESP_OK) return err;
+
+  stats.sectors_erased++;
+  stats.bytes_erased += sector_size;
+
+  return ESP_OK;
+}
@@ -0,0 +1,71 @@
+#ifndef STATE_JOURNAL_HPP
+#define STATE_JOURNAL_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include "Flash.hpp"
+#include "LightState.hpp"
+#include "esp_err.h"
+
+struct JournalStats {
+  // Boot scan
+  uint32_t scan_reads;
+  int64_t scan_time_us;
+
+  // Writes since boot
+  uint32_t records_written;
+  uint32_t sectors_erased;
+  uint64_t bytes_programmed;
+  uint64_t bytes_erased;
+};
+
+// Append-only ring log of fixed-size state records. Records carry an
+// increasing sequence number, so the latest one can be found with a binary
+// search at boot. Sectors are only erased when the ring wraps around.
+class StateJournal {
+ public:
+  StateJournal(Flash& flash);
+  esp_err_t init();
+
+  esp_err_t append(const LightState& state);
+
+  bool has_state();
+  // Values the latest record doesn't carry are taken from defaults
+  LightState get_state(const LightState& defaults);
+
+  JournalStats get_stats();
+  // Flash bytes programmed and erased per byte of state written, in percent
+  uint32_t get_write_amplification();
+
+ private:
+  struct __attribute__((packed)) Record {
+    uint32_t sequence;
+    // RECORD_FLAG_* bits
+    uint8_t flags;
+    uint8_t level;
+    uint16_t color_x;
+    uint16_t color_y;
+    // Erased (0xFFFF) in records written before color temperature support
+    uint16_t color_temperature;
+    uint32_t crc;
+  };
+
+  enum class SlotStatus { ERASED, VALID, INVALID };
+
+  SlotStatus read_slot(size_t slot, Record* record);
+  esp_err_t recover();
+  esp_err_t prepare_sector(size_t sector);
+
+  Flash& flash;
+  size_t slot_count;
+  size_t slots_per_sector;
+
+  bool has_record;
+  Record latest;
+  size_t next_slot;
+
+  JournalStats stats;
+};
+
+#endif
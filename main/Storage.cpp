@@ -1,90 +1,367 @@
 #include "Storage.hpp"
 
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+#include "BootFrame.hpp"
+#include "Color.hpp"
+#include "LatencyTrace.hpp"
+#include "Log.hpp"
+#include "esp_rom_crc.h"
 #include "nvs_flash.h"
 
-constexpr char NVS_NAMESPACE[] = "zigbee_device";
+constexpr char STATE_NVS_KEY[] = "state";
+constexpr uint8_t STATE_VERSION = 3;
+constexpr uint8_t STATE_VERSION_TEMPERATURE = 2;
+constexpr uint8_t STATE_VERSION_XY = 1;
+
+constexpr char SCENES_NVS_KEY[] = "scenes";
+// Scenes of older versions are not read, the stack passes a scene's values on
+// recall and the table stores it again
+constexpr uint8_t SCENES_VERSION = 4;
+
+// Keys used before the state was stored as a single blob
+constexpr char LEGACY_ACTIVE_NVS_KEY[] = "active";
+constexpr char LEGACY_BRIGHTNESS_NVS_KEY[] = "brightness";
+constexpr char LEGACY_COLOR_X_NVS_KEY[] = "color_x";
+constexpr char LEGACY_COLOR_Y_NVS_KEY[] = "color_y";
+constexpr uint32_t LEGACY_SCALE_BITS = 53;
+
+constexpr uint8_t MAX_LEVEL = 254;
+constexpr uint16_t MAX_COORD = 65535;
+
+#ifdef CONFIG_STORAGE_WRITE_BEHIND
+constexpr int64_t FLUSH_QUIET_US = CONFIG_STORAGE_FLUSH_QUIET_MS * 1000LL;
+constexpr int64_t FLUSH_MAX_LATENCY_US =
+    CONFIG_STORAGE_FLUSH_MAX_LATENCY_MS * 1000LL;
+#else
+constexpr int64_t FLUSH_QUIET_US = 0;
+constexpr int64_t FLUSH_MAX_LATENCY_US = 0;
+#endif
+
+struct __attribute__((packed)) StoredState {
+  uint8_t version;
+  uint8_t active;
+  uint8_t level;
+  uint16_t color_x;
+  uint16_t color_y;
+  uint8_t color_mode;
+  uint16_t color_temperature;
+  uint16_t enhanced_hue;
+  uint8_t saturation;
+  uint32_t crc;
+};
+
+// Stored before hue and saturation support
+struct __attribute__((packed)) StoredStateTemperature {
+  uint8_t version;
+  uint8_t active;
+  uint8_t level;
+  uint16_t color_x;
+  uint16_t color_y;
+  uint8_t color_mode;
+  uint16_t color_temperature;
+  uint32_t crc;
+};
+
+// Stored before color temperature support
+struct __attribute__((packed)) StoredStateXY {
+  uint8_t version;
+  uint8_t active;
+  uint8_t level;
+  uint16_t color_x;
+  uint16_t color_y;
+  uint32_t crc;
+};
+
+// Only the first count scenes are stored
+struct __attribute__((packed)) StoredScenes {
+  uint8_t version;
+  uint8_t count;
+  uint32_t crc;
+  StoredScene scenes[MAX_SCENES];
+};
+
+constexpr size_t SCENES_HEADER_SIZE = offsetof(StoredScenes, scenes);
+
+static uint32_t scenes_crc(const StoredScenes& stored) {
+  uint32_t crc = esp_rom_crc32_le(0, &stored.count, sizeof(stored.count));
+  return esp_rom_crc32_le(crc, reinterpret_cast<const uint8_t*>(stored.scenes),
+                          stored.count * sizeof(StoredScene));
+}
+
+template <typename T>
+static uint32_t state_crc(const T& state) {
+  return esp_rom_crc32_le(0, reinterpret_cast<const uint8_t*>(&state),
+                          offsetof(T, crc));
+}
+
+// Reads a blob stored with the layout T, false if it is not one
+template <typename T>
+static bool read_state(const void* blob, size_t size, uint8_t version,
+                       T* state) {
+  if (size != sizeof(T)) return false;
+
+  memcpy(state, blob, sizeof(T));
+  return state->version == version && state->crc == state_crc(*state);
+}
+
+static StoredState make_state(const LightState& state) {
+  StoredState stored = {
+      .version = STATE_VERSION,
+      .active = static_cast<uint8_t>(state.active ? 1 : 0),
+      .level = state.level,
+      .color_x = state.color_x,
+      .color_y = state.color_y,
+      .color_mode = static_cast<uint8_t>(state.color_mode),
+      .color_temperature = state.color_temperature,
+      .enhanced_hue = state.enhanced_hue,
+      .saturation = state.saturation,
+      .crc = 0,
+  };
+  stored.crc = state_crc(stored);
+  return stored;
+}
 
-constexpr char ACTIVE_NVS_KEY[] = "active";
-constexpr char BRIGHTNESS_NVS_KEY[] = "brightness";
-constexpr char COLOR_X_NVS_KEY[] = "color_x";
-constexpr char COLOR_Y_NVS_KEY[] = "color_y";
+static bool is_valid_mode(uint8_t mode) {
+  return mode <= static_cast<uint8_t>(ColorMode::ENHANCED_HUE_SATURATION);
+}
 
-constexpr uint64_t DOUBLE_SCALE_FACTOR = (1ULL << 53);
+// Converts a legacy value in [0, 1] scaled by 2^53 to [0, max], rounded
+static uint32_t legacy_to_zcl(uint64_t value, uint32_t max) {
+  constexpr uint32_t PRE_SHIFT = LEGACY_SCALE_BITS - 32;
+  uint64_t scaled = (value >> PRE_SHIFT) * max + (1ULL << 31);
+  return std::min(static_cast<uint32_t>(scaled >> 32), max);
+}
 
-Storage::Storage(bool default_active, double default_brightness,
-                 double default_color_x, double default_color_y)
-    : active(default_active),
-      brightness(default_brightness),
-      color_x(default_color_x),
-      color_y(default_color_y) {}
+Storage::Storage(const char* name_space, const LightState& defaults,
+                 uint8_t light)
+    : name_space(name_space),
+      light(light),
+      state(defaults),
+#ifdef CONFIG_STORAGE_BACKEND_JOURNAL
+      journal_flash(CONFIG_STORAGE_JOURNAL_PARTITION),
+      journal(journal_flash),
+#endif
+      dirty(false),
+      flush_policy(FLUSH_QUIET_US, FLUSH_MAX_LATENCY_US),
+      flush_timer(nullptr),
+      lock(portMUX_INITIALIZER_UNLOCKED) {}
 
 esp_err_t Storage::init() {
-  nvs_handle_t nvs_storage;
-  esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_storage);
-  if (err != ESP_OK) {
-    return err;
-  }
+  esp_err_t err;
+  bool loaded = false;
 
-  uint8_t active_val;
-  if (nvs_get_u8(nvs_storage, ACTIVE_NVS_KEY, &active_val) == ESP_OK) {
-    this->active = active_val != 0;
+#ifdef CONFIG_STORAGE_BACKEND_JOURNAL
+  err = journal_flash.init();
+  if (err != ESP_OK) return err;
+
+  err = journal.init();
+  if (err != ESP_OK) return err;
+
+  JournalStats stats = journal.get_stats();
+  log_info("State journal scanned in %lu us (%lu reads)",
+           static_cast<uint32_t>(stats.scan_time_us), stats.scan_reads);
+
+  if (journal.has_state()) {
+    LightState state = journal.get_state(this->state);
+    state.level = std::min(state.level, MAX_LEVEL);
+    state.saturation = std::min(state.saturation, MAX_LEVEL);
+    this->state = state;
+    loaded = true;
   }
+#endif
+
+  // An empty journal falls back to NVS, so that state survives switching
+  // storage backends
+  if (!loaded) {
+    nvs_handle_t nvs_storage;
+    err = nvs_open(name_space, NVS_READWRITE, &nvs_storage);
+    if (err != ESP_OK) {
+      return err;
+    }
+
+    err = load(nvs_storage);
+    if (err != ESP_OK) {
+      nvs_close(nvs_storage);
+      return err;
+    }
 
-  uint64_t brightness_val;
-  if (nvs_get_u64(nvs_storage, BRIGHTNESS_NVS_KEY, &brightness_val) == ESP_OK) {
-    this->brightness = brightness_val / DOUBLE_SCALE_FACTOR;
+    nvs_close(nvs_storage);
   }
 
-  uint64_t color_x_val;
-  if (nvs_get_u64(nvs_storage, COLOR_X_NVS_KEY, &color_x_val) == ESP_OK) {
-    this->color_x = color_x_val / DOUBLE_SCALE_FACTOR;
+  // The range may have changed since the state was stored
+  state.color_temperature =
+      std::clamp(state.color_temperature, COLOR_TEMP_MIN_MIREDS,
+                 COLOR_TEMP_MAX_MIREDS);
+
+#ifdef CONFIG_STORAGE_WRITE_BEHIND
+  esp_timer_create_args_t timer_args = {
+      .callback = flush_timer_callback,
+      .arg = this,
+      .dispatch_method = ESP_TIMER_TASK,
+      .name = "storage_flush",
+      .skip_unhandled_events = true,
+  };
+  err = esp_timer_create(&timer_args, &flush_timer);
+  if (err != ESP_OK) return err;
+#endif
+
+  return ESP_OK;
+}
+
+esp_err_t Storage::flush() {
+  portENTER_CRITICAL(&lock);
+  bool dirty = this->dirty;
+  LightState state = this->state;
+  this->dirty = false;
+  flush_policy.on_flush();
+  portEXIT_CRITICAL(&lock);
+
+  if (!dirty) return ESP_OK;
+
+  uint32_t start = trace_now();
+  esp_err_t err = persist(state);
+  trace_record(TraceStage::STORAGE_COMMIT, start);
+  if (err != ESP_OK) {
+    // Keep the state dirty so that the next flush retries it
+    portENTER_CRITICAL(&lock);
+    this->dirty = true;
+    portEXIT_CRITICAL(&lock);
+#ifdef CONFIG_STORAGE_WRITE_BEHIND
+    mark_dirty();
+#endif
+    return err;
   }
 
-  uint64_t color_y_val;
-  if (nvs_get_u64(nvs_storage, COLOR_Y_NVS_KEY, &color_y_val) == ESP_OK) {
-    this->color_y = color_y_val / DOUBLE_SCALE_FACTOR;
+#ifdef CONFIG_LIGHT_BOOT_FRAME
+  // Only lights the LED after a power cycle, the stored state stays what
+  // counts. Without the partition BootFrame warns once.
+  if (light != NO_LIGHT) {
+    err = save_cold_boot_state(light, state);
+    if (err != ESP_OK && err != ESP_ERR_NOT_FOUND) {
+      log_warn("Error saving cold boot state: %s", esp_err_to_name(err));
+    }
   }
+#endif
 
-  nvs_close(nvs_storage);
   return ESP_OK;
 }
 
 esp_err_t Storage::set_active(bool active) {
+  portENTER_CRITICAL(&lock);
+  state.active = active;
+  portEXIT_CRITICAL(&lock);
+
+  return commit();
+}
+
+bool Storage::get_active() { return state.active; }
+
+esp_err_t Storage::set_brightness(uint8_t level) {
+  if (level > MAX_LEVEL) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  portENTER_CRITICAL(&lock);
+  state.level = level;
+  portEXIT_CRITICAL(&lock);
+
+  return commit();
+}
+
+uint8_t Storage::get_brightness() { return state.level; }
+
+esp_err_t Storage::set_color(uint16_t color_x, uint16_t color_y) {
+  portENTER_CRITICAL(&lock);
+  state.color_x = color_x;
+  state.color_y = color_y;
+  state.color_mode = ColorMode::XY;
+  portEXIT_CRITICAL(&lock);
+
+  return commit();
+}
+
+uint16_t Storage::get_color_x() { return state.color_x; }
+
+uint16_t Storage::get_color_y() { return state.color_y; }
+
+ColorMode Storage::get_color_mode() { return state.color_mode; }
+
+uint16_t Storage::get_color_temperature() { return state.color_temperature; }
+
+LightState Storage::get_state() {
+  portENTER_CRITICAL(&lock);
+  LightState state = this->state;
+  portEXIT_CRITICAL(&lock);
+
+  return state;
+}
+
+esp_err_t Storage::set_state(const LightState& state) {
+  if (state.level > MAX_LEVEL) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  portENTER_CRITICAL(&lock);
+  this->state = state;
+  portEXIT_CRITICAL(&lock);
+
+  return commit();
+}
+
+esp_err_t Storage::load_scenes(StoredScene* scenes, size_t* count) {
+  *count = 0;
+
   nvs_handle_t nvs_storage;
-  esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_storage);
+  esp_err_t err = nvs_open(name_space, NVS_READWRITE, &nvs_storage);
   if (err != ESP_OK) return err;
 
-  err = nvs_set_u8(nvs_storage, ACTIVE_NVS_KEY, active ? 1 : 0);
-  if (err != ESP_OK) {
-    nvs_close(nvs_storage);
-    return err;
+  StoredScenes stored;
+  size_t size = sizeof(stored);
+  err = nvs_get_blob(nvs_storage, SCENES_NVS_KEY, &stored, &size);
+  nvs_close(nvs_storage);
+  if (err == ESP_ERR_NVS_NOT_FOUND) return ESP_OK;
+  // Stored by a build with a higher CONFIG_LIGHT_MAX_SCENES
+  if (err == ESP_ERR_NVS_INVALID_LENGTH) {
+    log_warn("Ignoring stored scenes beyond the table size");
+    return ESP_OK;
   }
+  if (err != ESP_OK) return err;
 
-  err = nvs_commit(nvs_storage);
-  if (err != ESP_OK) {
-    nvs_close(nvs_storage);
-    return err;
+  if (size < SCENES_HEADER_SIZE || stored.version != SCENES_VERSION ||
+      stored.count > MAX_SCENES ||
+      size != SCENES_HEADER_SIZE + stored.count * sizeof(StoredScene) ||
+      stored.crc != scenes_crc(stored)) {
+    log_warn("Ignoring invalid stored scenes: size=%u",
+             static_cast<unsigned>(size));
+    return ESP_OK;
   }
 
-  this->active = active;
+  std::copy_n(stored.scenes, stored.count, scenes);
+  *count = stored.count;
 
-  nvs_close(nvs_storage);
   return ESP_OK;
 }
 
-bool Storage::get_active() { return active; }
-
-esp_err_t Storage::set_brightness(double brightness) {
-  if (brightness < 0.0 || brightness > 1.0) {
+esp_err_t Storage::save_scenes(const StoredScene* scenes, size_t count) {
+  if (count > MAX_SCENES) {
     return ESP_ERR_INVALID_ARG;
   }
 
+  StoredScenes stored;
+  stored.version = SCENES_VERSION;
+  stored.count = static_cast<uint8_t>(count);
+  std::copy_n(scenes, count, stored.scenes);
+  stored.crc = scenes_crc(stored);
+
   nvs_handle_t nvs_storage;
-  esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_storage);
+  esp_err_t err = nvs_open(name_space, NVS_READWRITE, &nvs_storage);
   if (err != ESP_OK) return err;
 
-  err = nvs_set_u64(nvs_storage, BRIGHTNESS_NVS_KEY,
-                    static_cast<uint64_t>(brightness * DOUBLE_SCALE_FACTOR));
+  err = nvs_set_blob(nvs_storage, SCENES_NVS_KEY, &stored,
+                     SCENES_HEADER_SIZE + count * sizeof(StoredScene));
   if (err != ESP_OK) {
     nvs_close(nvs_storage);
     return err;
@@ -96,55 +373,170 @@ esp_err_t Storage::set_brightness(double brightness) {
     return err;
   }
 
-  this->brightness = brightness;
-
   nvs_close(nvs_storage);
   return ESP_OK;
 }
 
-double Storage::get_brightness() { return brightness; }
+// PRIVATE METHODS
+void Storage::flush_timer_callback(void* arg) {
+  auto* storage = static_cast<Storage*>(arg);
 
-esp_err_t Storage::set_color_x(double color_x) {
-  if (color_x < 0.0 || color_x > 1.0) {
-    return ESP_ERR_INVALID_ARG;
+  esp_err_t err = storage->flush();
+  if (err != ESP_OK) {
+    log_error("Error flushing Storage: %s", esp_err_to_name(err));
   }
+}
 
-  nvs_handle_t nvs_storage;
-  esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_storage);
+esp_err_t Storage::load(nvs_handle_t nvs_storage) {
+  uint8_t blob[sizeof(StoredState)];
+  size_t size = sizeof(blob);
+  esp_err_t err = nvs_get_blob(nvs_storage, STATE_NVS_KEY, blob, &size);
+  if (err == ESP_ERR_NVS_NOT_FOUND) {
+    return migrate_legacy_keys(nvs_storage);
+  }
   if (err != ESP_OK) return err;
 
-  err = nvs_set_u64(nvs_storage, COLOR_X_NVS_KEY,
-                    static_cast<uint64_t>(color_x * DOUBLE_SCALE_FACTOR));
-  if (err != ESP_OK) {
-    nvs_close(nvs_storage);
-    return err;
+  // States of earlier versions keep the defaults for the values they lack,
+  // and are stored in the current version by the next commit
+  StoredState stored;
+  StoredStateTemperature stored_temperature;
+  StoredStateXY stored_xy;
+  if (read_state(blob, size, STATE_VERSION, &stored) &&
+      is_valid_mode(stored.color_mode)) {
+    state.active = stored.active != 0;
+    state.level = std::min(stored.level, MAX_LEVEL);
+    state.color_x = stored.color_x;
+    state.color_y = stored.color_y;
+    state.color_mode = static_cast<ColorMode>(stored.color_mode);
+    state.color_temperature = stored.color_temperature;
+    state.enhanced_hue = stored.enhanced_hue;
+    state.saturation = std::min(stored.saturation, MAX_LEVEL);
+  } else if (read_state(blob, size, STATE_VERSION_TEMPERATURE,
+                        &stored_temperature) &&
+             is_valid_mode(stored_temperature.color_mode)) {
+    state.active = stored_temperature.active != 0;
+    state.level = std::min(stored_temperature.level, MAX_LEVEL);
+    state.color_x = stored_temperature.color_x;
+    state.color_y = stored_temperature.color_y;
+    state.color_mode = static_cast<ColorMode>(stored_temperature.color_mode);
+    state.color_temperature = stored_temperature.color_temperature;
+  } else if (read_state(blob, size, STATE_VERSION_XY, &stored_xy)) {
+    state.active = stored_xy.active != 0;
+    state.level = std::min(stored_xy.level, MAX_LEVEL);
+    state.color_x = stored_xy.color_x;
+    state.color_y = stored_xy.color_y;
+    state.color_mode = ColorMode::XY;
+  } else {
+    log_warn("Ignoring invalid stored state: size=%u, version=%u",
+             static_cast<unsigned>(size), blob[0]);
   }
 
-  err = nvs_commit(nvs_storage);
-  if (err != ESP_OK) {
-    nvs_close(nvs_storage);
-    return err;
+  return ESP_OK;
+}
+
+esp_err_t Storage::migrate_legacy_keys(nvs_handle_t nvs_storage) {
+  bool found = false;
+
+  uint8_t active_val;
+  if (nvs_get_u8(nvs_storage, LEGACY_ACTIVE_NVS_KEY, &active_val) == ESP_OK) {
+    state.active = active_val != 0;
+    found = true;
   }
 
-  this->color_x = color_x;
+  uint64_t brightness_val;
+  if (nvs_get_u64(nvs_storage, LEGACY_BRIGHTNESS_NVS_KEY, &brightness_val) ==
+      ESP_OK) {
+    state.level = legacy_to_zcl(brightness_val, MAX_LEVEL);
+    found = true;
+  }
 
-  nvs_close(nvs_storage);
-  return ESP_OK;
+  uint64_t color_x_val;
+  if (nvs_get_u64(nvs_storage, LEGACY_COLOR_X_NVS_KEY, &color_x_val) ==
+      ESP_OK) {
+    state.color_x = legacy_to_zcl(color_x_val, MAX_COORD);
+    found = true;
+  }
+
+  uint64_t color_y_val;
+  if (nvs_get_u64(nvs_storage, LEGACY_COLOR_Y_NVS_KEY, &color_y_val) ==
+      ESP_OK) {
+    state.color_y = legacy_to_zcl(color_y_val, MAX_COORD);
+    found = true;
+  }
+
+  // Nothing to migrate on a fresh device, defaults are used until first write
+  if (!found) return ESP_OK;
+
+  log_info("Migrating legacy Storage keys");
+
+  StoredState stored = make_state(state);
+  esp_err_t err =
+      nvs_set_blob(nvs_storage, STATE_NVS_KEY, &stored, sizeof(stored));
+  if (err != ESP_OK) return err;
+
+  const char* legacy_keys[] = {
+      LEGACY_ACTIVE_NVS_KEY,
+      LEGACY_BRIGHTNESS_NVS_KEY,
+      LEGACY_COLOR_X_NVS_KEY,
+      LEGACY_COLOR_Y_NVS_KEY,
+  };
+  for (const char* key : legacy_keys) {
+    err = nvs_erase_key(nvs_storage, key);
+    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) return err;
+  }
+
+  return nvs_commit(nvs_storage);
 }
 
-double Storage::get_color_x() { return color_x; }
+esp_err_t Storage::commit() {
+  portENTER_CRITICAL(&lock);
+  dirty = true;
+  portEXIT_CRITICAL(&lock);
 
-esp_err_t Storage::set_color_y(double color_y) {
-  if (color_y < 0.0 || color_y > 1.0) {
-    return ESP_ERR_INVALID_ARG;
+#ifdef CONFIG_STORAGE_WRITE_BEHIND
+  return mark_dirty();
+#else
+  return flush();
+#endif
+}
+
+esp_err_t Storage::mark_dirty() {
+  int64_t now = esp_timer_get_time();
+
+  portENTER_CRITICAL(&lock);
+  int64_t deadline = flush_policy.on_write(now);
+  portEXIT_CRITICAL(&lock);
+
+  // Restart the timer, so it fires once writes have settled or the max
+  // latency has been reached, whichever comes first
+  esp_timer_stop(flush_timer);
+  int64_t timeout = deadline > now ? deadline - now : 0;
+  return esp_timer_start_once(flush_timer, static_cast<uint64_t>(timeout));
+}
+
+esp_err_t Storage::persist(const LightState& state) {
+#ifdef CONFIG_STORAGE_BACKEND_JOURNAL
+  uint32_t sectors_erased = journal.get_stats().sectors_erased;
+
+  esp_err_t err = journal.append(state);
+  if (err != ESP_OK) return err;
+
+  // Sectors are erased once per wrap, which is rare enough to report on
+  JournalStats stats = journal.get_stats();
+  if (stats.sectors_erased != sectors_erased) {
+    log_info("State journal: %lu records, write amplification %lu%%",
+             stats.records_written, journal.get_write_amplification());
   }
 
+  return ESP_OK;
+#else
+  StoredState stored = make_state(state);
+
   nvs_handle_t nvs_storage;
-  esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_storage);
+  esp_err_t err = nvs_open(name_space, NVS_READWRITE, &nvs_storage);
   if (err != ESP_OK) return err;
 
-  err = nvs_set_u64(nvs_storage, COLOR_Y_NVS_KEY,
-                    static_cast<uint64_t>(color_y * DOUBLE_SCALE_FACTOR));
+  err = nvs_set_blob(nvs_storage, STATE_NVS_KEY, &stored, sizeof(stored));
   if (err != ESP_OK) {
     nvs_close(nvs_storage);
     return err;
@@ -156,10 +548,7 @@ esp_err_t Storage::set_color_y(double color_y) {
     return err;
   }
 
-  this->color_y = color_y;
-
   nvs_close(nvs_storage);
   return ESP_OK;
+#endif
 }
-
-double Storage::get_color_y() { return color_y; }
@@ -1,33 +1,95 @@
 #ifndef STORAGE_HPP
 #define STORAGE_HPP
 
+#include <cstddef>
 #include <cstdint>
 
+#include "FlushPolicy.hpp"
+#include "LightState.hpp"
+#include "PartitionFlash.hpp"
+#include "StateJournal.hpp"
 #include "esp_err.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "nvs.h"
+
+constexpr size_t MAX_SCENES = CONFIG_LIGHT_MAX_SCENES;
+
+// Storage of no light, which saves no cold boot state
+constexpr uint8_t NO_LIGHT = UINT8_MAX;
+
+// Scene as persisted, 19 bytes each
+struct __attribute__((packed)) StoredScene {
+  uint16_t group_id;
+  uint8_t scene_id;
+  uint8_t active;
+  uint8_t level;
+  uint16_t color_x;
+  uint16_t color_y;
+  uint8_t color_mode;
+  uint16_t color_temperature;
+  uint16_t enhanced_hue;
+  uint8_t saturation;
+  uint32_t transition_ms;
+};
 
 class Storage {
  public:
-  Storage(bool default_active, double default_brightness,
-          double default_color_x, double default_color_y);
+  // Each light stores its state and scenes under its own NVS namespace. The
+  // state of a light is saved as its cold boot state as well, whenever it is
+  // persisted.
+  Storage(const char* name_space, const LightState& defaults,
+          uint8_t light = NO_LIGHT);
   esp_err_t init();
 
+  // Writes all pending changes to flash immediately
+  esp_err_t flush();
+
   esp_err_t set_active(bool active);
   bool get_active();
 
-  esp_err_t set_brightness(double brightness);
-  double get_brightness();
+  esp_err_t set_brightness(uint8_t level);
+  uint8_t get_brightness();
+
+  esp_err_t set_color(uint16_t color_x, uint16_t color_y);
+  uint16_t get_color_x();
+  uint16_t get_color_y();
+
+  ColorMode get_color_mode();
+  uint16_t get_color_temperature();
 
-  esp_err_t set_color_x(double color_x);
-  double get_color_x();
+  LightState get_state();
 
-  esp_err_t set_color_y(double color_y);
-  double get_color_y();
+  // Updates all values at once with a single commit
+  esp_err_t set_state(const LightState& state);
+
+  // Scenes are written through, they change far less often than the state.
+  // Loads nothing if no valid scenes are stored.
+  esp_err_t load_scenes(StoredScene* scenes, size_t* count);
+  esp_err_t save_scenes(const StoredScene* scenes, size_t count);
 
  private:
-  bool active;
-  double brightness;
-  double color_x;
-  double color_y;
+  static void flush_timer_callback(void* arg);
+
+  esp_err_t load(nvs_handle_t nvs_storage);
+  esp_err_t migrate_legacy_keys(nvs_handle_t nvs_storage);
+  esp_err_t commit();
+  esp_err_t mark_dirty();
+  esp_err_t persist(const LightState& state);
+
+  const char* const name_space;
+  const uint8_t light;
+  LightState state;
+
+#ifdef CONFIG_STORAGE_BACKEND_JOURNAL
+  PartitionFlash journal_flash;
+  StateJournal journal;
+#endif
+
+  bool dirty;
+  FlushPolicy flush_policy;
+  esp_timer_handle_t flush_timer;
+  portMUX_TYPE lock;
 };
 
 #endif
@@ -0,0 +1,64 @@
+#include "Transition.hpp"
+
+constexpr uint32_t FRACTION_BITS = 8;
+constexpr int32_t HALF = 1 << (FRACTION_BITS - 1);
+
+Transition::Transition() : current{}, delta{}, target{}, frames_left(0) {}
+
+void Transition::set(ColorRGB16 value) {
+  target[0] = value.r;
+  target[1] = value.g;
+  target[2] = value.b;
+
+  for (int i = 0; i < 3; i++) {
+    current[i] = static_cast<int32_t>(target[i]) << FRACTION_BITS;
+    delta[i] = 0;
+  }
+  frames_left = 0;
+}
+
+void Transition::retarget(ColorRGB16 value, uint32_t frames) {
+  if (frames == 0) {
+    set(value);
+    return;
+  }
+
+  target[0] = value.r;
+  target[1] = value.g;
+  target[2] = value.b;
+
+  for (int i = 0; i < 3; i++) {
+    int32_t distance =
+        (static_cast<int32_t>(target[i]) << FRACTION_BITS) - current[i];
+    delta[i] = distance / static_cast<int32_t>(frames);
+  }
+  frames_left = frames;
+}
+
+bool Transition::step() {
+  if (frames_left == 0) return false;
+
+  frames_left--;
+  if (frames_left == 0) {
+    // Snap to the target to get rid of accumulated rounding errors
+    for (int i = 0; i < 3; i++) {
+      current[i] = static_cast<int32_t>(target[i]) << FRACTION_BITS;
+    }
+    return false;
+  }
+
+  for (int i = 0; i < 3; i++) {
+    current[i] += delta[i];
+  }
+  return true;
+}
+
+ColorRGB16 Transition::get_output() {
+  return ColorRGB16{
+      .r = static_cast<uint16_t>((current[0] + HALF) >> FRACTION_BITS),
+      .g = static_cast<uint16_t>((current[1] + HALF) >> FRACTION_BITS),
+      .b = static_cast<uint16_t>((current[2] + HALF) >> FRACTION_BITS),
+  };
+}
+
+bool Transition::is_running() { return frames_left > 0; }
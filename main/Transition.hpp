@@ -0,0 +1,35 @@
+#ifndef TRANSITION_HPP
+#define TRANSITION_HPP
+
+#include <cstdint>
+
+#include "Color.hpp"
+
+// Linear RGB transition stepped one frame at a time. 16-bit channels are kept
+// with 8 fraction bits and advanced by a precomputed per-frame delta, so a
+// frame costs three additions regardless of how the target color was derived.
+class Transition {
+ public:
+  Transition();
+
+  // Jumps to value immediately
+  void set(ColorRGB16 value);
+
+  // Moves from the current output to target over the given number of frames.
+  // A running transition continues from wherever it currently is.
+  void retarget(ColorRGB16 target, uint32_t frames);
+
+  // Advances by one frame. Returns false once the target has been reached.
+  bool step();
+
+  ColorRGB16 get_output();
+  bool is_running();
+
+ private:
+  int32_t current[3];
+  int32_t delta[3];
+  uint16_t target[3];
+  uint32_t frames_left;
+};
+
+#endif
@@ -1,19 +1,40 @@
 #include "ZigbeeDevice.hpp"
 
+#include <algorithm>
+
+#include "LatencyTrace.hpp"
+#include "Log.hpp"
+
 constexpr uint32_t APP_DEVICE_VERSION = 1;
 
+ZigbeeDevice* ZigbeeDevice::pending_devices = nullptr;
+bool ZigbeeDevice::flush_scheduled = false;
+
 // PUBLIC METHODS
-ZigbeeDevice::ZigbeeDevice(const DeviceConfig config) : config(config) {}
+ZigbeeDevice::ZigbeeDevice(const DeviceConfig config)
+    : action_dispatcher(nullptr),
+      groups(config.endpoint),
+      attribute_groups{},
+      attribute_group_count(0),
+      next_pending(nullptr),
+      has_pending(false),
+      config(config) {}
 
 esp_err_t ZigbeeDevice::init(ClustersSetupHandler setup_clusters) {
   clusters = esp_zb_zcl_cluster_list_create();
 
-  esp_err_t err = setup_basic_cluster(clusters);
+  esp_err_t err = groups.init();
+  if (err != ESP_OK) return err;
+
+  err = setup_basic_cluster(clusters);
   if (err != ESP_OK) return err;
 
   err = setup_identify_cluster(clusters);
   if (err != ESP_OK) return err;
 
+  err = setup_groups_cluster(clusters);
+  if (err != ESP_OK) return err;
+
   err = setup_clusters(clusters);
   if (err != ESP_OK) return err;
 
@@ -23,23 +44,145 @@ esp_err_t ZigbeeDevice::init(ClustersSetupHandler setup_clusters) {
       .app_device_id = config.app_device_id,
       .app_device_version = APP_DEVICE_VERSION,
   };
-  EndpointHandler endpoint_handler =
-      [this](uint16_t cluster_id, uint32_t callback_id, const void* msg) {
-        ActionKey key = make_action_key(cluster_id, callback_id);
-        auto iter = this->action_handlers.find(key);
-        if (iter != this->action_handlers.end()) {
-          auto& [_, handler] = *iter;
-          return handler(msg);
-        }
-        return ESP_OK;
-      };
-  err = Zigbee.register_endpoint(endpoint_config, clusters, endpoint_handler);
+  err = Zigbee.register_endpoint(endpoint_config, clusters,
+                                 handle_endpoint_action, this, &groups);
   if (err != ESP_OK) return err;
 
   return ESP_OK;
 }
 
+esp_err_t ZigbeeDevice::handle_attribute_group(
+    uint16_t cluster_id, std::initializer_list<uint16_t> attr_ids,
+    AttributeGroupHandler handler) {
+  if (attr_ids.size() == 0 || attr_ids.size() > MAX_BATCH_ATTRIBUTES) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (attribute_group_count == MAX_ATTRIBUTE_GROUPS) return ESP_ERR_NO_MEM;
+
+  AttributeGroup& group = attribute_groups[attribute_group_count];
+  group = {
+      .cluster_id = cluster_id,
+      .attr_count = static_cast<uint8_t>(attr_ids.size()),
+      .attr_ids = {},
+      .handler = handler,
+      .pending = {},
+  };
+  std::copy(attr_ids.begin(), attr_ids.end(), group.attr_ids);
+  attribute_group_count++;
+
+  return ESP_OK;
+}
+
+const GroupTable& ZigbeeDevice::get_groups() { return groups; }
+
 // PRIVATE METHODS
+esp_err_t ZigbeeDevice::handle_endpoint_action(void* context,
+                                               uint16_t cluster_id,
+                                               uint32_t callback_id,
+                                               const void* msg) {
+  auto* device = static_cast<ZigbeeDevice*>(context);
+
+  if (callback_id == ESP_ZB_CORE_SET_ATTR_VALUE_CB_ID) {
+    const auto* attr_msg =
+        static_cast<const esp_zb_zcl_set_attr_value_message_t*>(msg);
+    AttributeGroup* group =
+        device->find_group(cluster_id, attr_msg->attribute.id);
+    if (group != nullptr) return device->collect_attribute(*group, attr_msg);
+  }
+
+  if (device->action_dispatcher == nullptr) return ESP_ERR_NOT_FOUND;
+
+  uint32_t start = trace_now();
+  esp_err_t err = device->action_dispatcher(cluster_id, callback_id, msg);
+  trace_record(TraceStage::HANDLER, start);
+
+  return err;
+}
+
+void ZigbeeDevice::flush_pending_groups(uint8_t param) {
+  flush_scheduled = false;
+
+  while (pending_devices != nullptr) {
+    ZigbeeDevice* device = pending_devices;
+    pending_devices = device->next_pending;
+    device->next_pending = nullptr;
+    device->has_pending = false;
+
+    for (uint8_t i = 0; i < device->attribute_group_count; i++) {
+      AttributeGroup& group = device->attribute_groups[i];
+      if (group.pending.count > 0) device->flush_group(group);
+    }
+  }
+}
+
+esp_err_t ZigbeeDevice::collect_attribute(
+    AttributeGroup& group, const esp_zb_zcl_set_attr_value_message_t* msg) {
+  const auto& attribute = msg->attribute;
+  if (attribute.data.value == nullptr ||
+      attribute.data.size > MAX_BATCH_VALUE_SIZE) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+
+  AttributeBatch& batch = group.pending;
+  batch.endpoint = config.endpoint;
+  batch.cluster_id = group.cluster_id;
+
+  uint8_t index = 0;
+  while (index < batch.count && batch.values[index].id != attribute.id) {
+    index++;
+  }
+  if (index == batch.count) batch.count++;
+
+  AttributeValue& value = batch.values[index];
+  value.id = attribute.id;
+  value.size = static_cast<uint8_t>(attribute.data.size);
+  memcpy(value.data, attribute.data.value, attribute.data.size);
+
+  // Every attribute of the group was written, no need to wait any longer
+  if (batch.count == group.attr_count) {
+    flush_group(group);
+    return ESP_OK;
+  }
+
+  if (!has_pending) {
+    has_pending = true;
+    next_pending = pending_devices;
+    pending_devices = this;
+  }
+
+  // Runs on the Zigbee task once the current command has been processed
+  if (!flush_scheduled) {
+    flush_scheduled = true;
+    esp_zb_scheduler_alarm(flush_pending_groups, 0, 0);
+  }
+
+  return ESP_OK;
+}
+
+void ZigbeeDevice::flush_group(AttributeGroup& group) {
+  AttributeBatch batch = group.pending;
+  group.pending.count = 0;
+
+  esp_err_t err = group.handler(batch);
+  if (err != ESP_OK) {
+    log_error("Error handling attribute group: cluster_id=%u, err=%s",
+              group.cluster_id, esp_err_to_name(err));
+  }
+}
+
+ZigbeeDevice::AttributeGroup* ZigbeeDevice::find_group(uint16_t cluster_id,
+                                                       uint16_t attr_id) {
+  for (uint8_t i = 0; i < attribute_group_count; i++) {
+    AttributeGroup& group = attribute_groups[i];
+    if (group.cluster_id != cluster_id) continue;
+
+    for (uint8_t i = 0; i < group.attr_count; i++) {
+      if (group.attr_ids[i] == attr_id) return &group;
+    }
+  }
+  return nullptr;
+}
+
 void ZigbeeDevice::make_attr_str(const char* str, char* buf, size_t buf_len) {
   if (str == nullptr) {
     buf[0] = 0;
@@ -92,3 +235,17 @@ esp_err_t ZigbeeDevice::setup_identify_cluster(
 
   return ESP_OK;
 }
+
+// Membership is managed by the stack, which also answers the Groups commands
+esp_err_t ZigbeeDevice::setup_groups_cluster(esp_zb_cluster_list_t* clusters) {
+  esp_zb_groups_cluster_cfg_t groups_cfg = {
+      .groups_name_support_id = 0,
+  };
+  auto* groups_attrs = esp_zb_groups_cluster_create(&groups_cfg);
+
+  esp_err_t err = esp_zb_cluster_list_add_groups_cluster(
+      clusters, groups_attrs, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE);
+  if (err != ESP_OK) return err;
+
+  return ESP_OK;
+}
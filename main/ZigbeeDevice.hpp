@@ -1,15 +1,62 @@
 #ifndef ZIGBEE_DEVICE_HPP
 #define ZIGBEE_DEVICE_HPP
 
+#include <array>
 #include <cstdint>
+#include <cstring>
 #include <functional>
-#include <unordered_map>
+#include <initializer_list>
 
+#include "ActionTable.hpp"
+#include "GroupTable.hpp"
 #include "ZigbeeStack.hpp"
 #include "esp_zigbee_core.h"
 
-using ActionKey = uint64_t;
-using ActionHandler = std::function<esp_err_t(const void* msg)>;
+using ActionDispatcher = esp_err_t (*)(uint16_t cluster_id,
+                                       uint32_t callback_id, const void* msg);
+
+constexpr size_t MAX_ATTRIBUTE_GROUPS = CONFIG_ZIGBEE_MAX_ATTRIBUTE_GROUPS;
+constexpr size_t MAX_BATCH_ATTRIBUTES = 8;
+constexpr size_t MAX_BATCH_VALUE_SIZE = 8;
+
+struct AttributeValue {
+  uint16_t id;
+  uint8_t size;
+  uint8_t data[MAX_BATCH_VALUE_SIZE];
+};
+
+// Attribute writes to one cluster, collected while processing one command
+struct AttributeBatch {
+  uint8_t endpoint;
+  uint16_t cluster_id;
+  uint8_t count;
+  AttributeValue values[MAX_BATCH_ATTRIBUTES];
+
+  bool has(uint16_t attribute_id) const {
+    return find(attribute_id) != nullptr;
+  }
+
+  // Returns the written value, or fallback if the attribute was not written
+  template <typename T>
+  T get(uint16_t attribute_id, T fallback) const {
+    const AttributeValue* value = find(attribute_id);
+    if (value == nullptr || value->size != sizeof(T)) return fallback;
+
+    T result;
+    memcpy(&result, value->data, sizeof(T));
+    return result;
+  }
+
+ private:
+  const AttributeValue* find(uint16_t attribute_id) const {
+    for (uint8_t i = 0; i < count; i++) {
+      if (values[i].id == attribute_id) return &values[i];
+    }
+    return nullptr;
+  }
+};
+
+using AttributeGroupHandler = esp_err_t (*)(const AttributeBatch& batch);
 
 using ClustersSetupHandler =
     std::function<esp_err_t(esp_zb_cluster_list_t* clusters)>;
@@ -31,34 +78,56 @@ class ZigbeeDevice {
   ZigbeeDevice(const DeviceConfig config);
   esp_err_t init(ClustersSetupHandler setup_clusters);
 
-  template <typename T>
-  void handle_action(uint16_t cluster_id, uint32_t callback_id,
-                     std::function<esp_err_t(const T*)> handler) {
-    ActionKey key = make_action_key(cluster_id, callback_id);
-    ActionHandler action_handler = make_action_handler(handler);
-    action_handlers.insert_or_assign(key, action_handler);
+  // Handles actions with a table built at compile time from Action entries,
+  // replacing any previously set actions
+  template <typename... Actions>
+  void handle_actions() {
+    action_dispatcher = &ActionTable<Actions...>::dispatch;
   }
 
+  // Delivers writes to related attributes of a cluster as a single batch.
+  // Writes are collected until every attribute in the group was written, or
+  // until the Zigbee stack finished processing the current command.
+  esp_err_t handle_attribute_group(uint16_t cluster_id,
+                                   std::initializer_list<uint16_t> attr_ids,
+                                   AttributeGroupHandler handler);
+
+  const GroupTable& get_groups();
+
  private:
+  struct AttributeGroup {
+    uint16_t cluster_id;
+    uint8_t attr_count;
+    uint16_t attr_ids[MAX_BATCH_ATTRIBUTES];
+    AttributeGroupHandler handler;
+    AttributeBatch pending;
+  };
+
   static void make_attr_str(const char* str, char* buf, size_t buf_len);
-  static constexpr ActionKey make_action_key(uint16_t cluster_id,
-                                             uint32_t callback_id) {
-    return (static_cast<uint64_t>(callback_id) << 16) |
-           static_cast<uint64_t>(cluster_id);
-  }
-  template <typename T>
-  static ActionHandler make_action_handler(
-      std::function<esp_err_t(const T*)> handler) {
-    return [handler](const void* msg) {
-      return handler(static_cast<const T*>(msg));
-    };
-  }
+  static esp_err_t handle_endpoint_action(void* context, uint16_t cluster_id,
+                                          uint32_t callback_id,
+                                          const void* msg);
+
+  // Devices with collected attribute writes, linked through next_pending
+  static ZigbeeDevice* pending_devices;
+  static bool flush_scheduled;
+  static void flush_pending_groups(uint8_t param);
+  esp_err_t collect_attribute(AttributeGroup& group,
+                              const esp_zb_zcl_set_attr_value_message_t* msg);
+  void flush_group(AttributeGroup& group);
+  AttributeGroup* find_group(uint16_t cluster_id, uint16_t attr_id);
 
   esp_err_t setup_basic_cluster(esp_zb_cluster_list_t* clusters);
   esp_err_t setup_identify_cluster(esp_zb_cluster_list_t* clusters);
+  esp_err_t setup_groups_cluster(esp_zb_cluster_list_t* clusters);
 
   esp_zb_cluster_list_t* clusters;
-  std::unordered_map<ActionKey, ActionHandler> action_handlers;
+  ActionDispatcher action_dispatcher;
+  GroupTable groups;
+  std::array<AttributeGroup, MAX_ATTRIBUTE_GROUPS> attribute_groups;
+  uint8_t attribute_group_count;
+  ZigbeeDevice* next_pending;
+  bool has_pending;
   const DeviceConfig config;
 };
 
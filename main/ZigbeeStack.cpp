@@ -1,19 +1,106 @@
 #include "ZigbeeStack.hpp"
 
-#include <cstdio>
-
-#include "freertos/FreeRTOS.h"
-#include "freertos/task.h"
+#include "LatencyTrace.hpp"
+#include "Log.hpp"
+#include "esp_timer.h"
 
 constexpr char TASK_NAME[] = "ZigbeeStack";
-constexpr uint32_t TASK_STACK_SIZE = 4096;
+constexpr uint32_t TASK_STACK_SIZE = CONFIG_ZIGBEE_TASK_STACK_SIZE;
 constexpr uint32_t TASK_PRIORITY = 5;
 
+constexpr uint8_t BROADCAST_ENDPOINT = 0xFF;
+
+// ZCL frame header, see ZCL 2.4.1
+constexpr uint8_t ZCL_FRAME_TYPE_MASK = 0x03;
+constexpr uint8_t ZCL_FRAME_TYPE_CLUSTER = 0x01;
+constexpr uint8_t ZCL_FRAME_MANUF_SPECIFIC = 0x04;
+constexpr uint8_t ZCL_FRAME_TO_CLIENT = 0x08;
+constexpr uint8_t ZCL_FRAME_DISABLE_DEFAULT_RESPONSE = 0x10;
+constexpr size_t ZCL_HEADER_SIZE = 3;
+constexpr size_t ZCL_MANUF_CODE_SIZE = 2;
+
+constexpr uint8_t ZCL_STATUS_INSUFFICIENT_SPACE = 0x89;
+constexpr uint8_t GROUPS_CMD_ADD_GROUP_RESPONSE = 0x00;
+
+// Cluster specific command of a client to server ZCL frame
+struct ClusterCommand {
+  uint8_t sequence;
+  uint8_t id;
+  const uint8_t* payload;
+  size_t length;
+};
+
+static bool parse_cluster_command(const esp_zb_apsde_data_ind_t& ind,
+                                  ClusterCommand* command) {
+  if (ind.asdu == nullptr || ind.asdu_length < ZCL_HEADER_SIZE) return false;
+
+  uint8_t frame_control = ind.asdu[0];
+  if ((frame_control & ZCL_FRAME_TYPE_MASK) != ZCL_FRAME_TYPE_CLUSTER ||
+      (frame_control & ZCL_FRAME_TO_CLIENT) != 0) {
+    return false;
+  }
+
+  size_t header_size = ZCL_HEADER_SIZE;
+  if (frame_control & ZCL_FRAME_MANUF_SPECIFIC) {
+    header_size += ZCL_MANUF_CODE_SIZE;
+  }
+  if (ind.asdu_length < header_size) return false;
+
+  command->sequence = ind.asdu[header_size - 2];
+  command->id = ind.asdu[header_size - 1];
+  command->payload = ind.asdu + header_size;
+  command->length = ind.asdu_length - header_size;
+  return true;
+}
+
+// Add Group Response with INSUFFICIENT_SPACE to the sender of the command
+static void send_add_group_response(uint8_t endpoint,
+                                    const esp_zb_apsde_data_ind_t& ind,
+                                    const ClusterCommand& command) {
+  uint8_t frame[] = {
+      ZCL_FRAME_TYPE_CLUSTER | ZCL_FRAME_TO_CLIENT |
+          ZCL_FRAME_DISABLE_DEFAULT_RESPONSE,
+      command.sequence,
+      GROUPS_CMD_ADD_GROUP_RESPONSE,
+      ZCL_STATUS_INSUFFICIENT_SPACE,
+      command.payload[0],
+      command.payload[1],
+  };
+
+  esp_zb_apsde_data_req_t req = {};
+  req.dst_addr_mode = ESP_ZB_APS_ADDR_MODE_16_ENDP_PRESENT;
+  req.dst_addr.addr_short = ind.src_short_addr;
+  req.dst_endpoint = ind.src_endpoint;
+  req.profile_id = ind.profile_id;
+  req.cluster_id = ESP_ZB_ZCL_CLUSTER_ID_GROUPS;
+  req.src_endpoint = endpoint;
+  req.asdu_length = sizeof(frame);
+  req.asdu = frame;
+  req.tx_options = ESP_ZB_APSDE_TX_OPT_ACK_TX;
+  esp_err_t err = esp_zb_aps_data_request(&req);
+  if (err != ESP_OK) {
+    log_error("Error sending Add Group Response: %s", esp_err_to_name(err));
+  }
+}
+
+#ifdef CONFIG_STATIC_ALLOCATION
+static StackType_t task_stack[TASK_STACK_SIZE];
+static StaticTask_t task_buffer;
+#endif
+
 // Globally accessible singleton instance
 ZigbeeStack& Zigbee = ZigbeeStack::instance();
 
 // Private singleton constructor
-ZigbeeStack::ZigbeeStack() {}
+ZigbeeStack::ZigbeeStack()
+    : task_handle(nullptr),
+      route_slots{},
+      routes{},
+      route_count(0),
+      callback_stats{},
+      group_stats{},
+      running_handlers{},
+      running_handler_count(0) {}
 
 // Singleton instance accessor
 ZigbeeStack& ZigbeeStack::instance() {
@@ -41,27 +128,109 @@ esp_err_t ZigbeeStack::init() {
   if (err != ESP_OK) return err;
 
   esp_zb_core_action_handler_register(core_action_handler);
+  esp_zb_aps_data_indication_handler_register(aps_indication_handler);
 
   return ESP_OK;
 }
 
 esp_err_t ZigbeeStack::start() {
+#ifdef CONFIG_STATIC_ALLOCATION
+  task_handle = xTaskCreateStatic(task, TASK_NAME, TASK_STACK_SIZE, nullptr,
+                                  TASK_PRIORITY, task_stack, &task_buffer);
+  return (task_handle != nullptr) ? ESP_OK : ESP_FAIL;
+#else
   BaseType_t result = xTaskCreate(task, TASK_NAME, TASK_STACK_SIZE, nullptr,
-                                  TASK_PRIORITY, nullptr);
+                                  TASK_PRIORITY, &task_handle);
   return (result == pdPASS) ? ESP_OK : ESP_FAIL;
+#endif
 }
 
 esp_err_t ZigbeeStack::register_endpoint(
     esp_zb_endpoint_config_t& endpoint_config, esp_zb_cluster_list_t* clusters,
-    EndpointHandler handler) {
+    EndpointHandler handler, void* context, GroupTable* groups) {
+  uint8_t endpoint = endpoint_config.endpoint;
+  if (endpoint == 0 || endpoint > MAX_ENDPOINT_ID || handler == nullptr) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  uint8_t slot = route_slots[endpoint];
+  if (slot == 0) {
+    if (route_count == MAX_ENDPOINTS) return ESP_ERR_NO_MEM;
+    slot = route_count + 1;
+  }
+
   esp_err_t err = esp_zb_ep_list_add_ep(endpoints, clusters, endpoint_config);
   if (err != ESP_OK) return err;
 
-  endpoint_handlers.insert_or_assign(endpoint_config.endpoint, handler);
+  if (route_slots[endpoint] == 0) {
+    route_slots[endpoint] = slot;
+    route_count++;
+  }
+  routes[slot] = EndpointRoute{
+      .handler = handler,
+      .context = context,
+      .groups = groups,
+      .command_handler = nullptr,
+      .command_context = nullptr,
+      .endpoint = endpoint,
+      .stats = {},
+  };
+
+  return ESP_OK;
+}
 
+esp_err_t ZigbeeStack::handle_commands(uint8_t endpoint,
+                                       CommandHandler handler, void* context) {
+  if (endpoint > MAX_ENDPOINT_ID || route_slots[endpoint] == 0) {
+    return ESP_ERR_NOT_FOUND;
+  }
+
+  EndpointRoute& route = routes[route_slots[endpoint]];
+  route.command_handler = handler;
+  route.command_context = context;
   return ESP_OK;
 }
 
+esp_err_t ZigbeeStack::on_running(RunningHandler handler) {
+  if (handler == nullptr) return ESP_ERR_INVALID_ARG;
+  if (running_handler_count == MAX_RUNNING_HANDLERS) return ESP_ERR_NO_MEM;
+
+  running_handlers[running_handler_count++] = handler;
+  return ESP_OK;
+}
+
+void ZigbeeStack::notify_running() {
+  for (uint8_t i = 0; i < running_handler_count; i++) running_handlers[i]();
+}
+
+// The stack forgets its groups when it leaves the network for good or
+// starts factory new, the tables follow
+void ZigbeeStack::clear_groups() {
+  for (uint8_t slot = 1; slot <= route_count; slot++) {
+    GroupTable* groups = routes[slot].groups;
+    if (groups == nullptr) continue;
+
+    esp_err_t err = groups->remove_all();
+    if (err != ESP_OK) {
+      log_error("Error clearing groups: endpoint=%u, %s", routes[slot].endpoint,
+                esp_err_to_name(err));
+    }
+  }
+}
+
+CallbackStats ZigbeeStack::get_callback_stats() { return callback_stats; }
+
+TaskHandle_t ZigbeeStack::get_task_handle() { return task_handle; }
+
+bool ZigbeeStack::get_endpoint_stats(uint8_t endpoint, EndpointStats& stats) {
+  if (endpoint > MAX_ENDPOINT_ID || route_slots[endpoint] == 0) return false;
+
+  stats = routes[route_slots[endpoint]].stats;
+  return true;
+}
+
+GroupStats ZigbeeStack::get_group_stats() { return group_stats; }
+
 // PRIVATE METHODS
 void ZigbeeStack::task(void* pvParameters) {
   esp_zb_cfg_t zigbee_cfg = {
@@ -80,13 +249,13 @@ void ZigbeeStack::task(void* pvParameters) {
 
   esp_err_t err = esp_zb_device_register(Zigbee.endpoints);
   if (err != ESP_OK) {
-    printf("Error registering Zigbee endpoints: %s\n", esp_err_to_name(err));
+    log_error("Error registering Zigbee endpoints: %s", esp_err_to_name(err));
     return;
   }
 
   err = esp_zb_start(false);
   if (err != ESP_OK) {
-    printf("Error starting Zigbee stack: %s\n", esp_err_to_name(err));
+    log_error("Error starting Zigbee stack: %s", esp_err_to_name(err));
     return;
   }
 
@@ -95,17 +264,172 @@ void ZigbeeStack::task(void* pvParameters) {
 
 esp_err_t ZigbeeStack::core_action_handler(
     esp_zb_core_action_callback_id_t callback_id, const void* msg) {
+  uint32_t trace_start = trace_now();
+  if (callback_id == ESP_ZB_CORE_SET_ATTR_VALUE_CB_ID ||
+      callback_id == ESP_ZB_CORE_SCENES_RECALL_SCENE_CB_ID) {
+    trace_command_received(trace_start);
+  }
+
+  int64_t start = esp_timer_get_time();
+  esp_err_t err = Zigbee.dispatch_action(callback_id, msg);
+  Zigbee.record_callback_time(esp_timer_get_time() - start);
+
+  trace_record(TraceStage::DISPATCH, trace_start);
+  if (err != ESP_OK) trace_command_dropped();
+
+  return err;
+}
+
+// Sees every APS frame before the stack parses it. Returning true drops it.
+// The stack delivers the group frames that pass to the endpoints it has in
+// the group, which are the ones the group tables have.
+bool ZigbeeStack::aps_indication_handler(esp_zb_apsde_data_ind_t ind) {
+  if (ind.dst_addr_mode == ESP_ZB_APS_ADDR_MODE_16_GROUP_ENDP_NOT_PRESENT) {
+    Zigbee.group_stats.received++;
+    if (!Zigbee.is_group_member(ind.dst_short_addr)) {
+      Zigbee.group_stats.dropped++;
+      return true;
+    }
+  }
+
+  // Before the group tables change, so that a Remove Group multicast to the
+  // group it removes still reaches the endpoints
+  Zigbee.notify_command(ind);
+  if (ind.cluster_id == ESP_ZB_ZCL_CLUSTER_ID_GROUPS) {
+    return Zigbee.track_groups_command(ind);
+  }
+  return false;
+}
+
+esp_err_t ZigbeeStack::dispatch_action(
+    esp_zb_core_action_callback_id_t callback_id, const void* msg) {
   const auto* common = static_cast<const ActionCommonMessage*>(msg);
+  uint8_t endpoint = common->info.dst_endpoint;
 
-  auto iter = Zigbee.endpoint_handlers.find(common->info.dst_endpoint);
-  if (iter != Zigbee.endpoint_handlers.end()) {
-    auto& [_, handler] = *iter;
-    return handler(common->info.cluster, callback_id, msg);
+  uint8_t slot = endpoint <= MAX_ENDPOINT_ID ? route_slots[endpoint] : 0;
+  if (slot == 0) {
+    log_warn("Unhandled action: callback_id=%u, endpoint=%u, cluster=%u",
+             callback_id, endpoint, common->info.cluster);
+    return ESP_ERR_NOT_SUPPORTED;
   }
 
-  printf("Unhandled action: callback_id=%u, endpoint=%u, cluster=%u\n",
-         callback_id, common->info.dst_endpoint, common->info.cluster);
-  return ESP_ERR_NOT_SUPPORTED;
+  EndpointRoute& route = routes[slot];
+  route.stats.dispatched++;
+
+  esp_err_t err =
+      route.handler(route.context, common->info.cluster, callback_id, msg);
+  if (err == ESP_ERR_NOT_FOUND) {
+    route.stats.unhandled++;
+    return ESP_OK;
+  }
+  if (err != ESP_OK) route.stats.failed++;
+
+  return err;
+}
+
+bool ZigbeeStack::is_group_member(uint16_t group_id) {
+  for (uint8_t slot = 1; slot <= route_count; slot++) {
+    const GroupTable* groups = routes[slot].groups;
+    // Without a table membership is up to the stack
+    if (groups == nullptr || groups->contains(group_id)) return true;
+  }
+  return false;
+}
+
+// Keeps the group tables in step with the stack's own, which handles the
+// Groups commands and sends the responses. Returns true to drop a command
+// that would add a group a table has no room for, so that the stack never
+// has a member the table doesn't know about. A unicast Add Group is answered
+// with INSUFFICIENT_SPACE in place of the stack, as for its own full table.
+bool ZigbeeStack::track_groups_command(const esp_zb_apsde_data_ind_t& ind) {
+  ClusterCommand command;
+  if (!parse_cluster_command(ind, &command)) return false;
+
+  // A command to several endpoints, e.g. to the broadcast endpoint, is
+  // dropped for all of them, so no table changes unless all have room
+  bool drop = false;
+  for (uint8_t slot = 1; slot <= route_count; slot++) {
+    EndpointRoute& route = routes[slot];
+    if (route.groups == nullptr || !is_addressed(route, ind)) continue;
+    if (route.groups->has_room(command.id, command.payload, command.length)) {
+      continue;
+    }
+
+    log_warn("Group table full: endpoint=%u", route.endpoint);
+    drop = true;
+    if (command.id == GROUPS_CMD_ADD_GROUP &&
+        ind.dst_addr_mode != ESP_ZB_APS_ADDR_MODE_16_GROUP_ENDP_NOT_PRESENT) {
+      send_add_group_response(route.endpoint, ind, command);
+    }
+  }
+  if (drop) return true;
+
+  for (uint8_t slot = 1; slot <= route_count; slot++) {
+    EndpointRoute& route = routes[slot];
+    if (route.groups == nullptr || !is_addressed(route, ind)) continue;
+
+    esp_err_t err = route.groups->handle_command(command.id, command.payload,
+                                                 command.length);
+    if (err != ESP_OK) {
+      log_error("Error updating groups: endpoint=%u, command_id=%u, %s",
+                route.endpoint, command.id, esp_err_to_name(err));
+    }
+  }
+
+  return false;
+}
+
+void ZigbeeStack::notify_command(const esp_zb_apsde_data_ind_t& ind) {
+  ClusterCommand command;
+  if (!parse_cluster_command(ind, &command)) return;
+
+  for (uint8_t slot = 1; slot <= route_count; slot++) {
+    EndpointRoute& route = routes[slot];
+    if (route.command_handler == nullptr || !is_addressed(route, ind)) {
+      continue;
+    }
+
+    route.command_handler(route.command_context, ind.cluster_id, command.id,
+                          command.payload, command.length);
+  }
+}
+
+// Whether the stack delivers the frame to the endpoint: a group frame to the
+// members of its group, any other to its destination endpoint
+bool ZigbeeStack::is_addressed(const EndpointRoute& route,
+                               const esp_zb_apsde_data_ind_t& ind) {
+  if (ind.dst_addr_mode == ESP_ZB_APS_ADDR_MODE_16_GROUP_ENDP_NOT_PRESENT) {
+    return route.groups == nullptr ||
+           route.groups->contains(ind.dst_short_addr);
+  }
+  return ind.dst_endpoint == route.endpoint ||
+         ind.dst_endpoint == BROADCAST_ENDPOINT;
+}
+
+void ZigbeeStack::record_callback_time(int64_t duration_us) {
+  uint32_t duration = static_cast<uint32_t>(duration_us);
+
+  callback_stats.count++;
+  callback_stats.total_us += duration;
+  if (duration > callback_stats.max_us) callback_stats.max_us = duration;
+
+#if CONFIG_ZIGBEE_CALLBACK_STATS_INTERVAL > 0
+  if (callback_stats.count % CONFIG_ZIGBEE_CALLBACK_STATS_INTERVAL == 0) {
+    log_info("Zigbee callbacks: count=%lu, avg=%lu us, max=%lu us",
+             callback_stats.count,
+             static_cast<uint32_t>(callback_stats.total_us /
+                                   callback_stats.count),
+             callback_stats.max_us);
+
+    for (uint8_t slot = 1; slot <= route_count; slot++) {
+      const EndpointRoute& route = routes[slot];
+      log_info("Endpoint %u actions: dispatched=%lu, unhandled=%lu, "
+               "failed=%lu",
+               route.endpoint, route.stats.dispatched, route.stats.unhandled,
+               route.stats.failed);
+    }
+  }
+#endif
 }
 
 // GLOBAL ZIGBEE SIGNAL HANDLER
@@ -117,42 +441,54 @@ extern "C" void esp_zb_app_signal_handler(esp_zb_app_signal_t* signal_struct) {
   esp_zb_callback_t start_commissioning = [](uint8_t mode_mask) {
     esp_err_t err = esp_zb_bdb_start_top_level_commissioning(mode_mask);
     if (err != ESP_OK) {
-      printf("Error starting top level commissioning: %s\n",
-             esp_err_to_name(err));
+      log_error("Error starting top level commissioning: %s",
+                esp_err_to_name(err));
     }
   };
 
   switch (sig_type) {
     case ESP_ZB_ZDO_SIGNAL_SKIP_STARTUP:
-      printf("Initializing Zigbee stack\n");
+      log_info("Initializing Zigbee stack");
       start_commissioning(ESP_ZB_BDB_MODE_INITIALIZATION);
       break;
     case ESP_ZB_BDB_SIGNAL_DEVICE_FIRST_START:
     case ESP_ZB_BDB_SIGNAL_DEVICE_REBOOT:
       if (err != ESP_OK) {
-        printf("Restarting Zigbee stack: %s\n", esp_err_to_name(err));
+        log_warn("Restarting Zigbee stack: %s", esp_err_to_name(err));
         esp_zb_scheduler_alarm(start_commissioning,
                                ESP_ZB_BDB_MODE_INITIALIZATION, 1000);
         break;
       }
       if (esp_zb_bdb_is_factory_new()) {
-        printf("Starting network steering for factory new device\n");
+        Zigbee.clear_groups();
+        log_info("Starting network steering for factory new device");
         start_commissioning(ESP_ZB_BDB_MODE_NETWORK_STEERING);
       }
-      printf("Zigbee stack is running\n");
+      log_info("Zigbee stack is running");
+      Zigbee.notify_running();
       break;
     case ESP_ZB_BDB_SIGNAL_STEERING:
       if (err != ESP_OK) {
-        printf("Restarting network steering: %s\n", esp_err_to_name(err));
+        log_warn("Restarting network steering: %s", esp_err_to_name(err));
         esp_zb_scheduler_alarm(start_commissioning,
                                ESP_ZB_BDB_MODE_NETWORK_STEERING, 1000);
         break;
       }
-      printf("Joined network successfully!\n");
+      log_info("Joined network successfully!");
       break;
+    case ESP_ZB_ZDO_SIGNAL_LEAVE: {
+      const auto* params = static_cast<esp_zb_zdo_signal_leave_params_t*>(
+          esp_zb_app_signal_get_params(signal_struct->p_app_signal));
+      if (params != nullptr &&
+          params->leave_type == ESP_ZB_NWK_LEAVE_TYPE_RESET) {
+        log_info("Left the network, clearing groups");
+        Zigbee.clear_groups();
+      }
+      break;
+    }
     default:
-      printf("Unhandled Zigbee signal %s: %s\n",
-             esp_zb_zdo_signal_to_string(sig_type), esp_err_to_name(err));
+      log_info("Unhandled Zigbee signal %s: %s",
+               esp_zb_zdo_signal_to_string(sig_type), esp_err_to_name(err));
       break;
   }
 }
@@ -1,27 +1,86 @@
 #ifndef ZIGBEE_STACK_HPP
 #define ZIGBEE_STACK_HPP
 
+#include <array>
 #include <cstdint>
-#include <functional>
-#include <unordered_map>
 
+#include "GroupTable.hpp"
 #include "esp_zigbee_core.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 
-using EndpointHandler = std::function<esp_err_t(
-    uint16_t cluster_id, uint32_t callback_id, const void* msg)>;
+// Returns ESP_ERR_NOT_FOUND for actions the endpoint doesn't handle
+using EndpointHandler = esp_err_t (*)(void* context, uint16_t cluster_id,
+                                      uint32_t callback_id, const void* msg);
+
+// Called with a cluster specific command addressed to the endpoint, before
+// the stack processes it
+using CommandHandler = void (*)(void* context, uint16_t cluster_id,
+                                uint8_t command_id, const uint8_t* payload,
+                                size_t length);
+
+// Called on the Zigbee task once the stack has started
+using RunningHandler = void (*)();
+
+constexpr uint8_t MAX_ENDPOINT_ID = 240;
+constexpr size_t MAX_ENDPOINTS = CONFIG_ZIGBEE_MAX_ENDPOINTS;
+constexpr size_t MAX_RUNNING_HANDLERS = 4;
 
 struct ActionCommonMessage {
   esp_zb_device_cb_common_info_t info;
 };
 
+// Execution time of core action callbacks on the Zigbee task
+struct CallbackStats {
+  uint32_t count;
+  uint32_t max_us;
+  uint64_t total_us;
+};
+
+// Actions routed to one endpoint, by outcome
+struct EndpointStats {
+  uint32_t dispatched;
+  uint32_t unhandled;
+  uint32_t failed;
+};
+
+// Group addressed frames received, and dropped because no endpoint is a
+// member of their group
+struct GroupStats {
+  uint32_t received;
+  uint32_t dropped;
+};
+
 class ZigbeeStack {
  public:
   esp_err_t init();
   esp_err_t start();
 
+  // The group table of an endpoint follows the Groups commands sent to it,
+  // so that group frames for groups no endpoint is a member of are dropped
+  // before the stack parses them
   esp_err_t register_endpoint(esp_zb_endpoint_config_t& endpoint_config,
                               esp_zb_cluster_list_t* clusters,
-                              EndpointHandler handler);
+                              EndpointHandler handler, void* context,
+                              GroupTable* groups = nullptr);
+
+  // Sees the commands of the registered endpoint as they arrive, e.g. for
+  // parameters the stack doesn't pass on with the attributes it writes
+  esp_err_t handle_commands(uint8_t endpoint, CommandHandler handler,
+                            void* context);
+
+  esp_err_t on_running(RunningHandler handler);
+  // Called by the signal handler
+  void notify_running();
+  // Called by the signal handler once the stack has forgotten its groups
+  void clear_groups();
+
+  CallbackStats get_callback_stats();
+  TaskHandle_t get_task_handle();
+
+  // Returns false if the endpoint is not registered
+  bool get_endpoint_stats(uint8_t endpoint, EndpointStats& stats);
+  GroupStats get_group_stats();
 
   // Singleton instance accessor
   static ZigbeeStack& instance();
@@ -41,9 +100,38 @@ class ZigbeeStack {
   static void task(void* pvParameters);
   static esp_err_t core_action_handler(
       esp_zb_core_action_callback_id_t callback_id, const void* message);
+  static bool aps_indication_handler(esp_zb_apsde_data_ind_t ind);
+  esp_err_t dispatch_action(esp_zb_core_action_callback_id_t callback_id,
+                            const void* message);
+  bool is_group_member(uint16_t group_id);
+  bool track_groups_command(const esp_zb_apsde_data_ind_t& ind);
+  void notify_command(const esp_zb_apsde_data_ind_t& ind);
+  void record_callback_time(int64_t duration_us);
+
+  struct EndpointRoute {
+    EndpointHandler handler;
+    void* context;
+    GroupTable* groups;
+    CommandHandler command_handler;
+    void* command_context;
+    uint8_t endpoint;
+    EndpointStats stats;
+  };
+
+  bool is_addressed(const EndpointRoute& route,
+                    const esp_zb_apsde_data_ind_t& ind);
 
   esp_zb_ep_list_t* endpoints;
-  std::unordered_map<uint8_t, EndpointHandler> endpoint_handlers;
+  TaskHandle_t task_handle;
+  // Route slot of each endpoint ID, 0 when not registered
+  std::array<uint8_t, MAX_ENDPOINT_ID + 1> route_slots;
+  // Slot 0 is never used, so that route_slots can be zero-initialized
+  std::array<EndpointRoute, MAX_ENDPOINTS + 1> routes;
+  uint8_t route_count;
+  CallbackStats callback_stats;
+  GroupStats group_stats;
+  std::array<RunningHandler, MAX_RUNNING_HANDLERS> running_handlers;
+  uint8_t running_handler_count;
 };
 
 extern ZigbeeStack& Zigbee;
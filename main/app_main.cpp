@@ -1,91 +1,123 @@
-#include <cmath>
+#include <array>
 #include <cstdint>
 #include <cstdio>
-
-#include "SingleLED.hpp"
-#include "Storage.hpp"
-#include "ZigbeeDevice.hpp"
+#include <utility>
+
+#include "Color.hpp"
+#include "DiagnosticsCluster.hpp"
+#include "LightEndpoint.hpp"
+#include "LightWorker.hpp"
+#include "Log.hpp"
+#include "MemoryMonitor.hpp"
+#include "RenderScheduler.hpp"
+#include "ReportingManager.hpp"
 #include "ZigbeeStack.hpp"
 #include "esp_zigbee_core.h"
 #include "nvs_flash.h"
 
 constexpr bool DEFAULT_ACTIVE = CONFIG_LIGHT_DEFAULT_ACTIVE != 0 ? true : false;
-constexpr double DEFAULT_BRIGHTNESS = CONFIG_LIGHT_DEFAULT_BRIGHTNESS / 100.0;
-constexpr double DEFAULT_COLOR_X = CONFIG_LIGHT_DEFAULT_COLOR_X / 100.0;
-constexpr double DEFAULT_COLOR_Y = CONFIG_LIGHT_DEFAULT_COLOR_Y / 100.0;
-Storage storage(DEFAULT_ACTIVE, DEFAULT_BRIGHTNESS, DEFAULT_COLOR_X,
-                DEFAULT_COLOR_Y);
-
-SingleLED led(CONFIG_LED_PIN);
-
-ZigbeeDevice device(DeviceConfig{
-    .endpoint = CONFIG_LIGHT_ENDPOINT,
-    .app_device_id = ESP_ZB_HA_ON_OFF_LIGHT_DEVICE_ID,
-    .power_source = ESP_ZB_ZCL_BASIC_POWER_SOURCE_BATTERY,
-    .manufacturer = CONFIG_DEVICE_MANUFACTURER,
-    .model = CONFIG_DEVICE_MODEL,
-});
-
-esp_err_t setup_clusters(esp_zb_cluster_list_t* clusters) {
-  esp_zb_on_off_cluster_cfg_t on_off_cfg = {
-      .on_off = storage.get_active(),
-  };
-  auto* on_off_attrs = esp_zb_on_off_cluster_create(&on_off_cfg);
-  esp_err_t err = esp_zb_cluster_list_add_on_off_cluster(
-      clusters, on_off_attrs, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE);
+constexpr uint8_t DEFAULT_BRIGHTNESS =
+    (CONFIG_LIGHT_DEFAULT_BRIGHTNESS * 254 + 50) / 100;
+constexpr uint16_t DEFAULT_COLOR_X =
+    (CONFIG_LIGHT_DEFAULT_COLOR_X * 65535 + 50) / 100;
+constexpr uint16_t DEFAULT_COLOR_Y =
+    (CONFIG_LIGHT_DEFAULT_COLOR_Y * 65535 + 50) / 100;
+constexpr uint16_t DEFAULT_COLOR_TEMPERATURE =
+    CONFIG_LIGHT_DEFAULT_COLOR_TEMP_MIREDS;
+static_assert(DEFAULT_COLOR_TEMPERATURE >= COLOR_TEMP_MIN_MIREDS &&
+                  DEFAULT_COLOR_TEMPERATURE <= COLOR_TEMP_MAX_MIREDS,
+              "Default color temperature must be within the supported range");
+constexpr LightState DEFAULT_STATE = {
+    .active = DEFAULT_ACTIVE,
+    .level = DEFAULT_BRIGHTNESS,
+    .color_x = DEFAULT_COLOR_X,
+    .color_y = DEFAULT_COLOR_Y,
+    .color_mode = ColorMode::XY,
+    .color_temperature = DEFAULT_COLOR_TEMPERATURE,
+};
+
+RenderScheduler scheduler(CONFIG_LED_PIN, CONFIG_LED_PIXEL_COUNT);
+
+LightWorker worker(scheduler);
+
+template <size_t... Indices>
+std::array<LightEndpoint, MAX_LIGHTS> make_lights(
+    std::index_sequence<Indices...>) {
+  return {LightEndpoint(Indices, scheduler, worker, DEFAULT_STATE)...};
+}
+
+std::array<LightEndpoint, MAX_LIGHTS> lights =
+    make_lights(std::make_index_sequence<MAX_LIGHTS>{});
+
+MemoryMonitor memory;
+
+DiagnosticsCluster diagnostics(CONFIG_LIGHT_ENDPOINT);
+
+extern "C" void app_main(void) {
+  esp_err_t err = Log.start();
   if (err != ESP_OK) {
-    return err;
+    printf("Error starting DeferredLog: %s\n", esp_err_to_name(err));
+    return;
   }
 
-  esp_zb_level_cluster_cfg_t level_cfg = {
-      .current_level =
-          static_cast<uint8_t>(std::round(storage.get_brightness() * 254.0)),
-  };
-  auto* level_attrs = esp_zb_level_cluster_create(&level_cfg);
-  err = esp_zb_cluster_list_add_level_cluster(clusters, level_attrs,
-                                              ESP_ZB_ZCL_CLUSTER_SERVER_ROLE);
+  // Before anything slower, so retained frames light the LEDs right away
+  err = scheduler.init();
   if (err != ESP_OK) {
-    return err;
+    printf("Error initializing RenderScheduler: %s\n", esp_err_to_name(err));
+    return;
   }
 
-  esp_zb_color_cluster_cfg_t color_cfg = {
-      .current_x =
-          static_cast<uint16_t>(std::round(storage.get_color_x() * 65535.0)),
-      .current_y =
-          static_cast<uint16_t>(std::round(storage.get_color_y() * 65535.0)),
-      .color_mode = ESP_ZB_ZCL_COLOR_CONTROL_COLOR_MODE_DEFAULT_VALUE,
-      .options = ESP_ZB_ZCL_COLOR_CONTROL_OPTIONS_DEFAULT_VALUE,
-      .enhanced_color_mode =
-          ESP_ZB_ZCL_COLOR_CONTROL_ENHANCED_COLOR_MODE_DEFAULT_VALUE,
-      .color_capabilities = 0x0008,
-  };
-  auto* color_attrs = esp_zb_color_control_cluster_create(&color_cfg);
-  err = esp_zb_cluster_list_add_color_control_cluster(
-      clusters, color_attrs, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE);
-  if (err != ESP_OK) {
-    return err;
+  for (LightEndpoint& light : lights) {
+    err = light.init_led();
+    if (err != ESP_OK) {
+      printf("Error initializing SingleLED: %s\n", esp_err_to_name(err));
+      return;
+    }
   }
 
-  return ESP_OK;
-}
+  // Nothing to show without a boot frame, the strip would only be blanked
+  // and the boot to light time would measure that
+  size_t boot_frames = 0;
+  for (LightEndpoint& light : lights) {
+    if (light.get_led().has_boot_frame()) boot_frames++;
+  }
+  if (boot_frames > 0) {
+    err = scheduler.show();
+    if (err != ESP_OK) {
+      printf("Error showing boot frames: %s\n", esp_err_to_name(err));
+      return;
+    }
+  }
 
-extern "C" void app_main(void) {
-  esp_err_t err = nvs_flash_init();
+  err = nvs_flash_init();
   if (err != ESP_OK) {
     printf("Error initializing NVS flash: %s\n", esp_err_to_name(err));
     return;
   }
 
-  err = storage.init();
+  for (LightEndpoint& light : lights) {
+    err = light.load();
+    if (err != ESP_OK) {
+      printf("Error loading light %u: %s\n", light.get_endpoint(),
+             esp_err_to_name(err));
+      return;
+    }
+  }
+
+  // All lights reconciled with their stored state in one refresh
+  err = scheduler.show();
   if (err != ESP_OK) {
-    printf("Error initializing Storage: %s\n", esp_err_to_name(err));
+    printf("Error showing stored state: %s\n", esp_err_to_name(err));
     return;
   }
+  log_info("Boot to light: %lu us, boot frames on %u of %u lights",
+           static_cast<uint32_t>(scheduler.get_boot_to_light_us()),
+           static_cast<unsigned>(boot_frames),
+           static_cast<unsigned>(lights.size()));
 
-  err = led.init(storage.get_active(), storage.get_brightness(),
-                 storage.get_color_x(), storage.get_color_y());
+  err = worker.start();
   if (err != ESP_OK) {
-    printf("Error initializing SingleLED: %s\n", esp_err_to_name(err));
+    printf("Error starting LightWorker: %s\n", esp_err_to_name(err));
     return;
   }
 
@@ -95,84 +127,55 @@ extern "C" void app_main(void) {
     return;
   }
 
-  err = device.init(setup_clusters);
+  for (LightEndpoint& light : lights) {
+#ifdef CONFIG_LATENCY_TRACE
+    // Diagnostics are served from the first light's endpoint
+    ClustersSetupHandler setup_extra = nullptr;
+    if (light.get_endpoint() == CONFIG_LIGHT_ENDPOINT) {
+      setup_extra = [](esp_zb_cluster_list_t* clusters) {
+        return diagnostics.setup(clusters);
+      };
+    }
+    err = light.start(setup_extra);
+#else
+    err = light.start();
+#endif
+    if (err != ESP_OK) {
+      printf("Error starting light %u: %s\n", light.get_endpoint(),
+             esp_err_to_name(err));
+      return;
+    }
+  }
+
+  err = Zigbee.on_running(ReportingManager::start_all);
   if (err != ESP_OK) {
-    printf("Error initializing ZigbeeDevice: %s\n", esp_err_to_name(err));
+    printf("Error setting up attribute reporting: %s\n", esp_err_to_name(err));
     return;
   }
 
-  device.handle_action<esp_zb_zcl_set_attr_value_message_t>(
-      ESP_ZB_ZCL_CLUSTER_ID_ON_OFF, ESP_ZB_CORE_SET_ATTR_VALUE_CB_ID,
-      [](const auto* msg) {
-        switch (msg->attribute.id) {
-          case ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID: {
-            bool active = *static_cast<bool*>(msg->attribute.data.value);
-
-            esp_err_t err = storage.set_active(active);
-            if (err != ESP_OK) return err;
-
-            return led.set_active(active);
-          }
-          default:
-            printf("Unsupported action: cluster_id=%u, attribute_id=%u\n",
-                   msg->info.cluster, msg->attribute.id);
-            return ESP_ERR_NOT_SUPPORTED;
-        }
-      });
-
-  device.handle_action<esp_zb_zcl_set_attr_value_message_t>(
-      ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL, ESP_ZB_CORE_SET_ATTR_VALUE_CB_ID,
-      [](const auto* msg) {
-        switch (msg->attribute.id) {
-          case ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID: {
-            double brightness =
-                *static_cast<uint8_t*>(msg->attribute.data.value) / 254.0;
-
-            esp_err_t err = storage.set_brightness(brightness);
-            if (err != ESP_OK) return err;
-
-            return led.set_brightness(brightness);
-          }
-          default:
-            printf("Unsupported action: cluster_id=%u, attribute_id=%u\n",
-                   msg->info.cluster, msg->attribute.id);
-            return ESP_ERR_NOT_SUPPORTED;
-        }
-      });
-
-  device.handle_action<esp_zb_zcl_set_attr_value_message_t>(
-      ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, ESP_ZB_CORE_SET_ATTR_VALUE_CB_ID,
-      [](const auto* msg) {
-        switch (msg->attribute.id) {
-          case ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_X_ID: {
-            double x =
-                *static_cast<uint16_t*>(msg->attribute.data.value) / 65535.0;
-
-            esp_err_t err = storage.set_color_x(x);
-            if (err != ESP_OK) return err;
-
-            return led.set_color(x, led.get_color().y);
-          }
-          case ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_Y_ID: {
-            double y =
-                *static_cast<uint16_t*>(msg->attribute.data.value) / 65535.0;
-
-            esp_err_t err = storage.set_color_y(y);
-            if (err != ESP_OK) return err;
-
-            printf("Setting color Y to %.2f\n", y);
-            return led.set_color(led.get_color().x, y);
-          }
-          default:
-            printf("Unsupported action: cluster_id=%u, attribute_id=%u\n",
-                   msg->info.cluster, msg->attribute.id);
-            return ESP_ERR_NOT_SUPPORTED;
-        }
-      });
-
   err = Zigbee.start();
   if (err != ESP_OK) {
     printf("Error starting Zigbee: %s\n", esp_err_to_name(err));
     return;
   }
+
+#ifdef CONFIG_LATENCY_TRACE
+  err = diagnostics.start();
+  if (err != ESP_OK) {
+    printf("Error starting DiagnosticsCluster: %s\n", esp_err_to_name(err));
+    return;
+  }
+#endif
+
+  memory.add_task(Zigbee.get_task_handle());
+  memory.add_task(worker.get_task_handle());
+  memory.add_task(Log.get_task_handle());
+  err = memory.start(CONFIG_MEMORY_REPORT_INTERVAL_S * 1000);
+  if (err != ESP_OK) {
+    printf("Error starting MemoryMonitor: %s\n", esp_err_to_name(err));
+    return;
+  }
+
+  // Everything is set up, nothing should allocate from here on
+  memory.lock_heap();
 }
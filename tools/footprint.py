@@ -0,0 +1,333 @@
+#!/usr/bin/env python3
+"""Footprint report of the firmware, checked against budgets.
+
+Breaks the static flash and RAM use down per component and per symbol
+category from the linker map, and adds the minimum free heap and the task
+stack high-water marks from a captured MemoryMonitor report when one is
+given. Exits with status 1 when a budget in the budgets file is exceeded, so
+that the build fails. See the Footprint section of the README.
+"""
+
+import argparse
+import json
+import re
+import sys
+from collections import defaultdict
+
+# Output sections that only reserve address space or are not loaded
+SKIPPED_SECTIONS = re.compile(
+    r"^\.(debug|comment|note|stab|gnu\.attributes|riscv\.attributes|xt\.)"
+    r"|dummy|noload"
+)
+
+# Symbol categories by mangled name, checked in order before the component
+# based ones
+NAME_CATEGORIES = [
+    ("std::function",
+     re.compile(r"St8function|_Function_handler|_Function_base")),
+    ("unordered_map",
+     re.compile(r"St13unordered_map|_Hashtable|_Hash_node|8__detail")),
+    ("other std templates", re.compile(r"^_ZN?K?St|__gnu_cxx")),
+]
+
+# Categories of everything else, by component
+COMPONENT_CATEGORIES = [
+    ("application", re.compile(r"^main$")),
+    ("zigbee libraries", re.compile(r"zigbee|zboss|zb_")),
+    ("c++ runtime", re.compile(r"^(stdc\+\+|supc\+\+|gcc)$")),
+    ("c library", re.compile(r"^(c|m|newlib|g)$")),
+]
+OTHER_CATEGORY = "esp-idf and other"
+
+# Kconfig option holding the stack size of a task, by task name
+TASK_STACK_OPTIONS = {
+    "ZigbeeStack": "ZIGBEE_TASK_STACK_SIZE",
+}
+
+HEAP_LINE = re.compile(r"Memory: free heap=(\d+), min free heap=(\d+)")
+STACK_LINE = re.compile(r"Task (\S+): stack high-water mark=(\d+) bytes")
+
+
+def parse_size(text):
+    """Parses a size as written in partitions.csv: 4096, 0x1000, 4K or 1M."""
+    text = text.strip()
+    multiplier = 1
+    if text[-1:].upper() == "K":
+        multiplier, text = 1024, text[:-1]
+    elif text[-1:].upper() == "M":
+        multiplier, text = 1024 * 1024, text[:-1]
+    return int(text, 0) * multiplier
+
+
+def read_csv_rows(path):
+    """Rows of a partitions.csv style file, without comments."""
+    with open(path, encoding="utf-8") as file:
+        for line in file:
+            line = line.split("#", 1)[0].strip()
+            if line:
+                yield [field.strip() for field in line.split(",")]
+
+
+def component_of(source):
+    """Component an input file of the linker map belongs to."""
+    if not source:
+        return "(linker)"
+    archive = source.split("(", 1)[0]
+    match = re.search(r"(?:managed_components|esp-idf|components)/([^/]+)/",
+                      archive)
+    if match and archive.endswith(".a"):
+        return match.group(1)
+    name = archive.rsplit("/", 1)[-1]
+    if name.endswith(".a"):
+        name = name[:-2].split(".", 1)[0]
+        return name[3:] if name.startswith("lib") else name
+    return "(objects)"
+
+
+def category_of(section, component):
+    """Symbol category of an input section, by its name and component."""
+    parts = section.split(".", 2)
+    symbol = parts[2] if len(parts) == 3 else ""
+    for name, pattern in NAME_CATEGORIES:
+        if symbol and pattern.search(symbol):
+            return name
+    for name, pattern in COMPONENT_CATEGORIES:
+        if pattern.search(component):
+            return name
+    return OTHER_CATEGORY
+
+
+def memory_of(output_section):
+    """Whether an output section takes flash, RAM or both."""
+    name = output_section.lower()
+    if "bss" in name or "noinit" in name:
+        return False, True
+    # Initialized data and code run from RAM are copied there from flash
+    if ("data" in name and "rodata" not in name) or "iram" in name or (
+            name.startswith(".rtc") and "text" in name):
+        return True, True
+    return True, False
+
+
+def parse_map(path):
+    """Sizes of the allocated input sections of a GNU ld map file, as
+    (output section, input section, size, source) tuples."""
+    with open(path, encoding="utf-8", errors="replace") as file:
+        lines = file.read().splitlines()
+
+    try:
+        start = lines.index("Linker script and memory map")
+    except ValueError:
+        sys.exit(f"{path}: not a linker map file")
+
+    output_section = None
+    output_skipped = True
+    pending = None
+    for line in lines[start + 1:]:
+        if not line.strip():
+            continue
+        tokens = line.split()
+
+        # Output sections start in the first column, and so does anything
+        # else that ends one, such as /DISCARD/
+        if not line[0].isspace():
+            output_skipped = True
+            if line.startswith("."):
+                output_section = tokens[0]
+                address = int(tokens[1], 16) if len(tokens) > 1 else None
+                # Sections that are not allocated have no address
+                output_skipped = address == 0 or bool(
+                    SKIPPED_SECTIONS.search(output_section))
+            pending = None
+            continue
+        if output_section is None or output_skipped:
+            continue
+
+        if tokens[0] == "*fill*":
+            if len(tokens) >= 3:
+                yield output_section, "*fill*", int(tokens[2], 16), "(padding)"
+            continue
+
+        # Long input section names put the rest on the next line
+        if pending is not None:
+            if len(tokens) >= 2 and tokens[0].startswith("0x") and \
+                    tokens[1].startswith("0x"):
+                source = " ".join(tokens[2:])
+                yield output_section, pending, int(tokens[1], 16), source
+            pending = None
+            continue
+
+        if tokens[0].startswith(".") or tokens[0] == "COMMON":
+            if len(tokens) == 1:
+                pending = tokens[0]
+            elif len(tokens) >= 3 and tokens[1].startswith("0x"):
+                source = " ".join(tokens[3:])
+                yield output_section, tokens[0], int(tokens[2], 16), source
+
+
+def parse_runtime(path):
+    """Minimum free heap and the lowest stack high-water mark of each task
+    in a log of MemoryMonitor reports."""
+    min_free_heap = None
+    stacks = {}
+    with open(path, encoding="utf-8", errors="replace") as file:
+        for line in file:
+            match = HEAP_LINE.search(line)
+            if match:
+                value = int(match.group(2))
+                min_free_heap = value if min_free_heap is None else min(
+                    min_free_heap, value)
+                continue
+            match = STACK_LINE.search(line)
+            if match:
+                task, value = match.group(1), int(match.group(2))
+                stacks[task] = min(stacks.get(task, value), value)
+    return min_free_heap, stacks
+
+
+def build_report(args):
+    components = defaultdict(lambda: {"flash": 0, "ram": 0})
+    categories = defaultdict(lambda: {"flash": 0, "ram": 0})
+    total = {"flash": 0, "ram": 0}
+    for output_section, section, size, source in parse_map(args.map):
+        if size == 0:
+            continue
+        component = component_of(source) if source != "(padding)" else source
+        category = category_of(section, component)
+        in_flash, in_ram = memory_of(output_section)
+        for memory, used in (("flash", in_flash), ("ram", in_ram)):
+            if used:
+                components[component][memory] += size
+                categories[category][memory] += size
+                total[memory] += size
+
+    report = {
+        "total": total,
+        "components": dict(sorted(components.items(),
+                                  key=lambda item: -item[1]["flash"])),
+        "categories": dict(sorted(categories.items(),
+                                  key=lambda item: -item[1]["flash"])),
+    }
+
+    if args.partitions:
+        for row in read_csv_rows(args.partitions):
+            if len(row) >= 5 and row[1] == "app":
+                report["app_partition"] = {"name": row[0],
+                                           "size": parse_size(row[4])}
+                break
+
+    if args.runtime:
+        sdkconfig = {}
+        if args.sdkconfig:
+            with open(args.sdkconfig, encoding="utf-8") as file:
+                sdkconfig = json.load(file)
+        min_free_heap, stacks = parse_runtime(args.runtime)
+        report["runtime"] = {
+            "min_free_heap": min_free_heap,
+            "stacks": {
+                task: {"min_free": free,
+                       "size": sdkconfig.get(TASK_STACK_OPTIONS.get(task))}
+                for task, free in sorted(stacks.items())
+            },
+        }
+
+    return report
+
+
+def check_budgets(report, path):
+    """Compares the report with the budgets, flash and ram are maxima of the
+    static size, heap and stack are minima of the free memory at runtime."""
+    results = []
+    for row in read_csv_rows(path):
+        if len(row) < 3:
+            sys.exit(f"{path}: expected Name, Type, Budget in {row}")
+        name, kind, budget = row[0], row[1], parse_size(row[2])
+
+        if kind in ("flash", "ram"):
+            if name == "*":
+                value = report["total"][kind]
+            else:
+                value = report["components"].get(name, {}).get(kind, 0)
+            ok = value <= budget
+        elif kind in ("heap", "stack"):
+            runtime = report.get("runtime")
+            if runtime is None:
+                continue
+            if kind == "heap":
+                value = runtime["min_free_heap"]
+            else:
+                value = runtime["stacks"].get(name, {}).get("min_free")
+            # Not in the log, nothing to check
+            if value is None:
+                continue
+            ok = value >= budget
+        else:
+            sys.exit(f"{path}: unknown budget type {kind}")
+
+        results.append({"name": name, "type": kind, "budget": budget,
+                        "value": value, "ok": ok})
+    return results
+
+
+def print_table(title, rows):
+    print(f"{title:<32} {'flash':>10} {'ram':>10}")
+    for name, sizes in rows.items():
+        print(f"  {name:<30} {sizes['flash']:>10} {sizes['ram']:>10}")
+
+
+def print_report(report, budgets):
+    total = report["total"]
+    print(f"Footprint: flash={total['flash']} bytes, "
+          f"static ram={total['ram']} bytes")
+    partition = report.get("app_partition")
+    if partition:
+        print(f"Partition {partition['name']}: {partition['size']} bytes, "
+              f"{partition['size'] - total['flash']} bytes left")
+    print_table("Component", report["components"])
+    print_table("Symbol category", report["categories"])
+
+    runtime = report.get("runtime")
+    if runtime:
+        print(f"Runtime: min free heap={runtime['min_free_heap']} bytes")
+        for task, stack in runtime["stacks"].items():
+            size = stack["size"]
+            used = f", peak use {size - stack['min_free']} of {size}" \
+                if size else ""
+            print(f"  Task {task}: min free stack={stack['min_free']} "
+                  f"bytes{used}")
+
+    for result in budgets:
+        relation = "<=" if result["type"] in ("flash", "ram") else ">="
+        status = "ok" if result["ok"] else "OVER BUDGET"
+        print(f"Budget {result['name']} {result['type']}: "
+              f"{result['value']} {relation} {result['budget']}: {status}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--map", required=True, help="linker map file")
+    parser.add_argument("--budgets", help="budgets file, Name, Type, Budget")
+    parser.add_argument("--partitions", help="partition table, for the "
+                        "space left in the app partition")
+    parser.add_argument("--runtime", help="console log with MemoryMonitor "
+                        "reports")
+    parser.add_argument("--sdkconfig", help="sdkconfig.json, for the task "
+                        "stack sizes")
+    parser.add_argument("--output", help="writes the report as JSON")
+    args = parser.parse_args()
+
+    report = build_report(args)
+    budgets = check_budgets(report, args.budgets) if args.budgets else []
+    report["budgets"] = budgets
+    print_report(report, budgets)
+
+    if args.output:
+        with open(args.output, "w", encoding="utf-8") as file:
+            json.dump(report, file, indent=2)
+
+    if not all(result["ok"] for result in budgets):
+        sys.exit("Footprint budget exceeded, see " + args.budgets)
+
+
+if __name__ == "__main__":
+    main()